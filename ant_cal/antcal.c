@@ -0,0 +1,246 @@
+/*
+ * antcal.c
+ *
+ * Joint antenna delay calibration from ranges between nodes at known separations.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include "deca_device_api.h"
+#include "antcal.h"
+#include "platform.h"
+
+/* Speed of light in air, in metres per second. */
+#define SPEED_OF_LIGHT 299702547
+
+/* Two-sided 95% quantile of the normal distribution */
+#define ANTCAL_Z95 1.96
+
+int antcal_init(antcal_t *cal, int num_nodes)
+{
+    int i, j;
+
+    if ((num_nodes < 2) || (num_nodes > ANTCAL_MAX_NODES))
+        return -1;
+
+    memset(cal, 0, sizeof(*cal));
+    cal->num_nodes = num_nodes;
+
+    for (i = 0; i < ANTCAL_MAX_NODES; i++)
+    {
+        for (j = 0; j < ANTCAL_MAX_NODES; j++)
+            cal->expected[i][j] = -1.0;
+        cal->ci[i] = -1.0; // not solved yet
+    }
+
+    return 0;
+}
+
+int antcal_setseparation(antcal_t *cal, int i, int j, double dist_m, uint8 chan, uint8 prf)
+{
+    double biased_m;
+
+    if ((i < 0) || (j < 0) || (i >= cal->num_nodes) || (j >= cal->num_nodes) || (i == j))
+        return -1;
+
+    /* Ranges are bias corrected by subtracting dwt_getrangebias(), so a perfectly calibrated pair measures the true
+     * separation plus its bias. */
+    biased_m = dist_m + dwt_getrangebias(chan, dist_m, prf);
+
+    cal->expected[i][j] = cal->expected[j][i] = biased_m / SPEED_OF_LIGHT / DWT_TIME_UNITS;
+
+    return 0;
+}
+
+int antcal_addsample(antcal_t *cal, int i, int j, double tof_dtu)
+{
+    double e;
+    int t;
+
+    if ((i < 0) || (j < 0) || (i >= cal->num_nodes) || (j >= cal->num_nodes) || (i == j))
+        return -1;
+    if (cal->expected[i][j] < 0)
+        return -1;
+
+    // Keep sums in the upper triangle
+    if (i > j)
+    {
+        t = i;
+        i = j;
+        j = t;
+    }
+
+    e = tof_dtu - cal->expected[i][j];
+    if (fabs(e) > ANTCAL_GATE_DTU)
+    {
+        cal->rejected++;
+        return -1;
+    }
+
+    cal->n[i][j]++;
+    cal->s1[i][j] += e;
+    cal->s2[i][j] += e * e;
+
+    return 0;
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn antcal_invert()
+ *
+ * @brief Invert the symmetric n x n matrix a into inv by Gauss-Jordan elimination with partial pivoting. a is destroyed.
+ *
+ * @return 0 on success, -1 if a is singular
+ */
+static int antcal_invert(double a[ANTCAL_MAX_NODES][ANTCAL_MAX_NODES], double inv[ANTCAL_MAX_NODES][ANTCAL_MAX_NODES], int n)
+{
+    int r, c, k, p;
+    double t;
+
+    for (r = 0; r < n; r++)
+        for (c = 0; c < n; c++)
+            inv[r][c] = (r == c) ? 1.0 : 0.0;
+
+    for (k = 0; k < n; k++)
+    {
+        p = k;
+        for (r = k + 1; r < n; r++)
+            if (fabs(a[r][k]) > fabs(a[p][k]))
+                p = r;
+
+        if (fabs(a[p][k]) < 1e-9)
+            return -1;
+
+        if (p != k)
+        {
+            for (c = 0; c < n; c++)
+            {
+                t = a[k][c]; a[k][c] = a[p][c]; a[p][c] = t;
+                t = inv[k][c]; inv[k][c] = inv[p][c]; inv[p][c] = t;
+            }
+        }
+
+        t = 1.0 / a[k][k];
+        for (c = 0; c < n; c++)
+        {
+            a[k][c] *= t;
+            inv[k][c] *= t;
+        }
+
+        for (r = 0; r < n; r++)
+        {
+            if (r == k || a[r][k] == 0.0)
+                continue;
+            t = a[r][k];
+            for (c = 0; c < n; c++)
+            {
+                a[r][c] -= t * a[k][c];
+                inv[r][c] -= t * inv[k][c];
+            }
+        }
+    }
+
+    return 0;
+}
+
+int antcal_solve(antcal_t *cal)
+{
+    double ata[ANTCAL_MAX_NODES][ANTCAL_MAX_NODES];
+    double inv[ANTCAL_MAX_NODES][ANTCAL_MAX_NODES];
+    double atb[ANTCAL_MAX_NODES];
+    double rss = 0.0, var;
+    uint32 m = 0;
+    int n = cal->num_nodes;
+    int i, j;
+
+    memset(ata, 0, sizeof(ata));
+    memset(atb, 0, sizeof(atb));
+
+    // Normal equations: each sample of pair (i, j) is a row with ones in columns i and j
+    for (i = 0; i < n; i++)
+    {
+        for (j = i + 1; j < n; j++)
+        {
+            if (cal->n[i][j] == 0)
+                continue;
+            ata[i][i] += cal->n[i][j];
+            ata[j][j] += cal->n[i][j];
+            ata[i][j] += cal->n[i][j];
+            ata[j][i] += cal->n[i][j];
+            atb[i] += cal->s1[i][j];
+            atb[j] += cal->s1[i][j];
+            m += cal->n[i][j];
+        }
+    }
+
+    if (m <= (uint32) n)
+        return -1;
+
+    if (antcal_invert(ata, inv, n) != 0)
+        return -1;
+
+    for (i = 0; i < n; i++)
+    {
+        cal->x[i] = 0.0;
+        for (j = 0; j < n; j++)
+            cal->x[i] += inv[i][j] * atb[j];
+    }
+
+    // Residual sum of squares from the per-pair sums: sum((e - r)^2) = s2 - 2 r s1 + n r^2
+    for (i = 0; i < n; i++)
+    {
+        for (j = i + 1; j < n; j++)
+        {
+            double r = cal->x[i] + cal->x[j];
+            if (cal->n[i][j] == 0)
+                continue;
+            rss += cal->s2[i][j] - 2.0 * r * cal->s1[i][j] + cal->n[i][j] * r * r;
+        }
+    }
+    if (rss < 0.0)
+        rss = 0.0;
+
+    var = rss / (double)(m - n);
+    cal->rms = sqrt(rss / (double) m);
+
+    for (i = 0; i < n; i++)
+        cal->ci[i] = ANTCAL_Z95 * sqrt(var * inv[i][i]);
+
+    return 0;
+}
+
+int antcal_converged(const antcal_t *cal, double ci_dtu)
+{
+    int i, j;
+
+    for (i = 0; i < cal->num_nodes; i++)
+    {
+        for (j = i + 1; j < cal->num_nodes; j++)
+        {
+            if ((cal->expected[i][j] >= 0) && (cal->n[i][j] < ANTCAL_MIN_PAIR_SAMPLES))
+                return 0;
+        }
+    }
+
+    for (i = 0; i < cal->num_nodes; i++)
+    {
+        if ((cal->ci[i] < 0) || (cal->ci[i] > ci_dtu))
+            return 0;
+    }
+
+    return 1;
+}
+
+uint16 antcal_antennadelay(const antcal_t *cal, int k, uint16 programmed)
+{
+    return (uint16) lround(programmed + cal->x[k]);
+}
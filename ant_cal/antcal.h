@@ -0,0 +1,112 @@
+/*
+ * antcal.h
+ *
+ * Joint antenna delay calibration from ranges between nodes at known separations.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _ANTCAL_H_
+#define _ANTCAL_H_
+
+#include "deca_types.h"
+
+#define ANTCAL_MAX_NODES        (16)
+
+/* Samples further than this from the expected time of flight are rejected as NLOS or bad frames (about 4.7 m) */
+#define ANTCAL_GATE_DTU         (1000.0)
+
+/* Minimum number of accepted samples per surveyed pair before the solution is trusted */
+#define ANTCAL_MIN_PAIR_SAMPLES (10)
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * Calibration state
+ *
+ * A DS-TWR time of flight between nodes i and j is biased by half the sum of the TX + RX antenna delay errors of both
+ * nodes: tof_meas = tof_true + x_i + x_j. With three or more nodes and an odd cycle in the surveyed pairs, every x_k is
+ * observable and is solved for by least squares. Only per-pair sums are kept so samples can be added at ranging rate.
+ */
+typedef struct
+{
+    int    num_nodes ;
+    double expected[ANTCAL_MAX_NODES][ANTCAL_MAX_NODES] ;  // expected ToF in DTU, < 0 for pairs without a known separation
+    uint32 n[ANTCAL_MAX_NODES][ANTCAL_MAX_NODES] ;         // number of accepted samples per pair (i < j)
+    double s1[ANTCAL_MAX_NODES][ANTCAL_MAX_NODES] ;        // sum of (tof_meas - expected) per pair
+    double s2[ANTCAL_MAX_NODES][ANTCAL_MAX_NODES] ;        // sum of (tof_meas - expected)^2 per pair
+    uint32 rejected ;                                      // samples dropped by the ANTCAL_GATE_DTU gate
+    double x[ANTCAL_MAX_NODES] ;                           // solved delay error per node, in DTU of ToF
+    double ci[ANTCAL_MAX_NODES] ;                          // 95% confidence half-width of x, in DTU
+    double rms ;                                           // RMS residual of the last solution, in DTU
+} antcal_t ;
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn antcal_init()
+ *
+ * @brief Reset the calibration state for num_nodes nodes (2 to ANTCAL_MAX_NODES)
+ *
+ * @return 0 on success, -1 if num_nodes is out of range
+ */
+int antcal_init(antcal_t *cal, int num_nodes);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn antcal_setseparation()
+ *
+ * @brief Set the known separation between nodes i and j. The expected time of flight includes the range bias for the
+ *        channel and PRF so that the solved delays apply to bias corrected ranges.
+ *
+ * @param dist_m - surveyed separation in metres
+ *
+ * @return 0 on success, -1 on invalid node index
+ */
+int antcal_setseparation(antcal_t *cal, int i, int j, double dist_m, uint8 chan, uint8 prf);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn antcal_addsample()
+ *
+ * @brief Add one DS-TWR time of flight measured between nodes i and j (in either direction)
+ *
+ * @param tof_dtu - measured time of flight in DTU
+ *
+ * @return 0 if the sample was accepted, -1 if the pair has no known separation or the sample was gated out
+ */
+int antcal_addsample(antcal_t *cal, int i, int j, double tof_dtu);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn antcal_solve()
+ *
+ * @brief Solve the normal equations for the per-node delay errors and their confidence intervals
+ *
+ * @return 0 on success, -1 if the surveyed pairs do not determine every node (e.g. fewer than 3 nodes or no odd cycle)
+ */
+int antcal_solve(antcal_t *cal);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn antcal_converged()
+ *
+ * @brief Check whether the last solution can be used: every surveyed pair has ANTCAL_MIN_PAIR_SAMPLES samples and every
+ *        node's 95% confidence half-width is below ci_dtu
+ *
+ * @return 1 if converged, 0 otherwise
+ */
+int antcal_converged(const antcal_t *cal, double ci_dtu);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn antcal_antennadelay()
+ *
+ * @brief Convert the solution for node k to the value to program with dwt_settxantennadelay/dwt_setrxantennadelay, the
+ *        delay error being split equally between TX and RX
+ *
+ * @param programmed - antenna delay (per direction) node k used while the samples were taken
+ *
+ * @return the calibrated antenna delay
+ */
+uint16 antcal_antennadelay(const antcal_t *cal, int k, uint16 programmed);
+
+#endif /* _ANTCAL_H_ */
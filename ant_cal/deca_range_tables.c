@@ -8,6 +8,9 @@
  *
  * All rights reserved.
  *
+ * The 25 cm tables below are not linked into the applications. At build time this file is compiled with RANGE_LUT_GEN
+ * defined into the range_lut_gen host tool, which expands them into the direct-indexed deca_range_lut.h used by
+ * dwt_getrangebias() and dwt_correctrangebias().
  */
 #include <stdio.h>
 #include <stdlib.h>
@@ -15,6 +18,8 @@
 #include "deca_device_api.h"
 #include "deca_param_types.h"
 
+#ifdef RANGE_LUT_GEN
+
 #define NUM_16M_OFFSET  (37)
 #define NUM_16M_OFFSETWB  (68)
 #define NUM_64M_OFFSET  (26)
@@ -620,34 +625,26 @@ const uint8 range25cm64PRFwb[2][NUM_64M_OFFSETWB] =
 
 
 /*! ------------------------------------------------------------------------------------------------------------------
- * @fn dwt_getrangebias()
+ * @fn rangebias_scan_cm()
  *
- * @brief This function is used to return the range bias correction need for TWR with DW1000 units.
+ * @brief Reference lookup used to generate deca_range_lut.h: scans the 25 cm table of the given channel and PRF for the
+ *        bias of a range expressed in integer units of 25 cm.
  *
- * input parameters:	
- * @param chan  - specifies the operating channel (e.g. 1, 2, 3, 4, 5, 6 or 7) 
- * @param range - the calculated distance before correction
- * @param prf	- this is the PRF e.g. DWT_PRF_16M or DWT_PRF_64M
+ * input parameters:
+ * @param chan         - specifies the operating channel (e.g. 1, 2, 3, 4, 5, 6 or 7)
+ * @param rangeint25cm - the calculated distance before correction, in integer units of 25 cm (0 to 255)
+ * @param prf          - this is the PRF e.g. DWT_PRF_16M or DWT_PRF_64M
  *
  * output parameters
  *
- * returns correction needed in meters
+ * returns correction needed in centimetres
  */
-double dwt_getrangebias(uint8 chan, float range, uint8 prf)
+static int rangebias_scan_cm(uint8 chan, int rangeint25cm, uint8 prf)
 {
-    // First get the lookup index that corresponds to given range for a particular channel at 16M PRF
     int i = 0 ;
     int chanIdx ;
     int cmoffseti ; // Integer number of CM offset
 
-    double mOffset ; // Final offset result in metres
-
-    // NB: note we may get some small negitive values e.g. up to -50 cm.
-
-    int rangeint25cm = (int) (range * 4.00) ; // Convert range to integer number of 25cm values.
-
-    if (rangeint25cm > 255) rangeint25cm = 255 ; // Make sure it matches largest value in table (all tables end in 255 !!!!)
-
     if (prf == DWT_PRF_16M)
     {
         switch(chan)
@@ -689,10 +686,134 @@ double dwt_getrangebias(uint8 chan, float range, uint8 prf)
         }//end of switch
     } // end else
 
+    return cmoffseti ;
+}
 
-    mOffset = (float) cmoffseti ; // Offset result in centimetres
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn main()
+ *
+ * @brief range_lut_gen entry point. Writes deca_range_lut.h to stdout: for each PRF and channel, the bias in centimetres
+ *        at every 25 cm step from 0 to 63.75 m.
+ *
+ * @param  none
+ *
+ * @return none
+ */
+int main(void)
+{
+    uint8 prf ;
+    uint8 chan ;
+    int r ;
 
-    mOffset *= 0.01 ; // Convert to metres
+    printf("/* deca_range_lut.h - generated by range_lut_gen from deca_range_tables.c, do not edit */\n\n") ;
+    printf("#define RANGE_LUT_LEN (256) // One entry per 25 cm step, all tables end in 255\n\n") ;
+    printf("// Range bias correction in centimetres, indexed by [prf - DWT_PRF_16M][chan][range in 25 cm units]\n") ;
+    printf("static const int8 range_bias_lut[2][NUM_CH_SUPPORTED][RANGE_LUT_LEN] =\n{\n") ;
 
-    return (mOffset) ;
+    for (prf = DWT_PRF_16M ; prf <= DWT_PRF_64M ; prf++)
+    {
+        printf("    // %s\n    {\n", (prf == DWT_PRF_16M) ? "16 MHz PRF" : "64 MHz PRF") ;
+        for (chan = 0 ; chan < NUM_CH_SUPPORTED ; chan++)
+        {
+            printf("        // Ch %d\n        {", chan) ;
+            for (r = 0 ; r < 256 ; r++)
+            {
+                printf("%s%4d%s", (r % 16) ? "" : "\n            ", rangebias_scan_cm(chan, r, prf), (r < 255) ? "," : "") ;
+            }
+            printf("\n        }%s\n", (chan < NUM_CH_SUPPORTED - 1) ? "," : "") ;
+        }
+        printf("    }%s\n", (prf == DWT_PRF_16M) ? "," : "") ;
+    }
+    printf("};\n") ;
+
+    return 0 ;
 }
+
+#else
+
+#include "deca_range_lut.h"
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn rangebias_lookup()
+ *
+ * @brief Linearly interpolate the bias of a range between the two surrounding 25 cm steps of a lookup table. At the
+ *        25 cm steps this gives the same value as the original table scan.
+ *
+ * input parameters:
+ * @param lut   - the RANGE_LUT_LEN entries of range_bias_lut for the operating channel and PRF
+ * @param range - the calculated distance before correction
+ *
+ * output parameters
+ *
+ * returns correction needed in meters
+ */
+static double rangebias_lookup(const int8 *lut, double range)
+{
+    double range25cm = range * 4.00 ; // Convert range to (fractional) number of 25cm values.
+    double frac ;
+    int idx ;
+
+    // NB: note we may get some small negitive values e.g. up to -50 cm.
+    if (range25cm <= 0)
+    {
+        return lut[0] * 0.01 ;
+    }
+    if (range25cm >= (RANGE_LUT_LEN - 1))
+    {
+        return lut[RANGE_LUT_LEN - 1] * 0.01 ; // Make sure it matches largest value in table (all tables end in 255 !!!!)
+    }
+
+    idx = (int) range25cm ;
+    frac = range25cm - idx ;
+
+    return (lut[idx] + frac * (lut[idx + 1] - lut[idx])) * 0.01 ;
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn dwt_getrangebias()
+ *
+ * @brief This function is used to return the range bias correction need for TWR with DW1000 units.
+ *
+ * input parameters:	
+ * @param chan  - specifies the operating channel (e.g. 1, 2, 3, 4, 5, 6 or 7) 
+ * @param range - the calculated distance before correction
+ * @param prf	- this is the PRF e.g. DWT_PRF_16M or DWT_PRF_64M
+ *
+ * output parameters
+ *
+ * returns correction needed in meters
+ */
+double dwt_getrangebias(uint8 chan, float range, uint8 prf)
+{
+    return rangebias_lookup(range_bias_lut[(prf == DWT_PRF_16M) ? 0 : 1][chan % NUM_CH_SUPPORTED], range) ;
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn dwt_correctrangebias()
+ *
+ * @brief This function is used to remove the range bias from an array of TWR ranges measured with the same channel and
+ *        PRF. The ranges are corrected in place.
+ *
+ * input parameters:
+ * @param chan   - specifies the operating channel (e.g. 1, 2, 3, 4, 5, 6 or 7)
+ * @param prf    - this is the PRF e.g. DWT_PRF_16M or DWT_PRF_64M
+ * @param ranges - the calculated distances before correction, in meters
+ * @param count  - number of entries in ranges
+ *
+ * output parameters
+ * @param ranges - the corrected distances, in meters
+ *
+ * no return value
+ */
+void dwt_correctrangebias(uint8 chan, uint8 prf, double *ranges, int count)
+{
+    const int8 *lut = range_bias_lut[(prf == DWT_PRF_16M) ? 0 : 1][chan % NUM_CH_SUPPORTED] ;
+    int i ;
+
+    for (i = 0 ; i < count ; i++)
+    {
+        ranges[i] -= rangebias_lookup(lut, ranges[i]) ;
+    }
+}
+
+#endif // RANGE_LUT_GEN
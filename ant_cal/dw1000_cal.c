@@ -0,0 +1,631 @@
+/*! ----------------------------------------------------------------------------
+ *  @file    dw1000_cal.c
+ *  @brief   Multi-node antenna delay calibration
+ *
+ *           Three or more nodes at surveyed separations range each other with DS TWR. Node 0 coordinates: it walks the list of surveyed
+ *           pairs, either ranging the pair itself or commanding the pair's initiator to do it, and collects the time of flight that every
+ *           responder reports back. After each round it jointly solves the antenna delay of every node (see antcal.c) and stops as soon as
+ *           every node's 95% confidence interval is below CAL_CI_DTU. The other nodes only serve commands and polls.
+ *
+ *           usage: dw1000_cal NODE_ID ANT_DELAY                       (nodes 1 .. N-1)
+ *                  dw1000_cal 0 ANT_DELAY NUM_NODES SEPARATIONS       (coordinator)
+ *
+ *           All nodes must use the same ANT_DELAY while calibrating. SEPARATIONS is a text file of "i j distance_m" lines, one per
+ *           surveyed pair. See NOTE 1 below.
+ *
+ * @attention
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "deca_device_api.h"
+#include "deca_regs.h"
+#include "platform.h"
+#include "antcal.h"
+
+/* Default communication configuration. We use here EVK1000's default mode (mode 3). */
+static dwt_config_t config = {
+    2,               /* Channel number. */
+    DWT_PRF_64M,     /* Pulse repetition frequency. */
+    DWT_PLEN_1024,   /* Preamble length. Used in TX only. */
+    DWT_PAC32,       /* Preamble acquisition chunk size. Used in RX only. */
+    9,               /* TX preamble code. Used in TX only. */
+    9,               /* RX preamble code. Used in RX only. */
+    1,               /* 0 to use standard SFD, 1 to use non-standard SFD. */
+    DWT_BR_110K,     /* Data rate. */
+    DWT_PHRMODE_STD, /* PHY header mode. */
+    (1025 + 64 - 32) /* SFD timeout (preamble length + 1 + SFD length - PAC size). Used in RX only. */
+};
+
+/* Default antenna delay values for 64 MHz PRF. */
+#define TX_ANT_DLY 16436
+
+/* Frames used in the calibration process. See NOTE 2 below. */
+static uint8 tx_msg[] = {0x41, 0x88, 0, 0xCA, 0xDE, 0, 'C', 0, 'C', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+/* Length of the common part of the message (up to and including the function code, see NOTE 2 below). */
+#define ALL_MSG_COMMON_LEN 10
+/* Indexes to access some of the fields in the frames defined above. */
+#define ALL_MSG_SN_IDX 2
+#define ALL_MSG_DEST_IDX 5
+#define ALL_MSG_SRC_IDX 7
+#define ALL_MSG_FUNC_IDX 9
+#define CMD_MSG_PEER_IDX 10
+#define REPORT_MSG_PEER_IDX 10
+#define REPORT_MSG_TOF_IDX 11
+#define FINAL_MSG_POLL_TX_TS_IDX 10
+#define FINAL_MSG_RESP_RX_TS_IDX 14
+#define FINAL_MSG_FINAL_TX_TS_IDX 18
+#define FINAL_MSG_TS_LEN 4
+/* Function codes */
+#define FUNC_POLL 0x21
+#define FUNC_RESP 0x10
+#define FUNC_FINAL 0x23
+#define FUNC_CMD 0x30
+#define FUNC_REPORT 0x31
+/* Frame lengths, including the 2-byte checksum */
+#define POLL_MSG_LEN 12
+#define RESP_MSG_LEN 15
+#define FINAL_MSG_LEN 24
+#define CMD_MSG_LEN 13
+#define REPORT_MSG_LEN 17
+/* Frame sequence number, incremented after each transmission. */
+static uint8 frame_seq_nb = 0;
+
+/* Buffer to store received messages. */
+#define RX_BUF_LEN 24
+static uint8 rx_buffer[RX_BUF_LEN];
+
+/* Hold copy of status register state here for reference so that it can be examined at a debug breakpoint. */
+static uint32 status_reg = 0;
+
+/* UWB microsecond (uus) to device time unit (dtu, around 15.65 ps) conversion factor.
+ * 1 uus = 512 / 499.2 µs and 1 µs = 499.2 * 128 dtu. */
+#define UUS_TO_DWT_TIME 65536
+
+/* Delays between frames, in UWB microseconds, as in the dw1000_init/dw1000_resp pair. */
+#define POLL_TX_TO_RESP_RX_DLY_UUS 150
+#define RESP_RX_TO_FINAL_TX_DLY_UUS 3100
+#define RESP_RX_TIMEOUT_UUS 2700
+#define POLL_RX_TO_RESP_TX_DLY_UUS 2600
+#define RESP_TX_TO_FINAL_RX_DLY_UUS 500
+#define FINAL_RX_TIMEOUT_UUS 3300
+/* Time the coordinator waits for a report after starting an exchange: command, poll, response, final and report frames. */
+#define REPORT_RX_TIMEOUT_UUS 60000
+
+/* Coordinator parameters */
+#define COORD_ID 0
+#define CAL_CI_DTU 2.0          /* Stop once every node's delay is known to +/- 2 DTU (about 1 cm of range) */
+#define CAL_MAX_ROUNDS 200      /* Give up after this many passes over the surveyed pairs */
+
+/* Timestamps of frames transmission/reception.
+ * As they are 40-bit wide, we need to define a 64-bit int type to handle them. */
+typedef signed long long int64;
+typedef unsigned long long uint64;
+
+static uint8 my_id;
+static uint16 ant_delay = TX_ANT_DLY;
+
+/* Declaration of static functions. */
+static uint64 get_tx_timestamp_u64(void);
+static uint64 get_rx_timestamp_u64(void);
+static void final_msg_set_ts(uint8 *ts_field, uint64 ts);
+static void final_msg_get_ts(const uint8 *ts_field, uint32 *ts);
+static void msg_set_header(uint8 dest, uint8 func);
+static int send_msg(uint16 len, uint8 mode);
+static int wait_msg(uint8 func, int rx_enable);
+static int twr_initiate(uint8 peer);
+static int twr_respond(uint8 peer);
+static int run_coordinator(int num_nodes, const char *sep_path);
+static void run_node(void);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn main()
+ *
+ * @brief Application entry point.
+ *
+ * @param  none
+ *
+ * @return none
+ */
+int main(int argc, char* argv[])
+{
+    if ((argc != 3) && (argc != 5))
+    {
+        printf("usage: %s NODE_ID ANT_DELAY [NUM_NODES SEPARATIONS]\n", argv[0]);
+        return 0;
+    }
+
+    my_id = (uint8) atoi(argv[1]);
+    ant_delay = (uint16) atoi(argv[2]);
+
+    if ((my_id == COORD_ID) != (argc == 5))
+    {
+        printf("node %d %s NUM_NODES and SEPARATIONS\n", COORD_ID, (my_id == COORD_ID) ? "needs" : "is the only node taking");
+        return 0;
+    }
+
+    /* Start with board specific hardware init. */
+    hardware_init();
+
+    /* Reset and initialise DW1000. */
+    reset_DW1000(); /* Target specific drive of RSTn line into DW1000 low for a period. */
+    spi_set_rate_low();
+    if (dwt_initialise(DWT_LOADUCODE) == DWT_ERROR)
+    {
+        printf("INIT FAILED\n");
+        return -1;
+    }
+    spi_set_rate_high();
+
+    dwt_configure(&config);
+
+    dwt_setrxantennadelay(ant_delay);
+    dwt_settxantennadelay(ant_delay);
+
+    /* Only accept data frames addressed to this node. See NOTE 3 below. */
+    dwt_setpanid(0xDECA);
+    dwt_setaddress16(('C' << 8) | my_id);
+    dwt_enableframefilter(DWT_FF_DATA_EN);
+
+    if (my_id == COORD_ID)
+        return run_coordinator(atoi(argv[3]), argv[4]);
+
+    run_node();
+    return 0;
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn run_coordinator()
+ *
+ * @brief Range every surveyed pair in turn until the antenna delays of all nodes have converged, then print them.
+ *
+ * @param  num_nodes  number of nodes taking part, with IDs 0 .. num_nodes - 1
+ *         sep_path   file of "i j distance_m" lines
+ *
+ * @return 0 if the calibration converged, -1 otherwise
+ */
+static int run_coordinator(int num_nodes, const char *sep_path)
+{
+    static antcal_t cal;
+    int pair_i[ANTCAL_MAX_NODES * ANTCAL_MAX_NODES];
+    int pair_j[ANTCAL_MAX_NODES * ANTCAL_MAX_NODES];
+    int num_pairs = 0;
+    int i, j, p, round;
+    double dist;
+    FILE *fp;
+
+    if (antcal_init(&cal, num_nodes) != 0)
+    {
+        printf("NUM_NODES must be between 2 and %d\n", ANTCAL_MAX_NODES);
+        return -1;
+    }
+
+    if ((fp = fopen(sep_path, "r")) == NULL)
+    {
+        perror("Unable to open separations file");
+        return -1;
+    }
+    while ((num_pairs < ANTCAL_MAX_NODES * ANTCAL_MAX_NODES) && (fscanf(fp, "%d %d %lf", &i, &j, &dist) == 3))
+    {
+        if (antcal_setseparation(&cal, i, j, dist, config.chan, config.prf) != 0)
+        {
+            printf("ignoring pair %d %d\n", i, j);
+            continue;
+        }
+        /* Let the coordinator initiate whenever it is part of the pair, so it can wait for the report right away. */
+        pair_i[num_pairs] = (j == COORD_ID) ? j : i;
+        pair_j[num_pairs] = (j == COORD_ID) ? i : j;
+        num_pairs++;
+    }
+    fclose(fp);
+
+    printf("Starting COORDINATOR: %d nodes, %d pairs\n", num_nodes, num_pairs);
+
+    for (round = 0; round < CAL_MAX_ROUNDS; round++)
+    {
+        for (p = 0; p < num_pairs; p++)
+        {
+            i = pair_i[p];
+            j = pair_j[p];
+
+            if (i == COORD_ID)
+            {
+                if (twr_initiate(j) != 0)
+                    continue;
+            }
+            else
+            {
+                /* Command node i to range node j. */
+                msg_set_header(i, FUNC_CMD);
+                tx_msg[CMD_MSG_PEER_IDX] = j;
+                if (send_msg(CMD_MSG_LEN, DWT_START_TX_IMMEDIATE) != 0)
+                    continue;
+            }
+
+            /* Collect the time of flight computed by the responder. */
+            dwt_setrxtimeout(REPORT_RX_TIMEOUT_UUS);
+            if ((wait_msg(FUNC_REPORT, 1) == 0) && (rx_buffer[ALL_MSG_SRC_IDX] == j) && (rx_buffer[REPORT_MSG_PEER_IDX] == i))
+            {
+                uint32 tof_dtu;
+                final_msg_get_ts(&rx_buffer[REPORT_MSG_TOF_IDX], &tof_dtu);
+                antcal_addsample(&cal, i, j, (double)(int32) tof_dtu);
+            }
+        }
+
+        if (antcal_solve(&cal) != 0)
+            continue;
+
+        printf("round %d rms %3.2f dtu rejected %u:", round, cal.rms, (unsigned) cal.rejected);
+        for (i = 0; i < num_nodes; i++)
+            printf(" %d:%+3.2f(+/-%3.2f)", i, cal.x[i], cal.ci[i]);
+        printf("\n");
+        fflush(stdout);
+
+        if (antcal_converged(&cal, CAL_CI_DTU))
+        {
+            for (i = 0; i < num_nodes; i++)
+                printf("NODE %d ANT_DELAY %d\n", i, antcal_antennadelay(&cal, i, ant_delay));
+            return 0;
+        }
+    }
+
+    printf("calibration did not converge after %d rounds\n", CAL_MAX_ROUNDS);
+    return -1;
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn run_node()
+ *
+ * @brief Serve commands and polls forever: range the commanded peer, or answer a poll and report the time of flight to
+ *        the coordinator.
+ *
+ * @param  none
+ *
+ * @return none
+ */
+static void run_node(void)
+{
+    printf("Starting NODE %d\n", my_id);
+
+    while (1)
+    {
+        dwt_setrxtimeout(0);
+        if (wait_msg(0, 1) != 0)
+            continue;
+
+        switch (rx_buffer[ALL_MSG_FUNC_IDX])
+        {
+            case FUNC_CMD:
+                twr_initiate(rx_buffer[CMD_MSG_PEER_IDX]);
+                break;
+            case FUNC_POLL:
+                twr_respond(rx_buffer[ALL_MSG_SRC_IDX]);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn twr_initiate()
+ *
+ * @brief DS TWR initiator side: poll, wait for the response and send the final message carrying our timestamps.
+ *
+ * @param  peer  ID of the responder
+ *
+ * @return 0 if the final message was sent, -1 otherwise
+ */
+static int twr_initiate(uint8 peer)
+{
+    uint64 poll_tx_ts, resp_rx_ts, final_tx_ts;
+    uint32 final_tx_time;
+
+    dwt_setrxaftertxdelay(POLL_TX_TO_RESP_RX_DLY_UUS);
+    dwt_setrxtimeout(RESP_RX_TIMEOUT_UUS);
+
+    msg_set_header(peer, FUNC_POLL);
+    if (send_msg(POLL_MSG_LEN, DWT_START_TX_IMMEDIATE | DWT_RESPONSE_EXPECTED) != 0)
+        return -1;
+    if (wait_msg(FUNC_RESP, 0) != 0)
+        return -1;
+
+    /* Retrieve poll transmission and response reception timestamp. */
+    poll_tx_ts = get_tx_timestamp_u64();
+    resp_rx_ts = get_rx_timestamp_u64();
+
+    /* Compute final message transmission time. */
+    final_tx_time = (resp_rx_ts + (RESP_RX_TO_FINAL_TX_DLY_UUS * UUS_TO_DWT_TIME)) >> 8;
+    dwt_setdelayedtrxtime(final_tx_time);
+
+    /* Final TX timestamp is the transmission time we programmed plus the TX antenna delay. */
+    final_tx_ts = (((uint64)(final_tx_time & 0xFFFFFFFEUL)) << 8) + ant_delay;
+
+    msg_set_header(peer, FUNC_FINAL);
+    final_msg_set_ts(&tx_msg[FINAL_MSG_POLL_TX_TS_IDX], poll_tx_ts);
+    final_msg_set_ts(&tx_msg[FINAL_MSG_RESP_RX_TS_IDX], resp_rx_ts);
+    final_msg_set_ts(&tx_msg[FINAL_MSG_FINAL_TX_TS_IDX], final_tx_ts);
+
+    return send_msg(FINAL_MSG_LEN, DWT_START_TX_DELAYED);
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn twr_respond()
+ *
+ * @brief DS TWR responder side, called once a poll has been received: send the response, wait for the final message,
+ *        compute the time of flight and report it to the coordinator.
+ *
+ * @param  peer  ID of the initiator
+ *
+ * @return 0 if the report was sent, -1 otherwise
+ */
+static int twr_respond(uint8 peer)
+{
+    uint64 poll_rx_ts, resp_tx_ts, final_rx_ts;
+    uint32 resp_tx_time;
+    uint32 poll_tx_ts, resp_rx_ts, final_tx_ts;
+    uint32 poll_rx_ts_32, resp_tx_ts_32, final_rx_ts_32;
+    double Ra, Rb, Da, Db;
+    int64 tof_dtu;
+
+    /* Retrieve poll reception timestamp. */
+    poll_rx_ts = get_rx_timestamp_u64();
+
+    /* Set send time for response. */
+    resp_tx_time = (poll_rx_ts + (POLL_RX_TO_RESP_TX_DLY_UUS * UUS_TO_DWT_TIME)) >> 8;
+    dwt_setdelayedtrxtime(resp_tx_time);
+
+    /* Set expected delay and timeout for final message reception. */
+    dwt_setrxaftertxdelay(RESP_TX_TO_FINAL_RX_DLY_UUS);
+    dwt_setrxtimeout(FINAL_RX_TIMEOUT_UUS);
+
+    msg_set_header(peer, FUNC_RESP);
+    tx_msg[10] = 0x02; /* Activity code: go on with the ranging exchange */
+    tx_msg[11] = tx_msg[12] = 0;
+    if (send_msg(RESP_MSG_LEN, DWT_START_TX_DELAYED | DWT_RESPONSE_EXPECTED) != 0)
+        return -1;
+    if ((wait_msg(FUNC_FINAL, 0) != 0) || (rx_buffer[ALL_MSG_SRC_IDX] != peer))
+        return -1;
+
+    /* Retrieve response transmission and final reception timestamps. */
+    resp_tx_ts = get_tx_timestamp_u64();
+    final_rx_ts = get_rx_timestamp_u64();
+
+    /* Get timestamps embedded in the final message. */
+    final_msg_get_ts(&rx_buffer[FINAL_MSG_POLL_TX_TS_IDX], &poll_tx_ts);
+    final_msg_get_ts(&rx_buffer[FINAL_MSG_RESP_RX_TS_IDX], &resp_rx_ts);
+    final_msg_get_ts(&rx_buffer[FINAL_MSG_FINAL_TX_TS_IDX], &final_tx_ts);
+
+    /* Compute time of flight. 32-bit subtractions give correct answers even if clock has wrapped. */
+    poll_rx_ts_32 = (uint32)poll_rx_ts;
+    resp_tx_ts_32 = (uint32)resp_tx_ts;
+    final_rx_ts_32 = (uint32)final_rx_ts;
+    Ra = (double)(resp_rx_ts - poll_tx_ts);
+    Rb = (double)(final_rx_ts_32 - resp_tx_ts_32);
+    Da = (double)(final_tx_ts - resp_rx_ts);
+    Db = (double)(resp_tx_ts_32 - poll_rx_ts_32);
+    tof_dtu = (int64)((Ra * Rb - Da * Db) / (Ra + Rb + Da + Db));
+
+    printf("%d -> %d: %lld dtu\n", peer, my_id, tof_dtu);
+
+    /* Report to the coordinator. */
+    msg_set_header(COORD_ID, FUNC_REPORT);
+    tx_msg[REPORT_MSG_PEER_IDX] = peer;
+    final_msg_set_ts(&tx_msg[REPORT_MSG_TOF_IDX], (uint64) tof_dtu);
+    return send_msg(REPORT_MSG_LEN, DWT_START_TX_IMMEDIATE);
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn msg_set_header()
+ *
+ * @brief Fill in the common part of the frame to transmit.
+ *
+ * @param  dest  ID of the destination node
+ *         func  function code
+ *
+ * @return none
+ */
+static void msg_set_header(uint8 dest, uint8 func)
+{
+    tx_msg[ALL_MSG_SN_IDX] = frame_seq_nb;
+    tx_msg[ALL_MSG_DEST_IDX] = dest;
+    tx_msg[ALL_MSG_SRC_IDX] = my_id;
+    tx_msg[ALL_MSG_FUNC_IDX] = func;
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn send_msg()
+ *
+ * @brief Send the first len bytes of tx_msg. When no response is expected, wait for the end of the transmission.
+ *
+ * @param  len   frame length including the checksum
+ *         mode  as for dwt_starttx()
+ *
+ * @return 0 on success, -1 if a delayed transmission was too late
+ */
+static int send_msg(uint16 len, uint8 mode)
+{
+    dwt_writetxdata(len, tx_msg, 0); /* Zero offset in TX buffer. */
+    dwt_writetxfctrl(len, 0, 1); /* Zero offset in TX buffer, ranging. */
+    if (dwt_starttx(mode) == DWT_ERROR)
+        return -1;
+
+    frame_seq_nb++;
+
+    if (!(mode & DWT_RESPONSE_EXPECTED))
+    {
+        /* Poll DW1000 until TX frame sent event set. */
+        while (!(dwt_read32bitreg(SYS_STATUS_ID) & SYS_STATUS_TXFRS))
+        { };
+        dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_TXFRS);
+    }
+
+    return 0;
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn wait_msg()
+ *
+ * @brief Wait for a frame and read it into rx_buffer. The RX timeout in force is the one last set with dwt_setrxtimeout().
+ *
+ * @param  func       expected function code, 0 to accept any
+ *         rx_enable  1 to turn the receiver on here, 0 if a transmission with DWT_RESPONSE_EXPECTED already did
+ *
+ * @return 0 if a valid frame with the expected function code was received, -1 otherwise
+ */
+static int wait_msg(uint8 func, int rx_enable)
+{
+    uint32 len;
+
+    if (rx_enable)
+    {
+        dwt_rxenable(DWT_START_RX_IMMEDIATE);
+    }
+
+    /* Poll for reception of a frame or error/timeout. */
+    while (!((status_reg = dwt_read32bitreg(SYS_STATUS_ID)) & (SYS_STATUS_RXFCG | SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_RX_ERR)))
+    { };
+
+    if (!(status_reg & SYS_STATUS_RXFCG))
+    {
+        /* Clear RX error/timeout events in the DW1000 status register. */
+        dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_RX_ERR);
+
+        /* Reset RX to properly reinitialise LDE operation. */
+        dwt_rxreset();
+        return -1;
+    }
+
+    /* Clear good RX frame event and TX frame sent in the DW1000 status register. */
+    dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_RXFCG | SYS_STATUS_TXFRS);
+
+    len = dwt_read32bitreg(RX_FINFO_ID) & RX_FINFO_RXFL_MASK_1023;
+    if ((len > RX_BUF_LEN) || (len < ALL_MSG_COMMON_LEN))
+        return -1;
+    dwt_readrxdata(rx_buffer, len, 0);
+
+    if ((rx_buffer[ALL_MSG_DEST_IDX] != my_id) || ((func != 0) && (rx_buffer[ALL_MSG_FUNC_IDX] != func)))
+        return -1;
+
+    return 0;
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn get_tx_timestamp_u64()
+ *
+ * @brief Get the TX time-stamp in a 64-bit variable.
+ *        /!\ This function assumes that length of time-stamps is 40 bits, for both TX and RX!
+ *
+ * @param  none
+ *
+ * @return  64-bit value of the read time-stamp.
+ */
+static uint64 get_tx_timestamp_u64(void)
+{
+    uint8 ts_tab[5];
+    uint64 ts = 0;
+    int i;
+    dwt_readtxtimestamp(ts_tab);
+    for (i = 4; i >= 0; i--)
+    {
+        ts <<= 8;
+        ts |= ts_tab[i];
+    }
+    return ts;
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn get_rx_timestamp_u64()
+ *
+ * @brief Get the RX time-stamp in a 64-bit variable.
+ *        /!\ This function assumes that length of time-stamps is 40 bits, for both TX and RX!
+ *
+ * @param  none
+ *
+ * @return  64-bit value of the read time-stamp.
+ */
+static uint64 get_rx_timestamp_u64(void)
+{
+    uint8 ts_tab[5];
+    uint64 ts = 0;
+    int i;
+    dwt_readrxtimestamp(ts_tab);
+    for (i = 4; i >= 0; i--)
+    {
+        ts <<= 8;
+        ts |= ts_tab[i];
+    }
+    return ts;
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn final_msg_set_ts()
+ *
+ * @brief Fill a given timestamp field in a message with the given value. The least significant byte is at the lower
+ *        address.
+ *
+ * @param  ts_field  pointer on the first byte of the timestamp field to fill
+ *         ts  timestamp value
+ *
+ * @return none
+ */
+static void final_msg_set_ts(uint8 *ts_field, uint64 ts)
+{
+    int i;
+    for (i = 0; i < FINAL_MSG_TS_LEN; i++)
+    {
+        ts_field[i] = (uint8) ts;
+        ts >>= 8;
+    }
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn final_msg_get_ts()
+ *
+ * @brief Read a given timestamp value from a message. The least significant byte is at the lower address.
+ *
+ * @param  ts_field  pointer on the first byte of the timestamp field to read
+ *         ts  timestamp value
+ *
+ * @return none
+ */
+static void final_msg_get_ts(const uint8 *ts_field, uint32 *ts)
+{
+    int i;
+    *ts = 0;
+    for (i = 0; i < FINAL_MSG_TS_LEN; i++)
+    {
+        *ts += ts_field[i] << (i * 8);
+    }
+}
+
+/*****************************************************************************************************************************************************
+ * NOTES:
+ *
+ * 1. DS TWR cannot tell the TX and RX antenna delays of a node apart: the time of flight measured between nodes i and j is biased by
+ *    x_i + x_j, where x_k is half of node k's total (TX + RX) delay error. With three nodes in a triangle (or any surveyed graph with an odd
+ *    cycle) every x_k is observable, and antcal.c solves for all of them at once by least squares over every sample of every pair. The
+ *    delay error is then split equally between TX and RX, as recommended for DW1000 antenna delay calibration. The expected time of flight of
+ *    each pair includes the range bias at its separation (see dwt_getrangebias) so that calibrated nodes report bias-corrected ranges.
+ * 2. The frames follow the IEEE 802.15.4 data frame layout of the other ranging examples:
+ *     - byte 0/1: frame control (0x8841 to indicate a data frame using 16-bit addressing).
+ *     - byte 2: sequence number, incremented for each new frame.
+ *     - byte 3/4: PAN ID (0xDECA).
+ *     - byte 5/6: destination address: node ID, 'C'.
+ *     - byte 7/8: source address: node ID, 'C'.
+ *     - byte 9: function code: 0x21 poll, 0x10 response, 0x23 final, 0x30 command, 0x31 report.
+ *    Command message (coordinator to initiator):
+ *     - byte 10: ID of the node to range.
+ *    Report message (responder to coordinator):
+ *     - byte 10: ID of the initiator.
+ *     - byte 11 -> 14: measured time of flight in DTU (signed).
+ *    Poll, response and final messages are as in dw1000_init/dw1000_resp.
+ * 3. Frame filtering makes each node's receiver drop the exchanges between other nodes, so the coordinator can listen for its report while
+ *    the commanded pair ranges.
+ ****************************************************************************************************************************************************/
@@ -22,6 +22,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <math.h>
 
 #include "deca_device_api.h"
 #include "deca_regs.h"
@@ -84,7 +85,7 @@ static uint32 status_reg = 0;
 #define PRE_TIMEOUT 8
 
 #define N_SAMPLES 100
-#define CABLE_COLOR "G"
+#define CABLE_COLOR 'G'
 
 /* Timestamps of frames transmission/reception.
  * As they are 40-bit wide, we need to define a 64-bit int type to handle them. */
@@ -102,6 +103,7 @@ static double tof;
 static double distance;
 static double tof_err;
 static double tof_array[N_SAMPLES] = {0};
+static double dist_array[N_SAMPLES] = {0};
 static int tof_array_idx = 0;
 
 
@@ -174,7 +176,7 @@ int main(void)
 
                 /* A frame has been received, read it into the local buffer. */
                 frame_len = dwt_read32bitreg(RX_FINFO_ID) & RX_FINFO_RXFL_MASK_1023;
-                if (frame_len <= RX_BUFFER_LEN)
+                if (frame_len <= RX_BUF_LEN)
                 {
                     dwt_readrxdata(rx_buffer, frame_len, 0);
                 }
@@ -263,10 +265,11 @@ int main(void)
 
                             /* Compute average tof for N_SAMPLES and display the error between measured and calibrated tof */
                             tof_array[tof_array_idx] = tof;
+                            dist_array[tof_array_idx] = distance;
                             tof_array_idx++;
                             /* Display computed distance on LCD. */
-                            sprintf(dist_str, "DIST: %3.3f m", distance + dwt_getrange_bias(config.chan,distance,config.prf));
-                            printf(dist_str);
+                            sprintf(dist_str, "DIST: %3.3f m", distance - dwt_getrangebias(config.chan, distance, config.prf));
+                            printf("%s\n", dist_str);
                         }
                     }
                     else
@@ -289,26 +292,32 @@ int main(void)
             }
         }
 
-        // Compute the average tof
+        // Remove the range bias from the whole batch at once
+        dwt_correctrangebias(config.chan, config.prf, dist_array, tof_array_idx);
+
+        // Compute the average tof and corrected distance
         double tof_avg = 0;
-        for(int j = 0; j<N_SAMPLES; j++)
+        double dist_avg = 0;
+        for(int j = 0; j<tof_array_idx; j++)
         {
             tof_avg += tof_array[j];
+            dist_avg += dist_array[j];
         }
         tof_avg = tof_avg/((double) tof_array_idx);
+        dist_avg = dist_avg/((double) tof_array_idx);
 
         // Get error for gold or black cable
-        if (CABLE_COLOR == "G")
+        if (CABLE_COLOR == 'G')
         {
-            tof_err = abs(tof_avg - 3.0401e-9)
+            tof_err = fabs(tof_avg - 3.0401e-9);
         }
-        else if (CABLE_COLOR == "B")
+        else if (CABLE_COLOR == 'B')
         {
-            tof_err = abs(tof_avg - 4.7875e-9)
+            tof_err = fabs(tof_avg - 4.7875e-9);
         }
 
 
-        printf("ERR: %3.4e ANT_DELAY %d", tof_err, (tx_dly+rx_dly));
+        printf("ERR: %3.4e ANT_DELAY %d DIST: %3.3f m\n", tof_err, (TX_ANT_DLY+RX_ANT_DLY), dist_avg);
         tof_array_idx = 0;
 
     }
@@ -186,3 +186,21 @@ void dwt_readrx_sys_count(uint8 * timestamp);
 * returns correction needed in meters
 */
 double dwt_getrangebias(uint8 chan, float range, uint8 prf);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+* @fn dwt_correctrangebias()
+*
+* @brief This function is used to remove the range bias from an array of TWR ranges measured with the same channel and PRF.
+*
+* input parameters:
+* @param chan   - specifies the operating channel (e.g. 1, 2, 3, 4, 5, 6 or 7)
+* @param prf    - this is the PRF e.g. DWT_PRF_16M or DWT_PRF_64M
+* @param ranges - the calculated distances before correction, in meters
+* @param count  - number of entries in ranges
+*
+* output parameters
+* @param ranges - the corrected distances, in meters
+*
+* no return value
+*/
+void dwt_correctrangebias(uint8 chan, uint8 prf, double *ranges, int count);
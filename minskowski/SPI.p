@@ -76,16 +76,46 @@ START:
     // Start
     //SET r30.t7
 
-    // Initialize sampling counter
-    LBCO r5, CONST_PRUSHAREDRAM, 0, 4
-    MOV  r6, 0
+    // Initialize ring: r5 head, r6 write offset, r8 dropped, r9 length, r11 end, r10/r12 per sample store offset and drop flag
+    MOV  r5, 0
+    MOV  r6, IQ_RING_OFFSET
+    MOV  r8, 0
+    MOV  r9, IQ_RING_LEN
+    MOV  r11, IQ_RING_END
+    SBCO r5, CONST_PRUSHAREDRAM, IQ_HEAD_OFFSET, 4
+    SBCO r8, CONST_PRUSHAREDRAM, IQ_DROP_OFFSET, 4
+
+IDLE:
+    // Acknowledge pause: the ARM may use MCSPI1 from now on
+    MOV  r7, IQ_CTRL_PAUSE
+    SBCO r7, CONST_PRUSHAREDRAM, IQ_STATE_OFFSET, 4
+IDLE_POLL:
+    LBCO r7, CONST_PRUSHAREDRAM, IQ_CTRL_OFFSET, 4
+    QBEQ EXIT, r7, IQ_CTRL_EXIT
+    QBNE IDLE_POLL, r7, IQ_CTRL_CAPTURE
+
+    // Acknowledge capture
+    SBCO r7, CONST_PRUSHAREDRAM, IQ_STATE_OFFSET, 4
+
 SMP:
+    // Go back to idle as soon as capture is paused, otherwise wait until sample is ready
+    LBCO r7, CONST_PRUSHAREDRAM, IQ_CTRL_OFFSET, 4
+    QBNE IDLE, r7, IQ_CTRL_CAPTURE
+    QBBC SMP, r31.t16
+
+    // Store into the ring unless it is full (head - tail == length)
+    MOV  r10, r6
+    MOV  r12, 0
+    LBCO r7, CONST_PRUSHAREDRAM, IQ_TAIL_OFFSET, 4
+    SUB  r7, r5, r7
+    QBLT ROOM, r9, r7
+    MOV  r10, IQ_SCRATCH_OFFSET
+    MOV  r12, 1
+ROOM:
+
     // Initialize word counter
     MOV  r3, 0
 
-    // Wait until sample is ready
-    WBS r31.t16
-
     // Configure channel 0 of MCSPI1
     CALL SET_SPIEN
 
@@ -118,10 +148,10 @@ SPI_RX:
     LBBO r2, r1, 0, 4
 
     // Store
-    SBCO r2, CONST_PRUSHAREDRAM, r6, 1 //byte to receive
+    SBCO r2, CONST_PRUSHAREDRAM, r10, 1 //byte to receive
 
     // Increment
-    ADD  r6, r6, 1
+    ADD  r10, r10, 1
 
     // Check channel 0
     MOV  r1, CHSTAT
@@ -141,9 +171,18 @@ END_LOOP:
     // Configure channel 0 of MCSPI1
     CALL CLR_SPIEN
 
-    // Increment counter
-    SUB r5, r5, 1
-    QBEQ EXIT, r5, 0
+    // Publish the sample, or count it as dropped if it went to the scratch slot
+    QBEQ PUBLISH, r12, 0
+    ADD  r8, r8, 1
+    SBCO r8, CONST_PRUSHAREDRAM, IQ_DROP_OFFSET, 4
+    JMP SMP
+PUBLISH:
+    ADD  r6, r6, IQ_SAMPLE_LEN
+    QBNE NO_WRAP, r6, r11
+    MOV  r6, IQ_RING_OFFSET
+NO_WRAP:
+    ADD  r5, r5, 1
+    SBCO r5, CONST_PRUSHAREDRAM, IQ_HEAD_OFFSET, 4
     JMP SMP
 
 //////////////////////////////////////
@@ -202,6 +241,8 @@ SET_SPIEN:
 EXIT:
     // End
     //CLR r30.t7
+    MOV  r7, IQ_CTRL_EXIT
+    SBCO r7, CONST_PRUSHAREDRAM, IQ_STATE_OFFSET, 4
 
     MOV R31.b0, PRU0_ARM_INTERRUPT+16
     HALT
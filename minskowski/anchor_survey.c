@@ -0,0 +1,157 @@
+/*
+ * Anchor Survey
+ *
+ * Reads the survey lines of the anchors (dw1000_ds_twr in survey mode, see survey.h) on stdin until its end, solves the
+ * relative anchor coordinates in DIM (2 or 3) dimensions and writes them as "anchor EUI x y z" lines, ready for the
+ * configuration of tdoa_agg and twr_agg, followed by the pairs that disagree with the solution. With SIM_ANCHORS,
+ * surveys a synthetic hall instead and reports the errors and the time the schedule takes.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "survey.h"
+#include "possvc.h"
+
+/* Synthetic hall (m), anchor heights, range noise (m), share of ranges through a blocked path and their excess (m) */
+#define SIM_LENGTH    40.0
+#define SIM_WIDTH     30.0
+#define SIM_Z_MIN     2.0
+#define SIM_Z_MAX     4.0
+#define SIM_STD       0.05
+#define SIM_NLOS      0.05
+#define SIM_NLOS_M    1.0
+
+/* Pairs further apart than this do not hear each other (m) */
+#define SIM_RANGE     35.0
+
+/* Pairs whose residual is over this many of their standard deviations are reported */
+#define SUSPECT_K     3.0
+
+static survey_t survey;
+
+static void print_solution(const survey_t *s)
+{
+	double d, std, r;
+	int i, j, pairs = 0;
+
+	for (i = 0; i < s->n; i++)
+		for (j = i + 1; j < s->n; j++)
+			pairs += s->w[i][j] > 0;
+	printf("# survey: %d anchors, %d pairs measured, %u ranges (%u dropped), resid %.3f m, %d iterations\n", s->n, pairs,
+		   s->ranges, s->dropped, s->resid, s->iter);
+
+	for (i = 0; i < s->n; i++)
+		printf("anchor %016llx %8.3f %8.3f %8.3f\n", (unsigned long long)(s->eui[i] ? s->eui[i] : (uint64_t)i),
+			   s->p[i][0], s->p[i][1], s->p[i][2]);
+
+	for (i = 0; i < s->n; i++)
+		for (j = i + 1; j < s->n; j++)
+			if (s->w[i][j] > 0 && survey_pair(s, i, j, &d, &std) > 0)
+			{
+				r = survey_dist(s->p[i], s->p[j]) - d;
+				if (fabs(r) > SUSPECT_K * std)
+					printf("# suspect pair %d %d: range %.3f m, resid %+.3f m\n", i, j, d, r);
+			}
+}
+
+/*
+ * Anchors scattered over the hall range every pair they can hear SURVEY_REPEAT times per pass, following the schedule;
+ * the schedule time counts every round in full, slots and guards, as the anchors do.
+ */
+static void run_sim(int n, int dim)
+{
+	static double p[SURVEY_ANCHORS][3];
+	double err2 = 0, rerr2 = 0, t_ms = 0;
+	int i, j, k, pass, round, m = 0;
+
+	for (i = 0; i < n; i++)
+	{
+		p[i][0] = SIM_LENGTH * rand() / RAND_MAX;
+		p[i][1] = SIM_WIDTH * rand() / RAND_MAX;
+		p[i][2] = (dim == 3) ? SIM_Z_MIN + (SIM_Z_MAX - SIM_Z_MIN) * rand() / RAND_MAX : 0;
+		survey.eui[i] = 0x5A00 + i;
+	}
+
+	for (pass = 0; pass < SURVEY_PASSES; pass++)
+		for (round = 0; round < survey_rounds(n); round++)
+		{
+			for (i = 0; i < n; i++)
+			{
+				if ((j = survey_partner(n, round, i, NULL)) < i)
+					continue;
+				if (survey_dist(p[i], p[j]) > SIM_RANGE)
+					continue;
+				for (k = 0; k < SURVEY_REPEAT; k++)
+					survey_add(&survey, i, j, survey_dist(p[i], p[j]) + SIM_STD * possvc_gauss()
+							   + ((double)rand() / RAND_MAX < SIM_NLOS ? SIM_NLOS_M * rand() / RAND_MAX : 0));
+			}
+			t_ms += survey_round_ms(n);
+		}
+
+	if (survey_solve(&survey, dim) != 0)
+	{
+		printf("SIM the pairs in range do not connect the anchors\n");
+		return;
+	}
+	print_solution(&survey);
+
+	/* The solution is in its own frame: compare the distances, and the coordinates of anchors 1 and 2 there */
+	for (i = 0; i < n; i++)
+		for (j = i + 1; j < n; j++)
+		{
+			double e = survey_dist(survey.p[i], survey.p[j]) - survey_dist(p[i], p[j]);
+			err2 += e * e;
+			m++;
+		}
+	rerr2 = fabs(survey.p[1][0] - survey_dist(p[0], p[1]));
+
+	printf("SIM anchors %d pairs %d schedule %.1f s distance error rms %.3f m (anchor 1 x error %.3f m)\n", n,
+		   n * (n - 1) / 2, t_ms / 1000, sqrt(err2 / m), rerr2);
+}
+
+static void run_stdin(int dim)
+{
+	char line[128];
+
+	while (fgets(line, sizeof(line), stdin) != NULL)
+		survey_line(&survey, line);
+
+	if (survey_solve(&survey, dim) != 0)
+	{
+		printf("# survey: the pairs measured do not connect the %d anchors in %d dimensions\n", survey.n, dim);
+		return;
+	}
+	print_solution(&survey);
+}
+
+int main(int argc, char *argv[])
+{
+	int dim;
+
+	if (argc < 2 || argc > 3 || ((dim = atoi(argv[1])) != 2 && dim != 3))
+	{
+		printf("usage: %s DIM [SIM_ANCHORS]\n", argv[0]);
+		return 0;
+	}
+
+	survey_init(&survey);
+	if (argc == 3)
+		run_sim(atoi(argv[2]) < SURVEY_ANCHORS ? atoi(argv[2]) : SURVEY_ANCHORS, dim);
+	else
+		run_stdin(dim);
+
+	return 0;
+}
@@ -0,0 +1,155 @@
+/*
+ * calstore.c
+ *
+ * Persistent per-device calibration store, keyed by the DW1000 part and lot IDs.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "deca_device_api.h"
+#include "calstore.h"
+
+static int calstore_valid(const calstore_file_t *cs)
+{
+    return (cs->magic == CALSTORE_MAGIC) && (cs->version == CALSTORE_VERSION) && (cs->num_recs <= CALSTORE_MAX_DEVICES);
+}
+
+static int calstore_find(const calstore_file_t *cs, uint32 partid, uint32 lotid)
+{
+    int i;
+
+    for (i = 0; i < cs->num_recs; i++)
+    {
+        if ((cs->rec[i].partid == partid) && (cs->rec[i].lotid == lotid))
+            return i;
+    }
+
+    return -1;
+}
+
+const calstore_rec_t *calstore_load(const char *path)
+{
+    const calstore_file_t *cs;
+    struct stat st;
+    int fd, i;
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return NULL;
+
+    if ((fstat(fd, &st) < 0) || (st.st_size < (off_t) sizeof(calstore_file_t)))
+    {
+        close(fd);
+        return NULL;
+    }
+
+    cs = mmap(NULL, sizeof(calstore_file_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); // the mapping holds its own reference
+    if (cs == MAP_FAILED)
+        return NULL;
+
+    if (!calstore_valid(cs) || ((i = calstore_find(cs, dwt_getpartid(), dwt_getlotid())) < 0))
+    {
+        munmap((void *) cs, sizeof(calstore_file_t));
+        return NULL;
+    }
+
+    return &cs->rec[i];
+}
+
+uint16 calstore_antennadelay(const calstore_rec_t *rec, uint8 chan, uint8 prf, uint16 dflt)
+{
+    uint16 dly;
+
+    if ((rec == NULL) || (chan >= CALSTORE_NUM_CHAN) || (prf < DWT_PRF_16M) || (prf > DWT_PRF_64M))
+        return dflt;
+
+    dly = rec->ant_dly[chan][prf - DWT_PRF_16M];
+
+    return (dly != 0) ? dly : dflt;
+}
+
+uint16 calstore_apply(const calstore_rec_t *rec, uint8 chan, uint8 prf, uint16 dflt)
+{
+    uint16 dly = calstore_antennadelay(rec, chan, prf, dflt);
+
+    dwt_setrxantennadelay(dly);
+    dwt_settxantennadelay(dly);
+
+    if ((rec != NULL) && (rec->flags & CALSTORE_HAS_XTALTRIM))
+        dwt_setxtaltrim(rec->xtaltrim);
+
+    return dly;
+}
+
+void calstore_initrec(calstore_rec_t *rec)
+{
+    memset(rec, 0, sizeof(*rec));
+    rec->partid = dwt_getpartid();
+    rec->lotid = dwt_getlotid();
+}
+
+int calstore_update(const char *path, const calstore_rec_t *rec)
+{
+    calstore_file_t *cs;
+    int fd, i, ret = 0;
+
+    if ((fd = open(path, O_RDWR | O_CREAT, 0644)) < 0)
+        return -1;
+
+    // A new file reads back as zeros, which is caught by the magic check below
+    if (ftruncate(fd, sizeof(calstore_file_t)) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    cs = mmap(NULL, sizeof(calstore_file_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (cs == MAP_FAILED)
+        return -1;
+
+    if (!calstore_valid(cs))
+    {
+        memset(cs, 0, sizeof(*cs));
+        cs->magic = CALSTORE_MAGIC;
+        cs->version = CALSTORE_VERSION;
+    }
+
+    if ((i = calstore_find(cs, rec->partid, rec->lotid)) < 0)
+    {
+        if (cs->num_recs < CALSTORE_MAX_DEVICES)
+        {
+            i = cs->num_recs++;
+        }
+        else
+        {
+            errno = ENOSPC;
+            ret = -1;
+        }
+    }
+
+    if (ret == 0)
+    {
+        cs->rec[i] = *rec;
+        ret = msync(cs, sizeof(calstore_file_t), MS_SYNC);
+    }
+
+    munmap(cs, sizeof(calstore_file_t));
+
+    return ret;
+}
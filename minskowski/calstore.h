@@ -0,0 +1,112 @@
+/*
+ * calstore.h
+ *
+ * Persistent per-device calibration store, keyed by the DW1000 part and lot IDs.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _CALSTORE_H_
+#define _CALSTORE_H_
+
+#include <stdint.h>
+#include "deca_types.h"
+
+#define CALSTORE_PATH        "/var/lib/dw1000/calstore.bin"
+
+#define CALSTORE_MAGIC       (0x4C414344)    // "DCAL"
+#define CALSTORE_VERSION     (1)
+#define CALSTORE_MAX_DEVICES (64)
+#define CALSTORE_NUM_CHAN    (8)             // indexed by channel number, 1 to 7
+
+/* Record flags */
+#define CALSTORE_HAS_XTALTRIM (0x01)
+#define CALSTORE_HAS_XODAC    (0x02)
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * Calibration record of one device
+ *
+ * The store file is an array of these behind a calstore_file_t header, in the native byte order of the node, with fixed
+ * width fields. It is mapped and used in place, so the layout only ever grows at the end of the record with a CALSTORE_VERSION bump.
+ */
+typedef struct
+{
+    uint32_t partid ;                             // dwt_getpartid()
+    uint32_t lotid ;                              // dwt_getlotid()
+    uint16_t ant_dly[CALSTORE_NUM_CHAN][2] ;      // [channel][PRF - DWT_PRF_16M]: one antenna delay for TX and RX, 0 if not calibrated
+    uint8_t  flags ;                              // CALSTORE_HAS_xxx
+    uint8_t  xtaltrim ;                           // dwt_setxtaltrim() value, valid with CALSTORE_HAS_XTALTRIM
+    uint16_t reserved ;
+    int32_t  xo_dac ;                             // 24-bit XO DAC setpoint, valid with CALSTORE_HAS_XODAC
+} calstore_rec_t ;
+
+typedef struct
+{
+    uint32_t magic ;
+    uint16_t version ;
+    uint16_t num_recs ;
+    calstore_rec_t rec[CALSTORE_MAX_DEVICES] ;
+} calstore_file_t ;
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn calstore_load()
+ *
+ * @brief Map the store read-only and find the record of the local DW1000. Must be called after dwt_initialise(). The
+ *        mapping is kept for the life of the process so the returned record can be used without any copy.
+ *
+ * @param path - store file, usually CALSTORE_PATH
+ *
+ * @return the record, or NULL if the store is missing or invalid or has no record for this device
+ */
+const calstore_rec_t *calstore_load(const char *path);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn calstore_antennadelay()
+ *
+ * @brief Get the antenna delay for a channel and PRF
+ *
+ * @param rec  - record from calstore_load(), may be NULL
+ * @param dflt - value to return if the device is not calibrated for this channel and PRF
+ *
+ * @return the antenna delay
+ */
+uint16 calstore_antennadelay(const calstore_rec_t *rec, uint8 chan, uint8 prf, uint16 dflt);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn calstore_apply()
+ *
+ * @brief Program the antenna delays for the channel and PRF, and the crystal trim if calibrated. Must be called after
+ *        dwt_configure().
+ *
+ * @param rec  - record from calstore_load(), may be NULL
+ * @param dflt - antenna delay to program if the device is not calibrated for this channel and PRF
+ *
+ * @return the antenna delay programmed
+ */
+uint16 calstore_apply(const calstore_rec_t *rec, uint8 chan, uint8 prf, uint16 dflt);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn calstore_initrec()
+ *
+ * @brief Initialise an empty (uncalibrated) record for the local DW1000. Must be called after dwt_initialise().
+ */
+void calstore_initrec(calstore_rec_t *rec);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn calstore_update()
+ *
+ * @brief Write a record to the store, replacing the record with the same part and lot IDs or adding a new one. The
+ *        store is created if needed.
+ *
+ * @return 0 on success, -1 on error (errno is set) or if the store is full
+ */
+int calstore_update(const char *path, const calstore_rec_t *rec);
+
+#endif /* _CALSTORE_H_ */
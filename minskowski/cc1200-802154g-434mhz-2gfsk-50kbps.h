@@ -136,7 +136,7 @@ static const registerSetting_t preferredSettings[]=
 
 static const registerSetting_t preferredSettings[]= 
 {
-  {CC1200_IOCFG0,            0x06},
+  {CC1200_IOCFG0,            CC1200_IOCFG_PKT_CRC_OK},
   {CC1200_SYNC3,             0x6F},
   {CC1200_SYNC2,             0x4E},
   {CC1200_SYNC1,             0x90},
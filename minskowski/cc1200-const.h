@@ -290,6 +290,7 @@
 #define CC1200_IOCFG_RSSI_VALID         13
 #define CC1200_IOCFG_RSSI_SIGNALS       14
 #define CC1200_IOCFG_CARRIER_SENSE      17
+#define CC1200_IOCFG_PKT_CRC_OK         19
 #define CC1200_IOCFG_MARC_2PIN_STATUS_1 37
 #define CC1200_IOCFG_MARC_2PIN_STATUS_0 38
 #define CC1200_IOCFG_RXFIFO_CHIP_RDY_N  50
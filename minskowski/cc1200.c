@@ -25,6 +25,7 @@
 #include <getopt.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
+#include <poll.h>
 #include <linux/spi/spidev.h>
 #include <linux/types.h>
 
@@ -37,6 +38,13 @@
  ******************************************************************************/
 #define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
 
+// Register settings written in bursts, and bursts per SPI message
+#define CC1200_MAX_SETTINGS 256
+#define CC1200_MAX_BURSTS 32
+
+// Status byte polls before giving up on reaching IDLE
+#define CC1200_IDLE_POLLS 1000
+
 // CC1200 SPI
 static uint32_t mode = 0;
 static uint8_t bits = 8;
@@ -44,9 +52,24 @@ static uint32_t speed = 7700000;
 static uint16_t delay = 1;
 
 static int fd;
+static int irq_fd = -1;
 
 static uint8_t buf[1024];
 
+// Profiles: index 0 is the chip after reset, 1 to num_profiles the registered configurations
+static const cc1200_rf_cfg_t *profile[CC1200_MAX_PROFILES + 1];
+static int num_profiles;
+static int cur_profile = -1;
+
+// Register image of each profile over the union of the addresses they set
+static uint16_t profile_addr[CC1200_MAX_SETTINGS];
+static uint8_t profile_image[CC1200_MAX_PROFILES + 1][CC1200_MAX_SETTINGS];
+static int profile_num_addr;
+
+// Registers to write to go from one profile to another
+static registerSetting_t profile_delta[CC1200_MAX_PROFILES + 1][CC1200_MAX_PROFILES + 1][CC1200_MAX_SETTINGS];
+static int profile_delta_len[CC1200_MAX_PROFILES + 1][CC1200_MAX_PROFILES + 1];
+
 int cc1200_cmd_strobe(uint8_t cmd)
 {
 	struct spi_ioc_transfer transfer = {
@@ -121,14 +144,79 @@ int cc1200_write_register(uint16_t reg, uint8_t value)
 void cc1200_write_reg_settings(const registerSetting_t *reg_settings,
 		uint16_t sizeof_reg_settings)
 {
-	int i = sizeof_reg_settings / sizeof(registerSetting_t);
-
-	if(reg_settings != NULL) {
-		while(i--) {
+	int n = sizeof_reg_settings / sizeof(registerSetting_t);
+	registerSetting_t sorted[CC1200_MAX_SETTINGS];
+	struct spi_ioc_transfer transfer[CC1200_MAX_BURSTS];
+	uint16_t next;
+	int i, j, start, len = 0, nt = 0;
+
+	if(reg_settings == NULL)
+		return;
+
+	// Too large to sort here: one write per register
+	if(n > CC1200_MAX_SETTINGS) {
+		while(n--) {
 			cc1200_write_register(reg_settings->addr,
 					reg_settings->val);
 			reg_settings++;
 		}
+		return;
+	}
+
+	// Stable sort by address, so a register listed twice keeps its last value
+	for(i = 0; i < n; i++) {
+		registerSetting_t s = reg_settings[i];
+		for(j = i; j > 0 && sorted[j-1].addr > s.addr; j--)
+			sorted[j] = sorted[j-1];
+		sorted[j] = s;
+	}
+
+	memset(transfer, 0, sizeof(transfer));
+
+	// One burst per run of consecutive addresses, all bursts in as few messages as possible
+	for(i = 0; i < n; i = j) {
+		start = len;
+
+		// Reg
+		if (!CC1200_IS_EXTENDED_ADDR(sorted[i].addr)) {
+			buf[len++] = CC1200_WRITE_BIT | CC1200_BURST_BIT | sorted[i].addr;
+		}
+		// Extended Address
+		else {
+			buf[len++] = CC1200_WRITE_BIT | CC1200_BURST_BIT | CC1200_EXT_REG_MASK;
+			buf[len++] = CC1200_UNEXTEND_ADDR(sorted[i].addr);
+		}
+
+		// The address auto-increments within the regular (below the extended access address) or extended space
+		next = sorted[i].addr;
+		for(j = i; j < n; j++) {
+			if(j > i && sorted[j].addr == next - 1)
+				buf[len - 1] = sorted[j].val;
+			else if(sorted[j].addr == next && (CC1200_IS_EXTENDED_ADDR(next) || next < CC1200_EXT_REG_MASK)) {
+				buf[len++] = sorted[j].val;
+				next++;
+			}
+			else
+				break;
+		}
+
+		transfer[nt].tx_buf = (unsigned long)&buf[start];
+		transfer[nt].rx_buf = (unsigned long)&buf[start];
+		transfer[nt].len = len - start;
+		transfer[nt].delay_usecs = delay;
+		transfer[nt].speed_hz = speed;
+		transfer[nt].bits_per_word = bits;
+		transfer[nt].cs_change = 1; // end the burst
+		nt++;
+
+		if(nt == CC1200_MAX_BURSTS || j == n) {
+			// CS is released at the end of the message anyway
+			transfer[nt-1].cs_change = 0;
+			ioctl(fd, SPI_IOC_MESSAGE(nt), transfer);
+			memset(transfer, 0, sizeof(transfer));
+			nt = 0;
+			len = 0;
+		}
 	}
 }
 
@@ -214,7 +302,7 @@ int cc1200_read_rxfifo(uint8_t *data, uint8_t len)
 	else
 	{
 		int j;
-		for (j = 0; j < transfer.len; j++)
+		for (j = 0; j < len; j++)
 		{
 			data[j] = buf[j+1];
 		}
@@ -224,6 +312,196 @@ int cc1200_read_rxfifo(uint8_t *data, uint8_t len)
 	return ret;
 }
 
+// Poll the status byte until the chip is ready (CHIP_RDYn low) and in IDLE
+static int cc1200_wait_idle(void)
+{
+	uint8_t status = 0;
+	int i;
+
+	for(i = 0; i < CC1200_IDLE_POLLS; i++) {
+		if(cc1200_get_status(&status) >= 0 && (status & 0xF0) == CC1200_STATUS_BYTE_IDLE)
+			return 0;
+	}
+
+	return -1;
+}
+
+static int cc1200_profile_index(uint16_t addr)
+{
+	int i;
+
+	for(i = 0; i < profile_num_addr; i++) {
+		if(profile_addr[i] == addr)
+			return i;
+	}
+
+	return -1;
+}
+
+int cc1200_profile_init(const cc1200_rf_cfg_t * const *cfgs, int count)
+{
+	const registerSetting_t *s;
+	int p, q, i, j, n;
+
+	if(count > CC1200_MAX_PROFILES)
+		return -1;
+
+	// Union of the addresses, ascending
+	profile_num_addr = 0;
+	for(p = 0; p < count; p++) {
+		s = cfgs[p]->register_settings;
+		n = cfgs[p]->size_of_register_settings / sizeof(registerSetting_t);
+		for(i = 0; i < n; i++) {
+			if(cc1200_profile_index(s[i].addr) >= 0)
+				continue;
+			if(profile_num_addr == CC1200_MAX_SETTINGS)
+				return -1;
+			for(j = profile_num_addr++; j > 0 && profile_addr[j-1] > s[i].addr; j--)
+				profile_addr[j] = profile_addr[j-1];
+			profile_addr[j] = s[i].addr;
+		}
+	}
+
+	// Reset values, from the chip itself once its crystal is up again
+	cc1200_cmd_strobe(CC1200_SRES);
+	if(cc1200_wait_idle() < 0)
+		return -1;
+	for(i = 0; i < profile_num_addr; i++) {
+		if(cc1200_read_register(profile_addr[i], &profile_image[0][i]) < 0)
+			return -1;
+	}
+
+	// Each profile is what SRES followed by its register table leaves
+	num_profiles = count;
+	profile[0] = NULL;
+	for(p = 1; p <= count; p++) {
+		profile[p] = cfgs[p-1];
+		memcpy(profile_image[p], profile_image[0], profile_num_addr);
+		s = profile[p]->register_settings;
+		n = profile[p]->size_of_register_settings / sizeof(registerSetting_t);
+		for(i = 0; i < n; i++)
+			profile_image[p][cc1200_profile_index(s[i].addr)] = s[i].val;
+	}
+
+	for(p = 0; p <= count; p++) {
+		for(q = 0; q <= count; q++) {
+			n = 0;
+			for(i = 0; i < profile_num_addr; i++) {
+				if(profile_image[p][i] != profile_image[q][i]) {
+					profile_delta[p][q][n].addr = profile_addr[i];
+					profile_delta[p][q][n].val = profile_image[q][i];
+					n++;
+				}
+			}
+			profile_delta_len[p][q] = n;
+		}
+	}
+
+	cur_profile = 0;
+
+	return 0;
+}
+
+int cc1200_profile_set(const cc1200_rf_cfg_t *cfg)
+{
+	int p;
+
+	for(p = 1; p <= num_profiles && profile[p] != cfg; p++)
+		;
+	if(p > num_profiles || cur_profile < 0)
+		return -1;
+
+	if(p == cur_profile)
+		return 0;
+
+	// Registers can only be written safely in IDLE
+	cc1200_cmd_strobe(CC1200_SIDLE);
+	if(cc1200_wait_idle() < 0)
+		return -1;
+
+	// SRES would have emptied them
+	cc1200_cmd_strobe(CC1200_SFRX);
+	cc1200_cmd_strobe(CC1200_SFTX);
+
+	cc1200_write_reg_settings(profile_delta[cur_profile][p], profile_delta_len[cur_profile][p] * sizeof(registerSetting_t));
+	cur_profile = p;
+
+	return 0;
+}
+
+int cc1200_profile_reset(void)
+{
+	cc1200_cmd_strobe(CC1200_SRES);
+	if(cur_profile >= 0)
+		cur_profile = 0;
+
+	return cc1200_wait_idle();
+}
+
+static int cc1200_gpio_write(int pin, const char *attr, const char *value)
+{
+	char path[64];
+	FILE *f;
+
+	sprintf(path, "/sys/class/gpio/gpio%d/%s", pin, attr);
+	if ((f = fopen(path, "w")) == NULL)
+		return -1;
+	fputs(value, f);
+
+	return (fclose(f) == 0) ? 0 : -1;
+}
+
+int cc1200_irq_init(int pin)
+{
+	char path[64], value[4];
+	FILE *f;
+
+	// Export the pin, which fails harmlessly if it already is
+	if ((f = fopen("/sys/class/gpio/export", "w")) != NULL) {
+		fprintf(f, "%d", pin);
+		fclose(f);
+	}
+
+	if (cc1200_gpio_write(pin, "direction", "in") < 0 || cc1200_gpio_write(pin, "edge", "rising") < 0) {
+		printf("Unable to set up CC1200 GPIO%d\n", pin);
+		return -1;
+	}
+
+	sprintf(path, "/sys/class/gpio/gpio%d/value", pin);
+	if ((irq_fd = open(path, O_RDONLY)) < 0) {
+		perror("Unable to open CC1200 IRQ value");
+		return -1;
+	}
+
+	// Reading the value is what acknowledges an edge
+	read(irq_fd, value, sizeof(value));
+
+	return 0;
+}
+
+void cc1200_irq_clear(void)
+{
+	char value[4];
+
+	lseek(irq_fd, 0, SEEK_SET);
+	read(irq_fd, value, sizeof(value));
+}
+
+int cc1200_irq_wait(int timeout_ms)
+{
+	struct pollfd pfd = {
+		.fd = irq_fd,
+		.events = POLLPRI | POLLERR,
+	};
+	int ret;
+
+	ret = poll(&pfd, 1, timeout_ms);
+	if (ret > 0)
+		cc1200_irq_clear();
+
+	return ret;
+}
+
 int cc1200_init(char * spi_path)
 {
 	uint8_t partnum = 0;
@@ -277,5 +555,7 @@ int cc1200_init(char * spi_path)
 
 void cc1200_close()
 {
+	if (irq_fd >= 0)
+		close(irq_fd);
 	close(fd);
 }
\ No newline at end of file
@@ -30,4 +30,36 @@ void cc1200_write_reg_settings(const registerSetting_t *reg_settings,
 int cc1200_read_register(uint16_t reg, uint8_t *data);
 int cc1200_write_txfifo(uint8_t *data, uint8_t len);
 int cc1200_read_rxfifo(uint8_t *data, uint8_t len);
-void cc1200_close();
\ No newline at end of file
+void cc1200_close();
+
+/*
+ * Interrupt driven reception: one of the CC1200 GPIO pins is configured (IOCFGx) to assert on the event of interest and
+ * the host sleeps on its rising edge.
+ */
+
+/* Set up the host GPIO the CC1200 pin is wired to, through sysfs. Returns 0 on success, -1 on error. */
+int cc1200_irq_init(int pin);
+
+/* Forget any edge seen so far. */
+void cc1200_irq_clear(void);
+
+/* Wait for a rising edge, at most timeout_ms (-1 for ever). Returns 1 on an edge, 0 on timeout, -1 on error. */
+int cc1200_irq_wait(int timeout_ms);
+
+/*
+ * Profile switching: the register deltas between the configurations are computed once, then a switch only writes the
+ * registers that differ, from IDLE, instead of SRES and the whole table.
+ */
+#define CC1200_MAX_PROFILES 4
+
+/* Register up to CC1200_MAX_PROFILES configurations. Resets the chip to read the reset value of every register they
+ * set. Returns 0 on success, -1 if there are too many profiles or registers, or the chip does not come out of reset. */
+int cc1200_profile_init(const cc1200_rf_cfg_t * const *cfgs, int count);
+
+/* Go to IDLE, flush the FIFOs and switch to a registered configuration. Returns 0 on success, -1 if cfg is not
+ * registered or the chip does not reach IDLE. */
+int cc1200_profile_set(const cc1200_rf_cfg_t *cfg);
+
+/* Reset the chip (SRES), wait for it to be ready and keep track of it, for the next cc1200_profile_set(). Returns 0 on
+ * success, -1 if the chip does not come out of reset. */
+int cc1200_profile_reset(void);
\ No newline at end of file
@@ -38,6 +38,10 @@
  ******************************************************************************/
 #define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
 
+// Register settings written in bursts, and bursts per SPI message
+#define CC1200_MAX_SETTINGS 256
+#define CC1200_MAX_BURSTS 32
+
 #define SPI_PATH 	"/dev/spidev2.0"
 
 /*---------------------------------------------------------------------------*/
@@ -147,14 +151,79 @@ static int cc1200_write_register(uint16_t reg, uint8_t value)
 static void cc1200_write_reg_settings(const registerSetting_t *reg_settings,
 		uint16_t sizeof_reg_settings)
 {
-	int i = sizeof_reg_settings / sizeof(registerSetting_t);
-
-	if(reg_settings != NULL) {
-		while(i--) {
+	int n = sizeof_reg_settings / sizeof(registerSetting_t);
+	registerSetting_t sorted[CC1200_MAX_SETTINGS];
+	struct spi_ioc_transfer transfer[CC1200_MAX_BURSTS];
+	uint16_t next;
+	int i, j, start, len = 0, nt = 0;
+
+	if(reg_settings == NULL)
+		return;
+
+	// Too large to sort here: one write per register
+	if(n > CC1200_MAX_SETTINGS) {
+		while(n--) {
 			cc1200_write_register(reg_settings->addr,
 					reg_settings->val);
 			reg_settings++;
 		}
+		return;
+	}
+
+	// Stable sort by address, so a register listed twice keeps its last value
+	for(i = 0; i < n; i++) {
+		registerSetting_t s = reg_settings[i];
+		for(j = i; j > 0 && sorted[j-1].addr > s.addr; j--)
+			sorted[j] = sorted[j-1];
+		sorted[j] = s;
+	}
+
+	memset(transfer, 0, sizeof(transfer));
+
+	// One burst per run of consecutive addresses, all bursts in as few messages as possible
+	for(i = 0; i < n; i = j) {
+		start = len;
+
+		// Reg
+		if (!CC1200_IS_EXTENDED_ADDR(sorted[i].addr)) {
+			buf[len++] = CC1200_WRITE_BIT | CC1200_BURST_BIT | sorted[i].addr;
+		}
+		// Extended Address
+		else {
+			buf[len++] = CC1200_WRITE_BIT | CC1200_BURST_BIT | CC1200_EXT_REG_MASK;
+			buf[len++] = CC1200_UNEXTEND_ADDR(sorted[i].addr);
+		}
+
+		// The address auto-increments within the regular (below the extended access address) or extended space
+		next = sorted[i].addr;
+		for(j = i; j < n; j++) {
+			if(j > i && sorted[j].addr == next - 1)
+				buf[len - 1] = sorted[j].val;
+			else if(sorted[j].addr == next && (CC1200_IS_EXTENDED_ADDR(next) || next < CC1200_EXT_REG_MASK)) {
+				buf[len++] = sorted[j].val;
+				next++;
+			}
+			else
+				break;
+		}
+
+		transfer[nt].tx_buf = (unsigned long)&buf[start];
+		transfer[nt].rx_buf = (unsigned long)&buf[start];
+		transfer[nt].len = len - start;
+		transfer[nt].delay_usecs = delay;
+		transfer[nt].speed_hz = speed;
+		transfer[nt].bits_per_word = bits;
+		transfer[nt].cs_change = 1; // end the burst
+		nt++;
+
+		if(nt == CC1200_MAX_BURSTS || j == n) {
+			// CS is released at the end of the message anyway
+			transfer[nt-1].cs_change = 0;
+			ioctl(fd, SPI_IOC_MESSAGE(nt), transfer);
+			memset(transfer, 0, sizeof(transfer));
+			nt = 0;
+			len = 0;
+		}
 	}
 }
 
@@ -38,19 +38,20 @@
 #include <sys/mman.h>
 #include <errno.h>
 #include <sys/time.h>
-#include <pruss/prussdrv.h>
-#include <pruss/pruss_intc_mapping.h>
-#include "SPI_bin.h"
+
+// PRU
+#include "pru_iq.h"
+#include "cfo.h"
+#include "xodisc.h"
 
 /******************************************************************************
  * Local Macro Declarations                                                    * 
  ******************************************************************************/
 #define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
 
-#define PRU_NUM 	0
-#define OFFSET_SHAREDRAM 0		//equivalent with 0x00002000
-
-#define PRUSS0_SHARED_DATARAM    4
+// Register settings written in bursts, and bursts per SPI message
+#define CC1200_MAX_SETTINGS 256
+#define CC1200_MAX_BURSTS 32
 
 // Standard
 #define	HIGH							1
@@ -73,16 +74,6 @@ extern const cc1200_rf_cfg_t CC1200_RF_CFG;
 /******************************************************************************
  * Global variable Declarations                                                * 
  ******************************************************************************/
-struct IQSample {
-	uint8_t status0;
-	uint8_t status1;
-	uint8_t magn2;
-	uint8_t magn1;
-	uint8_t magn0;
-	uint8_t ang1;
-	uint8_t ang0;
-} iqsample;
-
 // CC1200 SPI
 static uint32_t mode = 0;
 static uint8_t bits = 8;
@@ -95,10 +86,6 @@ static uint8_t xo_bits = 16;
 static uint32_t xo_speed = 20000000;
 static uint16_t xo_delay = 1;
 
-static void *sharedMem;
-static unsigned int *sharedMem_int;
-static struct IQSample *sharedMem_struct;
-
 static int max_num_samples = 1000;
 //static int avg_count = 10;
 
@@ -171,14 +158,79 @@ static int cc1200_write_register(uint16_t reg, uint8_t value)
 static void cc1200_write_reg_settings(const registerSetting_t *reg_settings,
 		uint16_t sizeof_reg_settings)
 {
-	int i = sizeof_reg_settings / sizeof(registerSetting_t);
+	int n = sizeof_reg_settings / sizeof(registerSetting_t);
+	registerSetting_t sorted[CC1200_MAX_SETTINGS];
+	struct spi_ioc_transfer transfer[CC1200_MAX_BURSTS];
+	uint16_t next;
+	int i, j, start, len = 0, nt = 0;
 
-	if(reg_settings != NULL) {
-		while(i--) {
+	if(reg_settings == NULL)
+		return;
+
+	// Too large to sort here: one write per register
+	if(n > CC1200_MAX_SETTINGS) {
+		while(n--) {
 			cc1200_write_register(reg_settings->addr,
 					reg_settings->val);
 			reg_settings++;
 		}
+		return;
+	}
+
+	// Stable sort by address, so a register listed twice keeps its last value
+	for(i = 0; i < n; i++) {
+		registerSetting_t s = reg_settings[i];
+		for(j = i; j > 0 && sorted[j-1].addr > s.addr; j--)
+			sorted[j] = sorted[j-1];
+		sorted[j] = s;
+	}
+
+	memset(transfer, 0, sizeof(transfer));
+
+	// One burst per run of consecutive addresses, all bursts in as few messages as possible
+	for(i = 0; i < n; i = j) {
+		start = len;
+
+		// Reg
+		if (!CC1200_IS_EXTENDED_ADDR(sorted[i].addr)) {
+			buf[len++] = CC1200_WRITE_BIT | CC1200_BURST_BIT | sorted[i].addr;
+		}
+		// Extended Address
+		else {
+			buf[len++] = CC1200_WRITE_BIT | CC1200_BURST_BIT | CC1200_EXT_REG_MASK;
+			buf[len++] = CC1200_UNEXTEND_ADDR(sorted[i].addr);
+		}
+
+		// The address auto-increments within the regular (below the extended access address) or extended space
+		next = sorted[i].addr;
+		for(j = i; j < n; j++) {
+			if(j > i && sorted[j].addr == next - 1)
+				buf[len - 1] = sorted[j].val;
+			else if(sorted[j].addr == next && (CC1200_IS_EXTENDED_ADDR(next) || next < CC1200_EXT_REG_MASK)) {
+				buf[len++] = sorted[j].val;
+				next++;
+			}
+			else
+				break;
+		}
+
+		transfer[nt].tx_buf = (unsigned long)&buf[start];
+		transfer[nt].rx_buf = (unsigned long)&buf[start];
+		transfer[nt].len = len - start;
+		transfer[nt].delay_usecs = delay;
+		transfer[nt].speed_hz = speed;
+		transfer[nt].bits_per_word = bits;
+		transfer[nt].cs_change = 1; // end the burst
+		nt++;
+
+		if(nt == CC1200_MAX_BURSTS || j == n) {
+			// CS is released at the end of the message anyway
+			transfer[nt-1].cs_change = 0;
+			ioctl(fd, SPI_IOC_MESSAGE(nt), transfer);
+			memset(transfer, 0, sizeof(transfer));
+			nt = 0;
+			len = 0;
+		}
 	}
 }
 
@@ -243,7 +295,7 @@ void intHandler(int dummy) {
 
 /// MAIN ///
 int main(int argc, char* argv[]){
-	int i, j = 0;
+	int j = 0;
 	uint8_t partnum = 0;
 	uint8_t partver = 0;
 	uint8_t isTX = 0;
@@ -259,10 +311,10 @@ int main(int argc, char* argv[]){
 		doLin = atoi(argv[3]);
 		continuous = atoi(argv[4]);
 
-		if(max_num_samples <= 0 || num_cycles <= 10)
+		if(max_num_samples <= 0 || num_cycles <= 0)
 		{
 			printf("usage: %s [samples per cycles] [num_cycles] [Linear Regression] [Continuous]\n", argv[0]);
-			printf("RX Mode: samples > 0 & num_cycles > 10\n");
+			printf("RX Mode: samples > 0 & num_cycles > 0\n");
 			return 0;
 		}
 
@@ -384,6 +436,18 @@ int main(int argc, char* argv[]){
 
 	// T/RX
 	if (!isTX) {
+		// Load the capture program once, it keeps running across cycles
+		if(pru_iq_open() != 0)
+			return -1;
+
+		// The XO loop runs across captures, from the DAC midpoint
+		xodisc_params_t xo_params;
+		xodisc_t xo_loop;
+		struct timespec last_update, now;
+		int xo_params_saved = (xodisc_load_params(XODISC_PATH, &xo_params) == 0);
+		xodisc_init(&xo_loop, &xo_params, vco_ctrl);
+		clock_gettime(CLOCK_MONOTONIC, &last_update);
+
 		while(keepRunning != 0)
 		{
 			//usleep(1000000);
@@ -394,37 +458,10 @@ int main(int argc, char* argv[]){
 
 			cc1200_cmd_strobe(CC1200_SRX);
 
-			///////// START PRU /////////
-			unsigned int ret;
-			tpruss_intc_initdata pruss_intc_initdata = PRUSS_INTC_INITDATA;
-			
-			//Initializing PRU
-			prussdrv_init();
-			ret = prussdrv_open(PRU_EVTOUT_0);
-			if (ret){
-				printf("\tERROR: prussdrv_open open failed\n");
-				return (ret);
-			}
-
-			prussdrv_pruintc_init(&pruss_intc_initdata);
-			prussdrv_map_prumem(PRUSS0_SHARED_DATARAM, &sharedMem);
+			///////// START CAPTURE /////////
+			pru_iq_start();
 
 			int num_samples = 100;
-			sharedMem_int = (unsigned int *) sharedMem;
-
-			/*
-			sharedMem_int[OFFSET_SHAREDRAM + 0] = num_samples; //samples
-
-			// Executing PRU.
-			prussdrv_pru_write_memory(PRUSS0_PRU0_IRAM, PRU_NUM, PRUcode, sizeof(PRUcode));
-
-			// Trash the first 100 samples
-			prussdrv_pru_enable(PRU_NUM);
-
-			ret = prussdrv_pru_wait_event(PRU_EVTOUT_0);
-
-			prussdrv_pru_disable(PRU_NUM);
-			*/
 
 			// initialize
 			float fs = 45044.4;
@@ -438,7 +475,6 @@ int main(int argc, char* argv[]){
 			//int fnom = 40000000;
 			//int fmid = 40000017;
 			//int frange = fmax - fmin;
-			float frange = 800.0;
 			
 			// time
 			struct timespec prev_time;
@@ -447,6 +483,10 @@ int main(int argc, char* argv[]){
 			num_samples = 0;
 
 			double sum_xo_offset = 0.0;//, min_xo_offset = 0.0, max_xo_offset = 0.0;
+			cfo_est_t est;
+			const struct IQSample *iq;
+			uint32_t avail, dropped;
+			int dac, gaps = 0;
 
 			for(j = 0;j < num_cycles; j++)
 			{
@@ -457,159 +497,89 @@ int main(int argc, char* argv[]){
 				//	num_samples += 100;
 				//}
 
-				if(num_samples%2 == 0)
-				{
-					//printf("You are heading towards a dark alley! ");
-					num_samples++;
-					//printf("We fixed it for you with: %d\n", num_samples);
-				}
-				float nvar_x = (num_samples*num_samples - 1) * num_samples / 12.0;
-
-				prussdrv_pruintc_init(&pruss_intc_initdata);
-				sharedMem_int[OFFSET_SHAREDRAM + 0] = num_samples; //samples
-				prussdrv_pru_enable(PRU_NUM);
-
-				ret = prussdrv_pru_wait_event(PRU_EVTOUT_0);
-
-				sharedMem_struct = ( struct IQSample *) sharedMem;
-
-				// Print out AGC_GAIN3
-				uint8_t agc_gain;
-				cc1200_read_register(CC1200_AGC_GAIN3, &agc_gain);
-			
-				long unsigned int last_phase = 0;
-				int cumulative_phase = 0;
 				double cw_offset = 0.0;
 				double xo_offset = 0.0;
-				long unsigned int sum_mag = 0;
-				
-				//long unsigned int cp_start = 0, cp_end = 0;
-
-				// y = ax + b
-				//double sumx = 0.0, sumxsq = 0.0, sumy = 0.0, sumxy = 0.0, a = 0.0, b = 0.0, denom = 0.0;
-
-				//long unsigned int integral = 0;
-				//long unsigned int last_err = 0;
-				//double Kp = 0.5;
-				//double Ki = 0.3;
-				//double Kd = 0.2;
-
-				float sum_xy = 0.0;
-				int x_i = (-(num_samples-1)) / 2;
-
-				for(i = 0; i < num_samples; i++) {
-					long unsigned int mag = (sharedMem_struct[i].magn0&0xff) + ((sharedMem_struct[i].magn1<<8)&0xff00) + ((sharedMem_struct[i].magn2<<16)&0x010000);
-					long unsigned int ang = (sharedMem_struct[i].ang0&0xff) + ((sharedMem_struct[i].ang1<<8)&0xff00);
-					
-					sum_mag += mag;
-
-					int dp = ang - last_phase;
-					last_phase = ang;
-
-					// Phase difference wrapping
-					if (dp < -512)
-						dp += 1024;
-					if (dp > 511)
-						dp -= 1024;
-
-					if (i > 0)
-					{
-						cumulative_phase += dp;
-
-						sum_xy += cumulative_phase * x_i;
-						x_i++;
-					}
-
-					/*
-					if(i < avg_count+1)
-						cp_start += ang;
-					if(i > num_samples-(avg_count+1))
-						cp_end	 += ang;
-					*/
-
-					/*
-					double x = i;
-					double y = dp;
-					sumx 	+= x;
-					sumxsq 	+= x*x;
-					sumy 	+= y;
-					sumxy 	+= x*y;
-					*/
-					//printf("Set# %d Sample# %d MAGN: %lu ANGL: %lu AGC: %d PD: %d CP: %d\n", j, i, mag, ang, agc_gain, dp, cumulative_phase);	
-				}
+				double xo_std, elapsed;
 
-				//long unsigned int first = (sharedMem_struct[0].ang0&0xff) + ((sharedMem_struct[0].ang1<<8)&0xff00);
-				//long unsigned int last 	= (sharedMem_struct[num_samples-1].ang0&0xff) + ((sharedMem_struct[num_samples-1].ang1<<8)&0xff00);
+				// The regression is updated as the PRU delivers the samples, a block at a time, so the estimate is ready when the last one arrives
+				dropped = pru_iq_dropped();
+				cfo_start(&est, num_samples);
+				while(!cfo_done(&est))
+				{
+					avail = pru_iq_span(&iq);
+					pru_iq_consume(cfo_push_block(&est, iq, avail));
+				}
+				dropped = pru_iq_dropped() - dropped;
 
 				// Update XO
 				if(!doLin)
 				{
-					cw_offset = (cumulative_phase / 1024.0 / ((num_samples - 1) * dt));
+					cw_offset = (est.phase / (double) CFO_ANGLE_PERIOD / ((num_samples - 1) * dt));
 				}
 				else
 				{
 					// Linear method
-					//int ln_dp = (cp_end/avg_count) - (cp_start/avg_count);
-					//double lxo_offset = (ln_dp / 1024.0 / (num_samples * dt)) / pll_mult;
-
-					/*
-					denom = num_samples * sumxsq - (sumx * sumx);
-					a = (sumy * sumxsq - sumx * sumxy) / denom;
-					b = (num_samples * sumxy - sumx * sumy) / denom;
-					int ln_dp = (a * num_samples + b);
-					double lxo_offset = ( ln_dp / 1024.0 / (num_samples * dt)) / pll_mult;
-					*/
-					double beta = sum_xy / (nvar_x); //dib
-					cw_offset = (beta / 1024.0 / dt);
+					double beta = cfo_slope(&est); //dib
+					cw_offset = (beta / CFO_ANGLE_PERIOD / dt);
 				}
 				xo_offset = cw_offset / pll_mult;
-				//xo_offset += 3.688943753; // 138.88
-				xo_offset += (2.728371123 - 0.337881717433);
-				//xo_offset += 1.8953490308200003;
-				//xo_offset += 1.8788618061700002;
+				xo_std = cfo_slope_std(&est) / CFO_ANGLE_PERIOD / dt / pll_mult;
+
+				clock_gettime(CLOCK_MONOTONIC, &now);
+				elapsed = (now.tv_sec - last_update.tv_sec) + (now.tv_nsec - last_update.tv_nsec) / 1e9;
+				last_update = now;
+
+				// Captures without a clean tone (no carrier, collision) give a meaningless slope: the loop only follows its drift estimate
+				// The measurement bias (formerly added to xo_offset here) is the bias_hz loop parameter, with the opposite sign
+				// Neither is a capture the PRU ring overflowed during, as the regression would fit across the gap
+				if(dropped != 0)
+				{
+					gaps++;
+					dac = xodisc_miss(&xo_loop, elapsed);
+				}
+				else if(cfo_residual(&est) < CFO_MAX_RESIDUAL)
+					dac = xodisc_update(&xo_loop, xo_offset, xo_std, elapsed);
+				else
+					dac = xodisc_miss(&xo_loop, elapsed);
 
-				if(j > 10)
+				if(dac != vco_ctrl)
 				{
-					// Compute increment value	
-					int increment = (int)(xo_offset / frange * 0xFFFFFF);
-					vco_ctrl += increment;
-
-					//int error = (int)(xo_offset / frange * 0xFFFFFF);
-					//integral = integral + error;
-					//int derivative = error - last_err;
-					//last_err = error;
-					//vco_ctrl = (Kp * error) + (Ki + integral) + (Kd * derivative);
-					
-					//printf("error: %08x integral: %08x derivative: %08x vco_ctrl: %08x \n", error, integral, derivative, vco_ctrl);
+					vco_ctrl = dac;
 
 					default_tx[0] = (0x3000 + ((vco_ctrl>>12)&0xFFF)) & 0xFFFF; // DAC A
 					default_tx[1] = (0xB000 + (vco_ctrl&0xFFF)) & 0xFFFF;		// DAC B
 				
+					// The XO DAC shares MCSPI1 with the capture
+					pru_iq_pause();
 					xo_transfer(xo_fd, default_tx, default_rx, sizeof(default_tx));
+					pru_iq_start();
 				}
 
-				//printf("M: %ld CW: %6.2fHz XO: %4.2fHz CP: %d XO CTRL: %04x %04x %ld.%09lu\n", (sum_mag/num_cycles), cw_offset, xo_offset, cumulative_phase, default_tx[0], default_tx[1], prev_time.tv_sec, prev_time.tv_nsec);
-				printf("%d %ld %4.2f %4.9f %d %ld.%09lu\n", j, (sum_mag/num_cycles), cw_offset, xo_offset, cumulative_phase, prev_time.tv_sec, prev_time.tv_nsec);
-				//printf("M: %ld CP: %ld LPD: %d CCW: %6.1fHz CXO: %4.4fHz LXO: %4.4fHz y = %fx + %f \n", (sum_mag/num_cycles), cumulative_phase, ln_dp, cw_offset, xo_offset, lxo_offset, a, b);
+				//printf("M: %ld CW: %6.2fHz XO: %4.2fHz CP: %d XO CTRL: %04x %04x %ld.%09lu\n", (long)(est.sum_mag/num_cycles), cw_offset, xo_offset, est.phase, default_tx[0], default_tx[1], prev_time.tv_sec, prev_time.tv_nsec);
+				printf("%d %ld %4.2f %4.9f %d %ld.%09lu\n", j, (long)(est.sum_mag/num_cycles), cw_offset, xo_offset, est.phase, prev_time.tv_sec, prev_time.tv_nsec);
+				//printf("M: %ld CP: %ld LPD: %d CCW: %6.1fHz CXO: %4.4fHz LXO: %4.4fHz y = %fx + %f \n", (long)(est.sum_mag/num_cycles), est.phase, ln_dp, cw_offset, xo_offset, lxo_offset, a, b);
 				//if(j < num_cycles-1)
 				//	xo_transfer(xo_fd, default_tx, default_rx, sizeof(default_tx));
 
 				clock_gettime(CLOCK_REALTIME, &prev_time);
 
-				/* Disable PRU*/
-				prussdrv_pru_disable(PRU_NUM);
-
 				// Stats
-				if(j > 10)
+				if(xodisc_locked(&xo_loop))
 					sum_xo_offset += xo_offset;
+
+				// Write out the loop parameters that reached lock when there was no file to tune them in
+				if(xodisc_locked(&xo_loop) && !xo_params_saved)
+					xo_params_saved = (xodisc_save_params(XODISC_PATH, &xo_loop.p) == 0);
 			}
 
 			//printf("Average: %4.9f\n", (sum_xo_offset/(num_cycles-10)));
 
-			/* Exit PRU */
-			prussdrv_exit();
+			// Release MCSPI1 while idle
+			pru_iq_pause();
+			if(gaps != 0)
+				printf("%d of %d captures dropped samples\n", gaps, num_cycles);
 
-			///////// END PRU /////////
+			///////// END CAPTURE /////////
 
 			fflush(stdout);
 
@@ -621,6 +591,8 @@ int main(int argc, char* argv[]){
 			else
 				keepRunning = 0;
 		}
+
+		pru_iq_close();
 	}
 	else {
 		cc1200_cmd_strobe(CC1200_STX);
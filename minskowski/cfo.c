@@ -0,0 +1,307 @@
+/*
+ * cfo.c
+ *
+ * Streaming carrier frequency offset estimator for CC1200 CW captures.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "cfo.h"
+#include <string.h>
+#include <math.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define CFO_NEON
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+#define CFO_SSE41
+#endif
+
+// Samples unpacked at a time by cfo_push_block
+#define CFO_BLOCK 64
+
+// Wrap a phase step into [-CFO_ANGLE_PERIOD / 2, CFO_ANGLE_PERIOD / 2) without branches
+#define CFO_WRAP(d) ((((d) + CFO_ANGLE_PERIOD / 2) & (CFO_ANGLE_PERIOD - 1)) - CFO_ANGLE_PERIOD / 2)
+
+void cfo_start(cfo_est_t *e, uint32_t window)
+{
+	memset(e, 0, sizeof(*e));
+	e->window = (window > CFO_MAX_WINDOW) ? CFO_MAX_WINDOW : window;
+}
+
+void cfo_unpack(const struct IQSample *s, uint32_t count, int16_t *ang, uint32_t *mag)
+{
+	uint32_t i;
+
+	// The 7-byte records do not line up with any vector width, so this stays a plain gather
+	for (i = 0; i < count; i++)
+	{
+		ang[i] = (int16_t) CFO_ANGLE(&s[i]);
+		mag[i] = CFO_MAGNITUDE(&s[i]);
+	}
+}
+
+void cfo_accumulate_ref(cfo_est_t *e, const int16_t *ang, const uint32_t *mag, uint32_t count)
+{
+	uint32_t i;
+
+	for (i = 0; i < count; i++)
+	{
+		if (e->n > 0)
+		{
+			int32_t dp = CFO_WRAP(ang[i] - e->last_ang);
+
+			e->phase += dp;
+			e->sdp += dp;
+			e->sdp2 += dp * dp;
+		}
+		e->last_ang = ang[i];
+		e->sum_mag += mag[i];
+
+		e->sy += e->phase;
+		e->sxy += (int64_t) e->n * e->phase;
+		e->n++;
+	}
+}
+
+#if defined(CFO_NEON)
+
+void cfo_accumulate(cfo_est_t *e, const int16_t *ang, const uint32_t *mag, uint32_t count)
+{
+	const int32x4_t zero = vdupq_n_s32(0);
+	const int32x4_t half = vdupq_n_s32(CFO_ANGLE_PERIOD / 2);
+	const int32x4_t mask = vdupq_n_s32(CFO_ANGLE_PERIOD - 1);
+	const int32_t lane[4] = {0, 1, 2, 3};
+	int64x2_t sy = vdupq_n_s64(0), sxy = vdupq_n_s64(0), sdp = vdupq_n_s64(0), sdp2 = vdupq_n_s64(0);
+	uint64x2_t smag = vdupq_n_u64(0);
+	int32x4_t prev, x, phase;
+	uint32_t i = 0;
+
+	// The first sample of a window has no step; the vector loop needs a previous angle
+	if (e->n == 0 && count > 0)
+	{
+		cfo_accumulate_ref(e, ang, mag, 1);
+		i = 1;
+	}
+
+	prev = vdupq_n_s32(e->last_ang);
+	phase = vdupq_n_s32(e->phase);
+	x = vaddq_s32(vdupq_n_s32(e->n), vld1q_s32(lane));
+
+	for (; i + 4 <= count; i += 4)
+	{
+		int32x4_t a = vmovl_s16(vld1_s16(&ang[i]));
+		int32x4_t d, y;
+
+		// Steps from the previous angles: [prev3, a0, a1, a2]
+		d = vsubq_s32(a, vextq_s32(prev, a, 3));
+		d = vsubq_s32(vandq_s32(vaddq_s32(d, half), mask), half);
+
+		// Running sum of the steps across the lanes
+		y = vaddq_s32(d, vextq_s32(zero, d, 3));
+		y = vaddq_s32(y, vextq_s32(zero, y, 2));
+		y = vaddq_s32(y, phase);
+
+		sy = vpadalq_s32(sy, y);
+		sxy = vmlal_s32(sxy, vget_low_s32(x), vget_low_s32(y));
+		sxy = vmlal_s32(sxy, vget_high_s32(x), vget_high_s32(y));
+		sdp = vpadalq_s32(sdp, d);
+		sdp2 = vmlal_s32(sdp2, vget_low_s32(d), vget_low_s32(d));
+		sdp2 = vmlal_s32(sdp2, vget_high_s32(d), vget_high_s32(d));
+		smag = vpadalq_u32(smag, vld1q_u32(&mag[i]));
+
+		prev = a;
+		phase = vdupq_n_s32(vgetq_lane_s32(y, 3));
+		x = vaddq_s32(x, vdupq_n_s32(4));
+	}
+
+	e->sy += vgetq_lane_s64(sy, 0) + vgetq_lane_s64(sy, 1);
+	e->sxy += vgetq_lane_s64(sxy, 0) + vgetq_lane_s64(sxy, 1);
+	e->sdp += vgetq_lane_s64(sdp, 0) + vgetq_lane_s64(sdp, 1);
+	e->sdp2 += vgetq_lane_s64(sdp2, 0) + vgetq_lane_s64(sdp2, 1);
+	e->sum_mag += vgetq_lane_u64(smag, 0) + vgetq_lane_u64(smag, 1);
+	e->last_ang = vgetq_lane_s32(prev, 3);
+	e->phase = vgetq_lane_s32(phase, 3);
+	e->n = vgetq_lane_s32(x, 0);
+
+	cfo_accumulate_ref(e, &ang[i], &mag[i], count - i);
+}
+
+#elif defined(CFO_SSE41)
+
+// Sum of the four 32-bit lanes of v, each sign or zero extended to 64 bits, into the two 64-bit lanes of acc
+static inline __m128i cfo_widen_add(__m128i acc, __m128i v, int is_signed)
+{
+	if (is_signed)
+		return _mm_add_epi64(acc, _mm_add_epi64(_mm_cvtepi32_epi64(v), _mm_cvtepi32_epi64(_mm_srli_si128(v, 8))));
+	return _mm_add_epi64(acc, _mm_add_epi64(_mm_cvtepu32_epi64(v), _mm_cvtepu32_epi64(_mm_srli_si128(v, 8))));
+}
+
+// Signed 32x32 -> 64-bit products of the four lanes of a and b, added into the two 64-bit lanes of acc
+static inline __m128i cfo_mul_add(__m128i acc, __m128i a, __m128i b)
+{
+	acc = _mm_add_epi64(acc, _mm_mul_epi32(a, b));
+	return _mm_add_epi64(acc, _mm_mul_epi32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32)));
+}
+
+void cfo_accumulate(cfo_est_t *e, const int16_t *ang, const uint32_t *mag, uint32_t count)
+{
+	const __m128i half = _mm_set1_epi32(CFO_ANGLE_PERIOD / 2);
+	const __m128i mask = _mm_set1_epi32(CFO_ANGLE_PERIOD - 1);
+	__m128i sy = _mm_setzero_si128(), sxy = _mm_setzero_si128(), sdp = _mm_setzero_si128(), sdp2 = _mm_setzero_si128();
+	__m128i smag = _mm_setzero_si128();
+	__m128i prev, x, phase;
+	int64_t t[2];
+	uint32_t i = 0;
+
+	// The first sample of a window has no step; the vector loop needs a previous angle
+	if (e->n == 0 && count > 0)
+	{
+		cfo_accumulate_ref(e, ang, mag, 1);
+		i = 1;
+	}
+
+	prev = _mm_set1_epi32(e->last_ang);
+	phase = _mm_set1_epi32(e->phase);
+	x = _mm_add_epi32(_mm_set1_epi32(e->n), _mm_setr_epi32(0, 1, 2, 3));
+
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128i a = _mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i *) &ang[i]));
+		__m128i d, y;
+
+		// Steps from the previous angles: [prev3, a0, a1, a2]
+		d = _mm_sub_epi32(a, _mm_alignr_epi8(a, prev, 12));
+		d = _mm_sub_epi32(_mm_and_si128(_mm_add_epi32(d, half), mask), half);
+
+		// Running sum of the steps across the lanes
+		y = _mm_add_epi32(d, _mm_slli_si128(d, 4));
+		y = _mm_add_epi32(y, _mm_slli_si128(y, 8));
+		y = _mm_add_epi32(y, phase);
+
+		sy = cfo_widen_add(sy, y, 1);
+		sxy = cfo_mul_add(sxy, x, y);
+		sdp = cfo_widen_add(sdp, d, 1);
+		sdp2 = cfo_widen_add(sdp2, _mm_mullo_epi32(d, d), 0);
+		smag = cfo_widen_add(smag, _mm_loadu_si128((const __m128i *) &mag[i]), 0);
+
+		prev = a;
+		phase = _mm_shuffle_epi32(y, 0xFF);
+		x = _mm_add_epi32(x, _mm_set1_epi32(4));
+	}
+
+	_mm_storeu_si128((__m128i *) t, sy);   e->sy += t[0] + t[1];
+	_mm_storeu_si128((__m128i *) t, sxy);  e->sxy += t[0] + t[1];
+	_mm_storeu_si128((__m128i *) t, sdp);  e->sdp += t[0] + t[1];
+	_mm_storeu_si128((__m128i *) t, sdp2); e->sdp2 += t[0] + t[1];
+	_mm_storeu_si128((__m128i *) t, smag); e->sum_mag += (uint64_t) t[0] + (uint64_t) t[1];
+	e->last_ang = _mm_extract_epi32(prev, 3);
+	e->phase = _mm_extract_epi32(phase, 3);
+	e->n = _mm_cvtsi128_si32(x);
+
+	cfo_accumulate_ref(e, &ang[i], &mag[i], count - i);
+}
+
+#else
+
+void cfo_accumulate(cfo_est_t *e, const int16_t *ang, const uint32_t *mag, uint32_t count)
+{
+	cfo_accumulate_ref(e, ang, mag, count);
+}
+
+#endif
+
+int cfo_push(cfo_est_t *e, const struct IQSample *s)
+{
+	return cfo_push_block(e, s, 1) == 1 && cfo_done(e);
+}
+
+uint32_t cfo_push_block(cfo_est_t *e, const struct IQSample *s, uint32_t count)
+{
+	int16_t ang[CFO_BLOCK];
+	uint32_t mag[CFO_BLOCK];
+	uint32_t used = 0, k;
+
+	if (count > e->window - e->n)
+		count = e->window - e->n;
+
+	while (used < count)
+	{
+		k = count - used;
+		if (k > CFO_BLOCK)
+			k = CFO_BLOCK;
+
+		cfo_unpack(&s[used], k, ang, mag);
+		cfo_accumulate(e, ang, mag, k);
+		used += k;
+	}
+
+	return used;
+}
+
+int cfo_done(const cfo_est_t *e)
+{
+	return e->n >= e->window;
+}
+
+double cfo_slope(const cfo_est_t *e)
+{
+	double n = e->n;
+	double sx = n * (n - 1) / 2;
+	double den = n * n * (n * n - 1) / 12;  // n * sum(x^2) - sum(x)^2
+
+	if (e->n < 2)
+		return 0.0;
+
+	return (n * (double) e->sxy - sx * (double) e->sy) / den;
+}
+
+double cfo_residual(const cfo_est_t *e)
+{
+	double m, var;
+
+	if (e->n < 2)
+		return 0.0;
+
+	m = (double) e->sdp / (e->n - 1);
+	var = (double) e->sdp2 / (e->n - 1) - m * m;
+
+	return (var > 0) ? sqrt(var) : 0.0;
+}
+
+double cfo_slope_std(const cfo_est_t *e)
+{
+	double n = e->n;
+
+	if (e->n < 3)
+		return INFINITY;
+
+	// White phase noise of variance s^2 gives steps of variance 2 s^2, and a least squares slope of variance
+	// 12 s^2 / (n (n^2 - 1))
+	return cfo_residual(e) / sqrt(2.0) * sqrt(12.0 / (n * (n * n - 1)));
+}
+
+uint32_t cfo_next_window(const cfo_est_t *e, double target_std, uint32_t min, uint32_t max)
+{
+	double s = cfo_residual(e), n;
+
+	if (e->n < 3 || target_std <= 0 || s >= CFO_MAX_RESIDUAL)
+		return max;
+
+	// Inverse of cfo_slope_std(), taking n^2 - 1 as n^2
+	n = ceil(cbrt(6.0 * s * s / (target_std * target_std)));
+
+	if (n < min)
+		return min;
+	if (n > max)
+		return max;
+	return (uint32_t) n;
+}
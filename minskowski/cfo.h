@@ -0,0 +1,80 @@
+/*
+ * cfo.h
+ *
+ * Streaming carrier frequency offset estimator for CC1200 CW captures.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _CFO_H_
+#define _CFO_H_
+
+#include <stdint.h>
+#include "pru_iq.h"
+
+/* CC1200 ANG is a 10-bit angle, MAGN a 17-bit magnitude */
+#define CFO_ANGLE_PERIOD 1024
+#define CFO_ANGLE(s)     ((int32_t)((s)->ang0 | (((s)->ang1 << 8) & 0x0300)))
+#define CFO_MAGNITUDE(s) ((uint32_t)((s)->magn0 | ((s)->magn1 << 8) | (((s)->magn2 << 16) & 0x010000)))
+
+/* Longest window: keeps sum(x * phase) within 64 bits whatever the offset */
+#define CFO_MAX_WINDOW   65536
+
+/* Captures whose phase steps scatter more than this (RMS, in 1/CFO_ANGLE_PERIOD cycles) are noise, not a carrier.
+ * Uniformly random angles give CFO_ANGLE_PERIOD / sqrt(12), about 296. */
+#define CFO_MAX_RESIDUAL 128.0
+
+/*
+ * Least squares fit of the unwrapped phase against the sample index, updated as samples are captured so that the fit
+ * of a window is ready as soon as its last sample has arrived. All sums are exact integers: the sums over the sample
+ * index only depend on n and are computed in closed form.
+ */
+typedef struct {
+	uint32_t window;      // samples per estimate
+	uint32_t n;           // samples pushed so far
+	int32_t last_ang;     // angle of the previous sample
+	int32_t phase;        // unwrapped phase of the last sample, relative to the first, in 1/CFO_ANGLE_PERIOD cycles
+	uint64_t sum_mag;     // sum of magnitudes
+	int64_t sy, sxy;      // sums of y and x*y, x being the sample index and y the unwrapped phase
+	int64_t sdp, sdp2;    // sums of the n - 1 phase steps and of their squares
+} cfo_est_t;
+
+/* Start a new estimate over window samples (at most CFO_MAX_WINDOW). */
+void cfo_start(cfo_est_t *e, uint32_t window);
+
+/* Add the next sample. Returns 1 once the window is complete. */
+int cfo_push(cfo_est_t *e, const struct IQSample *s);
+
+/* Add up to count consecutive samples, stopping at the end of the window. Returns the number of samples used. */
+uint32_t cfo_push_block(cfo_est_t *e, const struct IQSample *s, uint32_t count);
+
+/* Returns 1 once the window is complete. */
+int cfo_done(const cfo_est_t *e);
+
+/* Phase slope of the samples pushed so far, in 1/CFO_ANGLE_PERIOD cycles per sample (0 if fewer than 2 samples). */
+double cfo_slope(const cfo_est_t *e);
+
+/* RMS deviation of the phase steps from their mean, in 1/CFO_ANGLE_PERIOD cycles. Compare with CFO_MAX_RESIDUAL. */
+double cfo_residual(const cfo_est_t *e);
+
+/* Standard deviation of cfo_slope(), assuming white phase noise, in 1/CFO_ANGLE_PERIOD cycles per sample. */
+double cfo_slope_std(const cfo_est_t *e);
+
+/* Window for the next capture to reach a slope standard deviation of target_std (as cfo_slope_std), given the phase
+ * noise seen by this one, within [min, max]. Returns max if this capture had no usable tone. */
+uint32_t cfo_next_window(const cfo_est_t *e, double target_std, uint32_t min, uint32_t max);
+
+/* Kernel, exported so the SIMD paths can be checked against the scalar reference. ang[] and mag[] are the SoA form of
+ * the samples (see cfo_unpack). cfo_accumulate uses NEON or SSE4.1 when the compiler targets them. */
+void cfo_unpack(const struct IQSample *s, uint32_t count, int16_t *ang, uint32_t *mag);
+void cfo_accumulate(cfo_est_t *e, const int16_t *ang, const uint32_t *mag, uint32_t count);
+void cfo_accumulate_ref(cfo_est_t *e, const int16_t *ang, const uint32_t *mag, uint32_t count);
+
+#endif /* _CFO_H_ */
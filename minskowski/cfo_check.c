@@ -0,0 +1,134 @@
+/*
+ * CFO Kernel Check
+ *
+ * Runs cfo_accumulate (the NEON or SSE4.1 body the compiler picked, see cfo.c) and cfo_accumulate_ref over the same
+ * synthetic captures and checks that every sum comes out identical. The captures are random angles (steps wrapping
+ * both ways), steady tones up to the wrap limit of +-CFO_ANGLE_PERIOD / 2 per sample with and without noise, full
+ * scale magnitudes and CFO_MAX_WINDOW windows, fed in blocks of random length so that the vector loops start at every
+ * alignment and leave every tail length. Returns 1 on the first mismatch, and CHECK_SKIPPED from a scalar build.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "cfo.h"
+
+/* Captures per kind, and longest block handed to the kernels at once */
+#define CHECK_CAPTURES  200
+#define CHECK_BLOCK     100
+
+/* Exit status when no vector kernel is compiled in, as automake test drivers read it */
+#define CHECK_SKIPPED   77
+
+enum { KIND_RANDOM, KIND_TONE, KIND_NOISY_TONE, KIND_WRAP, KIND_FULL_SCALE, KINDS };
+
+static const char *kind_name[KINDS] = { "random", "tone", "noisy tone", "wrap limit", "full scale" };
+
+static int16_t ang[CFO_MAX_WINDOW];
+static uint32_t mag[CFO_MAX_WINDOW];
+
+static const char *cfo_diff(const cfo_est_t *a, const cfo_est_t *b)
+{
+	if (a->n != b->n) return "n";
+	if (a->last_ang != b->last_ang) return "last_ang";
+	if (a->phase != b->phase) return "phase";
+	if (a->sum_mag != b->sum_mag) return "sum_mag";
+	if (a->sy != b->sy) return "sy";
+	if (a->sxy != b->sxy) return "sxy";
+	if (a->sdp != b->sdp) return "sdp";
+	if (a->sdp2 != b->sdp2) return "sdp2";
+	return NULL;
+}
+
+/* Angles and magnitudes as cfo_unpack gives them from the CC1200 fields */
+static void make_capture(int kind, uint32_t n)
+{
+	double slope = (2.0 * rand() / RAND_MAX - 1) * CFO_ANGLE_PERIOD / 2, phase = rand() % CFO_ANGLE_PERIOD;
+	uint32_t i;
+
+	if (kind == KIND_WRAP)
+		slope = (rand() & 1) ? CFO_ANGLE_PERIOD / 2 - 1 : -CFO_ANGLE_PERIOD / 2;
+
+	for (i = 0; i < n; i++)
+	{
+		double a = phase + slope * i;
+
+		if (kind == KIND_NOISY_TONE)
+			a += (rand() % 129) - 64;
+		if (kind == KIND_RANDOM)
+			ang[i] = rand() % CFO_ANGLE_PERIOD;
+		else
+			ang[i] = (int16_t)((int64_t)floor(a) & (CFO_ANGLE_PERIOD - 1));
+		mag[i] = (kind == KIND_FULL_SCALE) ? 0x1FFFF : (uint32_t)(rand() & 0x1FFFF);
+	}
+}
+
+static int check_capture(int kind, uint32_t n)
+{
+	cfo_est_t vec, ref;
+	uint32_t i = 0, k;
+	const char *field;
+
+	make_capture(kind, n);
+	cfo_start(&vec, n);
+	cfo_start(&ref, n);
+
+	while (i < n)
+	{
+		k = 1 + rand() % CHECK_BLOCK;
+		if (k > n - i)
+			k = n - i;
+
+		cfo_accumulate(&vec, &ang[i], &mag[i], k);
+		cfo_accumulate_ref(&ref, &ang[i], &mag[i], k);
+		i += k;
+
+		if ((field = cfo_diff(&vec, &ref)) != NULL)
+		{
+			printf("FAIL %s capture of %u samples: %s differs after %u samples\n", kind_name[kind], n, field, i);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int kind, c;
+
+	srand(argc > 1 ? atoi(argv[1]) : 1);
+
+	for (kind = 0; kind < KINDS; kind++)
+	{
+		for (c = 0; c < CHECK_CAPTURES; c++)
+		{
+			/* Short windows for the start and tail cases, and some as long as they get for the 64-bit sums */
+			uint32_t n = (c % 10 == 0) ? CFO_MAX_WINDOW : 1 + rand() % 4096;
+
+			if (check_capture(kind, n) != 0)
+				return 1;
+		}
+	}
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+	printf("OK NEON matches the reference on %d captures\n", KINDS * CHECK_CAPTURES);
+#elif defined(__SSE4_1__)
+	printf("OK SSE4.1 matches the reference on %d captures\n", KINDS * CHECK_CAPTURES);
+#else
+	printf("SKIP scalar build, no vector kernel to check\n");
+	return CHECK_SKIPPED;
+#endif
+	return 0;
+}
@@ -0,0 +1,212 @@
+/*
+ * clkmodel.c
+ *
+ * Model of the clock of a peer DW1000 against the local one, from the offsets measured at each sync round.
+ *
+ * The offset of the peer clock is fitted as a straight line of the local time over the last CLKMODEL_WINDOW rounds. Each
+ * round is weighted by the inverse of its variance plus the one the wander of the clock ratio has added since, so old
+ * rounds count less and the line follows the slow changes of the XOs instead of lagging them. The covariance of the fit,
+ * scaled up when the residuals are larger than the stated variances, and the wander since the newest round give the
+ * error of an extrapolated offset.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "clkmodel.h"
+#include <string.h>
+#include <math.h>
+
+#define CLKMODEL_MASK40      0xFFFFFFFFFFULL
+#define CLKMODEL_SPAN40      1099511627776.0
+
+// Samples further than this many bounds from the prediction are outliers, and this many in a row restart the model
+#define CLKMODEL_GATE        3.0
+#define CLKMODEL_MAX_REJECTS 3
+
+// Floor of the sample variance, dtu^2
+#define CLKMODEL_MIN_VAR     1.0
+
+int64_t clkmodel_unwrap(uint64_t t, uint64_t last, int64_t last_unw, double elapsed)
+{
+	int64_t d = (int64_t) ((t - last) & CLKMODEL_MASK40);
+	int64_t wraps = llround((elapsed * CLKMODEL_DTU_PER_S - d) / CLKMODEL_SPAN40);
+
+	return last_unw + d + wraps * (int64_t) CLKMODEL_SPAN40;
+}
+
+void clkmodel_init(clkmodel_t *m, double wander)
+{
+	memset(m, 0, sizeof(*m));
+	m->wander = (wander > 0) ? wander : CLKMODEL_WANDER;
+}
+
+int clkmodel_ready(const clkmodel_t *m)
+{
+	return m->n >= 2;
+}
+
+double clkmodel_drift(const clkmodel_t *m)
+{
+	return m->b;
+}
+
+// Variance (dtu^2) the ratio wander adds to an offset dx local ticks away from the newest sample
+static double clkmodel_age_var(const clkmodel_t *m, double dx)
+{
+	double t = dx / CLKMODEL_DTU_PER_S;
+	double e = m->wander * t * t / 2 * CLKMODEL_DTU_PER_S;
+
+	return e * e;
+}
+
+// Offset, and bound on its error, dx local ticks from the newest sample
+static double clkmodel_predict(const clkmodel_t *m, double dx, double *offset)
+{
+	double var = m->caa + 2 * dx * m->cab + dx * dx * m->cbb;
+
+	*offset = m->a + m->b * dx;
+
+	return 3 * sqrt((var > 0 ? var : 0) + clkmodel_age_var(m, dx));
+}
+
+static void clkmodel_fit(clkmodel_t *m)
+{
+	double sw = 0, sx = 0, sxx = 0, sy = 0, sxy = 0, chi2 = 0, det, dx, dy, r, scale = 1;
+	double w[CLKMODEL_WINDOW];
+	int i, newest = (m->head + CLKMODEL_WINDOW - 1) % CLKMODEL_WINDOW;
+
+	m->x0 = m->s[newest].x;
+	m->o0 = m->s[newest].y - m->s[newest].x;
+
+	for (i = 0; i < m->n; i++)
+	{
+		dx = (double) (m->s[i].x - m->x0);
+		w[i] = 1.0 / (m->s[i].var + clkmodel_age_var(m, dx));
+		dy = (double) (m->s[i].y - m->s[i].x - m->o0);
+		sw += w[i];
+		sx += w[i] * dx;
+		sxx += w[i] * dx * dx;
+		sy += w[i] * dy;
+		sxy += w[i] * dx * dy;
+	}
+
+	det = sw * sxx - sx * sx;
+	if (m->n < 2 || det <= 0)
+	{
+		m->a = sy / sw;
+		m->b = 0;
+		m->caa = 1.0 / sw;
+		m->cab = m->cbb = 0;
+		return;
+	}
+
+	m->b = (sw * sxy - sx * sy) / det;
+	m->a = (sy - m->b * sx) / sw;
+
+	// Residuals larger than the stated noise mean the line does not explain everything: widen the bound accordingly
+	if (m->n > 2)
+	{
+		for (i = 0; i < m->n; i++)
+		{
+			r = (double) (m->s[i].y - m->s[i].x - m->o0) - (m->a + m->b * (double) (m->s[i].x - m->x0));
+			chi2 += r * r * w[i];
+		}
+		if (chi2 / (m->n - 2) > 1)
+			scale = chi2 / (m->n - 2);
+	}
+
+	m->caa = scale * sxx / det;
+	m->cab = -scale * sx / det;
+	m->cbb = scale * sw / det;
+}
+
+int clkmodel_add(clkmodel_t *m, uint64_t local, uint64_t peer, double std, double mono)
+{
+	clkmodel_sample_t s;
+	double offset, bound;
+
+	local &= CLKMODEL_MASK40;
+	peer &= CLKMODEL_MASK40;
+
+	if (m->n == 0)
+	{
+		// The first sample sets the origin of the unwrapped times
+		s.x = (int64_t) local;
+		s.y = (int64_t) peer;
+	}
+	else
+	{
+		s.x = clkmodel_unwrap(local, m->last_local, m->x0, mono - m->last_mono);
+		s.y = clkmodel_unwrap(peer, m->last_peer, m->x0 + m->o0, mono - m->last_mono);
+	}
+	s.var = (std * std > CLKMODEL_MIN_VAR) ? std * std : CLKMODEL_MIN_VAR;
+
+	// Once the drift is known, a sample far off the line is more likely a bad exchange than the clocks
+	if (m->n >= 4)
+	{
+		bound = clkmodel_predict(m, (double) (s.x - m->x0), &offset);
+		bound += CLKMODEL_GATE * sqrt(s.var);
+		if (fabs((double) (s.y - s.x - m->o0) - offset) > CLKMODEL_GATE * bound)
+		{
+			if (++m->rejects < CLKMODEL_MAX_REJECTS)
+				return -1;
+
+			// The peer clock jumped (e.g. it was reset): start again from this sample
+			clkmodel_init(m, m->wander);
+			s.x = (int64_t) local;
+			s.y = (int64_t) peer;
+		}
+	}
+	m->rejects = 0;
+
+	m->s[m->head] = s;
+	m->head = (m->head + 1) % CLKMODEL_WINDOW;
+	if (m->n < CLKMODEL_WINDOW)
+		m->n++;
+
+	m->last_local = local;
+	m->last_peer = peer;
+	m->last_mono = mono;
+	clkmodel_fit(m);
+
+	return 0;
+}
+
+double clkmodel_to_peer(const clkmodel_t *m, uint64_t local, double mono, uint64_t *peer)
+{
+	double offset, bound;
+	int64_t x;
+
+	if (!clkmodel_ready(m))
+		return -1;
+
+	x = clkmodel_unwrap(local & CLKMODEL_MASK40, m->last_local, m->x0, mono - m->last_mono);
+	bound = clkmodel_predict(m, (double) (x - m->x0), &offset);
+	*peer = (uint64_t) (x + m->o0 + llround(offset)) & CLKMODEL_MASK40;
+
+	return bound;
+}
+
+double clkmodel_to_local(const clkmodel_t *m, uint64_t peer, double mono, uint64_t *local)
+{
+	double offset, bound;
+	int64_t y, x;
+
+	if (!clkmodel_ready(m))
+		return -1;
+
+	// Solve y = x + o0 + a + b * (x - x0) for x
+	y = clkmodel_unwrap(peer & CLKMODEL_MASK40, m->last_peer, m->x0 + m->o0, mono - m->last_mono);
+	x = m->x0 + llround((double) (y - m->x0 - m->o0 - m->a) / (1 + m->b));
+	bound = clkmodel_predict(m, (double) (x - m->x0), &offset);
+	*local = (uint64_t) x & CLKMODEL_MASK40;
+
+	return bound;
+}
@@ -0,0 +1,83 @@
+/*
+ * clkmodel.h
+ *
+ * Model of the clock of a peer DW1000 against the local one, from the offsets measured at each sync round.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _CLKMODEL_H_
+#define _CLKMODEL_H_
+
+#include <stdint.h>
+
+/* DW1000 time units (dtu) per second */
+#define CLKMODEL_DTU_PER_S   (499.2e6 * 128.0)
+
+/* Sync rounds kept in the regression */
+#define CLKMODEL_WINDOW      16
+
+/* Typical standard deviation of an offset measured by a DW1000 exchange, dtu (about 150 ps) */
+#define CLKMODEL_DW_STD      10.0
+
+/* Default wander of the clock ratio, per second (XO temperature and ageing), for the prediction bound */
+#define CLKMODEL_WANDER      1e-9
+
+typedef struct {
+	int64_t x;            // local time, unwrapped (dtu)
+	int64_t y;            // peer time at the same instant, unwrapped (dtu)
+	double var;           // variance of y - x (dtu^2)
+} clkmodel_sample_t;
+
+/*
+ * Weighted least squares fit of the peer clock offset (peer minus local time) against local time, over the last
+ * CLKMODEL_WINDOW rounds. The 40-bit DW1000 times wrap every 17.2 s, so the caller also gives a coarse time in seconds
+ * (e.g. CLOCK_MONOTONIC) with each sample and query, which lets rounds be further apart than that.
+ */
+typedef struct {
+	clkmodel_sample_t s[CLKMODEL_WINDOW];
+	int n, head;          // samples held, index of the next one
+	int rejects;          // consecutive samples rejected as outliers
+	double wander;        // clock ratio wander (1/s)
+
+	// Newest sample, used to unwrap the following ones
+	uint64_t last_local, last_peer;
+	double last_mono;
+
+	// Fit, relative to the newest sample: offset = o0 + a + b * (x - x0)
+	int64_t x0, o0;
+	double a, b;
+	double caa, cab, cbb; // covariance of (a, b)
+} clkmodel_t;
+
+/* Start an empty model. wander is the clock ratio wander used in the bound (CLKMODEL_WANDER if 0). */
+void clkmodel_init(clkmodel_t *m, double wander);
+
+/* Add the peer time peer (40-bit dtu) measured at local time local (40-bit dtu) with standard deviation std (dtu), at
+ * coarse time mono (s). Returns 0, or -1 if the sample is rejected as an outlier (the model restarts after a few). */
+int clkmodel_add(clkmodel_t *m, uint64_t local, uint64_t peer, double std, double mono);
+
+/* Returns 1 once the model can be queried (two samples). */
+int clkmodel_ready(const clkmodel_t *m);
+
+/* Peer time (40-bit dtu) at local time local, taken at coarse time mono. Returns the bound on its prediction error (dtu,
+ * about 3 standard deviations plus the effect of the ratio wander), or -1 if the model is not ready. */
+double clkmodel_to_peer(const clkmodel_t *m, uint64_t local, double mono, uint64_t *peer);
+
+/* Local time (40-bit dtu) at peer time peer, taken at coarse time mono. Same return value as clkmodel_to_peer(). */
+double clkmodel_to_local(const clkmodel_t *m, uint64_t peer, double mono, uint64_t *local);
+
+/* Unwrap the 40-bit time t, given the previous time last, unwrapped to last_unw, elapsed seconds (coarse time) earlier. */
+int64_t clkmodel_unwrap(uint64_t t, uint64_t last, int64_t last_unw, double elapsed);
+
+/* Drift of the peer clock against the local one (peer ticks per local tick, minus 1). */
+double clkmodel_drift(const clkmodel_t *m);
+
+#endif /* _CLKMODEL_H_ */
@@ -73,6 +73,8 @@ typedef struct
     uint32      sysCFGreg ;         // Local copy of system config register
     uint16      sleep_mode;         // Used for automatic reloading of LDO tune and microcode at wake-up
     uint8       wait4resp ;         // wait4response was set with last TX start command
+    uint8       chan ;              // Channel set by last dwt_configure call
+    uint8       dataRate ;          // Data rate set by last dwt_configure call
     dwt_cb_data_t cbData;           // Callback data structure
     dwt_cb_t    cbTxDone;           // Callback for TX confirmation event
     dwt_cb_t    cbRxOk;             // Callback for RX good frame event
@@ -441,6 +443,8 @@ void dwt_configure(dwt_config_t *config)
     }
 
     dw1000local.longFrames = config->phrMode ;
+    dw1000local.chan = chan ;
+    dw1000local.dataRate = config->dataRate ;
 
     dw1000local.sysCFGreg &= ~SYS_CFG_PHR_MODE_11;
     dw1000local.sysCFGreg |= (SYS_CFG_PHR_MODE_11 & (config->phrMode << SYS_CFG_PHR_MODE_SHFT));
@@ -711,6 +715,97 @@ void dwt_readdiagnostics(dwt_rxdiag_t *diagnostics)
     diagnostics->rxPreamCount = (dwt_read32bitreg(RX_FINFO_ID) & RX_FINFO_RXPACC_MASK) >> RX_FINFO_RXPACC_SHIFT  ;
 }
 
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn dwt_readcarrierintegrator()
+ *
+ * @brief This is used to read the RX carrier integrator value (relating to the frequency offset of the TX node). The value
+ *        is only valid after a frame has been received and before the receiver is re-enabled.
+ *
+ * input parameters
+ *
+ * output parameters
+ *
+ * returns the (signed 21-bit sign extended) carrier integrator value
+ */
+#define B20_SIGN_EXTEND_TEST (0x00100000UL)
+#define B20_SIGN_EXTEND_MASK (0xFFF00000UL)
+
+int32 dwt_readcarrierintegrator(void)
+{
+    uint32 regval = 0 ;
+    int j ;
+    uint8 buffer[DRX_CARRIER_INT_LEN] ;
+
+    // Read 3 bytes into buffer (21-bit quantity)
+    dwt_readfromdevice(DRX_CONF_ID, DRX_CARRIER_INT_OFFSET, DRX_CARRIER_INT_LEN, buffer) ;
+
+    for (j = DRX_CARRIER_INT_LEN - 1 ; j >= 0 ; j--)  // arrange the three bytes into an unsigned integer value
+    {
+        regval = (regval << 8) + buffer[j] ;
+    }
+
+    if (regval & B20_SIGN_EXTEND_TEST)
+    {
+        regval |= B20_SIGN_EXTEND_MASK ; // sign extend bit #20 to whole word
+    }
+    else
+    {
+        regval &= DRX_CARRIER_INT_MASK ; // make sure upper bits are clear if not sign extending
+    }
+
+    return (int32) regval ; // cast unsigned value to signed quantity
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn dwt_readclockoffsetppm()
+ *
+ * @brief This is used to estimate the clock offset between the local device and the remote device that sent the last
+ *        received frame. It reads the carrier integrator and scales it for the channel and data rate set by the last
+ *        dwt_configure call. A positive value means the local clock is slower than the remote transmitter.
+ *
+ * input parameters
+ *
+ * output parameters
+ *
+ * returns the clock offset in ppm (parts per million)
+ */
+double dwt_readclockoffsetppm(void)
+{
+    double hz_to_ppm ;
+    double freq_offset ;
+
+    switch (dw1000local.chan)
+    {
+        case 1:
+            hz_to_ppm = HERTZ_TO_PPM_MULTIPLIER_CHAN_1 ;
+            break ;
+        case 2:
+        case 4:
+            hz_to_ppm = HERTZ_TO_PPM_MULTIPLIER_CHAN_2 ;
+            break ;
+        case 3:
+            hz_to_ppm = HERTZ_TO_PPM_MULTIPLIER_CHAN_3 ;
+            break ;
+        case 5:
+        case 7:
+        default:
+            hz_to_ppm = HERTZ_TO_PPM_MULTIPLIER_CHAN_5 ;
+            break ;
+    }
+
+    // The integrator runs 8 times slower at 110 kbps
+    if (dw1000local.dataRate == DWT_BR_110K)
+    {
+        freq_offset = dwt_readcarrierintegrator() * FREQ_OFFSET_MULTIPLIER_110KB ;
+    }
+    else
+    {
+        freq_offset = dwt_readcarrierintegrator() * FREQ_OFFSET_MULTIPLIER ;
+    }
+
+    return freq_offset * hz_to_ppm ;
+}
+
 /*! ------------------------------------------------------------------------------------------------------------------
  * @fn dwt_readtxtimestamp()
  *
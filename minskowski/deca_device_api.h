@@ -65,6 +65,16 @@ typedef signed long int32;
 
 #define DWT_TIME_UNITS          (1.0/499.2e6/128.0) //!< = 15.65e-12 s
 
+//! multipliers to convert the carrier integrator value (see dwt_readcarrierintegrator) to a frequency offset in Hz
+#define FREQ_OFFSET_MULTIPLIER          (998.4e6/2.0/1024.0/131072.0)
+#define FREQ_OFFSET_MULTIPLIER_110KB    (998.4e6/2.0/8192.0/131072.0)
+
+//! multipliers to convert a frequency offset in Hz to a clock offset in ppm, per channel centre frequency
+#define HERTZ_TO_PPM_MULTIPLIER_CHAN_1  (-1.0e6/3494.4e6)
+#define HERTZ_TO_PPM_MULTIPLIER_CHAN_2  (-1.0e6/3993.6e6)
+#define HERTZ_TO_PPM_MULTIPLIER_CHAN_3  (-1.0e6/4492.8e6)
+#define HERTZ_TO_PPM_MULTIPLIER_CHAN_5  (-1.0e6/6489.6e6)
+
 #define DWT_DEVICE_ID   (0xDECA0130)        //!< DW1000 MP device ID
 
 //! constants for selecting the bit rate for data TX (and RX)
@@ -1266,6 +1276,38 @@ void dwt_readaccdata(uint8 *buffer, uint16 length, uint16 rxBufferOffset);
  */
 void dwt_readdiagnostics(dwt_rxdiag_t * diagnostics);
 
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn dwt_readcarrierintegrator()
+ *
+ * @brief This is used to read the RX carrier integrator value (relating to the frequency offset of the TX node). The value
+ *        is only valid after a frame has been received and before the receiver is re-enabled.
+ *
+ * input parameters
+ *
+ * output parameters
+ *
+ * returns the (signed 21-bit sign extended) carrier integrator value
+ */
+int32 dwt_readcarrierintegrator(void);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn dwt_readclockoffsetppm()
+ *
+ * @brief This is used to estimate the clock offset between the local device and the remote device that sent the last
+ *        received frame. It reads the carrier integrator and scales it for the channel and data rate set by the last
+ *        dwt_configure call. A positive value means the local clock is slower than the remote transmitter.
+ *
+ * NOTE: Both devices derive their carrier and their timestamp clock from the same crystal, so the carrier offset is also the
+ *       timestamp clock offset. This is what allows single-sided TWR to correct the responder's reply time.
+ *
+ * input parameters
+ *
+ * output parameters
+ *
+ * returns the clock offset in ppm (parts per million)
+ */
+double dwt_readclockoffsetppm(void);
+
 /*! ------------------------------------------------------------------------------------------------------------------
  * @fn dwt_loadopsettabfromotp()
  *
@@ -906,6 +906,11 @@ extern "C" {
 #define DRX_TUNE4H_PRE64        0x0010
 #define DRX_TUNE4H_PRE128PLUS   0x0028
 
+/* offset from DRX_CONF_ID in bytes */
+#define DRX_CARRIER_INT_OFFSET  0x28    /* 7.2.40.11 Sub-Register 0x27:28 - DRX_CAR_INT */
+#define DRX_CARRIER_INT_LEN     (3)
+#define DRX_CARRIER_INT_MASK    0x001FFFFF
+
 
 /****************************************************************************//**
  * @brief Bit definitions for register  RF_CONF
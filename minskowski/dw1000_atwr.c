@@ -344,7 +344,9 @@ int main(int argc, char* argv[])
 
 		        printf("delta_ts: %lld delta_stc: %lld ", Delta_ts, Delta_stc);
 		        printf("offset: %3.9e sec ", tof);
-		        printf("range: %4.3f m\n", tof*299792458.0*0.84);
+		        printf("range: %4.3f m ", tof*299792458.0*0.84);
+		        double range = tof*299792458.0;
+		        printf("corrected: %4.3f m\n", range - dwt_getrangebias(config.chan, range, config.prf));
 
 		        /*
 		        if(tof < 10e-9)
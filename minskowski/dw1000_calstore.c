@@ -0,0 +1,121 @@
+/*! ----------------------------------------------------------------------------
+ *  @file    dw1000_calstore.c
+ *  @brief   Calibration store tool
+ *
+ *           Reads the part and lot IDs of the local DW1000 and shows or updates its record in the calibration store, so that
+ *           applications calling calstore_load() come up calibrated after a reboot.
+ *
+ *           usage: dw1000_calstore SHOW
+ *                  dw1000_calstore ANTDLY CHAN PRF VALUE      (PRF 16 or 64)
+ *                  dw1000_calstore XTAL VALUE                 (0 to 31)
+ *                  dw1000_calstore XODAC VALUE                (0 to 0xFFFFFF)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// DW1000
+#include "deca_device_api.h"
+#include "deca_regs.h"
+#include "platform.h"
+#include "calstore.h"
+
+#define DW1000_PATH 	"/dev/spidev1.0"
+
+int main(int argc, char* argv[])
+{
+	const calstore_rec_t *cur;
+	calstore_rec_t rec;
+	int chan, prf, i;
+	long value;
+
+	if(argc < 2)
+	{
+		printf("usage: %s SHOW | ANTDLY CHAN PRF VALUE | XTAL VALUE | XODAC VALUE\n", argv[0]);
+		return 0;
+	}
+
+	hardware_init(DW1000_PATH);
+
+	reset_DW1000();
+	spi_set_rate_low();
+	if (dwt_initialise(DWT_LOADNONE) == DWT_ERROR)
+	{
+		printf("%s\n", "INIT FAILED");
+		return -1;
+	}
+	spi_set_rate_high();
+
+	// Start from the current record so that only the given field changes
+	cur = calstore_load(CALSTORE_PATH);
+	if(cur != NULL)
+		rec = *cur;
+	else
+		calstore_initrec(&rec);
+
+	if(!strcmp(argv[1], "SHOW"))
+	{
+		printf("part 0x%08X lot 0x%08X%s\n", (unsigned) rec.partid, (unsigned) rec.lotid, (cur != NULL) ? "" : " not in store");
+		for(i = 1; i < CALSTORE_NUM_CHAN; i++)
+		{
+			if(rec.ant_dly[i][0] || rec.ant_dly[i][1])
+				printf("chan %d ant delay 16M %d 64M %d\n", i, rec.ant_dly[i][0], rec.ant_dly[i][1]);
+		}
+		if(rec.flags & CALSTORE_HAS_XTALTRIM)
+			printf("xtal trim %d\n", rec.xtaltrim);
+		if(rec.flags & CALSTORE_HAS_XODAC)
+			printf("XO DAC 0x%06X\n", (unsigned) rec.xo_dac);
+		return 0;
+	}
+	else if(!strcmp(argv[1], "ANTDLY") && argc == 5)
+	{
+		chan = atoi(argv[2]);
+		prf = (atoi(argv[3]) == 64) ? DWT_PRF_64M : DWT_PRF_16M;
+		value = strtol(argv[4], NULL, 0);
+		if(chan < 1 || chan >= CALSTORE_NUM_CHAN || value <= 0 || value > 0xFFFF)
+		{
+			printf("invalid channel or antenna delay\n");
+			return -1;
+		}
+		rec.ant_dly[chan][prf - DWT_PRF_16M] = (uint16) value;
+	}
+	else if(!strcmp(argv[1], "XTAL") && argc == 3)
+	{
+		value = strtol(argv[2], NULL, 0);
+		if(value < 0 || value > FS_XTALT_MASK)
+		{
+			printf("invalid crystal trim\n");
+			return -1;
+		}
+		rec.xtaltrim = (uint8) value;
+		rec.flags |= CALSTORE_HAS_XTALTRIM;
+	}
+	else if(!strcmp(argv[1], "XODAC") && argc == 3)
+	{
+		value = strtol(argv[2], NULL, 0);
+		if(value < 0 || value > 0xFFFFFF)
+		{
+			printf("invalid XO DAC setpoint\n");
+			return -1;
+		}
+		rec.xo_dac = (int32_t) value;
+		rec.flags |= CALSTORE_HAS_XODAC;
+	}
+	else
+	{
+		printf("usage: %s SHOW | ANTDLY CHAN PRF VALUE | XTAL VALUE | XODAC VALUE\n", argv[0]);
+		return 0;
+	}
+
+	if(calstore_update(CALSTORE_PATH, &rec) != 0)
+	{
+		perror("Unable to update " CALSTORE_PATH);
+		return -1;
+	}
+
+	return 0;
+}
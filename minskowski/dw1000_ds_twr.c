@@ -24,11 +24,16 @@
 #include <unistd.h>
 #include <stdint.h>
 #include <string.h>
+#include <math.h>
+#include <time.h>
 
 // DW1000
 #include "deca_device_api.h"
 #include "deca_regs.h"
 #include "platform.h"
+#include "calstore.h"
+#include "survey.h"
+#include "tdoarec.h"
 
 #define DW1000_PATH 	"/dev/spidev1.0"
 
@@ -65,6 +70,9 @@ static dwt_config_t config = {
 static uint8 tx_poll_msg[] = {0x41, 0x88, 0, 0xCA, 0xDE, 'W', 'A', 'V', 'E', 0x21, 0, 0};
 static uint8 rx_resp_msg[] = {0x41, 0x88, 0, 0xCA, 0xDE, 'V', 'E', 'W', 'A', 0x10, 0x02, 0, 0, 0, 0};
 static uint8 tx_final_msg[] = {0x41, 0x88, 0, 0xCA, 0xDE, 'W', 'A', 'V', 'E', 0x23, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+/* Frames used in the single-sided ranging process. See NOTE 14 below. */
+static uint8 tx_ss_poll_msg[] = {0x41, 0x88, 0, 0xCA, 0xDE, 'W', 'A', 'V', 'E', 0xE0, 0, 0};
+static uint8 rx_ss_resp_msg[] = {0x41, 0x88, 0, 0xCA, 0xDE, 'V', 'E', 'W', 'A', 0xE1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
 /* Length of the common part of the message (up to and including the function code, see NOTE 2 below). */
 #define ALL_MSG_COMMON_LEN 10
 /* Indexes to access some of the fields in the frames defined above. */
@@ -73,6 +81,8 @@ static uint8 tx_final_msg[] = {0x41, 0x88, 0, 0xCA, 0xDE, 'W', 'A', 'V', 'E', 0x
 #define FINAL_MSG_RESP_RX_TS_IDX 14
 #define FINAL_MSG_FINAL_TX_TS_IDX 18
 #define FINAL_MSG_TS_LEN 4
+#define RESP_MSG_POLL_RX_TS_IDX 10
+#define RESP_MSG_RESP_TX_TS_IDX 14
 /* Frame sequence number, incremented after each transmission. */
 static uint8 frame_seq_nb = 0;
 
@@ -121,6 +131,8 @@ static void final_msg_set_ts(uint8 *ts_field, uint64 ts);
 static uint8 rx_poll_msg[] = {0x41, 0x88, 0, 0xCA, 0xDE, 'W', 'A', 'V', 'E', 0x21, 0, 0};
 static uint8 tx_resp_msg[] = {0x41, 0x88, 0, 0xCA, 0xDE, 'V', 'E', 'W', 'A', 0x10, 0x02, 0, 0, 0, 0};
 static uint8 rx_final_msg[] = {0x41, 0x88, 0, 0xCA, 0xDE, 'W', 'A', 'V', 'E', 0x23, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+static uint8 rx_ss_poll_msg[] = {0x41, 0x88, 0, 0xCA, 0xDE, 'W', 'A', 'V', 'E', 0xE0, 0, 0};
+static uint8 tx_ss_resp_msg[] = {0x41, 0x88, 0, 0xCA, 0xDE, 'V', 'E', 'W', 'A', 0xE1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
 
 /* Buffer to store received messages.
  * Its size is adjusted to longest frame that this example code is supposed to handle. */
@@ -131,6 +143,8 @@ static uint8 rx_buffer_resp[RESP_RX_BUF_LEN];
 /* This is the delay from Frame RX timestamp to TX reply timestamp used for calculating/setting the DW1000's delayed TX function. This includes the
  * frame length of approximately 2.46 ms with above configuration. */
 #define POLL_RX_TO_RESP_TX_DLY_UUS 5000 //2600
+/* Same delay for the single-sided response, kept as short as the frame lengths allow as its error grows with it. See NOTE 14 below. */
+#define SS_POLL_RX_TO_RESP_TX_DLY_UUS 2600
 /* This is the delay from the end of the frame transmission to the enable of the receiver, as programmed for the DW1000's wait for response feature. */
 #define RESP_TX_TO_FINAL_RX_DLY_UUS 500
 /* Receive final timeout. See NOTE 5 below. */
@@ -155,6 +169,79 @@ char dist_str[16] = {0};
 
 /* Declaration of static functions. */
 static void final_msg_get_ts(const uint8 *ts_field, uint32 *ts);
+static void ss_initiator(void);
+static void ss_responder(uint16 ant_delay);
+
+
+
+
+
+// BURST
+
+/* Most exchanges in a burst: the final message carries two timestamps per exchange (see NOTE 16 below). */
+#define BURST_MAX 8
+
+/* Frames used in burst mode. The response is the one of the DS TWR exchange. See NOTE 16 below. */
+static uint8 burst_poll_msg[] = {0x41, 0x88, 0, 0xCA, 0xDE, 'W', 'A', 'V', 'E', 0x24, 0, 0, 0, 0};
+static uint8 burst_final_msg[ALL_MSG_COMMON_LEN + 1 + (2 * BURST_MAX + 1) * FINAL_MSG_TS_LEN + 2] = {0x41, 0x88, 0, 0xCA, 0xDE, 'W', 'A', 'V', 'E', 0x25};
+#define BURST_POLL_INDEX_IDX 10
+#define BURST_POLL_COUNT_IDX 11
+#define BURST_FINAL_COUNT_IDX 10
+#define BURST_FINAL_TS_IDX 11
+#define BURST_FINAL_LEN(count) (BURST_FINAL_TS_IDX + (2u * (count) + 1) * FINAL_MSG_TS_LEN + 2)
+
+/* Receive timeout of the responder for the frame after its response, long enough for the longest final message. */
+#define BURST_RX_TIMEOUT_UUS 12000
+
+/* Samples further from their median than this many (robust) standard deviations are left out of the average. */
+#define BURST_MAD_K 3.0
+
+static uint8 rx_buffer_burst[sizeof(burst_final_msg)];
+
+static void burst_initiator(uint8 count, uint16 ant_delay);
+static void burst_responder(void);
+static double burst_average(double *tof_dtu, int n, int *used);
+
+
+
+
+
+// SURVEY
+
+/* Frames used in the survey mode, addressed by anchor ID. See NOTE 15 below. */
+static uint8 survey_beacon_msg[] = {0x41, 0x88, 0, 0xCA, 0xDE, 0xFF, 0xFF, 0, 0, 0x50, 0, 0, 0, 0, 0, 0};
+static uint8 survey_poll_msg[] = {0x41, 0x88, 0, 0xCA, 0xDE, 0, 0, 0, 0, 0x21, 0, 0};
+static uint8 survey_resp_msg[] = {0x41, 0x88, 0, 0xCA, 0xDE, 0, 0, 0, 0, 0x10, 0x02, 0, 0, 0, 0};
+static uint8 survey_final_msg[] = {0x41, 0x88, 0, 0xCA, 0xDE, 0, 0, 0, 0, 0x23, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+#define SURVEY_DST_IDX 5
+#define SURVEY_SRC_IDX 7
+#define SURVEY_FUNC_IDX 9
+#define SURVEY_BEACON_ROUND_IDX 10
+#define SURVEY_BEACON_ROUNDS_IDX 12
+
+/* Preamble codes of the pairs sharing a slot (the PRF 64 MHz codes of channel 2); the first one also carries the beacons. */
+static const uint8 survey_codes[SURVEY_CODES] = {9, 10, 11, 12};
+
+/* Receive timeout of a responder waiting for a poll, and of an anchor waiting for a beacon, in UWB microseconds, so that
+ * they can watch the time. No receive timeout may outlast SURVEY_END_GUARD_MS (1 UUS is about 1/975 ms). */
+#define SURVEY_POLL_RX_TIMEOUT_UUS 50000
+#define SURVEY_BEACON_RX_TIMEOUT_UUS 50000
+#if SURVEY_POLL_RX_TIMEOUT_UUS / 975 >= SURVEY_END_GUARD_MS || RESP_RX_TIMEOUT_UUS / 975 >= SURVEY_END_GUARD_MS
+#error "SURVEY_END_GUARD_MS must outlast the survey receive timeouts"
+#endif
+
+/* Time an anchor waits for the next beacon before giving the survey up, in milliseconds. */
+#define SURVEY_BEACON_WAIT_MS 60000
+
+static uint64 get_eui(void);
+static double survey_now_ms(void);
+static void survey_set_code(uint8 code);
+static void survey_address(uint8 *msg, uint8 dst, uint8 src);
+static uint16 survey_rx_timeout(uint16 timeout, double end_ms);
+static int survey_wait_beacon(int *round, int *rounds, double end_ms);
+static int survey_initiate(uint8 id, uint8 peer, uint16 ant_delay, double end_ms);
+static int survey_respond(uint8 id, uint8 peer, double end_ms);
+static void survey_anchor(uint8 id, uint8 n, uint16 ant_delay);
 
 /*! ------------------------------------------------------------------------------------------------------------------
  * @fn main()
@@ -169,17 +256,44 @@ int main(int argc, char* argv[])
 {
 	// User input from terminal
 	uint8_t isRESP = 0;
+	uint8_t isSS = 0;
+	uint8_t burst = 0;
 	uint16_t ant_delay = 0;
+	uint8_t survey_id = 0, survey_n = 0;
 	
-	if(argc != 3)
+	if(argc < 3 || argc > 5 || (atoi(argv[1]) == 2 && argc != 5))
 	{
-		printf("usage: %s REF/SYNC\n", argv[0]);
+		printf("usage: %s INIT/RESP ANT_DELAY [SS [BURST]]\n", argv[0]);
+		printf("       %s 2 ANT_DELAY ID ANCHORS (survey)\n", argv[0]);
 		return 0;
 	}
-	else if(argc == 3)
+	else
 	{
 		isRESP = atoi(argv[1]);
 		ant_delay = (uint16_t) atoi(argv[2]);
+		if(argc >= 4 && isRESP != 2)
+		{
+			isSS = atoi(argv[3]);
+		}
+		if(argc == 5 && isRESP != 2)
+		{
+			burst = atoi(argv[4]);
+			if(isSS || burst > BURST_MAX)
+			{
+				printf("BURST is for DS TWR (SS 0), up to %d exchanges\n", BURST_MAX);
+				return 0;
+			}
+		}
+		else if(argc == 5)
+		{
+			survey_id = atoi(argv[3]);
+			survey_n = atoi(argv[4]);
+			if(survey_n < 2 || survey_n > SURVEY_ANCHORS || survey_id >= survey_n)
+			{
+				printf("ID must be below ANCHORS, and ANCHORS in 2..%d\n", SURVEY_ANCHORS);
+				return 0;
+			}
+		}
 	}
 
     /* Start with board specific hardware init. */
@@ -201,14 +315,49 @@ int main(int argc, char* argv[])
     /* Configure DW1000. See NOTE 7 below. */
     dwt_configure(&config);
 
-    /* Apply default antenna delay value. See NOTE 1 below. */
-    dwt_setrxantennadelay(ant_delay);
-    dwt_settxantennadelay(ant_delay);
+    /* Apply antenna delay value. An ANT_DELAY of 0 takes it, and the crystal trim, from the calibration store. See NOTE 1 below. */
+    if(ant_delay == 0)
+    {
+    	ant_delay = calstore_apply(calstore_load(CALSTORE_PATH), config.chan, config.prf, TX_ANT_DLY);
+    	printf("ANT_DELAY %d\n", ant_delay);
+    }
+    else
+    {
+    	dwt_setrxantennadelay(ant_delay);
+    	dwt_settxantennadelay(ant_delay);
+    }
 
     /* Set expected response's delay and timeout. See NOTE 4, 5 and 6 below.
      * As this example only handles one incoming frame with always the same delay and timeout, those values can be set here once for all. */
     //dwt_setpreambledetecttimeout(PRE_TIMEOUT); /* Sets the receiver to timeout and disable when no preamble is received within the specified time 5.31 api */
 
+    // Range every pair of anchors for the anchor survey. See NOTE 15 below.
+    if(isRESP == 2)
+    {
+    	survey_anchor(survey_id, survey_n, ant_delay);
+    	return 0;
+    }
+
+    // Run bursts of pipelined DS TWR exchanges. See NOTE 16 below.
+    if(burst)
+    {
+    	if(!isRESP)
+    		burst_initiator(burst, ant_delay);
+    	else
+    		burst_responder();
+    	return 0;
+    }
+
+    // Run single-sided TWR with clock offset correction. See NOTE 14 below.
+    if(isSS)
+    {
+    	if(!isRESP)
+    		ss_initiator();
+    	else
+    		ss_responder(ant_delay);
+    	return 0;
+    }
+
     // Run INITIATOR program
     if(!isRESP)
     {
@@ -274,7 +423,7 @@ int main(int argc, char* argv[])
 	                dwt_setdelayedtrxtime(final_tx_time);
 
 	                /* Final TX timestamp is the transmission time we programmed plus the TX antenna delay. */
-	                final_tx_ts = (((uint64)(final_tx_time & 0xFFFFFFFEUL)) << 8) + TX_ANT_DLY;
+	                final_tx_ts = (((uint64)(final_tx_time & 0xFFFFFFFEUL)) << 8) + ant_delay;
 
 	                /* Write all timestamps in the final message. See NOTE 11 below. */
 	                final_msg_set_ts(&tx_final_msg[FINAL_MSG_POLL_TX_TS_IDX], poll_tx_ts);
@@ -438,9 +587,11 @@ int main(int argc, char* argv[])
 
 	                        tof = tof_dtu * DWT_TIME_UNITS;
 	                        distance = tof * SPEED_OF_LIGHT;
+	                        distance -= dwt_getrangebias(config.chan, distance, config.prf);
 
 	                        printf("%3.9e sec ", tof);
-	                        printf("%4.3f m\n", tof*299792458.0*0.84);
+	                        printf("%4.3f m ", tof*299792458.0*0.84);
+	                        printf("%4.3f m corrected\n", distance);
 
 	                        /* Display computed distance on LCD. */
 	                        // sprintf(dist_str, "DIST: %3.2f m", distance);
@@ -472,6 +623,890 @@ int main(int argc, char* argv[])
 }
 
 
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn ss_initiator()
+ *
+ * @brief Single-sided TWR initiator. Sends a poll and computes the time of flight from the response, which carries the
+ *        responder's poll RX and response TX timestamps. The responder's reply time is corrected with the clock offset
+ *        measured by the carrier integrator on the response frame, so only two frames are needed per range.
+ *
+ * @param  none
+ *
+ * @return none
+ */
+static void ss_initiator(void)
+{
+	printf("Starting SS INITIATOR\n");
+
+    dwt_setrxaftertxdelay(POLL_TX_TO_RESP_RX_DLY_UUS);
+    dwt_setrxtimeout(RESP_RX_TIMEOUT_UUS);
+
+    /* Loop forever initiating ranging exchanges. */
+    while (1)
+    {
+        /* Write frame data to DW1000 and prepare transmission. See NOTE 8 below. */
+        tx_ss_poll_msg[ALL_MSG_SN_IDX] = frame_seq_nb;
+        dwt_writetxdata(sizeof(tx_ss_poll_msg), tx_ss_poll_msg, 0); /* Zero offset in TX buffer. */
+        dwt_writetxfctrl(sizeof(tx_ss_poll_msg), 0, 1); /* Zero offset in TX buffer, ranging. */
+        dwt_starttx(DWT_START_TX_IMMEDIATE | DWT_RESPONSE_EXPECTED);
+
+        /* We assume that the transmission is achieved correctly, poll for reception of a frame or error/timeout. See NOTE 9 below. */
+        while (!((status_reg = dwt_read32bitreg(SYS_STATUS_ID)) & (SYS_STATUS_RXFCG | SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_RX_ERR)))
+        { };
+
+        /* Increment frame sequence number after transmission of the poll message (modulo 256). */
+        frame_seq_nb++;
+
+        if (status_reg & SYS_STATUS_RXFCG)
+        {
+            uint32 frame_len;
+
+            /* Clear good RX frame event and TX frame sent in the DW1000 status register. */
+            dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_RXFCG | SYS_STATUS_TXFRS);
+
+            /* A frame has been received, read it into the local buffer. */
+            frame_len = dwt_read32bitreg(RX_FINFO_ID) & RX_FINFO_RXFLEN_MASK;
+            if (frame_len <= INIT_RX_BUF_LEN)
+            {
+                dwt_readrxdata(rx_buffer_init, frame_len, 0);
+            }
+
+            rx_buffer_init[ALL_MSG_SN_IDX] = 0;
+            if (memcmp(rx_buffer_init, rx_ss_resp_msg, ALL_MSG_COMMON_LEN) == 0)
+            {
+                uint32 poll_tx_ts_32, resp_rx_ts_32, poll_rx_ts_32, resp_tx_ts_32;
+                int32 rtd_init, rtd_resp;
+                double clock_offset_ratio;
+
+                /* Retrieve poll transmission and response reception timestamps. See NOTE 11 below. */
+                poll_tx_ts_32 = dwt_readtxtimestamplo32();
+                resp_rx_ts_32 = dwt_readrxtimestamplo32();
+
+                /* Read carrier integrator value and calculate clock offset ratio. See NOTE 14 below. */
+                clock_offset_ratio = dwt_readclockoffsetppm() / 1.0e6;
+
+                /* Get timestamps embedded in response message. */
+                final_msg_get_ts(&rx_buffer_init[RESP_MSG_POLL_RX_TS_IDX], &poll_rx_ts_32);
+                final_msg_get_ts(&rx_buffer_init[RESP_MSG_RESP_TX_TS_IDX], &resp_tx_ts_32);
+
+                /* Compute time of flight, using clock offset ratio to correct for differing local and remote clock rates. */
+                rtd_init = resp_rx_ts_32 - poll_tx_ts_32;
+                rtd_resp = resp_tx_ts_32 - poll_rx_ts_32;
+
+                tof = ((rtd_init - rtd_resp * (1.0 - clock_offset_ratio)) / 2.0) * DWT_TIME_UNITS;
+                distance = tof * SPEED_OF_LIGHT;
+                distance -= dwt_getrangebias(config.chan, distance, config.prf);
+
+                printf("%3.9e sec ", tof);
+                printf("%4.3f m ", distance);
+                printf("%3.3f ppm\n", clock_offset_ratio * 1.0e6);
+            }
+        }
+        else
+        {
+            /* Clear RX error/timeout events in the DW1000 status register. */
+            dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_RX_ERR);
+
+            /* Reset RX to properly reinitialise LDE operation. */
+            dwt_rxreset();
+        }
+
+        /* Execute a delay between ranging exchanges. */
+        sleep_ms(RNG_DELAY_MS);
+    }
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn ss_responder()
+ *
+ * @brief Single-sided TWR responder. Answers each poll with a delayed response carrying the poll RX timestamp and the
+ *        (pre-computed) response TX timestamp.
+ *
+ * @param  ant_delay  TX antenna delay programmed in the DW1000, added to the predicted response TX timestamp
+ *
+ * @return none
+ */
+static void ss_responder(uint16 ant_delay)
+{
+	printf("Starting SS RESPONDER\n");
+
+    /* Loop forever responding to ranging requests. */
+    while (1)
+    {
+        /* Activate reception immediately. */
+        dwt_rxenable(DWT_START_RX_IMMEDIATE);
+
+        /* Poll for reception of a frame or error/timeout. See NOTE 8 below. */
+        while (!((status_reg = dwt_read32bitreg(SYS_STATUS_ID)) & (SYS_STATUS_RXFCG | SYS_STATUS_ALL_RX_ERR)))
+        { };
+
+        if (status_reg & SYS_STATUS_RXFCG)
+        {
+            uint32 frame_len;
+
+            /* Clear good RX frame event in the DW1000 status register. */
+            dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_RXFCG);
+
+            /* A frame has been received, read it into the local buffer. */
+            frame_len = dwt_read32bitreg(RX_FINFO_ID) & RX_FINFO_RXFL_MASK_1023;
+            if (frame_len <= RESP_RX_BUF_LEN)
+            {
+                dwt_readrxdata(rx_buffer_resp, frame_len, 0);
+            }
+
+            rx_buffer_resp[ALL_MSG_SN_IDX] = 0;
+            if (memcmp(rx_buffer_resp, rx_ss_poll_msg, ALL_MSG_COMMON_LEN) == 0)
+            {
+                uint32 resp_tx_time;
+                int ret;
+
+                /* Retrieve poll reception timestamp. */
+                poll_rx_ts = get_rx_timestamp_u64();
+
+                /* Compute response message transmission time. See NOTE 10 below. */
+                resp_tx_time = (poll_rx_ts + (SS_POLL_RX_TO_RESP_TX_DLY_UUS * UUS_TO_DWT_TIME)) >> 8;
+                dwt_setdelayedtrxtime(resp_tx_time);
+
+                /* Response TX timestamp is the transmission time we programmed plus the antenna delay. */
+                resp_tx_ts = (((uint64)(resp_tx_time & 0xFFFFFFFEUL)) << 8) + ant_delay;
+
+                /* Write all timestamps in the response message. */
+                final_msg_set_ts(&tx_ss_resp_msg[RESP_MSG_POLL_RX_TS_IDX], poll_rx_ts);
+                final_msg_set_ts(&tx_ss_resp_msg[RESP_MSG_RESP_TX_TS_IDX], resp_tx_ts);
+
+                /* Write and send the response message. See NOTE 8 below.*/
+                tx_ss_resp_msg[ALL_MSG_SN_IDX] = frame_seq_nb;
+                dwt_writetxdata(sizeof(tx_ss_resp_msg), tx_ss_resp_msg, 0); /* Zero offset in TX buffer. */
+                dwt_writetxfctrl(sizeof(tx_ss_resp_msg), 0, 1); /* Zero offset in TX buffer, ranging. */
+                ret = dwt_starttx(DWT_START_TX_DELAYED);
+
+                /* If dwt_starttx() returns an error, abandon this ranging exchange and proceed to the next one. See NOTE 12 below. */
+                if (ret == DWT_SUCCESS)
+                {
+                    /* Poll DW1000 until TX frame sent event set. */
+                    while (!(dwt_read32bitreg(SYS_STATUS_ID) & SYS_STATUS_TXFRS))
+                    { };
+
+                    /* Clear TXFRS event. */
+                    dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_TXFRS);
+
+                    /* Increment frame sequence number after transmission of the response message (modulo 256). */
+                    frame_seq_nb++;
+                }
+                else
+                {
+                    printf("Response late, raise SS_POLL_RX_TO_RESP_TX_DLY_UUS\n");
+                }
+            }
+        }
+        else
+        {
+            /* Clear RX error events in the DW1000 status register. */
+            dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_ALL_RX_ERR);
+
+            /* Reset RX to properly reinitialise LDE operation. */
+            dwt_rxreset();
+        }
+    }
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn burst_initiator()
+ *
+ * @brief Burst initiator: count polls, each sent at a fixed delay after the response to the previous one (delayed TX),
+ *        then a single final message carrying the TX timestamps of the polls, the RX timestamps of the responses and
+ *        its own TX timestamp. See NOTE 16 below.
+ *
+ * @param  count  exchanges per burst, up to BURST_MAX
+ *         ant_delay  TX antenna delay programmed in the DW1000, added to the predicted final TX timestamp
+ *
+ * @return none
+ */
+static void burst_initiator(uint8 count, uint16 ant_delay)
+{
+    uint64 burst_poll_tx_ts[BURST_MAX], burst_resp_rx_ts[BURST_MAX];
+
+    printf("Starting BURST INITIATOR (%d exchanges)\n", count);
+
+    dwt_setrxaftertxdelay(POLL_TX_TO_RESP_RX_DLY_UUS);
+    dwt_setrxtimeout(RESP_RX_TIMEOUT_UUS);
+
+    /* Loop forever initiating bursts. */
+    while (1)
+    {
+        int k;
+
+        for (k = 0; k < count; k++)
+        {
+            uint32 frame_len;
+
+            /* Write the poll, the first one sent at once and the others at a fixed delay after the previous response. */
+            burst_poll_msg[ALL_MSG_SN_IDX] = frame_seq_nb;
+            burst_poll_msg[BURST_POLL_INDEX_IDX] = k;
+            burst_poll_msg[BURST_POLL_COUNT_IDX] = count;
+            dwt_writetxdata(sizeof(burst_poll_msg), burst_poll_msg, 0);
+            dwt_writetxfctrl(sizeof(burst_poll_msg), 0, 1);
+            if (k == 0)
+            {
+                dwt_starttx(DWT_START_TX_IMMEDIATE | DWT_RESPONSE_EXPECTED);
+            }
+            else
+            {
+                dwt_setdelayedtrxtime((burst_resp_rx_ts[k - 1] + (RESP_RX_TO_FINAL_TX_DLY_UUS * UUS_TO_DWT_TIME)) >> 8);
+                if (dwt_starttx(DWT_START_TX_DELAYED | DWT_RESPONSE_EXPECTED) != DWT_SUCCESS)
+                    break;
+            }
+
+            while (!((status_reg = dwt_read32bitreg(SYS_STATUS_ID)) & (SYS_STATUS_RXFCG | SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_RX_ERR)))
+            { };
+            frame_seq_nb++;
+
+            if (!(status_reg & SYS_STATUS_RXFCG))
+            {
+                dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_RX_ERR);
+                dwt_rxreset();
+                break;
+            }
+            dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_RXFCG | SYS_STATUS_TXFRS);
+
+            frame_len = dwt_read32bitreg(RX_FINFO_ID) & RX_FINFO_RXFLEN_MASK;
+            if (frame_len > INIT_RX_BUF_LEN)
+                break;
+            dwt_readrxdata(rx_buffer_init, frame_len, 0);
+            rx_buffer_init[ALL_MSG_SN_IDX] = 0;
+            if (memcmp(rx_buffer_init, rx_resp_msg, ALL_MSG_COMMON_LEN) != 0)
+                break;
+
+            burst_poll_tx_ts[k] = get_tx_timestamp_u64();
+            burst_resp_rx_ts[k] = get_rx_timestamp_u64();
+        }
+
+        /* Every response came back: send the final message. See NOTE 10 and 11 below. */
+        if (k == count)
+        {
+            uint32 final_tx_time;
+            uint16 len = BURST_FINAL_LEN(count);
+
+            final_tx_time = (burst_resp_rx_ts[count - 1] + (RESP_RX_TO_FINAL_TX_DLY_UUS * UUS_TO_DWT_TIME)) >> 8;
+            dwt_setdelayedtrxtime(final_tx_time);
+            final_tx_ts = (((uint64)(final_tx_time & 0xFFFFFFFEUL)) << 8) + ant_delay;
+
+            burst_final_msg[ALL_MSG_SN_IDX] = frame_seq_nb;
+            burst_final_msg[BURST_FINAL_COUNT_IDX] = count;
+            for (k = 0; k < count; k++)
+            {
+                final_msg_set_ts(&burst_final_msg[BURST_FINAL_TS_IDX + k * FINAL_MSG_TS_LEN], burst_poll_tx_ts[k]);
+                final_msg_set_ts(&burst_final_msg[BURST_FINAL_TS_IDX + (count + k) * FINAL_MSG_TS_LEN], burst_resp_rx_ts[k]);
+            }
+            final_msg_set_ts(&burst_final_msg[BURST_FINAL_TS_IDX + 2 * count * FINAL_MSG_TS_LEN], final_tx_ts);
+
+            dwt_writetxdata(len, burst_final_msg, 0);
+            dwt_writetxfctrl(len, 0, 1);
+            if (dwt_starttx(DWT_START_TX_DELAYED) == DWT_SUCCESS)
+            {
+                while (!(dwt_read32bitreg(SYS_STATUS_ID) & SYS_STATUS_TXFRS))
+                { };
+                dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_TXFRS);
+                frame_seq_nb++;
+            }
+        }
+
+        /* Execute a delay between bursts. */
+        sleep_ms(RNG_DELAY_MS);
+    }
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn burst_responder()
+ *
+ * @brief Burst responder: answers the polls of a burst, keeping their RX timestamps and the TX timestamps of its
+ *        responses, and on the final message computes one DS TWR time of flight per exchange and their robust average.
+ *        See NOTE 16 below.
+ *
+ * @param  none
+ *
+ * @return none
+ */
+static void burst_responder(void)
+{
+    uint64 burst_poll_rx_ts[BURST_MAX], burst_resp_tx_ts[BURST_MAX];
+    int n = 0;
+
+    printf("Starting BURST RESPONDER\n");
+
+    /* Loop forever responding to bursts. */
+    while (1)
+    {
+        uint32 frame_len;
+
+        /* Between bursts, listen without a timeout; within one the receiver is turned on after each response. */
+        if (n == 0)
+        {
+            dwt_setrxtimeout(0);
+            dwt_rxenable(DWT_START_RX_IMMEDIATE);
+        }
+
+        while (!((status_reg = dwt_read32bitreg(SYS_STATUS_ID)) & (SYS_STATUS_RXFCG | SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_RX_ERR)))
+        { };
+
+        if (!(status_reg & SYS_STATUS_RXFCG))
+        {
+            dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_RX_ERR);
+            dwt_rxreset();
+            n = 0;
+            continue;
+        }
+        dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_RXFCG | SYS_STATUS_TXFRS);
+
+        frame_len = dwt_read32bitreg(RX_FINFO_ID) & RX_FINFO_RXFL_MASK_1023;
+        if (frame_len > sizeof(rx_buffer_burst))
+        {
+            n = 0;
+            continue;
+        }
+        dwt_readrxdata(rx_buffer_burst, frame_len, 0);
+        rx_buffer_burst[ALL_MSG_SN_IDX] = 0;
+
+        if (memcmp(rx_buffer_burst, burst_poll_msg, ALL_MSG_COMMON_LEN) == 0)
+        {
+            uint32 resp_tx_time;
+
+            /* A poll out of turn starts over (or is dropped). */
+            if (rx_buffer_burst[BURST_POLL_INDEX_IDX] == 0)
+                n = 0;
+            if (rx_buffer_burst[BURST_POLL_INDEX_IDX] != n || n >= BURST_MAX)
+            {
+                n = 0;
+                continue;
+            }
+
+            /* The poll also closes the previous exchange: the TX timestamp of the previous response is still readable. */
+            if (n > 0)
+                burst_resp_tx_ts[n - 1] = get_tx_timestamp_u64();
+            burst_poll_rx_ts[n] = get_rx_timestamp_u64();
+
+            resp_tx_time = (burst_poll_rx_ts[n] + (POLL_RX_TO_RESP_TX_DLY_UUS * UUS_TO_DWT_TIME)) >> 8;
+            dwt_setdelayedtrxtime(resp_tx_time);
+            dwt_setrxaftertxdelay(RESP_TX_TO_FINAL_RX_DLY_UUS);
+            dwt_setrxtimeout(BURST_RX_TIMEOUT_UUS);
+
+            tx_resp_msg[ALL_MSG_SN_IDX] = frame_seq_nb;
+            dwt_writetxdata(sizeof(tx_resp_msg), tx_resp_msg, 0);
+            dwt_writetxfctrl(sizeof(tx_resp_msg), 0, 1);
+            if (dwt_starttx(DWT_START_TX_DELAYED | DWT_RESPONSE_EXPECTED) == DWT_ERROR)
+            {
+                n = 0;
+                continue;
+            }
+            frame_seq_nb++;
+            n++;
+        }
+        else if (n > 0 && memcmp(rx_buffer_burst, burst_final_msg, ALL_MSG_COMMON_LEN) == 0
+                 && rx_buffer_burst[BURST_FINAL_COUNT_IDX] == n && frame_len >= BURST_FINAL_LEN(n))
+        {
+            uint32 p_tx, r_rx, p_tx_next, f_tx;
+            double tof_dtu[BURST_MAX], Ra, Rb, Da, Db;
+            int k, used;
+
+            burst_resp_tx_ts[n - 1] = get_tx_timestamp_u64();
+            final_rx_ts = get_rx_timestamp_u64();
+            final_msg_get_ts(&rx_buffer_burst[BURST_FINAL_TS_IDX + 2 * n * FINAL_MSG_TS_LEN], &f_tx);
+
+            /* Exchange k closes with poll k + 1, the last one with the final message. See NOTE 12 below. */
+            for (k = 0; k < n; k++)
+            {
+                final_msg_get_ts(&rx_buffer_burst[BURST_FINAL_TS_IDX + k * FINAL_MSG_TS_LEN], &p_tx);
+                final_msg_get_ts(&rx_buffer_burst[BURST_FINAL_TS_IDX + (n + k) * FINAL_MSG_TS_LEN], &r_rx);
+                Ra = (double)(r_rx - p_tx);
+                Db = (double)((uint32)burst_resp_tx_ts[k] - (uint32)burst_poll_rx_ts[k]);
+                if (k < n - 1)
+                {
+                    final_msg_get_ts(&rx_buffer_burst[BURST_FINAL_TS_IDX + (k + 1) * FINAL_MSG_TS_LEN], &p_tx_next);
+                    Rb = (double)((uint32)burst_poll_rx_ts[k + 1] - (uint32)burst_resp_tx_ts[k]);
+                    Da = (double)(p_tx_next - r_rx);
+                }
+                else
+                {
+                    Rb = (double)((uint32)final_rx_ts - (uint32)burst_resp_tx_ts[k]);
+                    Da = (double)(f_tx - r_rx);
+                }
+                tof_dtu[k] = (Ra * Rb - Da * Db) / (Ra + Rb + Da + Db);
+            }
+
+            tof = burst_average(tof_dtu, n, &used) * DWT_TIME_UNITS;
+            distance = tof * SPEED_OF_LIGHT;
+            distance -= dwt_getrangebias(config.chan, distance, config.prf);
+
+            printf("%3.9e sec ", tof);
+            printf("%4.3f m corrected ", distance);
+            printf("(%d/%d exchanges)\n", used, n);
+            n = 0;
+        }
+        else
+        {
+            n = 0;
+        }
+    }
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn burst_average()
+ *
+ * @brief Robust average of the time of flight samples of a burst: the mean of the samples within BURST_MAD_K median
+ *        absolute deviations of their median (with a floor of one device time unit).
+ *
+ * @param  tof_dtu  samples, sorted on return
+ *         n  number of samples
+ *         used  set to the number of samples averaged
+ *
+ * @return  average time of flight, in device time units
+ */
+static double burst_average(double *tof_dtu, int n, int *used)
+{
+    double dev[BURST_MAX], med, lim, sum = 0;
+    int i, j;
+
+    for (i = 1; i < n; i++)
+        for (j = i; j > 0 && tof_dtu[j - 1] > tof_dtu[j]; j--)
+        {
+            double t = tof_dtu[j];
+            tof_dtu[j] = tof_dtu[j - 1];
+            tof_dtu[j - 1] = t;
+        }
+    med = (tof_dtu[(n - 1) / 2] + tof_dtu[n / 2]) / 2;
+
+    for (i = 0; i < n; i++)
+        dev[i] = fabs(tof_dtu[i] - med);
+    for (i = 1; i < n; i++)
+        for (j = i; j > 0 && dev[j - 1] > dev[j]; j--)
+        {
+            double t = dev[j];
+            dev[j] = dev[j - 1];
+            dev[j - 1] = t;
+        }
+    lim = BURST_MAD_K * 1.4826 * (dev[(n - 1) / 2] + dev[n / 2]) / 2;
+    if (lim < 1)
+        lim = 1;
+
+    *used = 0;
+    for (i = 0; i < n; i++)
+        if (fabs(tof_dtu[i] - med) <= lim)
+        {
+            sum += tof_dtu[i];
+            (*used)++;
+        }
+    return sum / *used;
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn survey_anchor()
+ *
+ * @brief Anchor survey: range every other anchor SURVEY_REPEAT times per pass, following the round robin schedule of
+ *        survey.h. Anchor 0 starts each round with a beacon; in a round every anchor has at most one partner, and the
+ *        pairs range SURVEY_CODES at a time, each on its own preamble code. The responder of each pair writes a
+ *        "SURVEY RANGE" line per range for anchor_survey. See NOTE 15 below.
+ *
+ * @param  id  ID of this anchor, 0 for the one sending the beacons
+ *         n  number of anchors
+ *         ant_delay  TX antenna delay programmed in the DW1000
+ *
+ * @return none
+ */
+static void survey_anchor(uint8 id, uint8 n, uint16 ant_delay)
+{
+    int per_pass = survey_rounds(n), rounds = per_pass * SURVEY_PASSES, round = -1;
+
+    printf("%s ANCHOR %d %016llx\n", SURVEY_LINE_TAG, id, get_eui());
+    fflush(stdout);
+
+    while (round + 1 < rounds)
+    {
+        double t0, start;
+        int peer, slot = 0;
+
+        survey_set_code(survey_codes[0]);
+        if (id == 0)
+        {
+            /* Write and send the beacon of the next round. */
+            round++;
+            survey_beacon_msg[ALL_MSG_SN_IDX] = frame_seq_nb++;
+            survey_beacon_msg[SURVEY_SRC_IDX] = id;
+            survey_beacon_msg[SURVEY_BEACON_ROUND_IDX] = (uint8) round;
+            survey_beacon_msg[SURVEY_BEACON_ROUND_IDX + 1] = (uint8) (round >> 8);
+            survey_beacon_msg[SURVEY_BEACON_ROUNDS_IDX] = (uint8) rounds;
+            survey_beacon_msg[SURVEY_BEACON_ROUNDS_IDX + 1] = (uint8) (rounds >> 8);
+            dwt_writetxdata(sizeof(survey_beacon_msg), survey_beacon_msg, 0);
+            dwt_writetxfctrl(sizeof(survey_beacon_msg), 0, 0);
+            dwt_starttx(DWT_START_TX_IMMEDIATE);
+            while (!(dwt_read32bitreg(SYS_STATUS_ID) & SYS_STATUS_TXFRS))
+            { };
+            dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_TXFRS);
+        }
+        else if (survey_wait_beacon(&round, &rounds, survey_now_ms() + SURVEY_BEACON_WAIT_MS) != 0)
+        {
+            printf("%s LOST after round %d\n", SURVEY_LINE_TAG, round);
+            return;
+        }
+        t0 = survey_now_ms();
+
+        /* Wait for the slot of this anchor's pair, on its preamble code. */
+        if ((peer = survey_partner(n, round % per_pass, id, &slot)) >= 0)
+        {
+            start = t0 + SURVEY_GUARD_MS + (slot / SURVEY_CODES) * SURVEY_SLOT_MS;
+            while (survey_now_ms() < start)
+                sleep_ms(1);
+            survey_set_code(survey_codes[slot % SURVEY_CODES]);
+
+            if (id < peer)
+            {
+                int k;
+
+                for (k = 0; k < SURVEY_REPEAT && survey_now_ms() < start + SURVEY_SLOT_MS; k++)
+                    survey_initiate(id, peer, ant_delay, start + SURVEY_SLOT_MS);
+            }
+            else
+            {
+                survey_respond(id, peer, start + SURVEY_SLOT_MS);
+                fflush(stdout);
+            }
+        }
+
+        /* Anchor 0 waits for the end of the round, guard included, before the next beacon. */
+        if (id == 0)
+        {
+            while (survey_now_ms() < t0 + survey_round_ms(n))
+                sleep_ms(1);
+        }
+    }
+
+    printf("%s DONE %d rounds\n", SURVEY_LINE_TAG, rounds);
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn survey_wait_beacon()
+ *
+ * @brief Receive until a survey beacon comes, on the current preamble code, or until end_ms.
+ *
+ * @param  round  set to the round the beacon starts
+ *         rounds  set to the number of rounds of the survey
+ *         end_ms  time to give up at, as given by survey_now_ms()
+ *
+ * @return  0 if a beacon was received, -1 otherwise
+ */
+static int survey_wait_beacon(int *round, int *rounds, double end_ms)
+{
+    uint32 frame_len;
+    uint16 timeout;
+
+    while ((timeout = survey_rx_timeout(SURVEY_BEACON_RX_TIMEOUT_UUS, end_ms)) != 0)
+    {
+        dwt_setrxtimeout(timeout);
+        dwt_rxenable(DWT_START_RX_IMMEDIATE);
+        while (!((status_reg = dwt_read32bitreg(SYS_STATUS_ID)) & (SYS_STATUS_RXFCG | SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_RX_ERR)))
+        { };
+
+        if (!(status_reg & SYS_STATUS_RXFCG))
+        {
+            dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_RX_ERR);
+            dwt_rxreset();
+            continue;
+        }
+        dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_RXFCG);
+
+        frame_len = dwt_read32bitreg(RX_FINFO_ID) & RX_FINFO_RXFL_MASK_1023;
+        if (frame_len != sizeof(survey_beacon_msg) || frame_len > RESP_RX_BUF_LEN)
+            continue;
+        dwt_readrxdata(rx_buffer_resp, frame_len, 0);
+        if (rx_buffer_resp[SURVEY_FUNC_IDX] != survey_beacon_msg[SURVEY_FUNC_IDX] || rx_buffer_resp[SURVEY_SRC_IDX] != 0)
+            continue;
+
+        *round = rx_buffer_resp[SURVEY_BEACON_ROUND_IDX] | (rx_buffer_resp[SURVEY_BEACON_ROUND_IDX + 1] << 8);
+        *rounds = rx_buffer_resp[SURVEY_BEACON_ROUNDS_IDX] | (rx_buffer_resp[SURVEY_BEACON_ROUNDS_IDX + 1] << 8);
+        return 0;
+    }
+    return -1;
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn survey_initiate()
+ *
+ * @brief One DS TWR exchange with peer as the initiator: poll, response, and the final message carrying the timestamps,
+ *        from which the responder computes the range.
+ *
+ * @param  id  ID of this anchor
+ *         peer  ID of the responder
+ *         ant_delay  TX antenna delay programmed in the DW1000, added to the predicted final TX timestamp
+ *         end_ms  end of the slot, as given by survey_now_ms()
+ *
+ * @return  0 if the final message was sent, -1 otherwise
+ */
+static int survey_initiate(uint8 id, uint8 peer, uint16 ant_delay, double end_ms)
+{
+    uint8 expect[ALL_MSG_COMMON_LEN];
+    uint32 frame_len, final_tx_time;
+    uint16 timeout;
+
+    if ((timeout = survey_rx_timeout(RESP_RX_TIMEOUT_UUS, end_ms)) == 0)
+        return -1;
+    dwt_setrxaftertxdelay(POLL_TX_TO_RESP_RX_DLY_UUS);
+    dwt_setrxtimeout(timeout);
+
+    survey_address(survey_poll_msg, peer, id);
+    survey_poll_msg[ALL_MSG_SN_IDX] = frame_seq_nb++;
+    dwt_writetxdata(sizeof(survey_poll_msg), survey_poll_msg, 0);
+    dwt_writetxfctrl(sizeof(survey_poll_msg), 0, 1);
+    dwt_starttx(DWT_START_TX_IMMEDIATE | DWT_RESPONSE_EXPECTED);
+
+    while (!((status_reg = dwt_read32bitreg(SYS_STATUS_ID)) & (SYS_STATUS_RXFCG | SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_RX_ERR)))
+    { };
+
+    if (!(status_reg & SYS_STATUS_RXFCG))
+    {
+        dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_RX_ERR);
+        dwt_rxreset();
+        return -1;
+    }
+    dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_RXFCG | SYS_STATUS_TXFRS);
+
+    /* Only the response of the peer, to this anchor, goes on. */
+    frame_len = dwt_read32bitreg(RX_FINFO_ID) & RX_FINFO_RXFLEN_MASK;
+    if (frame_len > RESP_RX_BUF_LEN)
+        return -1;
+    dwt_readrxdata(rx_buffer_resp, frame_len, 0);
+    memcpy(expect, survey_resp_msg, ALL_MSG_COMMON_LEN);
+    survey_address(expect, id, peer);
+    rx_buffer_resp[ALL_MSG_SN_IDX] = expect[ALL_MSG_SN_IDX] = 0;
+    if (memcmp(rx_buffer_resp, expect, ALL_MSG_COMMON_LEN) != 0)
+        return -1;
+
+    poll_tx_ts = get_tx_timestamp_u64();
+    resp_rx_ts = get_rx_timestamp_u64();
+
+    /* Final TX time and timestamp as in the initiator. See NOTE 10 below. */
+    final_tx_time = (resp_rx_ts + (RESP_RX_TO_FINAL_TX_DLY_UUS * UUS_TO_DWT_TIME)) >> 8;
+    dwt_setdelayedtrxtime(final_tx_time);
+    final_tx_ts = (((uint64)(final_tx_time & 0xFFFFFFFEUL)) << 8) + ant_delay;
+
+    final_msg_set_ts(&survey_final_msg[FINAL_MSG_POLL_TX_TS_IDX], poll_tx_ts);
+    final_msg_set_ts(&survey_final_msg[FINAL_MSG_RESP_RX_TS_IDX], resp_rx_ts);
+    final_msg_set_ts(&survey_final_msg[FINAL_MSG_FINAL_TX_TS_IDX], final_tx_ts);
+
+    survey_address(survey_final_msg, peer, id);
+    survey_final_msg[ALL_MSG_SN_IDX] = frame_seq_nb;
+    dwt_writetxdata(sizeof(survey_final_msg), survey_final_msg, 0);
+    dwt_writetxfctrl(sizeof(survey_final_msg), 0, 1);
+    if (dwt_starttx(DWT_START_TX_DELAYED) != DWT_SUCCESS)
+        return -1;
+
+    while (!(dwt_read32bitreg(SYS_STATUS_ID) & SYS_STATUS_TXFRS))
+    { };
+    dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_TXFRS);
+    frame_seq_nb++;
+    return 0;
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn survey_respond()
+ *
+ * @brief Answer the DS TWR exchanges of peer until SURVEY_REPEAT ranges are measured or the slot ends, writing a
+ *        "SURVEY RANGE" line for each.
+ *
+ * @param  id  ID of this anchor
+ *         peer  ID of the initiator
+ *         end_ms  end of the slot, as given by survey_now_ms()
+ *
+ * @return  number of ranges measured
+ */
+static int survey_respond(uint8 id, uint8 peer, double end_ms)
+{
+    uint8 expect[ALL_MSG_COMMON_LEN];
+    uint32 frame_len, resp_tx_time;
+    uint16 timeout;
+    int ranges = 0;
+
+    while (ranges < SURVEY_REPEAT && (timeout = survey_rx_timeout(SURVEY_POLL_RX_TIMEOUT_UUS, end_ms)) != 0)
+    {
+        dwt_setrxtimeout(timeout);
+        dwt_rxenable(DWT_START_RX_IMMEDIATE);
+        while (!((status_reg = dwt_read32bitreg(SYS_STATUS_ID)) & (SYS_STATUS_RXFCG | SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_RX_ERR)))
+        { };
+
+        if (!(status_reg & SYS_STATUS_RXFCG))
+        {
+            dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_RX_ERR);
+            dwt_rxreset();
+            continue;
+        }
+        dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_RXFCG);
+
+        /* A poll of the peer to this anchor. */
+        frame_len = dwt_read32bitreg(RX_FINFO_ID) & RX_FINFO_RXFL_MASK_1023;
+        if (frame_len > RESP_RX_BUF_LEN)
+            continue;
+        dwt_readrxdata(rx_buffer_resp, frame_len, 0);
+        memcpy(expect, survey_poll_msg, ALL_MSG_COMMON_LEN);
+        survey_address(expect, id, peer);
+        rx_buffer_resp[ALL_MSG_SN_IDX] = expect[ALL_MSG_SN_IDX] = 0;
+        if (memcmp(rx_buffer_resp, expect, ALL_MSG_COMMON_LEN) != 0)
+            continue;
+
+        poll_rx_ts = get_rx_timestamp_u64();
+        resp_tx_time = (poll_rx_ts + (POLL_RX_TO_RESP_TX_DLY_UUS * UUS_TO_DWT_TIME)) >> 8;
+        dwt_setdelayedtrxtime(resp_tx_time);
+        dwt_setrxaftertxdelay(RESP_TX_TO_FINAL_RX_DLY_UUS);
+        if ((timeout = survey_rx_timeout(FINAL_RX_TIMEOUT_UUS, end_ms)) == 0)
+            break;
+        dwt_setrxtimeout(timeout);
+
+        survey_address(survey_resp_msg, peer, id);
+        survey_resp_msg[ALL_MSG_SN_IDX] = frame_seq_nb;
+        dwt_writetxdata(sizeof(survey_resp_msg), survey_resp_msg, 0);
+        dwt_writetxfctrl(sizeof(survey_resp_msg), 0, 1);
+        if (dwt_starttx(DWT_START_TX_DELAYED | DWT_RESPONSE_EXPECTED) == DWT_ERROR)
+            continue;
+
+        while (!((status_reg = dwt_read32bitreg(SYS_STATUS_ID)) & (SYS_STATUS_RXFCG | SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_RX_ERR)))
+        { };
+        frame_seq_nb++;
+
+        if (!(status_reg & SYS_STATUS_RXFCG))
+        {
+            dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_RX_ERR);
+            dwt_rxreset();
+            continue;
+        }
+        dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_RXFCG | SYS_STATUS_TXFRS);
+
+        /* The final message of the peer: the range, as in the responder. See NOTE 12 below. */
+        frame_len = dwt_read32bitreg(RX_FINFO_ID) & RX_FINFO_RXFLEN_MASK;
+        if (frame_len > RESP_RX_BUF_LEN)
+            continue;
+        dwt_readrxdata(rx_buffer_resp, frame_len, 0);
+        memcpy(expect, survey_final_msg, ALL_MSG_COMMON_LEN);
+        survey_address(expect, id, peer);
+        rx_buffer_resp[ALL_MSG_SN_IDX] = expect[ALL_MSG_SN_IDX] = 0;
+        if (memcmp(rx_buffer_resp, expect, ALL_MSG_COMMON_LEN) == 0)
+        {
+            uint32 poll_tx_ts, resp_rx_ts, final_tx_ts;
+            double Ra, Rb, Da, Db;
+
+            resp_tx_ts = get_tx_timestamp_u64();
+            final_rx_ts = get_rx_timestamp_u64();
+            final_msg_get_ts(&rx_buffer_resp[FINAL_MSG_POLL_TX_TS_IDX], &poll_tx_ts);
+            final_msg_get_ts(&rx_buffer_resp[FINAL_MSG_RESP_RX_TS_IDX], &resp_rx_ts);
+            final_msg_get_ts(&rx_buffer_resp[FINAL_MSG_FINAL_TX_TS_IDX], &final_tx_ts);
+
+            Ra = (double)(resp_rx_ts - poll_tx_ts);
+            Rb = (double)((uint32)final_rx_ts - (uint32)resp_tx_ts);
+            Da = (double)(final_tx_ts - resp_rx_ts);
+            Db = (double)((uint32)resp_tx_ts - (uint32)poll_rx_ts);
+            tof = (int64)((Ra * Rb - Da * Db) / (Ra + Rb + Da + Db)) * DWT_TIME_UNITS;
+            distance = tof * SPEED_OF_LIGHT;
+            distance -= dwt_getrangebias(config.chan, distance, config.prf);
+
+            printf("%s RANGE %d %d %.3f\n", SURVEY_LINE_TAG, peer, id, distance);
+            ranges++;
+        }
+    }
+    return ranges;
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn survey_rx_timeout()
+ *
+ * @brief Receive timeout cut to the time left until end_ms, so that no reception runs past the end of a slot.
+ *
+ * @param  timeout  receive timeout wanted, in UWB microseconds
+ *         end_ms  end of the slot, as given by survey_now_ms()
+ *
+ * @return  receive timeout to set, in UWB microseconds, or 0 if the slot is over (which the DW1000 would take as none)
+ */
+static uint16 survey_rx_timeout(uint16 timeout, double end_ms)
+{
+    double left = (end_ms - survey_now_ms()) * 1e3 * 499.2 / 512;
+
+    if (left < 1)
+        return 0;
+    return (left < timeout) ? (uint16) left : timeout;
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn survey_set_code()
+ *
+ * @brief Switch the TX and RX preamble codes. The LDE replica coefficient follows the code, so the whole configuration
+ *        is written again.
+ *
+ * @param  code  preamble code
+ *
+ * @return none
+ */
+static void survey_set_code(uint8 code)
+{
+    if (config.txCode == code && config.rxCode == code)
+        return;
+    config.txCode = code;
+    config.rxCode = code;
+    dwt_configure(&config);
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn survey_address()
+ *
+ * @brief Set the destination and source addresses of a survey frame to anchor IDs.
+ *
+ * @param  msg  frame
+ *         dst  ID of the destination anchor
+ *         src  ID of the source anchor
+ *
+ * @return none
+ */
+static void survey_address(uint8 *msg, uint8 dst, uint8 src)
+{
+    msg[SURVEY_DST_IDX] = dst;
+    msg[SURVEY_DST_IDX + 1] = 0;
+    msg[SURVEY_SRC_IDX] = src;
+    msg[SURVEY_SRC_IDX + 1] = 0;
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn survey_now_ms()
+ *
+ * @brief Monotonic time of the host, in milliseconds, to follow the slots of the survey.
+ *
+ * @param  none
+ *
+ * @return  time in milliseconds
+ */
+static double survey_now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec * 1e-6;
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn get_eui()
+ *
+ * @brief Get the EUI of this node: the one programmed in OTP, or one made of the part and lot IDs if there is none.
+ *
+ * @param  none
+ *
+ * @return  EUI, least significant byte first as sent over the air.
+ */
+static uint64 get_eui(void)
+{
+    uint8 eui[8];
+
+    dwt_geteui(eui);
+    if (!memcmp(eui, "\0\0\0\0\0\0\0\0", 8) || !memcmp(eui, "\xff\xff\xff\xff\xff\xff\xff\xff", 8))
+    {
+        uint32 part = dwt_getpartid(), lot = dwt_getlotid();
+        memcpy(&eui[0], &part, 4);
+        memcpy(&eui[4], &lot, 4);
+    }
+    return tdoarec_eui(eui);
+}
 
 /*! ------------------------------------------------------------------------------------------------------------------
  * @fn get_tx_timestamp_u64()
@@ -578,7 +1613,8 @@ static void final_msg_get_ts(const uint8 *ts_field, uint32 *ts)
  *
  * 1. The sum of the values is the TX to RX antenna delay, experimentally determined by a calibration process. Here we use a hard coded typical value
  *    but, in a real application, each device should have its own antenna delay properly calibrated to get the best possible precision when performing
- *    range measurements.
+ *    range measurements. Passing an ANT_DELAY of 0 loads the calibration of this device from CALSTORE_PATH (see calstore.h), falling back to the
+ *    typical value if it has none.
  * 2. The messages here are similar to those used in the DecaRanging ARM application (shipped with EVK1000 kit). They comply with the IEEE
  *    802.15.4 standard MAC data frame encoding and they are following the ISO/IEC:24730-62:2013 standard. The messages used are:
  *     - a poll message sent by the initiator to trigger the ranging exchange.
@@ -641,6 +1677,29 @@ static void final_msg_get_ts(const uint8 *ts_field, uint32 *ts)
  *     awaiting the "final" and proceed to have its receiver on ready to poll of the following exchange.
  * 13. The user is referred to DecaRanging ARM application (distributed with EVK1000 product) for additional practical example of usage, and to the
  *     DW1000 API Guide for more details on the DW1000 driver functions.
+ * 14. Passing a non-zero third argument selects single-sided TWR: a poll (function code 0xE0) and a response (0xE1) carrying the poll RX
+ *     timestamp in bytes 10 -> 13 and the response TX timestamp in bytes 14 -> 17. Plain SS-TWR is biased by the crystal offset between the two
+ *     nodes multiplied by the reply time (20 ppm over a 2.6 ms reply time is 26 ns of ToF, i.e. 7.8 m). The initiator reads the carrier integrator on
+ *     the response with dwt_readclockoffsetppm() and scales the responder's reply time by (1 - offset), which brings the accuracy in line with the
+ *     3-message DS-TWR exchange while using one frame less per range. What is left is the error of the offset estimate times the reply time, so
+ *     the responder uses its own SS_POLL_RX_TO_RESP_TX_DLY_UUS, as short as the poll payload, the response preamble and the SPI transfers allow
+ *     (the 5 ms DS-TWR reply delay would double it); raise it if the responder reports late responses.
+ * 15. A first argument of 2 runs the anchor survey (survey.h): start every anchor with its ID (0 to ANCHORS - 1, each used once) and the number of
+ *     anchors, anchor 0 last as it drives the schedule with beacons (function code 0x50, carrying the round number in bytes 10/11 and the number
+ *     of rounds in bytes 12/13, on preamble code 9). The poll, response and final messages are those of NOTE 2, with the anchor IDs as
+ *     destination and source addresses. Each round pairs every anchor with at most one other, and the pairs of a round range SURVEY_CODES at a
+ *     time on preamble codes 9 to 12, which barely see each other. The slots are timed from the beacon by the host clock, hence their generous
+ *     length, and every receive timeout is cut at the end of its slot; a round ends with SURVEY_END_GUARD_MS of silence, longer than any receive
+ *     timeout, before the next beacon. 30 anchors (435 pairs, 87 rounds of 880 ms) are surveyed SURVEY_PASSES times in about 77 s, as
+ *     anchor_survey 2 30 reports. An anchor that hears no beacon for SURVEY_BEACON_WAIT_MS writes a "SURVEY LOST" line and stops, so start anchor
+ *     0 within a minute of the others. Feed the output of all the anchors to anchor_survey to get their coordinates.
+ * 16. A fifth argument BURST (with SS 0) runs bursts of BURST pipelined DS TWR exchanges per RNG_DELAY_MS instead of one. The poll (function code
+ *     0x24) carries its index in the burst in byte 10 and the burst length in byte 11; the response is that of NOTE 2. Every poll after the first
+ *     is sent with a delayed TX at a fixed delay after the previous response, like the final message, so it also closes the previous exchange:
+ *     the K exchanges take 2K + 1 frames instead of 3K, with one host wake-up and one line of output per burst. The final message (function code
+ *     0x25) carries the burst length in byte 10, then from byte 11 the K poll TX timestamps, the K response RX timestamps and its own TX
+ *     timestamp, 4 bytes each as in NOTE 11. The responder computes the K times of flight and averages those within BURST_MAD_K median absolute
+ *     deviations of their median. With the delays used here a burst of 8 takes about 90 ms of air.
  ****************************************************************************************************************************************************/
 
 /*****************************************************************************************************************************************************
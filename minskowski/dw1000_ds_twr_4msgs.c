@@ -9,6 +9,9 @@
  *           time-stamp for the final message itself. The companion "DS TWR responder" example application works out the time-of-flight over-the-air
  *           and, thus, the estimated distance between the two devices.
  *
+ *           The fourth message this variant used to send is gone: the responder returns each range in its next response instead, so both
+ *           ends learn the range with three frames per exchange. See NOTE 14 below.
+ *
  * @attention
  *
  * Copyright 2015 (c) Decawave Ltd, Dublin, Ireland.
@@ -29,6 +32,7 @@
 #include "deca_device_api.h"
 #include "deca_regs.h"
 #include "platform.h"
+#include "calstore.h"
 
 #define DW1000_PATH 	"/dev/spidev1.0"
 
@@ -63,7 +67,7 @@ static dwt_config_t config = {
 
 /* Frames used in the ranging process. See NOTE 2 below. */
 static uint8 tx_poll_msg[] = {0x41, 0x88, 0, 0xCA, 0xDE, 'W', 'A', 'V', 'E', 0x21, 0, 0};
-static uint8 rx_resp_msg[] = {0x41, 0x88, 0, 0xCA, 0xDE, 'V', 'E', 'W', 'A', 0x10, 0x02, 0, 0, 0, 0};
+static uint8 rx_resp_msg[] = {0x41, 0x88, 0, 0xCA, 0xDE, 'V', 'E', 'W', 'A', 0x10, 0x02, 0, 0, 0, 0, 0, 0, 0, 0};
 static uint8 tx_final_msg[] = {0x41, 0x88, 0, 0xCA, 0xDE, 'W', 'A', 'V', 'E', 0x23, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
 /* Length of the common part of the message (up to and including the function code, see NOTE 2 below). */
 #define ALL_MSG_COMMON_LEN 10
@@ -73,9 +77,22 @@ static uint8 tx_final_msg[] = {0x41, 0x88, 0, 0xCA, 0xDE, 'W', 'A', 'V', 'E', 0x
 #define FINAL_MSG_RESP_RX_TS_IDX 14
 #define FINAL_MSG_FINAL_TX_TS_IDX 18
 #define FINAL_MSG_TS_LEN 4
+#define RESP_MSG_RESULT_IDX 11
+#define RESP_MSG_RESULT_SN_IDX 12
+#define RESP_MSG_RESULT_TOF_IDX 13
+#define ALL_MSG_DST_IDX 5
+#define ALL_MSG_SRC_IDX 7
 /* Frame sequence number, incremented after each transmission. */
 static uint8 frame_seq_nb = 0;
 
+/* The last SENT_SLOTS exchanges of the initiator, oldest overwritten first, whose range it is waiting for. See NOTE 14 below. */
+#define SENT_SLOTS 4
+static struct {
+    uint8 seq;      /* Sequence number of the poll. */
+    uint8 open;     /* Set until its range comes back. */
+} sent[SENT_SLOTS];
+static int sent_next = 0;
+
 /* Buffer to store received response message.
  * Its size is adjusted to longest frame that this example code is supposed to handle. */
 #define INIT_RX_BUF_LEN 20
@@ -110,6 +127,7 @@ static uint64 final_tx_ts;
 static uint64 get_tx_timestamp_u64(void);
 static uint64 get_rx_timestamp_u64(void);
 static void final_msg_set_ts(uint8 *ts_field, uint64 ts);
+static uint16 get_short_addr(void);
 
 
 
@@ -119,7 +137,7 @@ static void final_msg_set_ts(uint8 *ts_field, uint64 ts);
 
 /* Frames used in the ranging process. See NOTE 2 below. */
 static uint8 rx_poll_msg[] = {0x41, 0x88, 0, 0xCA, 0xDE, 'W', 'A', 'V', 'E', 0x21, 0, 0};
-static uint8 tx_resp_msg[] = {0x41, 0x88, 0, 0xCA, 0xDE, 'V', 'E', 'W', 'A', 0x10, 0x02, 0, 0, 0, 0};
+static uint8 tx_resp_msg[] = {0x41, 0x88, 0, 0xCA, 0xDE, 'V', 'E', 'W', 'A', 0x10, 0x02, 0, 0, 0, 0, 0, 0, 0, 0};
 static uint8 rx_final_msg[] = {0x41, 0x88, 0, 0xCA, 0xDE, 'W', 'A', 'V', 'E', 0x23, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
 
 /* Buffer to store received messages.
@@ -153,8 +171,19 @@ static double distance;
 /* String used to display measured distance on LCD screen (16 characters maximum). */
 char dist_str[16] = {0};
 
+/* Ranges computed by the responder, waiting to go back in the next response to their initiator. See NOTE 14 below. */
+#define PENDING_PEERS 8
+typedef struct {
+    uint16 peer;    /* Source address of the initiator. */
+    uint8 valid;    /* Set while the range has not been sent. */
+    uint8 seq;      /* Sequence number of the poll of its exchange. */
+    int32 tof_dtu;  /* Time of flight, in device time units. */
+} pending_t;
+static pending_t pending[PENDING_PEERS];
+
 /* Declaration of static functions. */
 static void final_msg_get_ts(const uint8 *ts_field, uint32 *ts);
+static pending_t *pending_find(uint16 peer);
 
 /*! ------------------------------------------------------------------------------------------------------------------
  * @fn main()
@@ -201,9 +230,17 @@ int main(int argc, char* argv[])
     /* Configure DW1000. See NOTE 7 below. */
     dwt_configure(&config);
 
-    /* Apply default antenna delay value. See NOTE 1 below. */
-    dwt_setrxantennadelay(ant_delay);
-    dwt_settxantennadelay(ant_delay);
+    /* Apply antenna delay value. An ANT_DELAY of 0 takes it, and the crystal trim, from the calibration store. See NOTE 1 below. */
+    if(ant_delay == 0)
+    {
+    	ant_delay = calstore_apply(calstore_load(CALSTORE_PATH), config.chan, config.prf, TX_ANT_DLY);
+    	printf("ANT_DELAY %d\n", ant_delay);
+    }
+    else
+    {
+    	dwt_setrxantennadelay(ant_delay);
+    	dwt_settxantennadelay(ant_delay);
+    }
 
     /* Set expected response's delay and timeout. See NOTE 4, 5 and 6 below.
      * As this example only handles one incoming frame with always the same delay and timeout, those values can be set here once for all. */
@@ -212,7 +249,13 @@ int main(int argc, char* argv[])
     // Run INITIATOR program
     if(!isRESP)
     {
-    	printf("Starting INITIATOR\n");
+    	uint16 addr = get_short_addr();
+    	int k;
+
+    	/* This initiator's own address, as the source of its frames and the destination of the responses. See NOTE 3 below. */
+    	printf("Starting INITIATOR %04x\n", addr);
+    	tx_poll_msg[ALL_MSG_SRC_IDX] = tx_final_msg[ALL_MSG_SRC_IDX] = rx_resp_msg[ALL_MSG_DST_IDX] = (uint8)addr;
+    	tx_poll_msg[ALL_MSG_SRC_IDX + 1] = tx_final_msg[ALL_MSG_SRC_IDX + 1] = rx_resp_msg[ALL_MSG_DST_IDX + 1] = (uint8)(addr >> 8);
 
 	    /* INITIATOR ONLY */
 	    /* Set expected response's delay and timeout. See NOTE 4, 5 and 6 below.
@@ -234,6 +277,9 @@ int main(int argc, char* argv[])
 
 	        /* Write frame data to DW1000 and prepare transmission. See NOTE 8 below. */
 	        tx_poll_msg[ALL_MSG_SN_IDX] = frame_seq_nb;
+	        sent[sent_next].seq = frame_seq_nb;
+	        sent[sent_next].open = 1;
+	        sent_next = (sent_next + 1) % SENT_SLOTS;
 	        dwt_writetxdata(sizeof(tx_poll_msg), tx_poll_msg, 0); /* Zero offset in TX buffer. */
 	        dwt_writetxfctrl(sizeof(tx_poll_msg), 0, 1); /* Zero offset in TX buffer, ranging. */
 			if (dwt_starttx(DWT_START_TX_IMMEDIATE | DWT_RESPONSE_EXPECTED) == DWT_ERROR)
@@ -307,6 +353,26 @@ int main(int argc, char* argv[])
             resp_rx_ts = get_rx_timestamp_u64();
         	printf("Message 2 received\n");
 
+        	/* The response carries the range of an earlier exchange, if the responder has one. See NOTE 14 below. */
+        	if (rx_buffer_init[RESP_MSG_RESULT_IDX])
+        	{
+        		uint8 seq = rx_buffer_init[RESP_MSG_RESULT_SN_IDX];
+        		uint32 tof_32;
+
+        		final_msg_get_ts(&rx_buffer_init[RESP_MSG_RESULT_TOF_IDX], &tof_32);
+        		for (k = 0; k < SENT_SLOTS; k++)
+        		{
+        			if (sent[k].open && sent[k].seq == seq)
+        			{
+        				sent[k].open = 0;
+        				tof = (int32)tof_32 * DWT_TIME_UNITS;
+        				distance = tof * SPEED_OF_LIGHT;
+        				distance -= dwt_getrangebias(config.chan, distance, config.prf);
+        				printf("Range of exchange %d: %3.9e sec %4.3f m %4.3f m corrected\n", seq, tof, tof*299792458.0*0.84, distance);
+        			}
+        		}
+        	}
+
 
 
 
@@ -321,9 +387,10 @@ int main(int argc, char* argv[])
 
             /* Compute final message transmission time. See NOTE 10 below. */
             final_tx_time = (resp_rx_ts + (RESP_RX_TO_FINAL_TX_DLY_UUS * UUS_TO_DWT_TIME)) >> 8;
+            dwt_setdelayedtrxtime(final_tx_time);
 
             /* Final TX timestamp is the transmission time we programmed plus the TX antenna delay. */
-            final_tx_ts = (((uint64)(final_tx_time & 0xFFFFFFFEUL)) << 8) + TX_ANT_DLY;
+            final_tx_ts = (((uint64)(final_tx_time & 0xFFFFFFFEUL)) << 8) + ant_delay;
 
             /* Write all timestamps in the final message. See NOTE 11 below. */
             final_msg_set_ts(&tx_final_msg[FINAL_MSG_POLL_TX_TS_IDX], poll_tx_ts);
@@ -334,7 +401,7 @@ int main(int argc, char* argv[])
             tx_final_msg[ALL_MSG_SN_IDX] = frame_seq_nb;
             dwt_writetxdata(sizeof(tx_final_msg), tx_final_msg, 0); /* Zero offset in TX buffer. */
             dwt_writetxfctrl(sizeof(tx_final_msg), 0, 1); /* Zero offset in TX buffer, ranging. */
-            ret = dwt_starttx(DWT_START_TX_IMMEDIATE);
+            ret = dwt_starttx(DWT_START_TX_DELAYED);
 
             /* If dwt_starttx() returns an error, abandon this ranging exchange and proceed to the next one. See NOTE 12 below. */
             if (ret == DWT_ERROR)
@@ -348,8 +415,6 @@ int main(int argc, char* argv[])
 	        /* Poll DW1000 until TX frame sent event set. See NOTE 9 below. */
             while (!(dwt_read32bitreg(SYS_STATUS_ID) & SYS_STATUS_TXFRS))
             { };
-        	/* Get the transmitted timestamp */
-	        final_tx_ts = get_tx_timestamp_u64();
         	printf("Message 3 sent\n");
 
             /* Clear TXFRS event. */
@@ -366,47 +431,6 @@ int main(int argc, char* argv[])
 
 
 
-        	// TRANSMISSION OF MESSAGE 4
-            usleep(100);
-            /* Write all timestamps in the final message. See NOTE 11 below. */
-            final_msg_set_ts(&tx_final_msg[FINAL_MSG_POLL_TX_TS_IDX], poll_tx_ts);
-            final_msg_set_ts(&tx_final_msg[FINAL_MSG_RESP_RX_TS_IDX], resp_rx_ts);
-            final_msg_set_ts(&tx_final_msg[FINAL_MSG_FINAL_TX_TS_IDX], final_tx_ts);
-
-            /* Write and send final message. See NOTE 8 below. */
-            tx_final_msg[ALL_MSG_SN_IDX] = frame_seq_nb;
-            dwt_writetxdata(sizeof(tx_final_msg), tx_final_msg, 0); /* Zero offset in TX buffer. */
-            dwt_writetxfctrl(sizeof(tx_final_msg), 0, 1); /* Zero offset in TX buffer, ranging. */
-            ret = dwt_starttx(DWT_START_TX_IMMEDIATE);
-
-            /* If dwt_starttx() returns an error, abandon this ranging exchange and proceed to the next one. See NOTE 12 below. */
-            /* If dwt_starttx() returns an error, abandon this ranging exchange and proceed to the next one. See NOTE 12 below. */
-            if (ret == DWT_ERROR)
-	        {
-	            /* Print a row of zeros */
-	            printf("Send Message 4 - FAIL!\n");
-	            /* Execute a delay between ranging exchanges. */
-	        	sleep_ms(RNG_DELAY_MS);
-	            continue;
-	        }
-
-            /* Poll DW1000 until TX frame sent event set. See NOTE 9 below. */
-            while (!(dwt_read32bitreg(SYS_STATUS_ID) & SYS_STATUS_TXFRS))
-            { };
-
-        	printf("Transmission 4 sent\n");
-
-            /* Clear TXFRS event. */
-            dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_TXFRS);
-
-            /* Increment frame sequence number after transmission of the final message (modulo 256). */
-            frame_seq_nb++;
-
-
-
-
-	        
-
 	        /* Execute a delay between ranging exchanges. */
 	        sleep_ms(RNG_DELAY_MS);
 	    }
@@ -464,14 +488,20 @@ int main(int argc, char* argv[])
                 dwt_readrxdata(rx_buffer_resp, frame_len, 0);
             }
 
-            /* Check that the frame is a poll sent by "DS TWR initiator" example.
-             * As the sequence number field of the frame is not relevant, it is cleared to simplify the validation of the frame. */
+            /* Check that the frame is a poll sent by "DS TWR initiator" example, from any initiator.
+             * The sequence number and the source address identify the exchange for the range sent back later. See NOTE 14 below. */
+            uint8 poll_seq = rx_buffer_resp[ALL_MSG_SN_IDX];
+            uint16 peer = rx_buffer_resp[ALL_MSG_SRC_IDX] | (rx_buffer_resp[ALL_MSG_SRC_IDX + 1] << 8);
+            pending_t *pend;
             rx_buffer_resp[ALL_MSG_SN_IDX] = 0;
+            rx_poll_msg[ALL_MSG_SRC_IDX] = rx_final_msg[ALL_MSG_SRC_IDX] = tx_resp_msg[ALL_MSG_DST_IDX] = (uint8)peer;
+            rx_poll_msg[ALL_MSG_SRC_IDX + 1] = rx_final_msg[ALL_MSG_SRC_IDX + 1] = tx_resp_msg[ALL_MSG_DST_IDX + 1] = (uint8)(peer >> 8);
             if (memcmp(rx_buffer_resp, rx_poll_msg, ALL_MSG_COMMON_LEN) != 0)
             {
             	printf("Incorrect Message 1\n");
             	continue;
             }
+            pend = pending_find(peer);
 
             /* Retrieve poll reception timestamp. */
             poll_rx_ts = get_rx_timestamp_u64();
@@ -499,6 +529,12 @@ int main(int argc, char* argv[])
             dwt_setrxaftertxdelay(RESP_TX_TO_FINAL_RX_DLY_UUS);
             dwt_setrxtimeout(FINAL_RX_TIMEOUT_UUS);
 
+            /* Return the range of the previous exchange with this initiator, if any. See NOTE 14 below. */
+            tx_resp_msg[RESP_MSG_RESULT_IDX] = pend->valid;
+            tx_resp_msg[RESP_MSG_RESULT_SN_IDX] = pend->seq;
+            final_msg_set_ts(&tx_resp_msg[RESP_MSG_RESULT_TOF_IDX], (uint32)pend->tof_dtu);
+            pend->valid = 0;
+
             /* Write and send the response message. See NOTE 10 below.*/
             tx_resp_msg[ALL_MSG_SN_IDX] = frame_seq_nb;
             dwt_writetxdata(sizeof(tx_resp_msg), tx_resp_msg, 0); /* Zero offset in TX buffer. */
@@ -560,7 +596,7 @@ int main(int argc, char* argv[])
                 dwt_readrxdata(rx_buffer_resp, frame_len, 0);
             }
 
-            /* Check that the frame is a final message sent by "DS TWR initiator" example.
+            /* Check that the frame is a final message sent by "DS TWR initiator" example, from the initiator of the poll.
              * As the sequence number field of the frame is not used in this example, it can be zeroed to ease the validation of the frame. */
             rx_buffer_resp[ALL_MSG_SN_IDX] = 0;
             if (memcmp(rx_buffer_resp, rx_final_msg, ALL_MSG_COMMON_LEN) != 0)
@@ -571,64 +607,6 @@ int main(int argc, char* argv[])
             final_rx_ts = get_rx_timestamp_u64();
         	printf("Message 3 received\n");
 
-
-
-
-
-
-
-
-
-
-            // RECEPTION OF MESSAGE 4
-
-	        /* Clear reception timeout to start next ranging process. */
-	        dwt_setrxtimeout(0);
-
-	        /* Activate reception immediately. */
-	        dwt_rxenable(DWT_START_RX_IMMEDIATE);
-            
-
-            /* Poll for reception of expected "final" frame or error/timeout. See NOTE 8 below. */
-            while (!((status_reg = dwt_read32bitreg(SYS_STATUS_ID)) & (SYS_STATUS_RXFCG | SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_RX_ERR)))
-            { };
-
-            /* Increment frame sequence number after transmission of the response message (modulo 256). */
-            frame_seq_nb++;
-
-            if ((status_reg & SYS_STATUS_RXFCG) == 0)
-	    	{
-	    		printf("Failed to receive Message 4\n");
-	    		/* Clear RX error/timeout events in the DW1000 status register. */
-                dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_RX_ERR);
-
-                /* Reset RX to properly reinitialise LDE operation. */
-                dwt_rxreset();
-
-	            continue;
-	    	}
-
-            /* Clear good RX frame event and TX frame sent in the DW1000 status register. */
-            dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_RXFCG | SYS_STATUS_TXFRS);
-
-            /* A frame has been received, read it into the local buffer. */
-            frame_len = dwt_read32bitreg(RX_FINFO_ID) & RX_FINFO_RXFLEN_MASK;
-            if (frame_len <= RESP_RX_BUF_LEN)
-            {
-                dwt_readrxdata(rx_buffer_resp, frame_len, 0);
-            }
-
-            /* Check that the frame is a final message sent by "DS TWR initiator" example.
-             * As the sequence number field of the frame is not used in this example, it can be zeroed to ease the validation of the frame. */
-            rx_buffer_resp[ALL_MSG_SN_IDX] = 0;
-            if (memcmp(rx_buffer_resp, rx_final_msg, ALL_MSG_COMMON_LEN) != 0)
-            {
-            	printf("Incorrect Message 4\n");
-            	continue;
-            }
-        	printf("Message 4 received\n");
-
-        	
             uint32 poll_tx_ts, resp_rx_ts, final_tx_ts;
             uint32 poll_rx_ts_32, resp_tx_ts_32, final_rx_ts_32;
             double Ra, Rb, Da, Db;
@@ -651,9 +629,16 @@ int main(int argc, char* argv[])
 
             tof = tof_dtu * DWT_TIME_UNITS;
             distance = tof * SPEED_OF_LIGHT;
+            distance -= dwt_getrangebias(config.chan, distance, config.prf);
 
             printf("%3.9e sec ", tof);
-            printf("%4.3f m\n", tof*299792458.0*0.84);
+            printf("%4.3f m ", tof*299792458.0*0.84);
+            printf("%4.3f m corrected\n", distance);
+
+            /* Keep the range for the next response to this initiator. */
+            pend->tof_dtu = (int32)tof_dtu;
+            pend->seq = poll_seq;
+            pend->valid = 1;
 
             /* Display computed distance on LCD. */
             // sprintf(dist_str, "DIST: %3.2f m", distance);
@@ -668,6 +653,63 @@ int main(int argc, char* argv[])
 
 
 
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn pending_find()
+ *
+ * @brief Find the range waiting for an initiator, or take a free entry (the first one when all are taken) for it.
+ *
+ * @param  peer  source address of the initiator
+ *
+ * @return  entry of the initiator
+ */
+static pending_t *pending_find(uint16 peer)
+{
+    pending_t *free_entry = NULL;
+    int i;
+
+    for (i = 0; i < PENDING_PEERS; i++)
+    {
+        if (pending[i].valid && pending[i].peer == peer)
+            return &pending[i];
+        if (free_entry == NULL && !pending[i].valid)
+            free_entry = &pending[i];
+    }
+    if (free_entry == NULL)
+        free_entry = &pending[0];
+
+    memset(free_entry, 0, sizeof(*free_entry));
+    free_entry->peer = peer;
+    return free_entry;
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn get_short_addr()
+ *
+ * @brief Get the 16-bit address of this node, folded from its EUI: the one programmed in OTP, or one made of the part and
+ *        lot IDs if there is none (as in dw1000_tdoa). See NOTE 3 below.
+ *
+ * @param  none
+ *
+ * @return  address, never the broadcast one
+ */
+static uint16 get_short_addr(void)
+{
+    uint8 eui[8];
+    uint16 addr = 0;
+    int i;
+
+    dwt_geteui(eui);
+    if (!memcmp(eui, "\0\0\0\0\0\0\0\0", 8) || !memcmp(eui, "\xff\xff\xff\xff\xff\xff\xff\xff", 8))
+    {
+        uint32 part = dwt_getpartid(), lot = dwt_getlotid();
+        memcpy(&eui[0], &part, 4);
+        memcpy(&eui[4], &lot, 4);
+    }
+    for (i = 0; i < 8; i += 2)
+        addr ^= eui[i] | (eui[i + 1] << 8);
+    return (addr == 0xFFFF) ? 0xFFFE : addr;
+}
+
 /*! ------------------------------------------------------------------------------------------------------------------
  * @fn get_tx_timestamp_u64()
  *
@@ -773,7 +815,8 @@ static void final_msg_get_ts(const uint8 *ts_field, uint32 *ts)
  *
  * 1. The sum of the values is the TX to RX antenna delay, experimentally determined by a calibration process. Here we use a hard coded typical value
  *    but, in a real application, each device should have its own antenna delay properly calibrated to get the best possible precision when performing
- *    range measurements.
+ *    range measurements. Passing an ANT_DELAY of 0 loads the calibration of this device from CALSTORE_PATH (see calstore.h), falling back to the
+ *    typical value if it has none.
  * 2. The messages here are similar to those used in the DecaRanging ARM application (shipped with EVK1000 kit). They comply with the IEEE
  *    802.15.4 standard MAC data frame encoding and they are following the ISO/IEC:24730-62:2013 standard. The messages used are:
  *     - a poll message sent by the initiator to trigger the ranging exchange.
@@ -792,7 +835,9 @@ static void final_msg_get_ts(const uint8 *ts_field, uint32 *ts)
  *     - no more data
  *    Response message:
  *     - byte 10: activity code (0x02 to tell the initiator to go on with the ranging exchange).
- *     - byte 11/12: activity parameter, not used here for activity code 0x02.
+ *     - byte 11: 1 if the rest of the message carries the range of an earlier exchange, see NOTE 14 below.
+ *     - byte 12: sequence number of the poll of that exchange.
+ *     - byte 13 -> 16: its time-of-flight, in device time units (signed, least significant byte first).
  *    Final message:
  *     - byte 10 -> 13: poll message transmission timestamp.
  *     - byte 14 -> 17: response message reception timestamp.
@@ -800,7 +845,9 @@ static void final_msg_get_ts(const uint8 *ts_field, uint32 *ts)
  *    All messages end with a 2-byte checksum automatically set by DW1000.
  * 3. Source and destination addresses are hard coded constants in this example to keep it simple but for a real product every device should have a
  *    unique ID. Here, 16-bit addressing is used to keep the messages as short as possible but, in an actual application, this should be done only
- *    after an exchange of specific messages used to define those short addresses for each device participating to the ranging exchange.
+ *    after an exchange of specific messages used to define those short addresses for each device participating to the ranging exchange. The
+ *    responder keeps the constant "WA", but each initiator folds its EUI into its own address (get_short_addr()), so that the responder can tell
+ *    the initiators sharing it apart and answer each at its address.
  * 4. Delays between frames have been chosen here to ensure proper synchronisation of transmission and reception of the frames between the initiator
  *    and the responder and to ensure a correct accuracy of the computed distance. The user is referred to DecaRanging ARM Source Code Guide for more
  *    details about the timings involved in the ranging process.
@@ -836,6 +883,11 @@ static void final_msg_get_ts(const uint8 *ts_field, uint32 *ts)
  *     awaiting the "final" and proceed to have its receiver on ready to poll of the following exchange.
  * 13. The user is referred to DecaRanging ARM application (distributed with EVK1000 product) for additional practical example of usage, and to the
  *     DW1000 API Guide for more details on the DW1000 driver functions.
+ * 14. This example used to send a fourth message, from the initiator, only to give the responder the actual TX timestamp of the final, read back
+ *     after an immediate transmission. The final is now a delayed transmission (see NOTE 10 of the initiator) whose timestamp is known
+ *     before it goes, so three messages are enough for the responder, and the range it computes goes back to the initiator in its next response
+ *     (bytes 11 to 16), one exchange late, instead of costing another frame. The responder keeps one range per initiator, by the source address
+ *     of a valid poll; the initiator matches it by sequence number to one of its last SENT_SLOTS polls, and drops it if that poll is older.
  ****************************************************************************************************************************************************/
 
 /*****************************************************************************************************************************************************
@@ -862,7 +914,9 @@ static void final_msg_get_ts(const uint8 *ts_field, uint32 *ts)
  *     - no more data
  *    Response message:
  *     - byte 10: activity code (0x02 to tell the initiator to go on with the ranging exchange).
- *     - byte 11/12: activity parameter, not used for activity code 0x02.
+ *     - byte 11: 1 if the rest of the message carries the range of an earlier exchange, see NOTE 14 below.
+ *     - byte 12: sequence number of the poll of that exchange.
+ *     - byte 13 -> 16: its time-of-flight, in device time units (signed, least significant byte first).
  *    Final message:
  *     - byte 10 -> 13: poll message transmission timestamp.
  *     - byte 14 -> 17: response message reception timestamp.
@@ -870,7 +924,9 @@ static void final_msg_get_ts(const uint8 *ts_field, uint32 *ts)
  *    All messages end with a 2-byte checksum automatically set by DW1000.
  * 3. Source and destination addresses are hard coded constants in this example to keep it simple but for a real product every device should have a
  *    unique ID. Here, 16-bit addressing is used to keep the messages as short as possible but, in an actual application, this should be done only
- *    after an exchange of specific messages used to define those short addresses for each device participating to the ranging exchange.
+ *    after an exchange of specific messages used to define those short addresses for each device participating to the ranging exchange. The
+ *    responder keeps the constant "WA", but each initiator folds its EUI into its own address (get_short_addr()), so that the responder can tell
+ *    the initiators sharing it apart and answer each at its address.
  * 4. Delays between frames have been chosen here to ensure proper synchronisation of transmission and reception of the frames between the initiator
  *    and the responder and to ensure a correct accuracy of the computed distance. The user is referred to DecaRanging ARM Source Code Guide for more
  *    details about the timings involved in the ranging process.
@@ -904,4 +960,9 @@ static void final_msg_get_ts(const uint8 *ts_field, uint32 *ts)
  *     subtraction.
  * 13. The user is referred to DecaRanging ARM application (distributed with EVK1000 product) for additional practical example of usage, and to the
  *     DW1000 API Guide for more details on the DW1000 driver functions.
+ * 14. This example used to send a fourth message, from the initiator, only to give the responder the actual TX timestamp of the final, read back
+ *     after an immediate transmission. The final is now a delayed transmission (see NOTE 10 of the initiator) whose timestamp is known
+ *     before it goes, so three messages are enough for the responder, and the range it computes goes back to the initiator in its next response
+ *     (bytes 11 to 16), one exchange late, instead of costing another frame. The responder keeps one range per initiator, by the source address
+ *     of a valid poll; the initiator matches it by sequence number to one of its last SENT_SLOTS polls, and drops it if that poll is older.
  ****************************************************************************************************************************************************/
@@ -35,6 +35,7 @@
 #include "deca_device_api.h"
 #include "deca_regs.h"
 #include "platform.h"
+#include "calstore.h"
 
 // CC1200
 #include "cc1200-const.h"
@@ -47,9 +48,15 @@
 #include <sys/mman.h>
 #include <errno.h>
 #include <sys/time.h>
-#include <pruss/prussdrv.h>
-#include <pruss/pruss_intc_mapping.h>
-#include "SPI_bin.h"
+
+// PRU
+#include "pru_iq.h"
+#include "cfo.h"
+#include "xodisc.h"
+#include "syncrep.h"
+#include "clkmodel.h"
+#include "timebase.h"
+#include "hostclk.h"
 
 /******************************************************************************
  * Local Macro Declarations                                                    * 
@@ -57,29 +64,19 @@
 
 #define DW1000_PATH 	"/dev/spidev1.0"
 #define CC1200_PATH 	"/dev/spidev2.0"
+#define CC1200_IRQ_GPIO	67		/* CC1200 GPIO0 on P8.8 (GPIO2_3) */
+#define CC1200_RX_TIMEOUT_MS	50
+#define CC1200_TX_TIMEOUT_MS	50
 #define XO_PATH 		"/dev/spidev2.1"
 
 /////////////// PRU ///////////////
-#define PRU_NUM 	0
-#define OFFSET_SHAREDRAM 0		//equivalent with 0x00002000
-#define PRUSS0_SHARED_DATARAM    4
-
-struct IQSample {
-	uint8_t status0;
-	uint8_t status1;
-	uint8_t magn2;
-	uint8_t magn1;
-	uint8_t magn0;
-	uint8_t ang1;
-	uint8_t ang0;
-} iqsample;
-
-static void *sharedMem;
-static unsigned int *sharedMem_int;
-static struct IQSample *sharedMem_struct;
-
 static int num_cycles = 100;
-static int num_samples = 1000;
+static int num_samples = 1000;		// longest capture
+static int min_samples = 100;		// shortest capture
+
+/* XO offset precision aimed for by each capture, and AGC gain change taken as a new link. See NOTE 12 below. */
+#define XO_TARGET_STD_HZ	0.02
+#define AGC_CHANGE_DB		6
 
 /////////////// DW1000 ///////////////
 /* Default communication configuration. We use here EVK1000's default mode (mode 3). */
@@ -118,6 +115,33 @@ static uint8 ref_msg[] = {0x41, 0x8C, 0, 0x9A, 0x60, 0, 0, 0, 0, 0, 0, 0, 0, 'D'
 #define DATA_FRAME_SN_IDX 2
 #define DATA_FRAME_DEST_IDX 5
 
+/* In-band mode: the REF node answers the blink with a data frame carrying the sync report (see syncrep.h) instead of sending it over the CC1200.
+ * See NOTE 16 below.
+ *     - byte 0/1: frame control (0x8841 to indicate a data frame using 16-bit addressing).
+ *     - byte 2: sequence number, incremented for each new frame.
+ *     - byte 3/4: PAN ID (0xDECA).
+ *     - byte 5/6: destination address (broadcast).
+ *     - byte 7/8: source address.
+ *     - byte 9: function code (0x11 to indicate a sync report).
+ *     - byte 10 -> 27: sync report, as packed by syncrep_pack().
+ *     - byte 28/29: frame check-sum, automatically set by DW1000. */
+static uint8 report_msg[10 + SYNCREP_LEN + 2] = {0x41, 0x88, 0, 0xCA, 0xDE, 0xFF, 0xFF, 'D', 'W', 0x11};
+#define REPORT_MSG_SN_IDX 2
+#define REPORT_MSG_FUNC_IDX 9
+#define REPORT_MSG_REP_IDX 10
+#define REPORT_MSG_FUNC_CODE 0x11
+
+/* Set from the command line to send the sync report in-band */
+static int uwb_report = 0;
+
+/* UWB microsecond (uus) to device time unit (dtu, around 15.65 ps) conversion factor.
+ * 1 uus = 512 / 499.2 µs and 1 µs = 499.2 * 128 dtu. */
+#define UUS_TO_DWT_TIME 65536
+
+/* Delay from the blink RX timestamp to the report TX timestamp, in UWB microseconds. It must cover reading the blink and writing the report over
+ * SPI, and stay below RX_RESP_TO_UUS. */
+#define BLINK_RX_TO_REPORT_TX_DLY_UUS 800
+
 /* Inter-frame delay period, in milliseconds. */
 #define TX_DELAY_MS 100//0
 
@@ -129,7 +153,7 @@ static uint8 ref_msg[] = {0x41, 0x8C, 0, 0x9A, 0x60, 0, 0, 0, 0, 0, 0, 0, 0, 'D'
 
 /* Buffer to store received frame. See NOTE 4 below. */
 #define FRAME_LEN_MAX 127
-//static uint8 rx_sync_buffer[FRAME_LEN_MAX];
+static uint8 rx_sync_buffer[FRAME_LEN_MAX];
 static uint8 rx_ref_buffer[FRAME_LEN_MAX];
 
 /* Hold copy of status register state here for reference so that it can be examined at a debug breakpoint. */
@@ -157,23 +181,10 @@ extern const cc1200_rf_cfg_t CC1200_RF_CW_CFG;
 extern const cc1200_rf_cfg_t CC1200_RF_CFG;
 #define CC1200_RF_CFG cc1200_802154g_434mhz_2gfsk_50kbps
 
-#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+/* The radio switches between these two. See NOTE 13 below. */
+static const cc1200_rf_cfg_t * const cc1200_profiles[] = {&CC1200_RF_CFG, &CC1200_RF_CW_CFG};
 
-typedef struct {
-	uint8  phr;
-	uint8  len;
-	uint64 t_rx2_ts;
-	uint64 t_rx2_stc;
-	uint64 my_delta_ts; /* Diff between T_tx2 and T_rx2 timestamps (dtu) */
-	uint64 my_delta_stc; /* Diff between T_tx2 and T_rx2 system counter (dtu) */
-}cc1200_msg_t;
-
-cc1200_msg_t cc1200_msg = {
-	0x18,
-	sizeof(cc1200_msg_t),
-	0xDEAD,
-	0xBEEF
-};
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
 
 #define N_SAMPLES 200//2000
 
@@ -258,6 +269,23 @@ static int xo_init(char * path)
 	return 0;
 }
 
+/* Returns 1 if the CC1200 front end gain moved by AGC_CHANGE_DB or more since the last call. The capture must be paused. */
+static int agc_changed(void)
+{
+	static int last_gain = -1;
+	uint8_t gain;
+	int changed;
+
+	if(cc1200_read_register(CC1200_AGC_GAIN3, &gain) != 0)
+		return 1;
+	gain &= 0x7F; // AGC_FRONT_END_GAIN, 1 dB steps
+
+	changed = (last_gain < 0) || (abs(gain - last_gain) >= AGC_CHANGE_DB);
+	last_gain = gain;
+
+	return changed;
+}
+
 /* Declaration of static functions */
 uint64 get_tx_timestamp_u64(void);
 uint64 get_rx_timestamp_u64(void);
@@ -266,7 +294,9 @@ uint64 get_rx_syscount_u64(void);
 uint64 compute_offset(uint64 t_rx2, uint64 t_tx1, uint64 d);
 uint64 compute_prop_delay(uint64 t_tx1, uint64 t_rx1, uint64 d);
 double dtu_2_s(uint64 d);
+void publish_timebase(const clkmodel_t *clk, int xo_locked);
 double compare (const void * a, const void * b);
+int send_report_frame(uint16 ant_delay);
 
 // Interrupt
 static volatile int keepRunning = N_SAMPLES;
@@ -284,16 +314,27 @@ int main(int argc, char* argv[])
 	int tof_counter = 0;
 	uint8_t isREF = 0;
 	uint16_t ant_delay = 16486;//16463;//0;
+	const calstore_rec_t *cal;
+	calstore_rec_t rec;
+	xodisc_params_t xo_params;
+	xodisc_t xo_loop;
+	struct timespec last_update, now;
+	int xo_saved = 0, xo_params_saved;
+	uint32_t window = num_samples;
+	uint64_t mag, last_mag = 0;
+	clkmodel_t ref_clk;
 	
-	if(argc != 2)
+	if(argc != 2 && argc != 3)
 	{
-		printf("usage: %s REF/SYNC\n", argv[0]);
+		printf("usage: %s REF/SYNC [UWB]\n", argv[0]);
 		return 0;
 	}
-	else if(argc == 2)
+	else
 	{
 		isREF = atoi(argv[1]);
 		//ant_delay = (uint16_t) atoi(argv[2]);
+		if(argc == 3)
+			uwb_report = atoi(argv[2]);
 	}
 
 	// Register exit
@@ -321,17 +362,37 @@ int main(int argc, char* argv[])
     /* Configure DW1000. See NOTE 6 below. */
     dwt_configure(&config);
 
-    /* Apply default antenna delay value.*/
-    dwt_setrxantennadelay(ant_delay);
-    dwt_settxantennadelay(ant_delay);
+    /* Apply this device's antenna delay, crystal trim and XO DAC setpoint from the calibration store, if it has been calibrated. */
+    cal = calstore_load(CALSTORE_PATH);
+    ant_delay = calstore_apply(cal, config.chan, config.prf, ant_delay);
+    if(cal != NULL && (cal->flags & CALSTORE_HAS_XODAC))
+    {
+    	vco_ctrl = cal->xo_dac;
+    	default_tx[0] = (0x3000 + ((vco_ctrl>>12)&0xFFF)) & 0xFFFF; // DAC A
+    	default_tx[1] = (0xB000 + (vco_ctrl&0xFFF)) & 0xFFFF;		// DAC B
+    	xo_transfer(xo_fd, default_tx, default_rx, sizeof(default_tx));
+    }
+    printf("ANT_DELAY %d%s\n", ant_delay, (cal != NULL) ? "" : " (uncalibrated)");
 
     // Init CC1200
     cc1200_init(CC1200_PATH);
+    if(cc1200_profile_init(cc1200_profiles, ARRAY_SIZE(cc1200_profiles)) != 0)
+    {
+    	printf("CC1200 PROFILES FAILED\n");
+    	return -1;
+    }
 
 	// Write registers to radio
-	cc1200_write_reg_settings(CC1200_RF_CFG.register_settings, CC1200_RF_CFG.size_of_register_settings);
+	if(cc1200_profile_set(&CC1200_RF_CFG) != 0)
+	{
+		printf("CC1200 PROFILE FAILED\n");
+		return -1;
+	}
+
+	// The data configuration raises GPIO0 on each packet received with a good CRC. See NOTE 14 below.
+	if(cc1200_irq_init(CC1200_IRQ_GPIO) != 0)
+		return -1;
 
-	uint8_t rxbytes;
 	uint8_t status;
 
 	/* Testing Purpose */
@@ -346,130 +407,144 @@ int main(int argc, char* argv[])
     	dwt_setrxaftertxdelay(TX_TO_RX_DELAY_UUS);    
     	dwt_setrxtimeout(RX_RESP_TO_UUS);
 
+    	// Load the capture program once, it keeps running across sync iterations
+    	if(pru_iq_open() != 0)
+    		return -1;
+
+    	// The XO loop also runs across sync iterations, from the stored setpoint. See NOTE 11 below.
+    	xo_params_saved = (xodisc_load_params(XODISC_PATH, &xo_params) == 0);
+    	xodisc_init(&xo_loop, &xo_params, vco_ctrl);
+    	clock_gettime(CLOCK_MONOTONIC, &last_update);
+
+    	// Model of the REF clock across sync rounds. See NOTE 17 below.
+    	clkmodel_init(&ref_clk, 0);
+
+    	// Local processes read the synchronized time from shared memory. See NOTE 18 below.
+    	timebase_publish_open();
+
 	    /* Loop forever sending and receiving frames periodically. */
 	    //while (1)
 	    /* Testing Purpose */
 	    //while (samples < N_SAMPLES)
 	    while(keepRunning != 0)
 	    {	
-	    	// Reset Radio
-			cc1200_cmd_strobe(CC1200_SRES);
+	    	// Correlate the DW1000 time with the host clock, between exchanges. See NOTE 19 below.
+	    	hostclk_poll();
 
-	    	// Write registers to radio
-			cc1200_write_reg_settings(CC1200_RF_CW_CFG.register_settings, CC1200_RF_CW_CFG.size_of_register_settings);
+	    	// Switch the radio to CW, or reset it and skip this capture. See NOTE 13 below.
+			if(cc1200_profile_set(&CC1200_RF_CW_CFG) != 0)
+			{
+				printf("CC1200 CW PROFILE FAILED\n");
+				cc1200_profile_reset();
+				sleep_ms(TX_DELAY_MS);
+				continue;
+			}
 
 	    	// RX
 			cc1200_cmd_strobe(CC1200_SRX);
 
-			///////// START PRU /////////
-			unsigned int ret;
-			tpruss_intc_initdata pruss_intc_initdata = PRUSS_INTC_INITDATA;
-			
-			//Initializing PRU
-			prussdrv_init();
-			ret = prussdrv_open(PRU_EVTOUT_0);
-			if (ret){
-				printf("\tERROR: prussdrv_open open failed\n");
-				return (ret);
-			}
-
-			prussdrv_pruintc_init(&pruss_intc_initdata);
-			prussdrv_map_prumem(PRUSS0_SHARED_DATARAM, &sharedMem);
-
-			sharedMem_int = (unsigned int *) sharedMem;
-			sharedMem_int[OFFSET_SHAREDRAM + 0] = num_samples; //samples
-
-			/* Executing PRU. */
-			prussdrv_pru_write_memory(PRUSS0_PRU0_IRAM, PRU_NUM, PRUcode, sizeof(PRUcode));
+			///////// START CAPTURE /////////
+			pru_iq_start();
 
 			float fs = 45044.4;
 			float dt = 1.0 / fs;
 			float pll_mult = 433.999939 / 38.4;
-			float frange = 800.0;
 
-			int i, j = 0;
+			cfo_est_t est;
+			const struct IQSample *iq;
+			uint32_t avail, dropped;
+			int j = 0, dac, gaps = 0;
 			for(j = 0;j < num_cycles; j++)
 			{
-				if(num_samples%2 == 0)
-				{
-					num_samples++;
-				}
-
-				float nvar_x = (num_samples*num_samples - 1) * num_samples / 12.0;
-
-				prussdrv_pruintc_init(&pruss_intc_initdata);
-				sharedMem_int[OFFSET_SHAREDRAM + 0] = num_samples; //samples
-				prussdrv_pru_enable(PRU_NUM);
-
-				ret = prussdrv_pru_wait_event(PRU_EVTOUT_0);
-
-				sharedMem_struct = ( struct IQSample *) sharedMem;
-
-				// Print out AGC_GAIN3
-				uint8_t agc_gain;
-				cc1200_read_register(CC1200_AGC_GAIN3, &agc_gain);
-			
-				long unsigned int last_phase = 0;
-				int cumulative_phase = 0;
 				double cw_offset = 0.0;
 				double xo_offset = 0.0;
-				long unsigned int sum_mag = 0;
-				
-				float sum_xy = 0.0;
-				int x_i = (-(num_samples-1)) / 2;
+				double xo_std, elapsed;
 
-				for(i = 0; i < num_samples; i++) {
-					long unsigned int mag = (sharedMem_struct[i].magn0&0xff) + ((sharedMem_struct[i].magn1<<8)&0xff00) + ((sharedMem_struct[i].magn2<<16)&0x010000);
-					long unsigned int ang = (sharedMem_struct[i].ang0&0xff) + ((sharedMem_struct[i].ang1<<8)&0xff00);
-					
-					sum_mag += mag;
+				// The regression is updated as the PRU delivers the samples, a block at a time, so the estimate is ready when the last one arrives
+				dropped = pru_iq_dropped();
+				cfo_start(&est, window);
+				while(!cfo_done(&est))
+				{
+					avail = pru_iq_span(&iq);
+					pru_iq_consume(cfo_push_block(&est, iq, avail));
+				}
 
-					int dp = ang - last_phase;
-					last_phase = ang;
+				dropped = pru_iq_dropped() - dropped;
 
-					// Phase difference wrapping
-					if (dp < -512)
-						dp += 1024;
-					if (dp > 511)
-						dp -= 1024;
+				double beta = cfo_slope(&est); //dib
+				cw_offset = (beta / CFO_ANGLE_PERIOD / dt);
+				xo_offset = cw_offset / pll_mult;
+				xo_std = cfo_slope_std(&est) / CFO_ANGLE_PERIOD / dt / pll_mult;
 
-					if (i > 0)
-					{
-						cumulative_phase += dp;
+				// Size the next capture from the noise of this one, back to the longest if the link fades. See NOTE 12 below.
+				if(dropped == 0)
+				{
+					mag = est.sum_mag / est.n;
+					window = cfo_next_window(&est, XO_TARGET_STD_HZ * pll_mult * CFO_ANGLE_PERIOD * dt, min_samples, num_samples);
+					if(mag < last_mag / 2)
+						window = num_samples;
+					last_mag = mag;
+				}
 
-						sum_xy += cumulative_phase * x_i;
-						x_i++;
-					}
+				clock_gettime(CLOCK_MONOTONIC, &now);
+				elapsed = (now.tv_sec - last_update.tv_sec) + (now.tv_nsec - last_update.tv_nsec) / 1e9;
+				last_update = now;
 
+				// See NOTE 10 below
+				if(dropped != 0)
+				{
+					gaps++;
+					dac = xodisc_miss(&xo_loop, elapsed);
 				}
+				else if(cfo_residual(&est) < CFO_MAX_RESIDUAL)
+					dac = xodisc_update(&xo_loop, xo_offset, xo_std, elapsed);
+				else
+					dac = xodisc_miss(&xo_loop, elapsed);
 
-				double beta = sum_xy / (nvar_x); //dib
-				cw_offset = (beta / 1024.0 / dt);
-				xo_offset = cw_offset / pll_mult;
-				xo_offset += (2.728371123 - 0.337881717433);
-
-				if(j > 10)
+				if(dac != vco_ctrl)
 				{
-					// Compute increment value	
-					int increment = (int)(xo_offset / frange * 0xFFFFFF);
-					vco_ctrl += increment;
+					vco_ctrl = dac;
 
 					default_tx[0] = (0x3000 + ((vco_ctrl>>12)&0xFFF)) & 0xFFFF; // DAC A
 					default_tx[1] = (0xB000 + (vco_ctrl&0xFFF)) & 0xFFFF;		// DAC B
 				
+					// The XO DAC shares MCSPI1 with the capture
+					pru_iq_pause();
 					xo_transfer(xo_fd, default_tx, default_rx, sizeof(default_tx));
+					if(agc_changed())
+						window = num_samples;
+					pru_iq_start();
 				}
 
-				//printf("%d %ld %4.2f %4.9f %d %ld.%09lu\n", j, (sum_mag/num_cycles), cw_offset, xo_offset, cumulative_phase, prev_time.tv_sec, prev_time.tv_nsec);
-				//printf("%d %ld %4.2f %4.9f %d\n", j, (sum_mag/num_cycles), cw_offset, xo_offset, cumulative_phase);
-			
-				// Disable PRU
-				prussdrv_pru_disable(PRU_NUM);
+				//printf("%d %ld %4.2f %4.9f %d %ld.%09lu\n", j, (long)(est.sum_mag/num_cycles), cw_offset, xo_offset, est.phase, prev_time.tv_sec, prev_time.tv_nsec);
+				//printf("%d %ld %4.2f %4.9f %d\n", j, (long)(est.sum_mag/num_cycles), cw_offset, xo_offset, est.phase);
 
 			}
 
-			// Exit PRU
-			prussdrv_exit();
+			// Release MCSPI1 for the CC1200
+			pru_iq_pause();
+			if(gaps != 0)
+				printf("%d of %d captures dropped samples\n", gaps, num_cycles);
+			if(agc_changed())
+				window = num_samples;
+
+			// Keep the setpoint of each new lock, so that the next start is already close to it
+			if(xodisc_locked(&xo_loop) && !xo_saved)
+			{
+				if(cal != NULL)
+					rec = *cal;
+				else
+					calstore_initrec(&rec);
+				rec.xo_dac = vco_ctrl;
+				rec.flags |= CALSTORE_HAS_XODAC;
+				xo_saved = (calstore_update(CALSTORE_PATH, &rec) == 0);
+
+				// Write out the loop parameters that reached lock when there was no file to tune them in
+				if(!xo_params_saved)
+					xo_params_saved = (xodisc_save_params(XODISC_PATH, &xo_loop.p) == 0);
+			}
+			else if(!xodisc_locked(&xo_loop))
+				xo_saved = 0;
 			
 			//printf("DONE SYNC TX MSG! ");
 
@@ -493,10 +568,21 @@ int main(int argc, char* argv[])
 	        t_tx1_ts = get_tx_timestamp_u64();
 	        t_tx1_stc = get_tx_syscount_u64();
 
-	        // Stop CW and reconfigure radio for data
-	        cc1200_cmd_strobe(CC1200_SRES);
-	        cc1200_write_reg_settings(CC1200_RF_CFG.register_settings, CC1200_RF_CFG.size_of_register_settings);
-	        cc1200_cmd_strobe(CC1200_SRX);
+	        // Stop CW and reconfigure radio for data, unless the report comes in-band. Without the data configuration the report
+	        // cannot arrive: drop this sync step and reset the radio.
+	        if(!uwb_report)
+	        {
+	        	if(cc1200_profile_set(&CC1200_RF_CFG) != 0)
+	        	{
+	        		printf("CC1200 DATA PROFILE FAILED\n");
+	        		dwt_forcetrxoff();
+	        		cc1200_profile_reset();
+	        		sleep_ms(TX_DELAY_MS);
+	        		continue;
+	        	}
+	        	cc1200_cmd_strobe(CC1200_SRX);
+	        	cc1200_irq_clear();
+	        }
 
 	        /* Poll for reception of a frame or error/timeout. See NOTE 8 below. */
 	        while (!((status_reg = dwt_read32bitreg(SYS_STATUS_ID)) & (SYS_STATUS_RXFCG | SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_RX_ERR)))
@@ -529,49 +615,28 @@ int main(int argc, char* argv[])
 	            /* Clear good RX frame event in the DW1000 status register. */
 	            dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_RXFCG);
 
-    	        /* Poll for message from CC1200 that contains detla and rx timestamp */
-				uint16_t retry = 300;
+    	        /* Wait for the message from CC1200 that contains delta and rx timestamp. See NOTE 14 below. */
 				uint8_t gotMsg = 0;
-				cc1200_msg_t rx_msg = {0, };
-				for(retry = 300; retry > 0; retry--)
-				{				
-					cc1200_read_register(CC1200_MARC_STATUS1, &status);
-					if(status == CC1200_MARC_STATUS1_RX_SUCCEED)
+				syncrep_t rx_msg;
+				if(uwb_report)
+				{
+					// The response just received is the report. See NOTE 16 below.
+					frame_len = dwt_read32bitreg(RX_FINFO_ID) & RX_FINFO_RXFL_MASK_1023;
+					if(frame_len == sizeof(report_msg))
 					{
-						cc1200_read_register(CC1200_NUM_RXBYTES, &rxbytes);
-						if (rxbytes != 0)
-						{
-							cc1200_read_register(CC1200_MARCSTATE, &status);
-							if ((status & 0x1F) == CC1200_MARC_STATE_RX_FIFO_ERR)
-							{
-								cc1200_cmd_strobe(CC1200_SFRX);
-							}
-							else
-							{
-								int rx_fifo_bytes = rxbytes - 2;
-								cc1200_read_rxfifo((uint8_t *)&rx_msg, rx_fifo_bytes);
-
-								//printf("MSG Received! DATA: %02x %02x %lld %lld %lld %lld rxbytes: %d ", rx_msg.phr, rx_msg.len, rx_msg.t_rx2_ts, rx_msg.t_rx2_stc, rx_msg.my_delta_ts, rx_msg.my_delta_stc, rxbytes);
-								//printf("retry = %d\n", (250-retry));
-
-								//int i;
-								//for (i = 0; i < rx_fifo_bytes; i++)
-								//	printf("%02x ", rx_msg[i]);
-								//printf(" bytes: %d\n", rxbytes);
-
-								cc1200_cmd_strobe(CC1200_SFRX);
-
-								gotMsg = 1;
-								break;
-							}
-						}
-
-						cc1200_cmd_strobe(CC1200_SRX);
+						dwt_readrxdata(rx_sync_buffer, frame_len, 0);
+						gotMsg = (rx_sync_buffer[REPORT_MSG_FUNC_IDX] == REPORT_MSG_FUNC_CODE) &&
+								 (syncrep_unpack(&rx_sync_buffer[REPORT_MSG_REP_IDX], SYNCREP_LEN, &rx_msg) == 0);
 					}
-					// if(retry % 10 == 0)
-					// {
-					// 	printf("retry=%d.\n", retry);
-					// }
+				}
+				else if(cc1200_irq_wait(CC1200_RX_TIMEOUT_MS) > 0)
+				{
+					// The packet is complete and its CRC checked: read it in one burst. See NOTE 15 below.
+					uint8_t rx_buf[SYNCREP_LEN];
+					cc1200_read_rxfifo(rx_buf, sizeof(rx_buf));
+					cc1200_cmd_strobe(CC1200_SFRX);
+
+					gotMsg = (syncrep_unpack(rx_buf, sizeof(rx_buf), &rx_msg) == 0);
 				}
 
 				if(gotMsg)
@@ -612,9 +677,28 @@ int main(int argc, char* argv[])
 			        double epsilon = ((t_rx1_ts_p + t_tx1_ts_p) - (t_tx2_ts_p + t_rx2_ts_p));
 			        double epsilon_t = dtu_2_s(epsilon);
 
+			        /* Check the REF time the model predicted for the blink arrival against the measured one, then add this round. See NOTE 17 below. */
+			        clock_gettime(CLOCK_MONOTONIC, &now);
+			        double mono = now.tv_sec + now.tv_nsec / 1e9;
+			        uint64 t_arrival = (t_tx1_ts + Delta_ts) & SYNCREP_MASK40;
+			        uint64_t t_pred = 0;
+			        double bound = clkmodel_to_peer(&ref_clk, t_arrival, mono, &t_pred);
+			        int64 pred_err = timebase_diff40(t_pred, t_rx2_ts);
+			        clkmodel_add(&ref_clk, t_arrival, t_rx2_ts, CLKMODEL_DW_STD, mono);
+			        publish_timebase(&ref_clk, xodisc_locked(&xo_loop));
+
 			        printf("delta_ts: %lld delta_stc: %lld ", Delta_ts, Delta_stc);
 			        printf("offset: %3.9e sec ", tof);
-			        printf("range: %4.3f m epsilon: %3.9e\n", tof*299792458.0, epsilon_t-epsilon_dt);
+			        double range = tof*299792458.0;
+			        printf("range: %4.3f m corrected: %4.3f m epsilon: %3.9e", range, range - dwt_getrangebias(config.chan, range, config.prf),
+			        	   epsilon_t-epsilon_dt);
+			        hostclk_map_t hm;
+			        if(hostclk_get(&hm) == 0)
+			        	printf(" host: %lld ns", (long long)hostclk_dw_to_ns(&hm, t_rx1_ts));
+			        if(bound >= 0)
+			        	printf(" model: %+.3f ns bound: %.3f ns drift: %.4f ppm", pred_err / CLKMODEL_DTU_PER_S * 1e9, bound / CLKMODEL_DTU_PER_S * 1e9,
+			        		   clkmodel_drift(&ref_clk) * 1e6);
+			        printf("\n");
 
 			        epsilon_dt = epsilon_t;
 
@@ -638,6 +722,7 @@ int main(int argc, char* argv[])
 			        		}
 			        		tof_avg = tof_avg/(double) N_SAMPLES;
 			        		printf("\n\n\n\n%3.9e seconds or %3.9e m median \n %3.9e seconds or %3.9e m avg\n\n\n\n", tof_array[N_SAMPLES/2], tof_array[N_SAMPLES/2]*299792458.0, tof_avg, tof_avg*299792458.0);
+			        		pru_iq_close();
 			        		return 0;
 
 			        		// reset for next round
@@ -680,6 +765,9 @@ int main(int argc, char* argv[])
 
 	    }
 
+	    pru_iq_close();
+	    timebase_publish_close();
+
     } // End of SYNC program
 
     // Run REF program
@@ -689,12 +777,13 @@ int main(int argc, char* argv[])
 	    //while (1)
 	    while(keepRunning != 0)
 	    {
-	    	// Start TX CW
-	    	// Reset Radio
-			cc1200_cmd_strobe(CC1200_SRES);
-
-	    	// Write registers to radio
-			cc1200_write_reg_settings(CC1200_RF_CW_CFG.register_settings, CC1200_RF_CW_CFG.size_of_register_settings);
+	    	// Start TX CW, or reset the radio and try again
+			if(cc1200_profile_set(&CC1200_RF_CW_CFG) != 0)
+			{
+				printf("CC1200 CW PROFILE FAILED\n");
+				cc1200_profile_reset();
+				continue;
+			}
 
 			// Transmit CW
 			cc1200_cmd_strobe(CC1200_STX);
@@ -710,9 +799,15 @@ int main(int argc, char* argv[])
 
 	        if (status_reg & SYS_STATUS_RXFCG)
 	        {
-	        	// Stop CW and reconfigure radio for data
-	        	cc1200_cmd_strobe(CC1200_SRES);
-	        	cc1200_write_reg_settings(CC1200_RF_CFG.register_settings, CC1200_RF_CFG.size_of_register_settings);
+	        	// Stop CW and reconfigure radio for data, unless the report goes in-band. The report could not be sent without it:
+	        	// drop this blink and reset the radio.
+	        	if(!uwb_report && cc1200_profile_set(&CC1200_RF_CFG) != 0)
+	        	{
+	        		printf("CC1200 DATA PROFILE FAILED\n");
+	        		dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_RXFCG);
+	        		cc1200_profile_reset();
+	        		continue;
+	        	}
 
 	            /* A frame has been received, read it into the local buffer. */
 	            frame_len = dwt_read32bitreg(RX_FINFO_ID) & RX_FINFO_RXFL_MASK_1023;
@@ -739,6 +834,16 @@ int main(int argc, char* argv[])
 	                //     ref_msg[DATA_FRAME_DEST_IDX + i] = rx_ref_buffer[BLINK_FRAME_SRC_IDX + i];
 	                // }
 
+	                /* Answer with the report itself. See NOTE 16 below. */
+	                if(uwb_report)
+	                {
+	                	if(send_report_frame(ant_delay) == DWT_ERROR)
+	                		printf("0 0 0 0 TX LATE\n");
+	                	else
+	                		printf("%lld %lld %lld %lld\n", t_rx2_ts, t_rx2_stc, t_tx2_ts, t_tx2_stc);
+	                	continue;
+	                }
+
 	                /* Write response frame data to DW1000 and prepare transmission. See NOTE 6 below.*/
 	                dwt_writetxdata(sizeof(ref_msg), ref_msg, 0); /* Zero offset in TX buffer. */
 	                dwt_writetxfctrl(sizeof(ref_msg), 0, 0); /* Zero offset in TX buffer, no ranging. */
@@ -790,25 +895,25 @@ int main(int argc, char* argv[])
 						// Write data into FIFO
 						//cc1200_write_txfifo(tx_msg, sizeof(tx_msg));
 
-						cc1200_msg.phr = 0x18;
-						cc1200_msg.len = sizeof(cc1200_msg);
-						cc1200_msg.t_rx2_ts = t_rx2_ts;
-						cc1200_msg.t_rx2_stc = t_rx2_stc;
-						if(t_tx2_ts > t_rx2_ts) // no wrapping
-						{
-							cc1200_msg.my_delta_ts  = t_tx2_ts - t_rx2_ts; // this is delta in our diagram
-			        		cc1200_msg.my_delta_stc = t_tx2_stc - t_rx2_stc; // this is delta in our diagram
-						}
-						else // wrapped
+						syncrep_t rep;
+						uint8_t tx_buf[SYNCREP_LEN];
+						rep.t_rx2_ts = t_rx2_ts;
+						rep.t_rx2_stc = t_rx2_stc;
+						// The counters are 40 bits wide, so the difference taken modulo 2^40 also holds across a wrap
+						rep.my_delta_ts  = (t_tx2_ts - t_rx2_ts) & SYNCREP_MASK40; // this is delta in our diagram
+						rep.my_delta_stc = (t_tx2_stc - t_rx2_stc) & SYNCREP_MASK40; // this is delta in our diagram
+
+						// Pack the report for the side channel. See NOTE 15 below.
+						if(syncrep_pack(&rep, tx_buf) < 0)
 						{
-							cc1200_msg.my_delta_ts  = (0 - t_tx2_ts) + t_rx2_ts; // this is delta in our diagram
-			        		cc1200_msg.my_delta_stc = (0 - t_tx2_stc) + t_rx2_stc; // this is delta in our diagram	
+							printf("sync report out of range\n");
+							break;
 						}
 
-						printf("%02x %02x %lld %lld %lld %lld size: %d\n", cc1200_msg.phr, cc1200_msg.len, cc1200_msg.t_rx2_ts, cc1200_msg.t_rx2_stc, cc1200_msg.my_delta_ts, cc1200_msg.my_delta_stc, sizeof(cc1200_msg));
+						printf("%lld %lld %lld %lld size: %d\n", (long long)rep.t_rx2_ts, (long long)rep.t_rx2_stc, (long long)rep.my_delta_ts, (long long)rep.my_delta_stc, SYNCREP_LEN);
 
 						// Write data into FIFO
-						cc1200_write_txfifo((uint8_t *)&cc1200_msg, sizeof(cc1200_msg));				
+						cc1200_write_txfifo(tx_buf, sizeof(tx_buf));				
 
 						// Check status
 						cc1200_get_status(&status);
@@ -822,12 +927,19 @@ int main(int argc, char* argv[])
 						cc1200_cmd_strobe(CC1200_STX);
 
 						// Check if TX completed
+						int tx_wait_ms = 0;
 						cc1200_read_register(CC1200_MARC_STATUS1, &status);
-						while(status != CC1200_MARC_STATUS1_TX_SUCCEED)
+						while(status != CC1200_MARC_STATUS1_TX_SUCCEED && tx_wait_ms++ < CC1200_TX_TIMEOUT_MS)
 						{
 							cc1200_read_register(CC1200_MARC_STATUS1, &status);
 							usleep(1000);
 						};
+						if(status != CC1200_MARC_STATUS1_TX_SUCCEED)
+						{
+							printf("cc1200 tx timeout\n");
+							cc1200_cmd_strobe(CC1200_SFTX);
+							continue;
+						}
 
 						printf("MSG SENT! retry = %d\n", retry);
 
@@ -908,6 +1020,50 @@ uint64 compute_prop_delay(uint64 t_tx1, uint64 t_rx1, uint64 d)
 }
 
 
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn send_report_frame()
+ *
+ * @brief Answer the blink received at t_rx2 with the in-band sync report. The frame is sent with delayed TX, so its TX timestamp
+ *        and system counter (t_tx2) are known before it goes out and are part of the report it carries.
+ *
+ * @param  ant_delay - TX antenna delay programmed in the DW1000
+ *
+ * @return  DWT_SUCCESS, or DWT_ERROR if the report could not be packed or the TX time had already passed.
+ */
+int send_report_frame(uint16 ant_delay)
+{
+    syncrep_t rep;
+    uint32 tx_time;
+
+    tx_time = (t_rx2_ts + (BLINK_RX_TO_REPORT_TX_DLY_UUS * UUS_TO_DWT_TIME)) >> 8;
+    dwt_setdelayedtrxtime(tx_time);
+
+    /* The DW1000 ignores the low 9 bits of the TX time, and the TX timestamp is the transmission time plus the TX antenna delay. */
+    t_tx2_stc = ((uint64)(tx_time & 0xFFFFFFFEUL)) << 8;
+    t_tx2_ts = (t_tx2_stc + ant_delay) & SYNCREP_MASK40;
+
+    rep.t_rx2_ts = t_rx2_ts;
+    rep.t_rx2_stc = t_rx2_stc;
+    rep.my_delta_ts = (t_tx2_ts - t_rx2_ts) & SYNCREP_MASK40;
+    rep.my_delta_stc = (t_tx2_stc - t_rx2_stc) & SYNCREP_MASK40;
+    if (syncrep_pack(&rep, &report_msg[REPORT_MSG_REP_IDX]) < 0)
+        return DWT_ERROR;
+
+    dwt_writetxdata(sizeof(report_msg), report_msg, 0); /* Zero offset in TX buffer. */
+    dwt_writetxfctrl(sizeof(report_msg), 0, 0); /* Zero offset in TX buffer, no ranging. */
+    if (dwt_starttx(DWT_START_TX_DELAYED) == DWT_ERROR)
+        return DWT_ERROR;
+
+    /* Poll DW1000 until TX frame sent event set, then clear it. */
+    while (!(dwt_read32bitreg(SYS_STATUS_ID) & SYS_STATUS_TXFRS))
+    { };
+    dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_TXFRS);
+
+    /* Increment the report frame sequence number (modulo 256). */
+    report_msg[REPORT_MSG_SN_IDX]++;
+
+    return DWT_SUCCESS;
+}
 
 /*! ------------------------------------------------------------------------------------------------------------------
  * @fn get_tx_timestamp_u64()
@@ -1005,6 +1161,66 @@ uint64 get_rx_syscount_u64(void)
     return ts;
 }
 
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn publish_timebase()
+ *
+ * @brief Publish the current timebase in shared memory: the local DW1000 time against CLOCK_MONOTONIC, from the host clock
+ *        correlator, and the network (REF) time from the clock model.
+ *
+ * @param  clk       - model of the REF clock
+ * @param  xo_locked - 1 if the XO loop is locked
+ *
+ * @return  none
+ */
+void publish_timebase(const clkmodel_t *clk, int xo_locked)
+{
+    static uint64_t last_ref;
+    static int64_t ref_unw;
+    static double last_mono;
+    static uint32_t rounds = 0;
+    hostclk_map_t hm;
+    timebase_t tb;
+    struct timespec now;
+    uint64_t dw, ref;
+    double mono, bound;
+
+    /* Nothing to anchor the page to until the correlator has two samples */
+    if (hostclk_get(&hm) != 0)
+        return;
+
+    memset(&tb, 0, sizeof(tb));
+
+    dw = hm.dw0;
+    tb.host_dw = dw;
+    tb.host_ns = hm.ns0;
+    tb.host_ns_per_dtu = hm.ns_per_dtu;
+    tb.flags = TIMEBASE_HOST | (xo_locked ? TIMEBASE_XO_LOCKED : 0);
+    /* The fit anchor can be a whole correlator window old: readers judge staleness by the time of publication */
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    tb.updated_ns = now.tv_sec * 1000000000LL + now.tv_nsec;
+    mono = tb.host_ns / 1e9;
+
+    bound = clkmodel_to_peer(clk, dw, mono, &ref);
+    if (bound >= 0)
+    {
+        /* Network time keeps counting across the 40-bit wraps of the REF clock */
+        ref_unw = (rounds == 0) ? (int64_t)ref : clkmodel_unwrap(ref, last_ref, ref_unw, mono - last_mono);
+        last_ref = ref;
+        last_mono = mono;
+        rounds++;
+
+        tb.sync_dw = dw;
+        tb.sync_ns0 = timebase_dtu_to_ns(ref_unw);
+        /* Network time only depends on the DW1000 timebase and the REF drift, not on the host crystal */
+        tb.sync_ns_per_dtu = (double)TIMEBASE_DTU_NUM / TIMEBASE_DTU_DEN * (1.0 + clkmodel_drift(clk));
+        tb.sync_bound_ns = bound * TIMEBASE_DTU_NUM / TIMEBASE_DTU_DEN;
+        tb.sync_rounds = rounds;
+        tb.flags |= TIMEBASE_SYNCED;
+    }
+
+    timebase_publish(&tb);
+}
+
 double dtu_2_s(uint64 d)
 {
 	return (double)d*(1.0/499.2e6/128.0);
@@ -1041,4 +1257,53 @@ double compare (const void * a, const void * b)
  *    refer to DW1000 User Manual for more details on "interrupts".
  * 9. The user is referred to DecaRanging ARM application (distributed with EVK1000 product) for additional practical example of usage, and to the
  *    DW1000 API Guide for more details on the DW1000 driver functions.
+ * 10. The XO is only steered from captures that actually contain the CW tone. With no carrier, or a collision, the angle is noise and the phase
+ *     steps scatter over the whole circle (an RMS of about CFO_ANGLE_PERIOD / sqrt(12)); cfo_residual() measures that scatter, and a capture
+ *     above CFO_MAX_RESIDUAL is only counted as a miss by the loop, which then follows its drift estimate rather than a meaningless slope. So is
+ *     a capture during which the PRU ring overflowed (pru_iq_dropped() moved): its samples have a gap that the regression would fit across.
+ * 11. The XO loop (xodisc.c) is a Kalman filter on the XO offset and drift driving the DAC. It removes the whole estimated offset until it locks,
+ *     which takes a few captures instead of the num_cycles the former proportional step needed, then tracks with the loop bandwidth set in
+ *     XODISC_PATH along with the DAC gain and the measurement bias (the CC1200 offset to the reference). The file is optional and the defaults
+ *     match the former constants; without it, the parameters in use are written there at the first lock, ready to be tuned for the node.
+ * 12. The capture length adapts to the link. The slope standard deviation of a capture of n samples is about sqrt(6) * s / n^1.5 for a phase step
+ *     scatter s, so the scatter of each capture gives the length the next one needs to reach XO_TARGET_STD_HZ, between min_samples and
+ *     num_samples: a strong link syncs with short captures, a weak one with long ones. As that only holds while the link is unchanged, the next
+ *     capture goes back to num_samples when the magnitude halves, or when the AGC gain, which can only be read while the capture is paused (at
+ *     each DAC update and at the end of the sync), moves by AGC_CHANGE_DB.
+ * 13. The CW and data configurations only differ in a few registers. cc1200_profile_init() works out those differences once, and switching
+ *     between the two is an SIDLE strobe, a FIFO flush and a single burst message with the differing registers, instead of an SRES, which
+ *     brings the whole chip back to its power-up state, followed by the whole table. The registers either configuration leaves at their reset
+ *     value are read from the chip at start-up, so the result is the same as the reset and full write. If a switch fails (the chip does not
+ *     reach IDLE), the chip is reset with cc1200_profile_reset(), which waits for it to be ready again, and the CW capture or the sync step in
+ *     progress is dropped; the next switch starts from the reset state.
+ * 14. The data configuration routes PKT_CRC_OK to the CC1200 GPIO0 pin, wired to P8.8, so the sync node sleeps in poll() on the rising edge of
+ *     that pin instead of polling MARC_STATUS1 and NUM_RXBYTES over SPI. The edge only comes once a whole packet has passed its CRC check,
+ *     so the message is then read from the RX FIFO in a single burst. Any edge left from before the receiver was started is cleared right
+ *     after SRX.
+ * 15. The sync report is packed by syncrep.c, shared by both sides, rather than sent as an in-memory struct: 40-bit values travel as 5 bytes,
+ *     the system counter values as their signed 24-bit difference to the matching timestamp, and a version byte guards the layout. The
+ *     frame starts with the length byte the CC1200 expects in variable packet length mode and leaves the CRC to the radio, which appends
+ *     and checks one. It is 18 bytes instead of 40 (with padding), which more than halves the CC1200 airtime of each sync round at 50 kbps.
+ * 16. With a second argument of 1 on both nodes, the REF node answers the blink with report_msg over UWB instead of ref_msg followed by the CC1200
+ *     report. The report frame is sent with delayed TX BLINK_RX_TO_REPORT_TX_DLY_UUS after the blink was received, so its own TX timestamp and
+ *     system counter are computed before it is sent and carried in it: the SYNC node timestamps the very frame it reads the report from. A sync
+ *     round is then a blink and a 30-byte frame at 6.8 Mbps, under a millisecond, instead of tens of milliseconds for the CC1200 profile switch
+ *     and 50 kbps packet, and the CC1200 stays in CW on both nodes, so the CFO captures are not interrupted by data exchanges. If the REF node
+ *     is too slow to meet the TX time, dwt_starttx() fails and the round is dropped; BLINK_RX_TO_REPORT_TX_DLY_UUS may then need to be raised.
+ * 17. Each round gives the REF time (t_rx2) at a known local time (t_tx1 plus the propagation delay). clkmodel.c fits the offset between the
+ *     two clocks against local time over the last rounds, weighting older rounds less, so the REF time can be worked out at any local instant
+ *     between rounds along with a bound on its error. The model is queried for the blink arrival before each new round is added, and the
+ *     difference printed next to its bound: as long as it stays within it, the sync rate (TX_DELAY_MS) can be lowered to match the accuracy
+ *     needed rather than every timestamp requiring a fresh round.
+ * 18. After each round the SYNC node publishes its timebase in the shared memory page TIMEBASE_SHM_NAME (see timebase.h): the local DW1000 time
+ *     against CLOCK_MONOTONIC (see NOTE 19), the network time (the REF clock, unwrapped, in ns) from the clock model with its error bound, and
+ *     the XO lock state. Other processes on the board include timebase.h, map the page once and convert their DW1000 or CLOCK_MONOTONIC times
+ *     with a consistent copy of it, without a syscall or parsing this program's output. The page is guarded by a sequence lock, so a reader never
+ *     waits for more than the few hundred nanoseconds of an update and the publisher never waits at all.
+ * 19. DW1000 timestamps are in the 40-bit device timebase, which wraps every 17.2 s and has nothing to do with the host clock. At the top of
+ *     each sync iteration, at most every HOSTCLK_PERIOD_MS, hostclk.c reads the DW1000 system time between two CLOCK_MONOTONIC reads, keeps
+ *     the narrowest of a burst of such brackets, and fits a line through the last samples, unrolling the device time across its wraps. Each
+ *     range line carries the host time of the blink reception from that fit ("host:"), so it can be matched with IMU or other host timestamped
+ *     data. The samples are taken from this loop rather than from a thread of their own, so that their SPI transfers never land between a
+ *     reception and the transmission timed from it.
  ****************************************************************************************************************************************************/
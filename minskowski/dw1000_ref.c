@@ -20,10 +20,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <string.h>
 
 #include "deca_device_api.h"
 #include "deca_regs.h"
 #include "platform.h"
+#include "syncbcast.h"
 
 #define SPI_PATH    "/dev/spidev1.0"
 
@@ -62,10 +64,20 @@ static uint8 tx_msg[] = {0x41, 0x8C, 0, 0x9A, 0x60, 0, 0, 0, 0, 0, 0, 0, 0, 'D',
 #define DATA_FRAME_SN_IDX 2
 #define DATA_FRAME_DEST_IDX 5
 
+/* Broadcast mode: instead of tx_msg, the blink is answered in a slot of this node with a frame carrying the sync report. See NOTE 8 below. */
+static uint8 bcast_msg[SYNCBCAST_MSG_LEN];
+static int bcast = 0;
+static int bcast_slot = -1;
+
+/* UWB microsecond (uus) to device time unit (dtu, around 15.65 ps) conversion factor.
+ * 1 uus = 512 / 499.2 µs and 1 µs = 499.2 * 128 dtu. */
+#define UUS_TO_DWT_TIME 65536
+
 /* Buffer to store received frame. See NOTE 1 below. */
 #define FRAME_LEN_MAX 127
 static uint8 rx_buffer[FRAME_LEN_MAX];
-/* Index to access to source address of the blink frame in the rx_buffer array. */
+/* Indexes to access to sequence number and source address of the blink frame in the rx_buffer array. */
+#define BLINK_FRAME_SN_IDX 1
 #define BLINK_FRAME_SRC_IDX 2
 
 /* Hold copy of status register state here for reference so that it can be examined at a debug breakpoint. */
@@ -90,12 +102,25 @@ static uint64 get_tx_timestamp_u64(void);
 static uint64 get_rx_timestamp_u64(void);
 static uint64 get_tx_syscount_u64(void);
 static uint64 get_rx_syscount_u64(void);
+static int send_bcast_reply(void);
 
 /**
  * Application entry point.
  */
-int main(void)
+int main(int argc, char* argv[])
 {
+    uint8 eui[8];
+
+    if (argc > 3)
+    {
+        printf("usage: %s [BCAST [SLOT]]\n", argv[0]);
+        return 0;
+    }
+    if (argc >= 2)
+        bcast = atoi(argv[1]);
+    if (argc == 3)
+        bcast_slot = atoi(argv[2]) % SYNCBCAST_SLOTS;
+
     /* Start with board specific hardware init. */
     hardware_init(SPI_PATH);
 
@@ -119,6 +144,21 @@ int main(void)
     dwt_setrxantennadelay(RX_ANT_DLY);
     dwt_settxantennadelay(TX_ANT_DLY);
 
+    /* The reply carries this node's EUI, which also gives its slot unless one is set on the command line. See NOTE 8 below. */
+    if (bcast)
+    {
+        dwt_geteui(eui);
+        if (!memcmp(eui, "\0\0\0\0\0\0\0\0", 8) || !memcmp(eui, "\xff\xff\xff\xff\xff\xff\xff\xff", 8))
+        {
+            uint32 part = dwt_getpartid(), lot = dwt_getlotid();
+            memcpy(&eui[0], &part, 4);
+            memcpy(&eui[4], &lot, 4);
+        }
+        if (bcast_slot < 0)
+            bcast_slot = syncbcast_slot(eui, SYNCBCAST_SLOTS);
+        syncbcast_build(bcast_msg, eui);
+        printf("BCAST SLOT %d\n", bcast_slot);
+    }
 
     /* Loop forever sending and receiving frames periodically. */
     while (1)
@@ -159,6 +199,15 @@ int main(void)
                 //     tx_msg[DATA_FRAME_DEST_IDX + i] = rx_buffer[BLINK_FRAME_SRC_IDX + i];
                 // }
 
+                if (bcast)
+                {
+                    if (send_bcast_reply() == DWT_ERROR)
+                        printf("0 0 0 0\n");
+                    else
+                        printf("%lld %lld %lld %lld\n", t_rx2_ts, t_rx2_stc, t_tx2_ts, t_tx2_stc);
+                    continue;
+                }
+
                 /* Write response frame data to DW1000 and prepare transmission. See NOTE 6 below.*/
                 dwt_writetxdata(sizeof(tx_msg), tx_msg, 0); /* Zero offset in TX buffer. */
                 dwt_writetxfctrl(sizeof(tx_msg), 0, 0); /* Zero offset in TX buffer, no ranging. */
@@ -209,6 +258,48 @@ int main(void)
     }
 }
 
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn send_bcast_reply()
+ *
+ * @brief Answer the blink held in rx_buffer, received at t_rx2, with the sync report, sent with delayed TX at the start of
+ *        this node's slot. The TX time is set before sending, so the report can carry it.
+ *
+ * @param  none
+ *
+ * @return  DWT_SUCCESS, or DWT_ERROR if the report could not be packed or the slot had already started.
+ */
+static int send_bcast_reply(void)
+{
+    syncrep_t rep;
+    uint32 tx_time;
+
+    tx_time = (t_rx2_ts + ((uint64)(SYNCBCAST_SLOT_FIRST_UUS + bcast_slot * SYNCBCAST_SLOT_LEN_UUS) * UUS_TO_DWT_TIME)) >> 8;
+    dwt_setdelayedtrxtime(tx_time);
+
+    /* The DW1000 ignores the low 9 bits of the TX time, and the TX timestamp is the transmission time plus the TX antenna delay. */
+    t_tx2_stc = ((uint64)(tx_time & 0xFFFFFFFEUL)) << 8;
+    t_tx2_ts = (t_tx2_stc + TX_ANT_DLY) & SYNCREP_MASK40;
+
+    rep.t_rx2_ts = t_rx2_ts;
+    rep.t_rx2_stc = t_rx2_stc;
+    rep.my_delta_ts = (t_tx2_ts - t_rx2_ts) & SYNCREP_MASK40;
+    rep.my_delta_stc = (t_tx2_stc - t_rx2_stc) & SYNCREP_MASK40;
+    if (syncbcast_fill(bcast_msg, rx_buffer[BLINK_FRAME_SN_IDX], &rep) != 0)
+        return DWT_ERROR;
+
+    dwt_writetxdata(sizeof(bcast_msg), bcast_msg, 0); /* Zero offset in TX buffer. */
+    dwt_writetxfctrl(sizeof(bcast_msg), 0, 0); /* Zero offset in TX buffer, no ranging. */
+    if (dwt_starttx(DWT_START_TX_DELAYED) == DWT_ERROR)
+        return DWT_ERROR;
+
+    /* Poll DW1000 until TX frame sent event set, then clear it. */
+    while (!(dwt_read32bitreg(SYS_STATUS_ID) & SYS_STATUS_TXFRS))
+    { };
+    dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_TXFRS);
+
+    return DWT_SUCCESS;
+}
+
 /*! ------------------------------------------------------------------------------------------------------------------
  * @fn get_tx_timestamp_u64()
  *
@@ -323,4 +414,9 @@ static uint64 get_rx_syscount_u64(void)
  *    work anymore then as we would still have to indicate the full length of the frame to dwt_writetxdata()).
  * 7. The user is referred to DecaRanging ARM application (distributed with EVK1000 product) for additional practical example of usage, and to the
  *    DW1000 API Guide for more details on the DW1000 driver functions.
+ * 8. Run with BCAST set to 1 when several REF nodes answer the same dw1000_sync node, also run in broadcast mode. Each node then answers every
+ *    blink in its own slot, SYNCBCAST_SLOT_FIRST_UUS + slot * SYNCBCAST_SLOT_LEN_UUS after the blink RX timestamp, with a frame carrying its EUI
+ *    and its sync report (see syncbcast.h), so one blink is enough for all of them. The slot is the low bits of the EUI modulo SYNCBCAST_SLOTS,
+ *    which only differ between nodes given consecutive EUIs; otherwise give each node its slot as the second argument. Without a programmed EUI
+ *    the node uses its part and lot IDs, see NOTE 1 of dw1000_sync.c.
  ****************************************************************************************************************************************************/
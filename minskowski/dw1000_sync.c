@@ -21,10 +21,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <time.h>
 
 #include "deca_device_api.h"
 #include "deca_regs.h"
 #include "platform.h"
+#include "syncbcast.h"
 
 #define SPI_PATH    "/dev/spidev1.0"
 
@@ -66,15 +68,28 @@ static uint8 tx_msg[] = {0xC5, 0, 'D', 'E', 'C', 'A', 'W', 'A', 'V', 'E', 0x43,
 /* Receive response timeout, expressed in UWB microseconds. See NOTE 3 below. */
 #define RX_RESP_TO_UUS 5000
 
+/* Broadcast mode: every REF node in range answers the blink in its own slot. See NOTE 10 below. */
+static int bcast = 0;
+
+/* Per REF node state in broadcast mode */
+static syncbcast_peer_t peers[SYNCBCAST_SLOTS];
+
+/* UWB microsecond (uus) to device time unit (dtu, around 15.65 ps) conversion factor.
+ * 1 uus = 512 / 499.2 µs and 1 µs = 499.2 * 128 dtu. */
+#define UUS_TO_DWT_TIME 65536
+
+/* Listening time after the blink in broadcast mode, to the end of the last slot, in UWB microseconds. */
+#define BCAST_WINDOW_UUS (SYNCBCAST_SLOT_FIRST_UUS + SYNCBCAST_SLOTS * SYNCBCAST_SLOT_LEN_UUS)
+
 /* Buffer to store received frame. See NOTE 4 below. */
 #define FRAME_LEN_MAX 127
-//static uint8 rx_buffer[FRAME_LEN_MAX];
+static uint8 rx_buffer[FRAME_LEN_MAX];
 
 /* Hold copy of status register state here for reference so that it can be examined at a debug breakpoint. */
 static uint32 status_reg = 0;
 
 /* Hold copy of frame length of frame received (if good) so that it can be examined at a debug breakpoint. */
-//static uint16 frame_len = 0;
+static uint16 frame_len = 0;
 
 /* Hold copies of timestamps */
 typedef unsigned long long uint64;
@@ -94,14 +109,23 @@ static uint64 get_tx_timestamp_u64(void);
 static uint64 get_rx_timestamp_u64(void);
 static uint64 get_tx_syscount_u64(void);
 static uint64 get_rx_syscount_u64(void);
+static void bcast_round(void);
 //static uint64 compute_offset(uint64 t_rx2, uint64 t_tx1, uint64 d);
 //static uint64 compute_prop_delay(uint64 t_tx1, uint64 t_rx1, uint64 d);
 
 /**
  * Application entry point.
  */
-int main(void)
+int main(int argc, char* argv[])
 {
+    if (argc > 2)
+    {
+        printf("usage: %s [BCAST]\n", argv[0]);
+        return 0;
+    }
+    if (argc == 2)
+        bcast = atoi(argv[1]);
+
     /* Start with board specific hardware init. */
     hardware_init(SPI_PATH);
 
@@ -134,6 +158,15 @@ int main(void)
     /* Loop forever sending and receiving frames periodically. */
     while (1)
     {
+        /* One blink for all the REF nodes in range. See NOTE 10 below. */
+        if (bcast)
+        {
+            bcast_round();
+            sleep_ms(TX_DELAY_MS);
+            tx_msg[BLINK_FRAME_SN_IDX]++;
+            continue;
+        }
+
         /* Write frame data to DW1000 and prepare transmission. See NOTE 7 below. */
         dwt_writetxdata(sizeof(tx_msg), tx_msg, 0); /* Zero offset in TX buffer. */
         dwt_writetxfctrl(sizeof(tx_msg), 0, 0); /* Zero offset in TX buffer, no ranging. */
@@ -263,6 +296,97 @@ static uint64 compute_prop_delay(uint64 t_tx1, uint64 t_rx1, uint64 d)
 }
 */
 
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn bcast_round()
+ *
+ * @brief Send a blink and collect the replies of the REF nodes in range until the end of the last slot, updating the
+ *        propagation delay, offset and clock ratio of each one. Prints one line per REF node that answered: EUI, number of
+ *        reports, propagation delay (m), offset (dtu) and clock offset (ppm).
+ *
+ * @param  none
+ *
+ * @return  none
+ */
+static void bcast_round(void)
+{
+    const uint8_t *eui;
+    uint8_t blink_sn;
+    syncrep_t rep;
+    syncbcast_peer_t *peer;
+    struct timespec now;
+    uint32 window_end;
+    int i;
+
+    /* The receiver stays on across the slots, the window end is checked against the system time instead. */
+    dwt_setrxtimeout(0);
+
+    dwt_writetxdata(sizeof(tx_msg), tx_msg, 0); /* Zero offset in TX buffer. */
+    dwt_writetxfctrl(sizeof(tx_msg), 0, 0); /* Zero offset in TX buffer, no ranging. */
+    if (dwt_starttx(DWT_START_TX_IMMEDIATE | DWT_RESPONSE_EXPECTED) == DWT_ERROR)
+    {
+        printf("0 0 0 0\n");
+        dwt_setrxtimeout(RX_RESP_TO_UUS);
+        return;
+    }
+
+    while (!(dwt_read32bitreg(SYS_STATUS_ID) & SYS_STATUS_TXFRS))
+    { };
+    dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_TXFRS);
+    t_tx1_ts = get_tx_timestamp_u64();
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    /* Compare in the high 32 bits of the system time, which wrap every 17 s */
+    window_end = (uint32)((t_tx1_ts + (uint64)BCAST_WINDOW_UUS * UUS_TO_DWT_TIME) >> 8);
+
+    while ((int32)(dwt_readsystimestamphi32() - window_end) < 0)
+    {
+        status_reg = dwt_read32bitreg(SYS_STATUS_ID);
+
+        if (status_reg & SYS_STATUS_RXFCG)
+        {
+            frame_len = dwt_read32bitreg(RX_FINFO_ID) & RX_FINFO_RXFL_MASK_1023;
+            if (frame_len <= FRAME_LEN_MAX)
+            {
+                dwt_readrxdata(rx_buffer, frame_len, 0);
+            }
+            t_rx1_ts = get_rx_timestamp_u64();
+
+            /* Listen for the next slot before handling this reply */
+            dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_RXFCG);
+            dwt_rxenable(DWT_START_RX_IMMEDIATE);
+
+            if (frame_len <= FRAME_LEN_MAX && syncbcast_parse(rx_buffer, frame_len, &eui, &blink_sn, &rep) == 0 &&
+                blink_sn == tx_msg[BLINK_FRAME_SN_IDX] && (peer = syncbcast_lookup(peers, SYNCBCAST_SLOTS, eui)) != NULL)
+            {
+                syncbcast_update(peer, blink_sn, t_tx1_ts, t_rx1_ts, &rep, now.tv_sec + now.tv_nsec / 1e9);
+            }
+        }
+        else if (status_reg & SYS_STATUS_ALL_RX_ERR)
+        {
+            /* A collision or a weak reply: the other slots are still worth listening to */
+            dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_ALL_RX_ERR);
+            dwt_rxreset();
+            dwt_rxenable(DWT_START_RX_IMMEDIATE);
+        }
+    }
+
+    dwt_forcetrxoff();
+    dwt_setrxtimeout(RX_RESP_TO_UUS);
+
+    for (i = 0; i < SYNCBCAST_SLOTS; i++)
+    {
+        if (peers[i].used && peers[i].blink_sn == tx_msg[BLINK_FRAME_SN_IDX])
+        {
+            printf("%02x%02x%02x%02x%02x%02x%02x%02x %lu %4.3f %.0f %3.3f\n",
+                   peers[i].eui[7], peers[i].eui[6], peers[i].eui[5], peers[i].eui[4],
+                   peers[i].eui[3], peers[i].eui[2], peers[i].eui[1], peers[i].eui[0],
+                   (unsigned long)peers[i].rounds, peers[i].delay * (1.0 / 499.2e6 / 128.0) * 299792458.0,
+                   peers[i].offset, (peers[i].ratio - 1.0) * 1e6);
+        }
+    }
+    fflush(stdout);
+}
+
 /*! ------------------------------------------------------------------------------------------------------------------
  * @fn get_tx_timestamp_u64()
  *
@@ -386,4 +510,12 @@ static uint64 get_rx_syscount_u64(void)
  *    refer to DW1000 User Manual for more details on "interrupts".
  * 9. The user is referred to DecaRanging ARM application (distributed with EVK1000 product) for additional practical example of usage, and to the
  *    DW1000 API Guide for more details on the DW1000 driver functions.
+ * 10. Run with BCAST set to 1 to synchronise all the REF nodes in range, run in broadcast mode too (see dw1000_ref.c), from one blink. Each REF
+ *     node answers in its own slot with its EUI and sync report, and the receiver is kept on until the end of the last slot, being re-enabled
+ *     as soon as each reply has been timestamped. A round is then one blink and one short reply per node instead of a full exchange per node.
+ *     Replies come up to BCAST_WINDOW_UUS after the blink, long enough for a 10 ppm XO offset to skew a reply time by a microsecond, so the
+ *     clock ratio of each REF node is fitted from the timestamps of its last blinks (clkmodel.c) and the reply time is scaled by it before the
+ *     propagation delay is worked out (see syncbcast.c). Until a node has answered two blinks its ratio is taken as 1, and its delay can be
+ *     off by a hundred metres. The same fit converts times to the clock of each node between rounds (syncbcast_to_ref()). Up to SYNCBCAST_SLOTS
+ *     nodes are kept in peers[], in the order they are first heard.
  ****************************************************************************************************************************************************/
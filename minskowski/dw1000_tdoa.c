@@ -0,0 +1,310 @@
+/*! ----------------------------------------------------------------------------
+ *  @file    dw1000_tdoa.c
+ *  @brief   TDoA anchor and blink-only tag
+ *
+ *           As an anchor, the DW1000 receiver is kept on in double buffered mode and every blink received is timestamped and written out as a
+ *           record line (see tdoarec.h): anchor EUI, tag EUI, sequence number, RX timestamp and first path quality. Anchors synchronised to a
+ *           common timebase turn the records of one blink into a position fix, with one frame from the tag whatever the number of anchors.
+ *           As a tag, the DW1000 sends a blink carrying its EUI every PERIOD_MS milliseconds and never listens.
+ *
+ * @attention
+ *
+ * Copyright 2015 (c) Decawave Ltd, Dublin, Ireland.
+ *
+ * All rights reserved.
+ *
+ * Written by:
+ * Peter Hillyard <peterhillyard@gmail.com>
+ * Anh Luong <luong@eng.utah.edu>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "deca_device_api.h"
+#include "deca_regs.h"
+#include "platform.h"
+#include "tdoarec.h"
+
+#define SPI_PATH    "/dev/spidev1.0"
+
+/* Default communication configuration. We use here EVK1000's default mode (mode 3). */
+static dwt_config_t config = {
+    2,               /* Channel number. */
+    DWT_PRF_64M,     /* Pulse repetition frequency. */
+    DWT_PLEN_1024,   /* Preamble length. Used in TX only. */
+    DWT_PAC32,       /* Preamble acquisition chunk size. Used in RX only. */
+    9,               /* TX preamble code. Used in TX only. */
+    9,               /* RX preamble code. Used in RX only. */
+    1,               /* 0 to use standard SFD, 1 to use non-standard SFD. */
+    DWT_BR_110K,     /* Data rate. */
+    DWT_PHRMODE_STD, /* PHY header mode. */
+    (1025 + 64 - 32) /* SFD timeout (preamble length + 1 + SFD length - PAC size). Used in RX only. */
+};
+
+/* Default antenna delay values for 64 MHz PRF. See NOTE 1 below. */
+#define TX_ANT_DLY 16436
+#define RX_ANT_DLY 16436
+
+/* Default period between the blinks of a tag, in milliseconds. */
+#define TAG_PERIOD_MS 100
+
+/* Buffer to store received frame. See NOTE 2 below. */
+#define FRAME_LEN_MAX 127
+static uint8 rx_buffer[FRAME_LEN_MAX];
+
+/* Hold copy of status register state here for reference so that it can be examined at a debug breakpoint. */
+static uint32 status_reg = 0;
+
+/* Hold copy of frame length of frame received (if good) so that it can be examined at a debug breakpoint. */
+static uint16 frame_len = 0;
+
+/* Receiver events counted by the anchor */
+static unsigned int rx_good = 0;
+static unsigned int rx_err = 0;
+static unsigned int rx_ovr = 0;
+
+/* Print the counters every this many blinks received. */
+#define STATS_PERIOD 1000
+
+/* Declaration of static functions */
+typedef unsigned long long uint64;
+static uint64 get_rx_timestamp_u64(void);
+static uint64 get_eui(void);
+static void run_anchor(uint64 eui);
+static void run_tag(uint64 eui, unsigned int period_ms);
+
+/**
+ * Application entry point.
+ */
+int main(int argc, char* argv[])
+{
+    unsigned int period_ms = TAG_PERIOD_MS;
+    int tag;
+    uint64 eui;
+
+    if (argc < 2 || argc > 3)
+    {
+        printf("usage: %s TAG [PERIOD_MS]\n", argv[0]);
+        return 0;
+    }
+    tag = atoi(argv[1]);
+    if (argc == 3)
+        period_ms = atoi(argv[2]);
+
+    /* Start with board specific hardware init. */
+    hardware_init(SPI_PATH);
+
+    /* Reset and initialise DW1000. See NOTE 3 below.
+     * For initialisation, DW1000 clocks must be temporarily set to crystal speed. After initialisation SPI rate can be increased for optimum
+     * performance. */
+    reset_DW1000(); /* Target specific drive of RSTn line into DW1000 low for a period. */
+    spi_set_rate_low();
+    if (dwt_initialise(DWT_LOADUCODE) == DWT_ERROR)
+    {
+        printf("%s\n", "INIT FAILED");
+        while (1)
+        { };
+    }
+    spi_set_rate_high();
+
+    /* Configure DW1000. */
+    dwt_configure(&config);
+
+    /* Apply default antenna delay value. See NOTE 1 below. */
+    dwt_setrxantennadelay(RX_ANT_DLY);
+    dwt_settxantennadelay(TX_ANT_DLY);
+
+    eui = get_eui();
+    printf("%s %016llx\n", tag ? "TAG" : "ANCHOR", eui);
+
+    if (tag)
+        run_tag(eui, period_ms);
+    else
+        run_anchor(eui);
+
+    return 0;
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn run_anchor()
+ *
+ * @brief Receive blinks for ever, writing a record for each. See NOTE 4 below.
+ *
+ * @param  eui - EUI of this anchor, written in the records
+ *
+ * @return  none
+ */
+static void run_anchor(uint64 eui)
+{
+    char line[TDOAREC_LINE_MAX];
+    dwt_rxdiag_t diag;
+    tdoarec_t rec;
+
+    memset(&rec, 0, sizeof(rec));
+    rec.anchor = eui;
+
+    /* Records go out in blocks: the output is only flushed when the receiver has nothing pending. See NOTE 5 below. */
+    setvbuf(stdout, NULL, _IOFBF, 16 * TDOAREC_LINE_MAX);
+
+    /* Receive into one buffer while the other is read, and re-enable the receiver after errors without the host. */
+    dwt_setdblrxbuffmode(1);
+    dwt_write32bitreg(SYS_CFG_ID, dwt_read32bitreg(SYS_CFG_ID) | SYS_CFG_RXAUTR);
+
+    /* Activate reception immediately. */
+    dwt_rxenable(DWT_START_RX_IMMEDIATE);
+
+    while (1)
+    {
+        /* Poll until a frame is received, an error occurs or the receiver overruns. */
+        while (!((status_reg = dwt_read32bitreg(SYS_STATUS_ID)) & (SYS_STATUS_RXFCG | SYS_STATUS_ALL_RX_ERR | SYS_STATUS_RXOVRR)))
+        {
+            fflush(stdout);
+        }
+
+        /* Both buffers were full: the frames they hold cannot be trusted, start over. */
+        if (status_reg & SYS_STATUS_RXOVRR)
+        {
+            rx_ovr++;
+            dwt_forcetrxoff();
+            dwt_rxreset();
+            dwt_rxenable(DWT_START_RX_IMMEDIATE);
+            continue;
+        }
+
+        if (status_reg & SYS_STATUS_ALL_RX_ERR)
+        {
+            /* The receiver has already been re-enabled, into the same buffer. */
+            rx_err++;
+            dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_ALL_RX_ERR);
+            if (!(status_reg & SYS_STATUS_RXFCG))
+                continue;
+        }
+
+        /* The frame, its timestamp and its diagnostics are all in the host side buffer set. */
+        frame_len = dwt_read32bitreg(RX_FINFO_ID) & RX_FINFO_RXFL_MASK_1023;
+        if (frame_len <= FRAME_LEN_MAX)
+            dwt_readrxdata(rx_buffer, frame_len, 0);
+        rec.rx_ts = get_rx_timestamp_u64();
+        dwt_readdiagnostics(&diag);
+
+        /* Release the buffer to the receiver as soon as it has been read. */
+        dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_ALL_DBLBUFF);
+        dwt_write8bitoffsetreg(SYS_CTRL_ID, SYS_CTRL_HRBT_OFFSET, 1);
+
+        if (frame_len > FRAME_LEN_MAX || tdoarec_parse_blink(rx_buffer, frame_len, &rec.tag, &rec.seq) != 0)
+            continue;
+
+        tdoarec_quality(&rec, diag.firstPathAmp1, diag.firstPathAmp2, diag.firstPathAmp3, diag.stdNoise, diag.maxGrowthCIR);
+        tdoarec_format(&rec, line, sizeof(line));
+        fputs(line, stdout);
+
+        if (++rx_good % STATS_PERIOD == 0)
+            printf("STATS %u %u %u\n", rx_good, rx_err, rx_ovr);
+    }
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn run_tag()
+ *
+ * @brief Send a blink every period_ms milliseconds, for ever.
+ *
+ * @param  eui       - EUI of this tag, carried in the blink
+ * @param  period_ms - period between blinks
+ *
+ * @return  none
+ */
+static void run_tag(uint64 eui, unsigned int period_ms)
+{
+    uint8 tx_msg[TDOAREC_BLINK_LEN];
+    uint8 seq = 0;
+
+    while (1)
+    {
+        tdoarec_build_blink(tx_msg, eui, seq++);
+
+        /* The FCS at the end of tx_msg is set by the DW1000. */
+        dwt_writetxdata(sizeof(tx_msg), tx_msg, 0); /* Zero offset in TX buffer. */
+        dwt_writetxfctrl(sizeof(tx_msg), 0, 0); /* Zero offset in TX buffer, no ranging. */
+        dwt_starttx(DWT_START_TX_IMMEDIATE);
+
+        /* Poll DW1000 until TX frame sent event set, then clear it. */
+        while (!(dwt_read32bitreg(SYS_STATUS_ID) & SYS_STATUS_TXFRS))
+        { };
+        dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_TXFRS);
+
+        sleep_ms(period_ms);
+    }
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn get_eui()
+ *
+ * @brief Get the EUI of this node: the one programmed in OTP, or one made of the part and lot IDs if there is none.
+ *
+ * @param  none
+ *
+ * @return  EUI, least significant byte first as sent over the air.
+ */
+static uint64 get_eui(void)
+{
+    uint8 eui[8];
+
+    dwt_geteui(eui);
+    if (!memcmp(eui, "\0\0\0\0\0\0\0\0", 8) || !memcmp(eui, "\xff\xff\xff\xff\xff\xff\xff\xff", 8))
+    {
+        uint32 part = dwt_getpartid(), lot = dwt_getlotid();
+        memcpy(&eui[0], &part, 4);
+        memcpy(&eui[4], &lot, 4);
+    }
+    return tdoarec_eui(eui);
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn get_rx_timestamp_u64()
+ *
+ * @brief Get the RX time-stamp in a 64-bit variable.
+ *        /!\ This function assumes that length of time-stamps is 40 bits, for both TX and RX!
+ *
+ * @param  none
+ *
+ * @return  64-bit value of the read time-stamp.
+ */
+static uint64 get_rx_timestamp_u64(void)
+{
+    uint8 ts_tab[5];
+    uint64 ts = 0;
+    int i;
+    dwt_readrxtimestamp(ts_tab);
+    for (i = 4; i >= 0; i--)
+    {
+        ts <<= 8;
+        ts |= ts_tab[i];
+    }
+    return ts;
+}
+
+/*****************************************************************************************************************************************************
+ * NOTES:
+ *
+ * 1. The antenna delay is part of every RX timestamp, so it must be calibrated on each anchor: a TDoA is the difference of two anchors' timestamps
+ *    and an error in one of the delays is an error in every TDoA involving that anchor.
+ * 2. In this example, maximum frame length is set to 127 bytes which is 802.15.4 UWB standard maximum frame length. DW1000 supports an extended frame
+ *    length (up to 1023 bytes long) mode which is not used in this example.
+ * 3. The LDE microcode must be loaded (DWT_LOADUCODE) for the DW1000 to timestamp the frames it receives.
+ * 4. Run with TAG set to 0 for an anchor, 1 for a tag. The anchor receiver is never turned off: the DW1000 receives the next frame into its second
+ *    buffer while the host reads the first, and re-enables itself after errors (SYS_CFG_RXAUTR), so the time the host takes over a frame is not
+ *    time the anchor is deaf. A 12-byte blink lasts about 2.6 ms at this configuration (1024-symbol preamble, 110 kbps), and tags blink
+ *    unscheduled, so two blinks that start within 2.6 ms of each other collide: to lose fewer than one in ten, a channel carries about 20 blinks a
+ *    second, e.g. 20 tags blinking once a second, against one exchange per tag and per anchor for two-way ranging. A 128-symbol preamble at
+ *    6.8 Mbps shortens the blink to about 0.18 ms and carries about fifteen times more. Only an overrun (both buffers full) needs the host, and is
+ *    counted in the STATS line with the good blinks and the errors.
+ *    The timestamps are in each anchor's own clock. One tag at a known position, the reference tag, gives the solver the offset and rate of
+ *    every anchor's clock against the others' from its blinks, which are received and written out like any other. tdoa_agg joins the
+ *    records of all the anchors (e.g. piped from each over the network) into fixes, see tdoa.c. dw1000_sync.c blinks are
+ *    accepted too but all carry the same ID, see its NOTE 1.
+ * 5. A record line is written for each blink, but stdout is fully buffered and only flushed when the receiver has nothing pending, so a burst of
+ *    blinks costs one write to the pipe or file rather than one per blink.
+ ****************************************************************************************************************************************************/
@@ -0,0 +1,289 @@
+/*! ----------------------------------------------------------------------------
+ *  @file    dw1000_xtaltrim.c
+ *  @brief   Crystal trim tuning against a reference node
+ *
+ *           The reference node transmits a blink frame every BLINK_PERIOD_MS. The node being tuned receives them and estimates its clock
+ *           offset to the reference from the carrier integrator of each frame (dwt_readclockoffsetppm). It bisects the crystal trim value
+ *           over its full range, checks the neighbours of the final value and writes the best trim to the calibration store, so that
+ *           applications calling calstore_apply() start with it. See NOTE 1 below.
+ *
+ *           usage: dw1000_xtaltrim REF/TUNE      (0 for the reference, 1 for the node being tuned)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+// DW1000
+#include "deca_device_api.h"
+#include "deca_regs.h"
+#include "platform.h"
+#include "calstore.h"
+
+#define DW1000_PATH 	"/dev/spidev1.0"
+
+/* Default communication configuration. We use here EVK1000's default mode (mode 3). */
+static dwt_config_t config = {
+    2,               /* Channel number. */
+    DWT_PRF_64M,     /* Pulse repetition frequency. */
+    DWT_PLEN_1024,   /* Preamble length. Used in TX only. */
+    DWT_PAC32,       /* Preamble acquisition chunk size. Used in RX only. */
+    9,               /* TX preamble code. Used in TX only. */
+    9,               /* RX preamble code. Used in RX only. */
+    1,               /* 0 to use standard SFD, 1 to use non-standard SFD. */
+    DWT_BR_110K,     /* Data rate. */
+    DWT_PHRMODE_STD, /* PHY header mode. */
+    (1024 + 1 + 64 - 32) /* SFD timeout (preamble length + 1 + SFD length - PAC size). Used in RX only. */
+};
+
+/* Blink frame sent by the reference. See NOTE 2 below. */
+static uint8 blink_msg[] = {0xC5, 0, 'D', 'E', 'C', 'A', 'W', 'A', 'V', 'E', 0, 0};
+#define BLINK_MSG_SN_IDX 1
+#define BLINK_MSG_ID_IDX 2
+#define BLINK_MSG_ID_LEN 8
+#define BLINK_PERIOD_MS 10
+
+/* Buffer to store received frame. */
+#define RX_BUF_LEN 12
+static uint8 rx_buffer[RX_BUF_LEN];
+
+/* Number of frames averaged per trim value, and number dropped after each trim change while the crystal settles. */
+#define FRAMES_PER_TRIM 20
+#define SETTLE_FRAMES 2
+/* Frames after which a trim value is given up on. */
+#define MAX_FRAMES_PER_TRIM 200
+/* Receive timeout, a few blink periods, so that a missing reference counts against MAX_FRAMES_PER_TRIM. Fits the 16-bit timeout register. */
+#define BLINK_RX_TIMEOUT_UUS (3 * BLINK_PERIOD_MS * 1000)
+
+/* Declaration of static functions. */
+static void reference(void);
+static int measure_ppm(uint8 trim, double *ppm);
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn main()
+ *
+ * @brief Application entry point.
+ *
+ * @param  none
+ *
+ * @return none
+ */
+int main(int argc, char* argv[])
+{
+	const calstore_rec_t *cur;
+	calstore_rec_t rec;
+	uint8_t isTUNE = 0;
+	int lo, hi, mid, t, best;
+	double ppm, best_ppm;
+
+	if(argc != 2)
+	{
+		printf("usage: %s REF/TUNE\n", argv[0]);
+		return 0;
+	}
+	isTUNE = atoi(argv[1]);
+
+    /* Start with board specific hardware init. */
+    hardware_init(DW1000_PATH);
+
+    /* Reset and initialise DW1000. */
+    reset_DW1000(); /* Target specific drive of RSTn line into DW1000 low for a period. */
+    spi_set_rate_low();
+    if (dwt_initialise(DWT_LOADUCODE) == DWT_ERROR)
+    {
+        printf("%s\n", "INIT FAILED");
+        return -1;
+    }
+    spi_set_rate_high();
+
+    /* Configure DW1000. */
+    dwt_configure(&config);
+
+    if(!isTUNE)
+    {
+    	/* The reference runs with its own calibrated trim, if any, as everybody is tuned to it. */
+    	calstore_apply(calstore_load(CALSTORE_PATH), config.chan, config.prf, 0);
+    	printf("Starting REFERENCE\n");
+    	reference();
+    	return 0;
+    }
+
+    printf("Starting TUNE, initial trim %d\n", dwt_getinitxtaltrim());
+
+    /* Bisect for the trim where the offset changes sign. Increasing the trim lowers the crystal frequency, and a positive offset means
+     * the local clock is slower than the reference, so it calls for a lower trim. */
+    lo = 0;
+    hi = FS_XTALT_MASK;
+    while(lo < hi)
+    {
+    	mid = (lo + hi) / 2;
+    	if(measure_ppm(mid, &ppm) != 0)
+    	{
+    		printf("no frames from the reference\n");
+    		return -1;
+    	}
+    	printf("trim %2d: %+6.3f ppm\n", mid, ppm);
+
+    	if(ppm > 0)
+    		hi = mid;
+    	else
+    		lo = mid + 1;
+    }
+
+    /* The zero crossing is between lo - 1 and lo: keep whichever is closer. */
+    best = lo;
+    best_ppm = INFINITY;
+    for(t = lo - 1; t <= lo; t++)
+    {
+    	if(t < 0 || t > FS_XTALT_MASK || measure_ppm(t, &ppm) != 0)
+    		continue;
+    	printf("trim %2d: %+6.3f ppm\n", t, ppm);
+    	if(fabs(ppm) < fabs(best_ppm))
+    	{
+    		best = t;
+    		best_ppm = ppm;
+    	}
+    }
+
+    if(isinf(best_ppm))
+    {
+    	printf("no frames from the reference\n");
+    	return -1;
+    }
+
+    dwt_setxtaltrim(best);
+    printf("TRIM %d (%+6.3f ppm)\n", best, best_ppm);
+
+    /* Store the result with the rest of this device's calibration. */
+    cur = calstore_load(CALSTORE_PATH);
+    if(cur != NULL)
+    	rec = *cur;
+    else
+    	calstore_initrec(&rec);
+    rec.xtaltrim = best;
+    rec.flags |= CALSTORE_HAS_XTALTRIM;
+    if(calstore_update(CALSTORE_PATH, &rec) != 0)
+    {
+    	perror("Unable to update " CALSTORE_PATH);
+    	return -1;
+    }
+
+    return 0;
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn reference()
+ *
+ * @brief Send a blink frame every BLINK_PERIOD_MS, forever.
+ *
+ * @param  none
+ *
+ * @return none
+ */
+static void reference(void)
+{
+    while (1)
+    {
+        /* Write frame data to DW1000 and prepare transmission. */
+        dwt_writetxdata(sizeof(blink_msg), blink_msg, 0); /* Zero offset in TX buffer. */
+        dwt_writetxfctrl(sizeof(blink_msg), 0, 0); /* Zero offset in TX buffer, no ranging. */
+
+        /* Start transmission. */
+        dwt_starttx(DWT_START_TX_IMMEDIATE);
+
+        /* Poll DW1000 until TX frame sent event set. */
+        while (!(dwt_read32bitreg(SYS_STATUS_ID) & SYS_STATUS_TXFRS))
+        { };
+
+        /* Clear TX frame sent event. */
+        dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_TXFRS);
+
+        usleep(BLINK_PERIOD_MS * 1000);
+
+        /* Increment the blink frame sequence number (modulo 256). */
+        blink_msg[BLINK_MSG_SN_IDX]++;
+    }
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * @fn measure_ppm()
+ *
+ * @brief Set the crystal trim and measure the clock offset to the reference, averaged over FRAMES_PER_TRIM blink frames.
+ *
+ * @param  trim  crystal trim value to set (0 to FS_XTALT_MASK)
+ *         ppm   average clock offset, positive when the local clock is slower than the reference
+ *
+ * @return 0 on success, -1 if too few frames were received
+ */
+static int measure_ppm(uint8 trim, double *ppm)
+{
+    uint32 status_reg, frame_len;
+    double sum = 0;
+    int n = 0, good = 0, frames;
+
+    dwt_setxtaltrim(trim);
+    dwt_setrxtimeout(BLINK_RX_TIMEOUT_UUS);
+
+    for (frames = 0; (frames < MAX_FRAMES_PER_TRIM) && (n < FRAMES_PER_TRIM); frames++)
+    {
+        dwt_rxenable(DWT_START_RX_IMMEDIATE);
+
+        /* Poll until a frame is properly received, a timeout or an error occurs. */
+        while (!((status_reg = dwt_read32bitreg(SYS_STATUS_ID)) & (SYS_STATUS_RXFCG | SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_RX_ERR)))
+        { };
+
+        if (!(status_reg & SYS_STATUS_RXFCG))
+        {
+            /* Clear RX error/timeout events in the DW1000 status register. */
+            dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_ALL_RX_TO | SYS_STATUS_ALL_RX_ERR);
+            dwt_rxreset();
+            continue;
+        }
+
+        /* Clear good RX frame event in the DW1000 status register. */
+        dwt_write32bitreg(SYS_STATUS_ID, SYS_STATUS_RXFCG);
+
+        frame_len = dwt_read32bitreg(RX_FINFO_ID) & RX_FINFO_RXFL_MASK_1023;
+        if (frame_len != sizeof(blink_msg))
+            continue;
+        dwt_readrxdata(rx_buffer, frame_len, 0);
+        if (memcmp(&rx_buffer[BLINK_MSG_ID_IDX], &blink_msg[BLINK_MSG_ID_IDX], BLINK_MSG_ID_LEN) != 0)
+            continue;
+
+        /* The carrier integrator is only valid until the receiver is re-enabled. See NOTE 3 below. */
+        if (++good > SETTLE_FRAMES)
+        {
+            sum += dwt_readclockoffsetppm();
+            n++;
+        }
+    }
+
+    if (n < FRAMES_PER_TRIM)
+        return -1;
+
+    *ppm = sum / n;
+    return 0;
+}
+
+/*****************************************************************************************************************************************************
+ * NOTES:
+ *
+ * 1. The DW1000 crystal trim has FS_XTALT_MASK + 1 steps of roughly 1.5 ppm each over a range of about +/- 25 ppm. Raising the trim slows the
+ *    crystal, and dwt_readclockoffsetppm() is positive when the local clock is the slower one, so the offset increases monotonically with the
+ *    trim, which makes a bisection on the sign of the measured offset converge in 5 steps. The best value is then within one step of the zero
+ *    crossing, so the two candidates either side of it are measured again and the one closer to zero is kept.
+ *    The reference should itself have been tuned against a good frequency standard, or be the node everybody else synchronises to.
+ * 2. The blink frame follows the ISO/IEC 24730-62:2013 encoding used by the simple TX example:
+ *     - byte 0: frame type (0xC5 for a blink).
+ *     - byte 1: sequence number, incremented for each new frame.
+ *     - byte 2 -> 9: device ID.
+ *     - byte 10/11: frame check-sum, automatically set by DW1000.
+ * 3. The carrier integrator tracks the carrier of the remote transmitter during the frame, so one frame gives an offset estimate with a noise of
+ *    a fraction of a ppm at 110 kbps. Averaging FRAMES_PER_TRIM frames brings it well below the trim step.
+ ****************************************************************************************************************************************************/
@@ -0,0 +1,167 @@
+/*
+ * hostclk.c
+ *
+ * Correlation of the local DW1000 system time with the host CLOCK_MONOTONIC.
+ *
+ * Each sample reads the DW1000 system time between two reads of the host clock and takes the middle of the bracket as the
+ * host time of the read. Scheduling and SPI queueing only ever widen the bracket, so of a burst of reads the narrowest
+ * one is kept, and the samples are weighted by the inverse square of their width in a least squares line fitted over the
+ * last HOSTCLK_WINDOW samples. The device time is unrolled across its 17.2 s wrap with the host time elapsed between
+ * samples.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "hostclk.h"
+#include "clkmodel.h"
+#include "timebase.h"
+#include "deca_device_api.h"
+#include <string.h>
+#include <time.h>
+#include <math.h>
+
+#define HOSTCLK_MASK40     0xFFFFFFFFFFULL
+
+// Floor of the bracket width used as weight, ns
+#define HOSTCLK_MIN_LAT    100.0
+
+typedef struct {
+	int64_t ns;           // host time, middle of the bracket
+	int64_t dw;           // device time, unrolled
+	double lat;           // bracket width
+} hostclk_sample_t;
+
+static hostclk_sample_t samples[HOSTCLK_WINDOW];
+static int num_samples = 0, head = 0;
+static uint64_t last_dw;
+static hostclk_map_t map;
+
+static int64_t hostclk_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void hostclk_fit(void)
+{
+	double sw = 0, sx = 0, sxx = 0, sy = 0, sxy = 0, chi2 = 0, w, x, y, r, det, k, c;
+	const hostclk_sample_t *s0 = &samples[(head + HOSTCLK_WINDOW - 1) % HOSTCLK_WINDOW];
+	int i;
+
+	for (i = 0; i < num_samples; i++)
+	{
+		w = 1.0 / (samples[i].lat * samples[i].lat);
+		x = (double) (samples[i].dw - s0->dw);
+		y = (double) (samples[i].ns - s0->ns);
+		sw += w;
+		sx += w * x;
+		sxx += w * x * x;
+		sy += w * y;
+		sxy += w * x * y;
+	}
+
+	det = sw * sxx - sx * sx;
+	if (num_samples < 2 || det <= 0)
+	{
+		k = 1e9 / CLKMODEL_DTU_PER_S;
+		c = 0;
+	}
+	else
+	{
+		k = (sw * sxy - sx * sy) / det;
+		c = (sy - k * sx) / sw;
+	}
+
+	for (i = 0; i < num_samples; i++)
+	{
+		r = (double) (samples[i].ns - s0->ns) - (c + k * (double) (samples[i].dw - s0->dw));
+		chi2 += r * r / (samples[i].lat * samples[i].lat);
+	}
+
+	map.dw0 = (uint64_t) s0->dw & HOSTCLK_MASK40;
+	map.ns0 = s0->ns + llround(c);
+	map.ns_per_dtu = k;
+	map.resid_ns = (sw > 0) ? sqrt(chi2 / sw) : 0;
+	map.latency_ns = s0->lat;
+	map.n = num_samples;
+}
+
+int hostclk_sample(void)
+{
+	hostclk_sample_t s, best = {0, 0, 0};
+	uint8 ts[5];
+	int64_t t0, t1;
+	uint64_t dw = 0, best_dw = 0;
+	int i, j;
+
+	for (i = 0; i < HOSTCLK_BURST; i++)
+	{
+		t0 = hostclk_now();
+		dwt_readsystime(ts);
+		t1 = hostclk_now();
+
+		for (j = 4, dw = 0; j >= 0; j--)
+			dw = (dw << 8) | ts[j];
+
+		s.ns = t0 + (t1 - t0) / 2;
+		s.lat = (t1 - t0 > HOSTCLK_MIN_LAT) ? (double) (t1 - t0) : HOSTCLK_MIN_LAT;
+		if (i == 0 || s.lat < best.lat)
+		{
+			best = s;
+			best_dw = dw;
+		}
+	}
+
+	if (num_samples == 0)
+		best.dw = (int64_t) best_dw;
+	else
+	{
+		const hostclk_sample_t *prev = &samples[(head + HOSTCLK_WINDOW - 1) % HOSTCLK_WINDOW];
+		best.dw = clkmodel_unwrap(best_dw, last_dw, prev->dw, (best.ns - prev->ns) / 1e9);
+	}
+	last_dw = best_dw;
+
+	samples[head] = best;
+	head = (head + 1) % HOSTCLK_WINDOW;
+	if (num_samples < HOSTCLK_WINDOW)
+		num_samples++;
+	hostclk_fit();
+
+	return 0;
+}
+
+int hostclk_poll(void)
+{
+	const hostclk_sample_t *prev = &samples[(head + HOSTCLK_WINDOW - 1) % HOSTCLK_WINDOW];
+
+	if (num_samples > 0 && hostclk_now() - prev->ns < HOSTCLK_PERIOD_MS * 1000000LL)
+		return 0;
+
+	hostclk_sample();
+	return 1;
+}
+
+int hostclk_get(hostclk_map_t *m)
+{
+	*m = map;
+	return (num_samples >= 2) ? 0 : -1;
+}
+
+int64_t hostclk_dw_to_ns(const hostclk_map_t *m, uint64_t dw)
+{
+	return m->ns0 + llround(timebase_diff40(dw & HOSTCLK_MASK40, m->dw0) * m->ns_per_dtu);
+}
+
+uint64_t hostclk_ns_to_dw(const hostclk_map_t *m, int64_t ns)
+{
+	return (m->dw0 + (uint64_t) llround((ns - m->ns0) / m->ns_per_dtu)) & HOSTCLK_MASK40;
+}
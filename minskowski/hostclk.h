@@ -0,0 +1,58 @@
+/*
+ * hostclk.h
+ *
+ * Correlation of the local DW1000 system time with the host CLOCK_MONOTONIC.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _HOSTCLK_H_
+#define _HOSTCLK_H_
+
+#include <stdint.h>
+
+/* Samples in the fit, reads per sample (the fastest one is kept), and time between the samples of hostclk_poll() */
+#define HOSTCLK_WINDOW     32
+#define HOSTCLK_BURST      8
+#define HOSTCLK_PERIOD_MS  500
+
+/*
+ * Linear map between the two clocks, anchored at the newest sample: ns = ns0 + (dw - dw0) * ns_per_dtu. DW1000 times are
+ * the 40-bit device times, converted relative to dw0, so within 8.6 s of it; with hostclk_poll() called every loop that
+ * covers any timestamp less than 8 s old.
+ */
+typedef struct {
+	uint64_t dw0;         // DW1000 time of the anchor (dtu)
+	int64_t ns0;          // CLOCK_MONOTONIC at the anchor (ns)
+	double ns_per_dtu;    // fitted rate, nominally 1 / 63.8976 GHz
+	double resid_ns;      // weighted RMS residual of the fit (ns)
+	double latency_ns;    // bracket width of the newest sample (ns)
+	int n;                // samples in the fit
+} hostclk_map_t;
+
+/* Take a sample now: HOSTCLK_BURST system time reads between host clock reads, keeping the one with the shortest bracket.
+ * Returns 0. */
+int hostclk_sample(void);
+
+/*
+ * Take a sample if HOSTCLK_PERIOD_MS have passed since the last one. Returns 1 if it did, 0 otherwise. Call it from the
+ * loop that drives the DW1000, between exchanges: the reads go over the same SPI bus, and a burst of them in the middle
+ * of an exchange could make a delayed TX late.
+ */
+int hostclk_poll(void);
+
+/* Copy of the current map. Returns 0, or -1 until two samples have been taken. */
+int hostclk_get(hostclk_map_t *map);
+
+/* CLOCK_MONOTONIC (ns) at DW1000 time dw, and back. */
+int64_t hostclk_dw_to_ns(const hostclk_map_t *map, uint64_t dw);
+uint64_t hostclk_ns_to_dw(const hostclk_map_t *map, int64_t ns);
+
+#endif /* _HOSTCLK_H_ */
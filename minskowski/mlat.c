@@ -0,0 +1,276 @@
+/*
+ * mlat.c
+ *
+ * Multilateration: position of a tag from anchor range differences (TDoA) or ranges (TWR).
+ *
+ * Each anchor count has its own solver (mlat_tdoa.inc, mlat_twr.inc), with all the loops and matrices sized at compile
+ * time and nothing allocated: a closed form (Chan's for TDoA, the linearised ranges for TWR) gives the starting point and
+ * a few Gauss-Newton iterations refine it. Planar fixes (in a horizontal plane at a given height) have their own solvers
+ * for every anchor count.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "mlat.h"
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+
+#define MLAT_CAT_(a, b) a##b
+#define MLAT_CAT(a, b)  MLAT_CAT_(a, b)
+
+static inline double mlat_dist(const double *p, const double *a)
+{
+	double dx = p[0] - a[0], dy = p[1] - a[1], dz = p[2] - a[2];
+	return sqrt(dx * dx + dy * dy + dz * dz);
+}
+
+/*
+ * Solve the symmetric d x d system A x = b in place in b, and A y = c in c if c is not NULL, by Gaussian elimination.
+ * Returns -1 if A is singular. d is a constant at every call, so the loops unroll.
+ */
+static inline int mlat_solve(double *A, double *b, double *c, int d)
+{
+	int i, j, k;
+
+	for (i = 0; i < d; i++)
+	{
+		double piv = A[i * d + i];
+
+		if (fabs(piv) < 1e-12 * (fabs(A[0]) + 1e-300))
+			return -1;
+		for (j = i + 1; j < d; j++)
+		{
+			double f = A[j * d + i] / piv;
+			for (k = i; k < d; k++)
+				A[j * d + k] -= f * A[i * d + k];
+			b[j] -= f * b[i];
+			if (c)
+				c[j] -= f * c[i];
+		}
+	}
+	for (i = d - 1; i >= 0; i--)
+	{
+		for (k = i + 1; k < d; k++)
+		{
+			b[i] -= A[i * d + k] * b[k];
+			if (c)
+				c[i] -= A[i * d + k] * c[k];
+		}
+		b[i] /= A[i * d + i];
+		if (c)
+			c[i] /= A[i * d + i];
+	}
+	return 0;
+}
+
+/*
+ * Dilution of precision of the fix whose d x d normal matrix (J'J, J the unit Jacobian) is A: sqrt(trace(A^-1)), the RMS
+ * position error per metre of range error. Returns -1 if A is singular.
+ */
+static inline double mlat_dop(const double *A, int d)
+{
+	double det, tr;
+
+	if (d == 2)
+	{
+		det = A[0] * A[3] - A[1] * A[2];
+		tr = A[0] + A[3];
+	}
+	else
+	{
+		double c0 = A[4] * A[8] - A[5] * A[7], c1 = A[0] * A[8] - A[2] * A[6], c2 = A[0] * A[4] - A[1] * A[3];
+
+		det = A[0] * c0 - A[1] * (A[3] * A[8] - A[5] * A[6]) + A[2] * (A[3] * A[7] - A[4] * A[6]);
+		tr = c0 + c1 + c2;
+	}
+	if (det <= 1e-12 * tr * tr * tr || tr <= 0)
+		return -1;
+	return sqrt(tr / det);
+}
+
+#define MLAT_D 2
+#define MLAT_N 3
+#include "mlat_tdoa.inc"
+#undef MLAT_N
+#define MLAT_N 4
+#include "mlat_tdoa.inc"
+#undef MLAT_N
+#define MLAT_N 5
+#include "mlat_tdoa.inc"
+#undef MLAT_N
+#define MLAT_N 6
+#include "mlat_tdoa.inc"
+#undef MLAT_N
+#define MLAT_N 7
+#include "mlat_tdoa.inc"
+#undef MLAT_N
+#define MLAT_N 8
+#include "mlat_tdoa.inc"
+#undef MLAT_N
+#undef MLAT_D
+
+#define MLAT_D 3
+#define MLAT_N 5
+#include "mlat_tdoa.inc"
+#undef MLAT_N
+#define MLAT_N 6
+#include "mlat_tdoa.inc"
+#undef MLAT_N
+#define MLAT_N 7
+#include "mlat_tdoa.inc"
+#undef MLAT_N
+#define MLAT_N 8
+#include "mlat_tdoa.inc"
+#undef MLAT_N
+#undef MLAT_D
+
+#define MLAT_D 2
+#define MLAT_N 3
+#include "mlat_twr.inc"
+#undef MLAT_N
+#define MLAT_N 4
+#include "mlat_twr.inc"
+#undef MLAT_N
+#define MLAT_N 5
+#include "mlat_twr.inc"
+#undef MLAT_N
+#define MLAT_N 6
+#include "mlat_twr.inc"
+#undef MLAT_N
+#define MLAT_N 7
+#include "mlat_twr.inc"
+#undef MLAT_N
+#define MLAT_N 8
+#include "mlat_twr.inc"
+#undef MLAT_N
+#undef MLAT_D
+
+#define MLAT_D 3
+#define MLAT_N 4
+#include "mlat_twr.inc"
+#undef MLAT_N
+#define MLAT_N 5
+#include "mlat_twr.inc"
+#undef MLAT_N
+#define MLAT_N 6
+#include "mlat_twr.inc"
+#undef MLAT_N
+#define MLAT_N 7
+#include "mlat_twr.inc"
+#undef MLAT_N
+#define MLAT_N 8
+#include "mlat_twr.inc"
+#undef MLAT_N
+#undef MLAT_D
+
+typedef int (*mlat_tdoa_fn)(mlat_tdoa_job_t *job);
+typedef int (*mlat_twr_fn)(mlat_twr_job_t *job);
+
+static const mlat_tdoa_fn mlat_tdoa2_fns[MLAT_MAX_ANCHORS + 1] = {
+	NULL, NULL, NULL, mlat_tdoa2_3, mlat_tdoa2_4, mlat_tdoa2_5, mlat_tdoa2_6, mlat_tdoa2_7, mlat_tdoa2_8
+};
+
+static const mlat_tdoa_fn mlat_tdoa3_fns[MLAT_MAX_ANCHORS + 1] = {
+	NULL, NULL, NULL, NULL, NULL, mlat_tdoa3_5, mlat_tdoa3_6, mlat_tdoa3_7, mlat_tdoa3_8
+};
+
+static const mlat_twr_fn mlat_twr2_fns[MLAT_MAX_ANCHORS + 1] = {
+	NULL, NULL, NULL, mlat_twr2_3, mlat_twr2_4, mlat_twr2_5, mlat_twr2_6, mlat_twr2_7, mlat_twr2_8
+};
+
+static const mlat_twr_fn mlat_twr3_fns[MLAT_MAX_ANCHORS + 1] = {
+	NULL, NULL, NULL, NULL, mlat_twr3_4, mlat_twr3_5, mlat_twr3_6, mlat_twr3_7, mlat_twr3_8
+};
+
+static mlat_tdoa_fn mlat_tdoa_fn_of(const mlat_tdoa_job_t *job)
+{
+	if (job->n < MLAT_MIN_ANCHORS || job->n > MLAT_MAX_ANCHORS)
+		return NULL;
+	return (job->planar || job->n < MLAT_3D_ANCHORS) ? mlat_tdoa2_fns[job->n] : mlat_tdoa3_fns[job->n];
+}
+
+static mlat_twr_fn mlat_twr_fn_of(const mlat_twr_job_t *job)
+{
+	if (job->n < MLAT_MIN_ANCHORS || job->n > MLAT_MAX_ANCHORS)
+		return NULL;
+	return (job->planar || job->n < MLAT_TWR_3D_ANCHORS) ? mlat_twr2_fns[job->n] : mlat_twr3_fns[job->n];
+}
+
+int mlat_tdoa(mlat_tdoa_job_t *job)
+{
+	mlat_tdoa_fn fn = mlat_tdoa_fn_of(job);
+
+	if (fn == NULL)
+		return job->status = -1;
+	return fn(job);
+}
+
+int mlat_tdoa_batch(mlat_tdoa_job_t *jobs, int count)
+{
+	mlat_tdoa_fn fn, fns[MLAT_MAX_ANCHORS * 2];
+	int i, k, nf = 0, solved = 0;
+
+	/* One pass per solver keeps each pass in one function */
+	for (i = 0; i < count; i++)
+	{
+		if ((fn = mlat_tdoa_fn_of(&jobs[i])) == NULL)
+		{
+			jobs[i].status = -1;
+			continue;
+		}
+		for (k = 0; k < nf && fns[k] != fn; k++)
+			;
+		if (k == nf)
+			fns[nf++] = fn;
+	}
+
+	for (k = 0; k < nf; k++)
+		for (i = 0; i < count; i++)
+			if (mlat_tdoa_fn_of(&jobs[i]) == fns[k] && fns[k](&jobs[i]) == 0)
+				solved++;
+
+	return solved;
+}
+
+int mlat_twr(mlat_twr_job_t *job)
+{
+	mlat_twr_fn fn = mlat_twr_fn_of(job);
+
+	if (fn == NULL)
+		return job->status = -1;
+	return fn(job);
+}
+
+int mlat_twr_batch(mlat_twr_job_t *jobs, int count)
+{
+	mlat_twr_fn fn, fns[MLAT_MAX_ANCHORS * 2];
+	int i, k, nf = 0, solved = 0;
+
+	for (i = 0; i < count; i++)
+	{
+		if ((fn = mlat_twr_fn_of(&jobs[i])) == NULL)
+		{
+			jobs[i].status = -1;
+			continue;
+		}
+		for (k = 0; k < nf && fns[k] != fn; k++)
+			;
+		if (k == nf)
+			fns[nf++] = fn;
+	}
+
+	for (k = 0; k < nf; k++)
+		for (i = 0; i < count; i++)
+			if (mlat_twr_fn_of(&jobs[i]) == fns[k] && fns[k](&jobs[i]) == 0)
+				solved++;
+
+	return solved;
+}
@@ -0,0 +1,87 @@
+/*
+ * mlat.h
+ *
+ * Multilateration: position of a tag from anchor range differences (TDoA) or ranges (TWR).
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _MLAT_H_
+#define _MLAT_H_
+
+/* Anchors in a fix. With fewer than MLAT_3D_ANCHORS (MLAT_TWR_3D_ANCHORS for ranges), the tag is solved in a horizontal
+ * plane at a given height. */
+#define MLAT_MIN_ANCHORS  3
+#define MLAT_MAX_ANCHORS  8
+#define MLAT_3D_ANCHORS   5
+#define MLAT_TWR_3D_ANCHORS 4
+
+/* RMS residual (m) under which two candidate positions fit the differences equally well, and the distance (m) between
+ * such candidates above which there is no telling which one the tag is at */
+#define MLAT_TIE          0.1
+#define MLAT_AMBIGUITY    0.5
+
+/* Largest dilution of precision (position error per range error) of a fix */
+#define MLAT_MAX_DOP      10.0
+
+/* Gauss-Newton iterations, and the step (m) below which they stop */
+#define MLAT_GN_ITER      10
+#define MLAT_GN_TOL       1e-4
+
+/* Speed of light, m/s */
+#define MLAT_C            299792458.0
+
+typedef struct {
+	double p[3];          // position (m)
+	double resid;         // RMS of the range difference residuals (m)
+	double dop;           // dilution of precision of the anchors at p
+	int iter;             // Gauss-Newton iterations run
+} mlat_fix_t;
+
+/*
+ * One TDoA problem: n anchors at a[], and the range differences r[i] = |p - a[i]| - |p - a[0]| (r[0] is unused), so the
+ * first anchor is the reference. Give it the best reception: all the differences share its error.
+ */
+typedef struct {
+	double a[MLAT_MAX_ANCHORS][3];
+	double r[MLAT_MAX_ANCHORS];
+	int n;
+	double z;             // tag height (m) for planar fixes
+	int planar;           // solve in the plane z = z even with MLAT_3D_ANCHORS or more
+	mlat_fix_t fix;       // solution
+	int status;           // 0 if solved, -1 if not (no solution, two of them, or dop over MLAT_MAX_DOP)
+} mlat_tdoa_job_t;
+
+/*
+ * One TWR problem: n anchors at a[], the ranges d[i] = |p - a[i]| measured to them and their weights w[i], the inverse of
+ * their variance. Solved by weighted least squares, from p0 if warm is set (e.g. the previous position of the tag).
+ */
+typedef struct {
+	double a[MLAT_MAX_ANCHORS][3];
+	double d[MLAT_MAX_ANCHORS];
+	double w[MLAT_MAX_ANCHORS];   // 1/m^2
+	int n;
+	double z;             // tag height (m) for planar fixes, and the starting height otherwise
+	int planar;           // solve in the plane z = z even with MLAT_TWR_3D_ANCHORS or more
+	double p0[3];         // starting position
+	int warm;             // start from p0 rather than from the linearised ranges
+	mlat_fix_t fix;       // solution; resid is the weighted RMS of the range residuals
+	int status;           // 0 if solved, -1 if not (no solution or dop over MLAT_MAX_DOP)
+} mlat_twr_job_t;
+
+/* Solve job. Returns job->status. */
+int mlat_tdoa(mlat_tdoa_job_t *job);
+int mlat_twr(mlat_twr_job_t *job);
+
+/* Solve count jobs, grouped by solver. Returns the number solved. */
+int mlat_tdoa_batch(mlat_tdoa_job_t *jobs, int count);
+int mlat_twr_batch(mlat_twr_job_t *jobs, int count);
+
+#endif /* _MLAT_H_ */
@@ -0,0 +1,221 @@
+/*
+ * possvc.c
+ *
+ * Positioning services (tdoa_agg, twr_agg): the anchor configuration they share, the loop that feeds them the lines of
+ * stdin, and the bookkeeping of their simulations.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "possvc.h"
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <sys/select.h>
+
+int possvc_load(possvc_conf_t *c, const char *path)
+{
+	char line[128], name[32];
+	unsigned long long eui;
+	double p[3], value;
+	FILE *fp;
+
+	memset(c, 0, sizeof(*c));
+	if ((fp = fopen(path, "r")) == NULL)
+		return -1;
+
+	while (fgets(line, sizeof(line), fp) != NULL)
+	{
+		if (line[0] == '#' || sscanf(line, "%31s", name) != 1)
+			continue;
+
+		if (!strcmp(name, "anchor") && sscanf(line, "%*s %llx %lf %lf %lf", &eui, &p[0], &p[1], &p[2]) == 4)
+		{
+			if (c->n_anchors < POSSVC_ANCHORS)
+			{
+				c->anchors[c->n_anchors].eui = eui;
+				memcpy(c->anchors[c->n_anchors++].p, p, sizeof(p));
+			}
+		}
+		else if (!strcmp(name, "ref") && sscanf(line, "%*s %llx %lf %lf %lf", &eui, &p[0], &p[1], &p[2]) == 4)
+		{
+			c->ref.eui = eui;
+			memcpy(c->ref.p, p, sizeof(p));
+			c->has_ref = 1;
+		}
+		else if (strlen(name) < sizeof(c->values[0].name) && c->n_values < POSSVC_VALUES &&
+				 sscanf(line, "%*s %lf", &value) == 1)
+		{
+			strcpy(c->values[c->n_values].name, name);
+			c->values[c->n_values++].value = value;
+		}
+	}
+
+	fclose(fp);
+	return 0;
+}
+
+int possvc_value(const possvc_conf_t *c, const char *name, double *value)
+{
+	int i;
+
+	/* The last line wins */
+	for (i = c->n_values - 1; i >= 0; i--)
+	{
+		if (!strcmp(c->values[i].name, name))
+		{
+			*value = c->values[i].value;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int possvc_args(int argc, char *argv[], const char *sim_name, possvc_conf_t *c, long *sim_n)
+{
+	if (argc < 2 || argc > 3)
+	{
+		printf("usage: %s ANCHORS_CONF [%s]\n", argv[0], sim_name);
+		return -1;
+	}
+
+	if (possvc_load(c, argv[1]) != 0)
+	{
+		printf("%s: cannot be read\n", argv[1]);
+		return -1;
+	}
+
+	*sim_n = (argc == 3) ? atol(argv[2]) : 0;
+	return 0;
+}
+
+double possvc_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+double possvc_gauss(void)
+{
+	double u = (rand() + 1.0) / (RAND_MAX + 2.0), v = (rand() + 1.0) / (RAND_MAX + 2.0);
+	return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+void possvc_run(const possvc_ops_t *ops)
+{
+	static char buf[1 << 16];
+	size_t len = 0;
+	double start = possvc_now(), last = start;
+
+	while (1)
+	{
+		struct timeval tv = { 0, (long)(POSSVC_POLL_S * 1e6) };
+		fd_set fds;
+		ssize_t got;
+		char *line, *nl;
+
+		FD_ZERO(&fds);
+		FD_SET(0, &fds);
+		if (select(1, &fds, NULL, NULL, &tv) > 0)
+		{
+			if ((got = read(0, buf + len, sizeof(buf) - 1 - len)) <= 0)
+				break;
+			len += got;
+			buf[len] = '\0';
+
+			for (line = buf; (nl = strchr(line, '\n')) != NULL; line = nl + 1)
+			{
+				*nl = '\0';
+				ops->line(ops->arg, line, possvc_now());
+			}
+			len -= line - buf;
+			memmove(buf, line, len);
+			if (len == sizeof(buf) - 1)
+				len = 0;
+		}
+
+		ops->poll(ops->arg, possvc_now());
+		if (possvc_now() - last >= 1)
+		{
+			last = possvc_now();
+			ops->stats(ops->arg, last - start);
+		}
+		fflush(stdout);
+	}
+
+	ops->flush(ops->arg, possvc_now());
+	ops->stats(ops->arg, possvc_now() - start);
+}
+
+void possvc_sim_init(possvc_sim_t *s, const possvc_conf_t *c)
+{
+	int i, k;
+
+	memset(s, 0, sizeof(*s));
+	s->lo[0] = s->lo[1] = 1e9;
+	s->hi[0] = s->hi[1] = -1e9;
+	for (i = 0; i < c->n_anchors; i++)
+	{
+		for (k = 0; k < 2; k++)
+		{
+			if (c->anchors[i].p[k] < s->lo[k]) s->lo[k] = c->anchors[i].p[k];
+			if (c->anchors[i].p[k] > s->hi[k]) s->hi[k] = c->anchors[i].p[k];
+		}
+	}
+}
+
+void possvc_sim_place(const possvc_sim_t *s, double *p, double z)
+{
+	p[0] = s->lo[0] + (s->hi[0] - s->lo[0]) * rand() / RAND_MAX;
+	p[1] = s->lo[1] + (s->hi[1] - s->lo[1]) * rand() / RAND_MAX;
+	p[2] = z;
+}
+
+void possvc_sim_fix(possvc_sim_t *s, const double *p, const double *truth)
+{
+	double dx = p[0] - truth[0], dy = p[1] - truth[1], dz = p[2] - truth[2], e2 = dx * dx + dy * dy + dz * dz;
+	double e = sqrt(e2);
+
+	s->err2_xy += dx * dx + dy * dy;
+	s->err2 += e2;
+	if (e > s->err_max)
+		s->err_max = e;
+	if (e > 1)
+		s->over_1m++;
+	s->hist[e < POSSVC_HIST_BIN * POSSVC_HIST_BINS ? (int)(e / POSSVC_HIST_BIN) : POSSVC_HIST_BINS]++;
+	s->n++;
+}
+
+/* Error (m) that half the fixes are within, to POSSVC_HIST_BIN */
+static double possvc_sim_median(const possvc_sim_t *s)
+{
+	uint64_t below = 0;
+	int i;
+
+	for (i = 0; i < POSSVC_HIST_BINS; i++)
+	{
+		below += s->hist[i];
+		if (2 * below >= s->n)
+			break;
+	}
+	return (i + 0.5) * POSSVC_HIST_BIN;
+}
+
+void possvc_sim_print(const possvc_sim_t *s, const char *what, long count)
+{
+	printf("SIM %s %ld fixes %llu error rms %.3f m (%.3f m horizontal) median %.3f m max %.3f m over 1 m %llu\n", what,
+		   count, (unsigned long long)s->n, s->n ? sqrt(s->err2 / s->n) : 0, s->n ? sqrt(s->err2_xy / s->n) : 0,
+		   s->n ? possvc_sim_median(s) : 0, s->err_max, (unsigned long long)s->over_1m);
+}
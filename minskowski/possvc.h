@@ -0,0 +1,107 @@
+/*
+ * possvc.h
+ *
+ * Positioning services (tdoa_agg, twr_agg): the anchor configuration they share, the loop that feeds them the lines of
+ * stdin, and the bookkeeping of their simulations.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _POSSVC_H_
+#define _POSSVC_H_
+
+#include <stdint.h>
+
+/* Anchors, and other values, a configuration holds */
+#define POSSVC_ANCHORS     32
+#define POSSVC_VALUES      16
+
+/* Longest wait for input before the service is polled (s) */
+#define POSSVC_POLL_S      0.01
+
+/* EUI of the first synthetic tag */
+#define POSSVC_SIM_TAG_EUI 0x5151000000000000ULL
+
+/* Histogram of the position errors of a simulation, for the median: bin (m), and how many */
+#define POSSVC_HIST_BIN    0.001
+#define POSSVC_HIST_BINS   10000
+
+typedef struct {
+	uint64_t eui;
+	double p[3];          // position (m)
+} possvc_anchor_t;
+
+typedef struct {
+	possvc_anchor_t anchors[POSSVC_ANCHORS];
+	int n_anchors;
+	possvc_anchor_t ref;  // reference tag, at a known position
+	int has_ref;
+	struct {
+		char name[16];
+		double value;
+	} values[POSSVC_VALUES];  // the "NAME value" lines, for the service to pick from
+	int n_values;
+} possvc_conf_t;
+
+/* What the service does with its input, all given arg */
+typedef struct {
+	void (*line)(void *arg, const char *line, double now);  // a line of stdin, read at now (s)
+	void (*poll)(void *arg, double now);                    // at least every POSSVC_POLL_S
+	void (*stats)(void *arg, double elapsed);               // every second, and at the end
+	void (*flush)(void *arg, double now);                   // at the end of the input
+	void *arg;
+} possvc_ops_t;
+
+typedef struct {
+	double lo[2], hi[2];  // horizontal extent of the anchors (m)
+	double err2, err2_xy; // sums of the squared position errors
+	double err_max;
+	uint64_t over_1m;     // fixes more than 1 m off
+	uint64_t n;
+	uint32_t hist[POSSVC_HIST_BINS + 1];  // fixes by error, the last bin for the rest
+} possvc_sim_t;
+
+/*
+ * Load "anchor EUI x y z", "ref EUI x y z" and "NAME value" lines from path (EUIs in hex, as in the records, lengths in
+ * m); lines starting with # are comments. Returns 0, or -1 if the file cannot be read.
+ */
+int possvc_load(possvc_conf_t *c, const char *path);
+
+/* Set *value to the value of the NAME line. Returns 1, or 0 (leaving *value) if there is none. */
+int possvc_value(const possvc_conf_t *c, const char *name, double *value);
+
+/*
+ * Read "ANCHORS_CONF [sim_name]" from the command line: load the configuration into c, and set *sim_n to the number
+ * given for a simulation, 0 if none. Returns 0, or -1 after saying what is wrong.
+ */
+int possvc_args(int argc, char *argv[], const char *sim_name, possvc_conf_t *c, long *sim_n);
+
+/* Time on a monotonic clock (s). */
+double possvc_now(void);
+
+/* Standard normal deviate, from rand(). */
+double possvc_gauss(void);
+
+/* Feed the lines of stdin to the service until its end. */
+void possvc_run(const possvc_ops_t *ops);
+
+/* Start a simulation over the anchors of c. */
+void possvc_sim_init(possvc_sim_t *s, const possvc_conf_t *c);
+
+/* Random horizontal position within the anchors, at height z. */
+void possvc_sim_place(const possvc_sim_t *s, double *p, double z);
+
+/* Account for a fix at p of a tag at truth. */
+void possvc_sim_fix(possvc_sim_t *s, const double *p, const double *truth);
+
+/* Print the SIM line: count of what (blinks, cycles) given, and the errors. */
+void possvc_sim_print(const possvc_sim_t *s, const char *what, long count);
+
+#endif /* _POSSVC_H_ */
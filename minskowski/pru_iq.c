@@ -0,0 +1,148 @@
+/*
+ * pru_iq.c
+ *
+ * Continuous CC1200 IQ capture by PRU0 into a ring buffer in PRU shared RAM (see SPI.p).
+ *
+ * The PRU program is loaded once and keeps running: while capturing it appends every sample to the ring and advances
+ * the head index, and the ARM reads the samples in place and advances the tail index. Capture is paused, rather than
+ * the PRU reloaded, whenever the ARM needs MCSPI1 for the CC1200 or the XO DAC.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "pru_iq.h"
+#include <stdio.h>
+#include <pruss/prussdrv.h>
+#include <pruss/pruss_intc_mapping.h>
+#include "SPI_bin.h"
+
+#define PRU_NUM 	0
+#define PRUSS0_SHARED_DATARAM    4
+
+#define PRU_IQ_WORD(offset) (pru_ctrl[(offset) / 4])
+
+static void *sharedMem;
+static volatile uint32_t *pru_ctrl;
+static volatile struct IQSample *pru_ring;
+static uint32_t tail;
+
+int pru_iq_open(void)
+{
+	unsigned int ret;
+	tpruss_intc_initdata pruss_intc_initdata = PRUSS_INTC_INITDATA;
+
+	//Initializing PRU
+	prussdrv_init();
+	ret = prussdrv_open(PRU_EVTOUT_0);
+	if (ret){
+		printf("\tERROR: prussdrv_open open failed\n");
+		return -1;
+	}
+
+	prussdrv_pruintc_init(&pruss_intc_initdata);
+	prussdrv_map_prumem(PRUSS0_SHARED_DATARAM, &sharedMem);
+
+	pru_ctrl = (volatile uint32_t *) sharedMem;
+	pru_ring = (volatile struct IQSample *) ((uint8_t *) sharedMem + PRU_IQ_RING_OFFSET);
+
+	// The PRU clears head and the drop count itself
+	tail = 0;
+	PRU_IQ_WORD(PRU_IQ_TAIL_OFFSET) = 0;
+	PRU_IQ_WORD(PRU_IQ_CTRL_OFFSET) = PRU_IQ_CTRL_PAUSE;
+	PRU_IQ_WORD(PRU_IQ_STATE_OFFSET) = PRU_IQ_CTRL_EXIT;
+
+	/* Executing PRU. */
+	prussdrv_pru_write_memory(PRUSS0_PRU0_IRAM, PRU_NUM, PRUcode, sizeof(PRUcode));
+	prussdrv_pru_enable(PRU_NUM);
+
+	// Wait until the program is up and idle
+	while (PRU_IQ_WORD(PRU_IQ_STATE_OFFSET) != PRU_IQ_CTRL_PAUSE)
+	{ };
+
+	return 0;
+}
+
+void pru_iq_start(void)
+{
+	// Paused, so head is stable
+	tail = PRU_IQ_WORD(PRU_IQ_HEAD_OFFSET);
+	PRU_IQ_WORD(PRU_IQ_TAIL_OFFSET) = tail;
+
+	PRU_IQ_WORD(PRU_IQ_CTRL_OFFSET) = PRU_IQ_CTRL_CAPTURE;
+	while (PRU_IQ_WORD(PRU_IQ_STATE_OFFSET) != PRU_IQ_CTRL_CAPTURE)
+	{ };
+}
+
+void pru_iq_pause(void)
+{
+	PRU_IQ_WORD(PRU_IQ_CTRL_OFFSET) = PRU_IQ_CTRL_PAUSE;
+	while (PRU_IQ_WORD(PRU_IQ_STATE_OFFSET) != PRU_IQ_CTRL_PAUSE)
+	{ };
+}
+
+const struct IQSample *pru_iq_next(void)
+{
+	while (PRU_IQ_WORD(PRU_IQ_HEAD_OFFSET) == tail)
+	{ };
+
+	// Make sure the record is read after the head index that published it
+	__sync_synchronize();
+
+	return (const struct IQSample *) &pru_ring[tail % PRU_IQ_RING_LEN];
+}
+
+void pru_iq_release(void)
+{
+	tail++;
+	__sync_synchronize();
+	PRU_IQ_WORD(PRU_IQ_TAIL_OFFSET) = tail;
+}
+
+uint32_t pru_iq_span(const struct IQSample **first)
+{
+	uint32_t head, count;
+
+	while ((head = PRU_IQ_WORD(PRU_IQ_HEAD_OFFSET)) == tail)
+	{ };
+
+	__sync_synchronize();
+
+	// Records past the end of the ring are at its start, which is not contiguous
+	count = head - tail;
+	if (count > PRU_IQ_RING_LEN - tail % PRU_IQ_RING_LEN)
+		count = PRU_IQ_RING_LEN - tail % PRU_IQ_RING_LEN;
+
+	*first = (const struct IQSample *) &pru_ring[tail % PRU_IQ_RING_LEN];
+	return count;
+}
+
+void pru_iq_consume(uint32_t count)
+{
+	tail += count;
+	__sync_synchronize();
+	PRU_IQ_WORD(PRU_IQ_TAIL_OFFSET) = tail;
+}
+
+uint32_t pru_iq_dropped(void)
+{
+	return PRU_IQ_WORD(PRU_IQ_DROP_OFFSET);
+}
+
+void pru_iq_close(void)
+{
+	PRU_IQ_WORD(PRU_IQ_CTRL_OFFSET) = PRU_IQ_CTRL_EXIT;
+	prussdrv_pru_wait_event(PRU_EVTOUT_0);
+
+	// Disable PRU
+	prussdrv_pru_disable(PRU_NUM);
+
+	// Exit PRU
+	prussdrv_exit();
+}
@@ -0,0 +1,73 @@
+/*
+ * pru_iq.h
+ *
+ * Continuous CC1200 IQ capture by PRU0 into a ring buffer in PRU shared RAM (see SPI.p).
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _PRU_IQ_H_
+#define _PRU_IQ_H_
+
+#include <stdint.h>
+
+/* Shared RAM layout, must match SPI.hp */
+#define PRU_IQ_HEAD_OFFSET   0      // samples written by the PRU (free running)
+#define PRU_IQ_TAIL_OFFSET   4      // samples consumed by the ARM (free running)
+#define PRU_IQ_CTRL_OFFSET   8      // command from the ARM
+#define PRU_IQ_STATE_OFFSET  12     // command the PRU last acted upon
+#define PRU_IQ_DROP_OFFSET   16     // samples dropped because the ring was full
+#define PRU_IQ_RING_OFFSET   32
+#define PRU_IQ_RING_LEN      1024
+
+#define PRU_IQ_CTRL_PAUSE    0
+#define PRU_IQ_CTRL_CAPTURE  1
+#define PRU_IQ_CTRL_EXIT     2
+
+/* One CC1200 status + MAGN + ANG read, as clocked out by the PRU */
+struct IQSample {
+	uint8_t status0;
+	uint8_t status1;
+	uint8_t magn2;
+	uint8_t magn1;
+	uint8_t magn0;
+	uint8_t ang1;
+	uint8_t ang0;
+};
+
+/* Load SPI.p into PRU0 and start it, paused. Call once per process. Returns 0 on success. */
+int pru_iq_open(void);
+
+/* Start capturing. Samples older than this call are discarded. */
+void pru_iq_start(void);
+
+/* Pause capturing and wait until the PRU has released MCSPI1, so the CC1200 and the XO DAC can be accessed. */
+void pru_iq_pause(void);
+
+/* Wait for the next sample and return it in place. It stays valid until pru_iq_release(). */
+const struct IQSample *pru_iq_next(void);
+
+/* Give the sample returned by pru_iq_next() back to the PRU. */
+void pru_iq_release(void);
+
+/* Wait for at least one sample and return the samples available in place, up to the end of the ring, so that they can
+ * be processed as one block. They stay valid until pru_iq_consume(). */
+uint32_t pru_iq_span(const struct IQSample **first);
+
+/* Give the first count samples returned by pru_iq_span() back to the PRU. */
+void pru_iq_consume(uint32_t count);
+
+/* Number of samples dropped because the ring was full, since pru_iq_open(). */
+uint32_t pru_iq_dropped(void);
+
+/* Stop the PRU program and release the PRU. */
+void pru_iq_close(void);
+
+#endif /* _PRU_IQ_H_ */
@@ -0,0 +1,508 @@
+/*
+ * survey.c
+ *
+ * Anchor self-survey: schedules the ranging between every pair of anchors, turns the ranges of each pair into a robust
+ * estimate, and solves the relative anchor coordinates.
+ *
+ * The schedule is the circle method of round robin tournaments: one anchor stays put while the others rotate, so each of
+ * the n - 1 rounds (n rounded up to even) pairs every anchor once and all the pairs of a round can range at the same
+ * time. A pair's estimate is the mean of its ranges within SURVEY_MAD_K median absolute deviations of their median. The
+ * coordinates start from classical MDS of the estimates (pairs not measured take the shortest path through the others)
+ * and are refined by Levenberg-Marquardt on the measured pairs, each weighted by the inverse of its variance.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "survey.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#define SURVEY_INF 1e30
+
+static inline int survey_idx(int i, int j)
+{
+	if (i > j)
+	{
+		int t = i;
+		i = j;
+		j = t;
+	}
+	return i * (2 * SURVEY_ANCHORS - i - 1) / 2 + (j - i - 1);
+}
+
+int survey_rounds(int n)
+{
+	return (n < 2) ? 0 : ((n + 1) & ~1) - 1;
+}
+
+int survey_slots(int n)
+{
+	return ((n + 1) / 2 + SURVEY_CODES - 1) / SURVEY_CODES;
+}
+
+double survey_round_ms(int n)
+{
+	return SURVEY_GUARD_MS + survey_slots(n) * SURVEY_SLOT_MS + SURVEY_END_GUARD_MS;
+}
+
+int survey_partner(int n, int round, int id, int *slot)
+{
+	int m = (n + 1) & ~1, r = m - 1, k, a, b;
+
+	if (n < 2 || id < 0 || id >= n)
+		return -1;
+
+	round %= r;
+	for (k = 0; k < m / 2; k++)
+	{
+		a = (k == 0) ? round : (round + k) % r;
+		b = (k == 0) ? m - 1 : (round - k + r) % r;
+		if (id == a || id == b)
+		{
+			b = (id == a) ? b : a;
+			if (b >= n)
+				return -1;
+			if (slot)
+				*slot = k;
+			return b;
+		}
+	}
+	return -1;
+}
+
+void survey_init(survey_t *s)
+{
+	memset(s, 0, sizeof(*s));
+}
+
+int survey_add(survey_t *s, int i, int j, double d)
+{
+	int k;
+
+	if (i < 0 || j < 0 || i >= SURVEY_ANCHORS || j >= SURVEY_ANCHORS || i == j || !(d >= 0))
+		return -1;
+
+	s->ranges++;
+	k = survey_idx(i, j);
+	if (s->cnt[k] >= SURVEY_SAMPLES)
+	{
+		s->dropped++;
+		return -1;
+	}
+	s->s[k][s->cnt[k]++] = (float)d;
+	if (i >= s->n)
+		s->n = i + 1;
+	if (j >= s->n)
+		s->n = j + 1;
+	return 0;
+}
+
+static void survey_sort(double *v, int n)
+{
+	int i, j;
+
+	for (i = 1; i < n; i++)
+	{
+		double x = v[i];
+		for (j = i; j > 0 && v[j - 1] > x; j--)
+			v[j] = v[j - 1];
+		v[j] = x;
+	}
+}
+
+int survey_pair(const survey_t *s, int i, int j, double *d, double *std)
+{
+	double v[SURVEY_SAMPLES], dev[SURVEY_SAMPLES], med, lim, sum = 0, sum2 = 0, sd;
+	int k, n, m = 0, idx;
+
+	if (i == j || i < 0 || j < 0 || i >= SURVEY_ANCHORS || j >= SURVEY_ANCHORS)
+		return 0;
+	idx = survey_idx(i, j);
+	if ((n = s->cnt[idx]) == 0)
+		return 0;
+
+	for (k = 0; k < n; k++)
+		v[k] = s->s[idx][k];
+	survey_sort(v, n);
+	med = (v[(n - 1) / 2] + v[n / 2]) / 2;
+
+	for (k = 0; k < n; k++)
+		dev[k] = fabs(v[k] - med);
+	survey_sort(dev, n);
+	lim = SURVEY_MAD_K * fmax(1.4826 * (dev[(n - 1) / 2] + dev[n / 2]) / 2, SURVEY_RANGE_STD);
+
+	for (k = 0; k < n; k++)
+	{
+		if (fabs(v[k] - med) > lim)
+			continue;
+		sum += v[k];
+		sum2 += v[k] * v[k];
+		m++;
+	}
+
+	*d = sum / m;
+	sd = (m > 1) ? sqrt(fmax(sum2 - sum * sum / m, 0) / (m - 1)) : 0;
+	sd = fmax(sd, SURVEY_RANGE_STD);
+	*std = sqrt(sd * sd / m + SURVEY_SYS_STD * SURVEY_SYS_STD);
+	return m;
+}
+
+/* Eigenvalues (in l) and eigenvectors (columns of V) of the symmetric n x n matrix A, by cyclic Jacobi rotations */
+static void survey_eigen(double A[SURVEY_ANCHORS][SURVEY_ANCHORS], int n, double *l, double V[SURVEY_ANCHORS][SURVEY_ANCHORS])
+{
+	int i, j, k, sweep;
+
+	for (i = 0; i < n; i++)
+		for (j = 0; j < n; j++)
+			V[i][j] = (i == j);
+
+	for (sweep = 0; sweep < 50; sweep++)
+	{
+		double off = 0, norm = 0;
+
+		for (i = 0; i < n; i++)
+			for (j = 0; j < n; j++)
+			{
+				norm += A[i][j] * A[i][j];
+				if (i != j)
+					off += A[i][j] * A[i][j];
+			}
+		if (off <= 1e-24 * norm)
+			break;
+
+		for (i = 0; i < n - 1; i++)
+			for (j = i + 1; j < n; j++)
+			{
+				double th, t, c, sn, aik, ajk;
+
+				if (A[i][j] == 0)
+					continue;
+				th = (A[j][j] - A[i][i]) / (2 * A[i][j]);
+				t = ((th >= 0) ? 1 : -1) / (fabs(th) + sqrt(th * th + 1));
+				c = 1 / sqrt(t * t + 1);
+				sn = t * c;
+
+				for (k = 0; k < n; k++)
+				{
+					aik = A[i][k];
+					ajk = A[j][k];
+					A[i][k] = c * aik - sn * ajk;
+					A[j][k] = sn * aik + c * ajk;
+				}
+				for (k = 0; k < n; k++)
+				{
+					aik = A[k][i];
+					ajk = A[k][j];
+					A[k][i] = c * aik - sn * ajk;
+					A[k][j] = sn * aik + c * ajk;
+				}
+				for (k = 0; k < n; k++)
+				{
+					aik = V[k][i];
+					ajk = V[k][j];
+					V[k][i] = c * aik - sn * ajk;
+					V[k][j] = sn * aik + c * ajk;
+				}
+			}
+	}
+
+	for (i = 0; i < n; i++)
+		l[i] = A[i][i];
+}
+
+/* Classical MDS of the n x n distances d into p */
+static void survey_mds(survey_t *s, int dim)
+{
+	static double B[SURVEY_ANCHORS][SURVEY_ANCHORS], V[SURVEY_ANCHORS][SURVEY_ANCHORS];
+	double l[SURVEY_ANCHORS], row[SURVEY_ANCHORS], all = 0;
+	int n = s->n, i, j, k, used[SURVEY_ANCHORS] = { 0 };
+
+	/* B = -1/2 J D^2 J, J the centering matrix */
+	for (i = 0; i < n; i++)
+	{
+		row[i] = 0;
+		for (j = 0; j < n; j++)
+			row[i] += s->d[i][j] * s->d[i][j] / n;
+		all += row[i] / n;
+	}
+	for (i = 0; i < n; i++)
+		for (j = 0; j < n; j++)
+			B[i][j] = -0.5 * (s->d[i][j] * s->d[i][j] - row[i] - row[j] + all);
+
+	survey_eigen(B, n, l, V);
+
+	/* Coordinates along the dim largest eigenvalues */
+	memset(s->p, 0, sizeof(s->p));
+	for (k = 0; k < dim; k++)
+	{
+		int best = -1;
+
+		for (i = 0; i < n; i++)
+			if (!used[i] && (best < 0 || l[i] > l[best]))
+				best = i;
+		used[best] = 1;
+		for (i = 0; i < n; i++)
+			s->p[i][k] = V[i][best] * sqrt(fmax(l[best], 0));
+	}
+}
+
+double survey_dist(const double *a, const double *b)
+{
+	double dx = a[0] - b[0], dy = a[1] - b[1], dz = a[2] - b[2];
+	return sqrt(dx * dx + dy * dy + dz * dz);
+}
+
+static double survey_cost(const survey_t *s, double p[SURVEY_ANCHORS][3])
+{
+	double cost = 0, f;
+	int i, j;
+
+	for (i = 0; i < s->n; i++)
+		for (j = i + 1; j < s->n; j++)
+			if (s->w[i][j] > 0)
+			{
+				f = survey_dist(p[i], p[j]) - s->d[i][j];
+				cost += s->w[i][j] * f * f;
+			}
+	return cost;
+}
+
+/* Solve the m x m system H x = g in place in g by Cholesky. Returns -1 if H is not positive definite. */
+static int survey_cholesky(double H[SURVEY_ANCHORS * 3][SURVEY_ANCHORS * 3], double *g, int m)
+{
+	int i, j, k;
+
+	for (j = 0; j < m; j++)
+	{
+		double sum = H[j][j];
+
+		for (k = 0; k < j; k++)
+			sum -= H[j][k] * H[j][k];
+		if (sum <= 0)
+			return -1;
+		H[j][j] = sqrt(sum);
+		for (i = j + 1; i < m; i++)
+		{
+			sum = H[i][j];
+			for (k = 0; k < j; k++)
+				sum -= H[i][k] * H[j][k];
+			H[i][j] = sum / H[j][j];
+		}
+	}
+	for (i = 0; i < m; i++)
+	{
+		for (k = 0; k < i; k++)
+			g[i] -= H[i][k] * g[k];
+		g[i] /= H[i][i];
+	}
+	for (i = m - 1; i >= 0; i--)
+	{
+		for (k = i + 1; k < m; k++)
+			g[i] -= H[k][i] * g[k];
+		g[i] /= H[i][i];
+	}
+	return 0;
+}
+
+/* Levenberg-Marquardt on the measured pairs */
+static void survey_refine(survey_t *s, int dim)
+{
+	static double q[SURVEY_ANCHORS][3];
+	double g[SURVEY_ANCHORS * 3], lambda = 1e-3, cost = survey_cost(s, s->p);
+	int n = s->n, m = n * dim, i, j, a, b, it, tries;
+
+	for (it = 0; it < SURVEY_ITER; it++)
+	{
+		double step2 = 0, c1 = cost;
+
+		for (tries = 0; tries < 10; tries++)
+		{
+			memset(g, 0, sizeof(g[0]) * m);
+			for (i = 0; i < m; i++)
+				memset(s->H[i], 0, sizeof(s->H[i][0]) * m);
+
+			for (i = 0; i < n; i++)
+				for (j = i + 1; j < n; j++)
+				{
+					double u[3], dist, f, w = s->w[i][j];
+
+					if (w <= 0)
+						continue;
+					dist = fmax(survey_dist(s->p[i], s->p[j]), 1e-9);
+					f = dist - s->d[i][j];
+					for (a = 0; a < dim; a++)
+						u[a] = (s->p[i][a] - s->p[j][a]) / dist;
+					for (a = 0; a < dim; a++)
+					{
+						g[i * dim + a] -= w * f * u[a];
+						g[j * dim + a] += w * f * u[a];
+						for (b = 0; b < dim; b++)
+						{
+							s->H[i * dim + a][i * dim + b] += w * u[a] * u[b];
+							s->H[j * dim + a][j * dim + b] += w * u[a] * u[b];
+							s->H[i * dim + a][j * dim + b] -= w * u[a] * u[b];
+							s->H[j * dim + a][i * dim + b] -= w * u[a] * u[b];
+						}
+					}
+				}
+
+			/* The damping also pins the translation and rotation the ranges leave free */
+			for (i = 0; i < m; i++)
+				s->H[i][i] += lambda * (s->H[i][i] + 1e-6);
+
+			if (survey_cholesky(s->H, g, m) == 0)
+			{
+				memcpy(q, s->p, sizeof(q));
+				for (i = 0; i < n; i++)
+					for (a = 0; a < dim; a++)
+						q[i][a] += g[i * dim + a];
+				if ((c1 = survey_cost(s, q)) <= cost)
+					break;
+			}
+			lambda *= 4;
+		}
+		if (tries == 10)
+			break;
+
+		for (i = 0; i < m; i++)
+			step2 += g[i] * g[i];
+		memcpy(s->p, q, sizeof(q));
+		cost = c1;
+		lambda = fmax(lambda / 3, 1e-9);
+		if (step2 / n < SURVEY_TOL * SURVEY_TOL)
+		{
+			it++;
+			break;
+		}
+	}
+	s->iter = it;
+}
+
+/* Move p to anchor 0 at the origin, anchor 1 on the x axis and anchor 2 in the xy plane, on the side of y > 0 */
+static void survey_frame(survey_t *s, int dim)
+{
+	double e[3][3], o[3], v[3], len, dot;
+	int i, k, top = -1;
+
+	memcpy(o, s->p[0], sizeof(o));
+	for (i = 0; i < s->n; i++)
+		for (k = 0; k < 3; k++)
+			s->p[i][k] -= o[k];
+
+	memset(e, 0, sizeof(e));
+	len = survey_dist(s->p[1], e[0]);
+	for (k = 0; k < 3; k++)
+		e[0][k] = (len > 0) ? s->p[1][k] / len : (k == 0);
+
+	dot = s->p[2][0] * e[0][0] + s->p[2][1] * e[0][1] + s->p[2][2] * e[0][2];
+	for (k = 0; k < 3; k++)
+		v[k] = s->p[2][k] - dot * e[0][k];
+	len = sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+	if (len > 0)
+		for (k = 0; k < 3; k++)
+			e[1][k] = v[k] / len;
+	else
+	{
+		e[1][0] = -e[0][1];
+		e[1][1] = e[0][0];
+	}
+
+	e[2][0] = e[0][1] * e[1][2] - e[0][2] * e[1][1];
+	e[2][1] = e[0][2] * e[1][0] - e[0][0] * e[1][2];
+	e[2][2] = e[0][0] * e[1][1] - e[0][1] * e[1][0];
+
+	for (i = 0; i < s->n; i++)
+	{
+		memcpy(v, s->p[i], sizeof(v));
+		for (k = 0; k < 3; k++)
+			s->p[i][k] = v[0] * e[k][0] + v[1] * e[k][1] + v[2] * e[k][2];
+		if (dim == 3 && (top < 0 || fabs(s->p[i][2]) > fabs(s->p[top][2])))
+			top = i;
+	}
+
+	/* The ranges cannot tell a 3D survey from its mirror image: put the anchor furthest from the plane above it */
+	if (top >= 0 && s->p[top][2] < 0)
+		for (i = 0; i < s->n; i++)
+			s->p[i][2] = -s->p[i][2];
+}
+
+int survey_solve(survey_t *s, int dim)
+{
+	double std;
+	int n = s->n, i, j, k;
+
+	if (n < dim + 1 || dim < 2 || dim > 3)
+		return -1;
+
+	for (i = 0; i < n; i++)
+	{
+		s->d[i][i] = 0;
+		s->w[i][i] = 0;
+		for (j = i + 1; j < n; j++)
+		{
+			if (survey_pair(s, i, j, &s->d[i][j], &std) > 0)
+				s->w[i][j] = 1 / (std * std);
+			else
+			{
+				s->d[i][j] = SURVEY_INF;
+				s->w[i][j] = 0;
+			}
+			s->d[j][i] = s->d[i][j];
+			s->w[j][i] = s->w[i][j];
+		}
+	}
+
+	/* Pairs not measured: shortest path through the others (Floyd-Warshall) */
+	for (k = 0; k < n; k++)
+		for (i = 0; i < n; i++)
+			for (j = 0; j < n; j++)
+				if (s->d[i][k] + s->d[k][j] < s->d[i][j])
+					s->d[i][j] = s->d[i][k] + s->d[k][j];
+	for (i = 0; i < n; i++)
+		for (j = 0; j < n; j++)
+			if (s->d[i][j] >= SURVEY_INF)
+				return -1;
+
+	survey_mds(s, dim);
+	survey_refine(s, dim);
+	survey_frame(s, dim);
+
+	s->resid = 0;
+	for (i = k = 0; i < n; i++)
+		for (j = i + 1; j < n; j++)
+			if (s->w[i][j] > 0)
+			{
+				double f = survey_dist(s->p[i], s->p[j]) - s->d[i][j];
+				s->resid += f * f;
+				k++;
+			}
+	s->resid = k ? sqrt(s->resid / k) : 0;
+	return 0;
+}
+
+int survey_line(survey_t *s, const char *line)
+{
+	unsigned long long eui;
+	int i, j;
+	double d;
+
+	if (sscanf(line, SURVEY_LINE_TAG " RANGE %d %d %lf", &i, &j, &d) == 3)
+		return survey_add(s, i, j, d);
+
+	if (sscanf(line, SURVEY_LINE_TAG " ANCHOR %d %llx", &i, &eui) == 2 && i >= 0 && i < SURVEY_ANCHORS)
+	{
+		s->eui[i] = eui;
+		if (i >= s->n)
+			s->n = i + 1;
+		return 0;
+	}
+	return -1;
+}
@@ -0,0 +1,109 @@
+/*
+ * survey.h
+ *
+ * Anchor self-survey: schedules the ranging between every pair of anchors, turns the ranges of each pair into a robust
+ * estimate, and solves the relative anchor coordinates by classical MDS refined by weighted least squares.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _SURVEY_H_
+#define _SURVEY_H_
+
+#include <stdint.h>
+
+/* Anchors surveyed, and pairs of them */
+#define SURVEY_ANCHORS     48
+#define SURVEY_PAIRS       (SURVEY_ANCHORS * (SURVEY_ANCHORS - 1) / 2)
+
+/* Ranges kept per pair */
+#define SURVEY_SAMPLES     64
+
+/* Pairs of a round ranging at the same time, each on its own preamble code */
+#define SURVEY_CODES       4
+
+/* Exchanges of a pair in its slot, length of a slot (ms), and passes over all the rounds */
+#define SURVEY_REPEAT      8
+#define SURVEY_SLOT_MS     200
+#define SURVEY_PASSES      3
+
+/*
+ * Time from a beacon to the first slot of its round, and from the end of the last slot to the next beacon (ms). The
+ * second outlasts the longest receive timeout of an anchor, so that an exchange cut by the end of its slot is over before
+ * the next round starts.
+ */
+#define SURVEY_GUARD_MS    20
+#define SURVEY_END_GUARD_MS 60
+
+/* Ranges further from the median of their pair than this many (robust) standard deviations are dropped */
+#define SURVEY_MAD_K       3.0
+
+/* Standard deviation of a single range (floor), and of the error common to all the ranges of a pair (m) */
+#define SURVEY_RANGE_STD   0.02
+#define SURVEY_SYS_STD     0.03
+
+/* Refinement iterations, and the RMS step they stop at (m) */
+#define SURVEY_ITER        100
+#define SURVEY_TOL         1e-5
+
+/* First word of a survey line: "SURVEY ANCHOR ID EUI" or "SURVEY RANGE INIT_ID RESP_ID RANGE_M" */
+#define SURVEY_LINE_TAG    "SURVEY"
+
+typedef struct {
+	int n;                // anchors, 1 + the highest ID seen
+	uint64_t eui[SURVEY_ANCHORS];   // EUI of each ID, 0 if not known
+	float s[SURVEY_PAIRS][SURVEY_SAMPLES];
+	uint8_t cnt[SURVEY_PAIRS];
+	uint32_t ranges;      // ranges given
+	uint32_t dropped;     // ranges past SURVEY_SAMPLES for their pair
+
+	/* Solution */
+	double d[SURVEY_ANCHORS][SURVEY_ANCHORS];  // pair estimates (m), shortest paths where not measured
+	double w[SURVEY_ANCHORS][SURVEY_ANCHORS];  // their weights (1/m^2), 0 where not measured
+	double p[SURVEY_ANCHORS][3];  // coordinates (m): 0 at the origin, 1 on the x axis, 2 in the xy plane (y > 0)
+	double resid;         // RMS of the pair residuals (m)
+	int iter;             // refinement iterations
+
+	/* Scratch */
+	double H[SURVEY_ANCHORS * 3][SURVEY_ANCHORS * 3];
+} survey_t;
+
+/* Rounds in which n anchors range every pair once. */
+int survey_rounds(int n);
+
+/* Slots of a round of n anchors, and the time from one beacon to the next (ms). */
+int survey_slots(int n);
+double survey_round_ms(int n);
+
+/*
+ * Partner of anchor id in round of n anchors, or -1 if it sits the round out. The pairs of a round are disjoint; *slot
+ * is the pair's index in the round, which the pairs share SURVEY_CODES at a time. The lower ID initiates.
+ */
+int survey_partner(int n, int round, int id, int *slot);
+
+/* Start with no ranges. */
+void survey_init(survey_t *s);
+
+/* Add a range between anchors i and j (in either order). Returns 0, or -1 if it was dropped. */
+int survey_add(survey_t *s, int i, int j, double d);
+
+/* Robust estimate of the range between i and j and its standard deviation. Returns the number of ranges kept. */
+int survey_pair(const survey_t *s, int i, int j, double *d, double *std);
+
+/* Solve the coordinates in dim (2 or 3) dimensions. Returns 0, or -1 if the measured pairs do not connect the anchors. */
+int survey_solve(survey_t *s, int dim);
+
+/* Take a survey line. Returns 0, or -1 if it is not one. */
+int survey_line(survey_t *s, const char *line);
+
+/* Distance between the points a and b (m). */
+double survey_dist(const double *a, const double *b);
+
+#endif /* _SURVEY_H_ */
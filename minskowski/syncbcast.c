@@ -0,0 +1,126 @@
+/*
+ * syncbcast.c
+ *
+ * Broadcast time sync: one blink from the SYNC node, answered by every REF node in range in a slot of its own.
+ *
+ * Each REF node answers the blink with delayed TX, at a time set by its slot, so the replies of up to SYNCBCAST_SLOTS nodes
+ * follow each other without colliding. The long and different reply times would turn the XO offset of each REF node into
+ * a large propagation delay error (10 ppm over 100 ms is 1 us, 300 m), so the clock ratio of each node is measured from
+ * its blink timestamps, fitted over the last rounds by clkmodel.c, and the reply time converted to the SYNC clock before
+ * it is used. The propagation delay is a constant of the fit, so the ratio does not depend on it.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "syncbcast.h"
+#include "timebase.h"
+#include <string.h>
+#include <math.h>
+
+#define SYNCBCAST_SN_IDX       2
+#define SYNCBCAST_EUI_IDX      7
+#define SYNCBCAST_FUNC_IDX     15
+#define SYNCBCAST_BLINK_IDX    16
+#define SYNCBCAST_REP_IDX      17
+
+// Clock ratios further than this from 1 come from a bad pair of reports, not from the XOs
+#define SYNCBCAST_MAX_PPM      100.0
+
+int syncbcast_slot(const uint8_t *eui, int nslots)
+{
+	// The low bytes of the EUI are the serial number part, give the nodes of an installation consecutive ones
+	return (eui[0] | (eui[1] << 8)) % nslots;
+}
+
+void syncbcast_build(uint8_t *msg, const uint8_t *eui)
+{
+	static const uint8_t hdr[] = {0x41, 0xC8, 0, 0xCA, 0xDE, 0xFF, 0xFF};
+
+	memset(msg, 0, SYNCBCAST_MSG_LEN);
+	memcpy(msg, hdr, sizeof(hdr));
+	memcpy(&msg[SYNCBCAST_EUI_IDX], eui, 8);
+	msg[SYNCBCAST_FUNC_IDX] = SYNCBCAST_FUNC_CODE;
+}
+
+int syncbcast_fill(uint8_t *msg, uint8_t blink_sn, const syncrep_t *r)
+{
+	if (syncrep_pack(r, &msg[SYNCBCAST_REP_IDX]) < 0)
+		return -1;
+
+	msg[SYNCBCAST_BLINK_IDX] = blink_sn;
+	msg[SYNCBCAST_SN_IDX]++;
+
+	return 0;
+}
+
+int syncbcast_parse(const uint8_t *msg, int len, const uint8_t **eui, uint8_t *blink_sn, syncrep_t *r)
+{
+	if (len != SYNCBCAST_MSG_LEN || msg[0] != 0x41 || msg[1] != 0xC8 || msg[SYNCBCAST_FUNC_IDX] != SYNCBCAST_FUNC_CODE)
+		return -1;
+
+	if (syncrep_unpack(&msg[SYNCBCAST_REP_IDX], SYNCREP_LEN, r) != 0)
+		return -1;
+
+	*eui = &msg[SYNCBCAST_EUI_IDX];
+	*blink_sn = msg[SYNCBCAST_BLINK_IDX];
+
+	return 0;
+}
+
+syncbcast_peer_t *syncbcast_lookup(syncbcast_peer_t *tab, int n, const uint8_t *eui)
+{
+	syncbcast_peer_t *free_entry = NULL;
+	int i;
+
+	for (i = 0; i < n; i++)
+	{
+		if (tab[i].used && !memcmp(tab[i].eui, eui, 8))
+			return &tab[i];
+		if (!tab[i].used && free_entry == NULL)
+			free_entry = &tab[i];
+	}
+
+	if (free_entry != NULL)
+	{
+		memset(free_entry, 0, sizeof(*free_entry));
+		memcpy(free_entry->eui, eui, 8);
+		free_entry->used = 1;
+		free_entry->ratio = 1.0;
+		clkmodel_init(&free_entry->clk, 0);
+	}
+
+	return free_entry;
+}
+
+void syncbcast_update(syncbcast_peer_t *p, uint8_t blink_sn, uint64_t t_tx1, uint64_t t_rx1, const syncrep_t *r, double mono)
+{
+	int64_t round;
+
+	// A rejected blink is an outlier of the fit, its reply is not trusted either
+	if (clkmodel_add(&p->clk, t_tx1, r->t_rx2_ts, CLKMODEL_DW_STD, mono) != 0)
+		return;
+
+	if (clkmodel_ready(&p->clk) && fabs(clkmodel_drift(&p->clk)) < SYNCBCAST_MAX_PPM * 1e-6)
+		p->ratio = 1.0 + clkmodel_drift(&p->clk);
+
+	// Round trip on the SYNC clock, less the reply time converted from the REF clock
+	round = timebase_diff40(t_rx1, t_tx1);
+	p->delay = (round - (double) r->my_delta_ts / p->ratio) / 2;
+	p->offset = timebase_diff40(r->t_rx2_ts, t_tx1) - p->delay;
+
+	p->blink_sn = blink_sn;
+	p->rounds++;
+}
+
+double syncbcast_to_ref(const syncbcast_peer_t *p, uint64_t local, double mono, uint64_t *ref)
+{
+	// The fit maps blink TX times to the REF time the blink arrived, a propagation delay later
+	return clkmodel_to_peer(&p->clk, (local - (uint64_t) llround(p->delay)) & SYNCREP_MASK40, mono, ref);
+}
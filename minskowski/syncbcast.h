@@ -0,0 +1,83 @@
+/*
+ * syncbcast.h
+ *
+ * Broadcast time sync: one blink from the SYNC node, answered by every REF node in range in a slot of its own.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _SYNCBCAST_H_
+#define _SYNCBCAST_H_
+
+#include <stdint.h>
+#include "syncrep.h"
+#include "clkmodel.h"
+
+/* Reply slots after each blink, and REF nodes the SYNC node keeps track of */
+#define SYNCBCAST_SLOTS        24
+
+/* Reply TX times from the blink RX timestamp, in UWB microseconds, for the 110 kbps, 1024-symbol preamble configuration of
+ * dw1000_sync/dw1000_ref. A reply takes about 4.6 ms on air; the first slot leaves time for the rest of the blink, the SPI
+ * accesses and the reply preamble, which starts before the programmed time. */
+#define SYNCBCAST_SLOT_FIRST_UUS  4000
+#define SYNCBCAST_SLOT_LEN_UUS    5000
+
+/*
+ * Reply frame, an IEEE 802.15.4 data frame:
+ *
+ *   0-1    frame control (0xC841: data frame, 16-bit destination, 64-bit source, PAN ID compression)
+ *   2      sequence number
+ *   3-4    PAN ID (0xDECA)
+ *   5-6    destination address (broadcast)
+ *   7-14   EUI of the REF node
+ *   15     function code (SYNCBCAST_FUNC_CODE)
+ *   16     sequence number of the blink answered
+ *   17-34  sync report (see syncrep.h)
+ *   35-36  frame check-sum, set by the DW1000
+ */
+#define SYNCBCAST_FUNC_CODE    0x12
+#define SYNCBCAST_MSG_LEN      (17 + SYNCREP_LEN + 2)
+
+/* State the SYNC node keeps for each REF node. Times are in DW1000 time units (dtu). */
+typedef struct {
+	uint8_t eui[8];
+	int used;
+	uint32_t rounds;        // reports received
+	uint8_t blink_sn;       // blink answered by the last report
+	clkmodel_t clk;         // blink RX time (REF clock) against blink TX time (SYNC clock)
+	double ratio;           // REF clock ticks per SYNC clock tick, 1 until two reports have been received
+	double delay;           // propagation delay
+	double offset;          // REF clock minus SYNC clock, modulo 2^40, as a signed value
+} syncbcast_peer_t;
+
+/* Reply slot of the REF node with this EUI (8 bytes, least significant first as read by dwt_geteui()). */
+int syncbcast_slot(const uint8_t *eui, int nslots);
+
+/* Write the fixed part of the reply frame of the REF node with this EUI into msg (SYNCBCAST_MSG_LEN bytes). */
+void syncbcast_build(uint8_t *msg, const uint8_t *eui);
+
+/* Put the report answering blink blink_sn into msg and advance its sequence number. Returns 0, or -1 if r cannot be packed. */
+int syncbcast_fill(uint8_t *msg, uint8_t blink_sn, const syncrep_t *r);
+
+/* Decode a received frame of len bytes. Returns 0 and sets eui (pointing into msg), blink_sn and r, or -1 if it is not a valid reply. */
+int syncbcast_parse(const uint8_t *msg, int len, const uint8_t **eui, uint8_t *blink_sn, syncrep_t *r);
+
+/* Entry of eui in the table of n peers, added if it is new. Returns NULL if the table is full. */
+syncbcast_peer_t *syncbcast_lookup(syncbcast_peer_t *tab, int n, const uint8_t *eui);
+
+/* Update the peer from the report r answering blink blink_sn, sent at t_tx1, whose reply was received at t_rx1 (SYNC clock),
+ * mono being a coarse time in seconds (CLOCK_MONOTONIC). */
+void syncbcast_update(syncbcast_peer_t *p, uint8_t blink_sn, uint64_t t_tx1, uint64_t t_rx1, const syncrep_t *r, double mono);
+
+/* REF time at SYNC time local, between rounds. Returns the bound on its error (dtu), or -1 if the peer has not been heard twice
+ * (see clkmodel_to_peer()). */
+double syncbcast_to_ref(const syncbcast_peer_t *p, uint64_t local, double mono, uint64_t *ref);
+
+#endif /* _SYNCBCAST_H_ */
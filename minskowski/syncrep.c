@@ -0,0 +1,76 @@
+/*
+ * syncrep.c
+ *
+ * Wire format of the sync report the reference node sends over the CC1200 side channel.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "syncrep.h"
+#include "timebase.h"
+
+#define SYNCREP_S24_MIN  (-(1 << 23))
+#define SYNCREP_S24_MAX  ((1 << 23) - 1)
+
+static void syncrep_put(uint8_t *p, uint64_t v, int bytes)
+{
+	while (bytes--)
+	{
+		*p++ = (uint8_t) v;
+		v >>= 8;
+	}
+}
+
+static uint64_t syncrep_get(const uint8_t *p, int bytes)
+{
+	uint64_t v = 0;
+
+	while (bytes--)
+		v = (v << 8) | p[bytes];
+
+	return v;
+}
+
+int syncrep_pack(const syncrep_t *r, uint8_t *buf)
+{
+	int64_t d_rx = timebase_diff40(r->t_rx2_stc, r->t_rx2_ts);
+	int64_t d_delta = timebase_diff40(r->my_delta_stc, r->my_delta_ts);
+
+	if (d_rx < SYNCREP_S24_MIN || d_rx > SYNCREP_S24_MAX || d_delta < SYNCREP_S24_MIN || d_delta > SYNCREP_S24_MAX)
+		return -1;
+
+	buf[0] = SYNCREP_LEN - 1;
+	buf[1] = SYNCREP_VERSION;
+	syncrep_put(&buf[2], r->t_rx2_ts, 5);
+	syncrep_put(&buf[7], (uint64_t) d_rx, 3);
+	syncrep_put(&buf[10], r->my_delta_ts, 5);
+	syncrep_put(&buf[15], (uint64_t) d_delta, 3);
+
+	return SYNCREP_LEN;
+}
+
+int syncrep_unpack(const uint8_t *buf, int len, syncrep_t *r)
+{
+	int64_t d_rx, d_delta;
+
+	if (len < SYNCREP_LEN || buf[0] != SYNCREP_LEN - 1 || buf[1] != SYNCREP_VERSION)
+		return -1;
+
+	// Sign extend the 24-bit differences
+	d_rx = (int64_t) (syncrep_get(&buf[7], 3) << 40) >> 40;
+	d_delta = (int64_t) (syncrep_get(&buf[15], 3) << 40) >> 40;
+
+	r->t_rx2_ts = syncrep_get(&buf[2], 5);
+	r->t_rx2_stc = (r->t_rx2_ts + d_rx) & SYNCREP_MASK40;
+	r->my_delta_ts = syncrep_get(&buf[10], 5);
+	r->my_delta_stc = (r->my_delta_ts + d_delta) & SYNCREP_MASK40;
+
+	return 0;
+}
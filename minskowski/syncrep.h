@@ -0,0 +1,58 @@
+/*
+ * syncrep.h
+ *
+ * Wire format of the sync report the reference node sends over the CC1200 side channel.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _SYNCREP_H_
+#define _SYNCREP_H_
+
+#include <stdint.h>
+
+#define SYNCREP_VERSION  2
+#define SYNCREP_MASK40   0xFFFFFFFFFFULL
+
+/*
+ * Frame, little endian like the DW1000 registers:
+ *
+ *   0      length of the bytes that follow (SYNCREP_LEN - 1)
+ *   1      SYNCREP_VERSION
+ *   2-6    t_rx2_ts                     40 bits
+ *   7-9    t_rx2_stc - t_rx2_ts         signed 24 bits
+ *   10-14  my_delta_ts                  40 bits
+ *   15-17  my_delta_stc - my_delta_ts   signed 24 bits
+ *
+ * Byte 0 is the length byte the CC1200 expects first in its FIFO in variable packet length mode; the UWB frames that
+ * carry the report keep it too, so that both sides parse the same bytes. The frame has no CRC of its own: the CC1200
+ * appends and checks one in hardware (GPIO0 only rises on PKT_CRC_OK), and so does the DW1000 with the frame
+ * check-sum.
+ *
+ * The system counter values are only ever a front edge correction away from the timestamps, so they travel as the
+ * difference to them.
+ */
+#define SYNCREP_LEN      18
+
+typedef struct {
+	uint64_t t_rx2_ts;       // reference RX timestamp of the sync frame (dtu)
+	uint64_t t_rx2_stc;      // system counter of the same event (dtu)
+	uint64_t my_delta_ts;    // reference reply time, T_tx2 - T_rx2 timestamps (dtu)
+	uint64_t my_delta_stc;   // reference reply time in system counter (dtu)
+} syncrep_t;
+
+/* Encode r into buf (SYNCREP_LEN bytes). Returns SYNCREP_LEN, or -1 if a system counter value is too far from its
+ * timestamp for the format. */
+int syncrep_pack(const syncrep_t *r, uint8_t *buf);
+
+/* Decode a frame of len bytes. Returns 0 on success, -1 if the length or version is wrong. */
+int syncrep_unpack(const uint8_t *buf, int len, syncrep_t *r);
+
+#endif /* _SYNCREP_H_ */
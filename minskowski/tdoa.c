@@ -0,0 +1,422 @@
+/*
+ * tdoa.c
+ *
+ * TDoA aggregation: joins the blink records of the anchors into position fixes.
+ *
+ * Records are joined by (tag EUI, sequence number) in an open addressing table with a bounded probe, so a record costs
+ * a few slot reads whatever the load. A blink is closed when every anchor has reported it, when it has waited for the
+ * timeout, or when the table needs its slot; a queue of the blinks in arrival order finds the timed out ones without a
+ * scan. Each anchor's timestamps are converted to the clock of the master anchor by a clock model (clkmodel.c) fed by
+ * the blinks of the reference tag, and the fixes are solved in batches by mlat.c.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "tdoa.h"
+#include "timebase.h"
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#define TDOA_MASK40 0xFFFFFFFFFFULL
+
+#define JOIN_EMPTY   0
+#define JOIN_OPEN    1
+#define JOIN_CLOSED  2
+
+static inline uint32_t tdoa_hash(uint64_t tag, uint8_t seq)
+{
+	uint64_t h = (tag ^ ((uint64_t)seq << 56)) * 0x9E3779B97F4A7C15ULL;
+	return (uint32_t)(h >> 32) & (TDOA_JOIN_SLOTS - 1);
+}
+
+static double tdoa_dist(const double *p, const double *a)
+{
+	double dx = p[0] - a[0], dy = p[1] - a[1], dz = p[2] - a[2];
+	return sqrt(dx * dx + dy * dy + dz * dz);
+}
+
+/* Time of flight from p to a, in dtu */
+static int64_t tdoa_tof(const double *p, const double *a)
+{
+	return (int64_t) llround(tdoa_dist(p, a) / MLAT_C * CLKMODEL_DTU_PER_S);
+}
+
+void tdoa_init(tdoa_t *t, tdoa_fix_cb cb, void *arg)
+{
+	memset(t, 0, sizeof(*t));
+	t->timeout = TDOA_TIMEOUT_S;
+	t->cb = cb;
+	t->cb_arg = arg;
+}
+
+int tdoa_add_anchor(tdoa_t *t, uint64_t eui, const double *p)
+{
+	tdoa_anchor_t *a;
+
+	if (t->n_anchors >= TDOA_ANCHORS)
+		return -1;
+
+	a = &t->anchors[t->n_anchors];
+	a->eui = eui;
+	memcpy(a->p, p, sizeof(a->p));
+	clkmodel_init(&a->clk, 0);
+	return t->n_anchors++;
+}
+
+void tdoa_set_ref(tdoa_t *t, uint64_t eui, const double *p)
+{
+	t->ref_eui = eui;
+	memcpy(t->ref_p, p, sizeof(t->ref_p));
+	t->has_ref = 1;
+}
+
+static int tdoa_find_anchor(const tdoa_t *t, uint64_t eui)
+{
+	int i;
+
+	for (i = 0; i < t->n_anchors; i++)
+		if (t->anchors[i].eui == eui)
+			return i;
+	return -1;
+}
+
+static void tdoa_solve(tdoa_t *t)
+{
+	struct timespec t0, t1;
+	int i;
+
+	if (t->n_jobs == 0)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	mlat_tdoa_batch(t->jobs, t->n_jobs);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	t->stats.solve_s += (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+
+	for (i = 0; i < t->n_jobs; i++)
+	{
+		tdoa_fix_t *fix = &t->fixes[i];
+
+		if (t->jobs[i].status != 0)
+		{
+			t->stats.failed++;
+			continue;
+		}
+
+		memcpy(fix->p, t->jobs[i].fix.p, sizeof(fix->p));
+		fix->resid = t->jobs[i].fix.resid;
+		fix->dop = t->jobs[i].fix.dop;
+		fix->latency = t->now - fix->latency;
+
+		t->stats.fixes++;
+		t->stats.lat_sum += fix->latency;
+		if (fix->latency > t->stats.lat_max)
+			t->stats.lat_max = fix->latency;
+
+		if (t->cb)
+			t->cb(fix, t->cb_arg);
+	}
+	t->n_jobs = 0;
+}
+
+/* A reference tag blink: each anchor heard it at its distance from the master's time of emission */
+static void tdoa_ref_blink(tdoa_t *t, const tdoa_join_t *j)
+{
+	uint64_t local, peer = 0;
+	int k, master = -1;
+
+	for (k = 0; k < j->n; k++)
+		if (j->anchor[k] == 0)
+			master = k;
+	if (master < 0)
+		return;
+
+	peer = (j->ts[master] - tdoa_tof(t->ref_p, t->anchors[0].p)) & TDOA_MASK40;
+	for (k = 0; k < j->n; k++)
+	{
+		tdoa_anchor_t *a = &t->anchors[j->anchor[k]];
+
+		if (k == master)
+			continue;
+		local = (j->ts[k] - tdoa_tof(t->ref_p, a->p)) & TDOA_MASK40;
+		clkmodel_add(&a->clk, local, peer, TDOA_TS_STD * M_SQRT2, j->first);
+	}
+	t->stats.ref_blinks++;
+}
+
+/*
+ * Spread (m) of the n anchors idx[] across the line that best fits them in the horizontal plane: the root of the smaller
+ * eigenvalue of the covariance of their x and y. Near 0, the tag and its mirror image in the line give the same
+ * differences, and a planar fix is a guess between them.
+ */
+static double tdoa_spread(const tdoa_t *t, const int *idx, int n)
+{
+	double mx = 0, my = 0, sxx = 0, syy = 0, sxy = 0, dx, dy;
+	int k;
+
+	for (k = 0; k < n; k++)
+	{
+		mx += t->anchors[idx[k]].p[0] / n;
+		my += t->anchors[idx[k]].p[1] / n;
+	}
+	for (k = 0; k < n; k++)
+	{
+		dx = t->anchors[idx[k]].p[0] - mx;
+		dy = t->anchors[idx[k]].p[1] - my;
+		sxx += dx * dx / n;
+		syy += dy * dy / n;
+		sxy += dx * dy / n;
+	}
+	return sqrt(fmax(0, (sxx + syy) / 2 - sqrt((sxx - syy) * (sxx - syy) / 4 + sxy * sxy)));
+}
+
+/* A tag blink: range differences to the anchor heard best, in the master's clock, from the best receptions */
+static void tdoa_tag_blink(tdoa_t *t, const tdoa_join_t *j)
+{
+	mlat_tdoa_job_t *job = &t->jobs[t->n_jobs];
+	tdoa_fix_t *fix = &t->fixes[t->n_jobs];
+	uint64_t ts[TDOA_JOIN_MAX];
+	float snr[TDOA_JOIN_MAX];
+	int idx[TDOA_JOIN_MAX];
+	int i, k, n = 0;
+
+	for (k = 0; k < j->n; k++)
+	{
+		const tdoa_anchor_t *a = &t->anchors[j->anchor[k]];
+
+		if (j->anchor[k] == 0)
+			ts[n] = j->ts[k];
+		else if (clkmodel_to_peer(&a->clk, j->ts[k], j->first, &ts[n]) < 0)
+		{
+			t->stats.unsynced++;
+			continue;
+		}
+		snr[n] = j->snr[k];
+		idx[n++] = j->anchor[k];
+	}
+
+	/* Best first: the reference of the differences, then the others down to MLAT_MAX_ANCHORS */
+	for (k = 0; k < n && k < MLAT_MAX_ANCHORS; k++)
+	{
+		int b = k;
+
+		for (i = k + 1; i < n; i++)
+			if (snr[i] > snr[b])
+				b = i;
+		if (b != k)
+		{
+			uint64_t tt = ts[k];
+			float ss = snr[k];
+			int ii = idx[k];
+
+			ts[k] = ts[b];
+			snr[k] = snr[b];
+			idx[k] = idx[b];
+			ts[b] = tt;
+			snr[b] = ss;
+			idx[b] = ii;
+		}
+	}
+	if (n > MLAT_MAX_ANCHORS)
+		n = MLAT_MAX_ANCHORS;
+
+	if (n < MLAT_MIN_ANCHORS)
+	{
+		t->stats.short_fixes++;
+		return;
+	}
+
+	/* 3D fixes have the solver's dop gate for anchors close to a plane */
+	if ((t->planar || n < MLAT_3D_ANCHORS) && tdoa_spread(t, idx, n) < TDOA_MIN_SPREAD)
+	{
+		t->stats.degenerate++;
+		return;
+	}
+
+	job->n = n;
+	job->z = t->height;
+	job->planar = t->planar;
+	job->r[0] = 0;
+	for (k = 0; k < n; k++)
+	{
+		memcpy(job->a[k], t->anchors[idx[k]].p, sizeof(job->a[k]));
+		if (k > 0)
+			job->r[k] = timebase_diff40(ts[k], ts[0]) / CLKMODEL_DTU_PER_S * MLAT_C;
+	}
+
+	fix->tag = j->tag;
+	fix->seq = j->seq;
+	fix->n = n;
+	fix->latency = j->first;  // until solved
+	if (++t->n_jobs == TDOA_BATCH)
+		tdoa_solve(t);
+}
+
+static void tdoa_close(tdoa_t *t, uint32_t slot)
+{
+	tdoa_join_t *j = &t->join[slot];
+
+	if (t->has_ref && j->tag == t->ref_eui)
+		tdoa_ref_blink(t, j);
+	else
+		tdoa_tag_blink(t, j);
+
+	j->used = JOIN_CLOSED;
+	j->gen++;
+}
+
+/* Drop the oldest queue entry, closing its blink if still open */
+static void tdoa_pop(tdoa_t *t, int force)
+{
+	uint32_t slot = t->queue[t->q_head].slot;
+
+	if (force && t->join[slot].used == JOIN_OPEN && t->join[slot].gen == t->queue[t->q_head].gen)
+	{
+		t->stats.evicted++;
+		tdoa_close(t, slot);
+	}
+	t->q_head = (t->q_head + 1) & (TDOA_JOIN_SLOTS - 1);
+	t->q_len--;
+}
+
+void tdoa_record(tdoa_t *t, const tdoarec_t *r, double now)
+{
+	uint32_t h = tdoa_hash(r->tag, r->seq), slot = 0;
+	int ai, k, free_slot = -1, found = 0;
+	tdoa_join_t *j;
+
+	t->now = now;
+	t->stats.records++;
+
+	if ((ai = tdoa_find_anchor(t, r->anchor)) < 0)
+	{
+		t->stats.unknown++;
+		return;
+	}
+
+	for (k = 0; k < TDOA_JOIN_PROBE; k++)
+	{
+		slot = (h + k) & (TDOA_JOIN_SLOTS - 1);
+		j = &t->join[slot];
+		if (j->used == JOIN_OPEN && j->tag == r->tag && j->seq == r->seq)
+		{
+			found = 1;
+			break;
+		}
+		if (j->used != JOIN_OPEN && free_slot < 0)
+			free_slot = slot;
+		if (j->used == JOIN_EMPTY)
+			break;
+	}
+
+	if (!found)
+	{
+		/* No room within the probe: close the oldest blink there */
+		if (free_slot < 0)
+		{
+			double oldest = 0;
+
+			for (k = 0; k < TDOA_JOIN_PROBE; k++)
+			{
+				slot = (h + k) & (TDOA_JOIN_SLOTS - 1);
+				if (free_slot < 0 || t->join[slot].first < oldest)
+				{
+					free_slot = slot;
+					oldest = t->join[slot].first;
+				}
+			}
+			t->stats.evicted++;
+			tdoa_close(t, free_slot);
+		}
+
+		if (t->q_len == TDOA_JOIN_SLOTS)
+			tdoa_pop(t, 1);
+
+		slot = free_slot;
+		j = &t->join[slot];
+		j->tag = r->tag;
+		j->seq = r->seq;
+		j->used = JOIN_OPEN;
+		j->n = 0;
+		j->first = now;
+		t->queue[(t->q_head + t->q_len) & (TDOA_JOIN_SLOTS - 1)].slot = slot;
+		t->queue[(t->q_head + t->q_len) & (TDOA_JOIN_SLOTS - 1)].gen = j->gen;
+		t->q_len++;
+	}
+
+	j = &t->join[slot];
+	for (k = 0; k < j->n; k++)
+	{
+		if (j->anchor[k] == ai)
+		{
+			t->stats.dups++;
+			return;
+		}
+	}
+
+	/* Heard by more anchors than kept: replace the worst reception, but never the master's */
+	k = j->n;
+	if (k == TDOA_JOIN_MAX)
+	{
+		int i, worst = -1;
+
+		for (i = 0; i < TDOA_JOIN_MAX; i++)
+			if (j->anchor[i] != 0 && (worst < 0 || j->snr[i] < j->snr[worst]))
+				worst = i;
+		if (ai != 0 && r->fp_snr <= j->snr[worst])
+			return;
+		k = worst;
+	}
+	else
+		j->n++;
+
+	j->anchor[k] = (uint8_t) ai;
+	j->ts[k] = r->rx_ts & TDOA_MASK40;
+	j->snr[k] = r->fp_snr;
+
+	if (j->n == t->n_anchors)
+		tdoa_close(t, slot);
+}
+
+void tdoa_poll(tdoa_t *t, double now)
+{
+	t->now = now;
+
+	while (t->q_len > 0)
+	{
+		uint32_t slot = t->queue[t->q_head].slot;
+		tdoa_join_t *j = &t->join[slot];
+
+		if (j->used == JOIN_OPEN && j->gen == t->queue[t->q_head].gen)
+		{
+			if (now - j->first < t->timeout)
+				break;
+			tdoa_close(t, slot);
+		}
+		tdoa_pop(t, 0);
+	}
+
+	tdoa_solve(t);
+}
+
+void tdoa_flush(tdoa_t *t)
+{
+	while (t->q_len > 0)
+	{
+		uint32_t slot = t->queue[t->q_head].slot;
+
+		if (t->join[slot].used == JOIN_OPEN && t->join[slot].gen == t->queue[t->q_head].gen)
+			tdoa_close(t, slot);
+		tdoa_pop(t, 0);
+	}
+
+	tdoa_solve(t);
+}
@@ -0,0 +1,135 @@
+/*
+ * tdoa.h
+ *
+ * TDoA aggregation: joins the blink records of the anchors (tdoarec.h) into position fixes.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _TDOA_H_
+#define _TDOA_H_
+
+#include <stdint.h>
+#include "clkmodel.h"
+#include "mlat.h"
+#include "tdoarec.h"
+
+/* Anchors configured */
+#define TDOA_ANCHORS       32
+
+/* Blinks being joined (a power of 2), and slots probed for one */
+#define TDOA_JOIN_SLOTS    1024
+#define TDOA_JOIN_PROBE    8
+
+/* Records kept for one blink: the best receptions if more anchors hear it */
+#define TDOA_JOIN_MAX      16
+
+/* Default time a blink waits for the records of all the anchors (s) */
+#define TDOA_TIMEOUT_S     0.05
+
+/* Fixes solved together */
+#define TDOA_BATCH         64
+
+/* Smallest spread (m) of the anchors of a planar fix across the line through them */
+#define TDOA_MIN_SPREAD    1.0
+
+/* Standard deviation of an RX timestamp (dtu) */
+#define TDOA_TS_STD        CLKMODEL_DW_STD
+
+typedef struct {
+	uint64_t eui;
+	double p[3];          // position (m)
+	clkmodel_t clk;       // clock of the master anchor against this one's
+} tdoa_anchor_t;
+
+/* Records of one blink */
+typedef struct {
+	uint64_t tag;
+	uint8_t seq;
+	uint8_t used;         // 0 empty, 1 joining, 2 done (the slot can be reused, but does not end a probe)
+	uint8_t n;
+	uint32_t gen;         // bumped when the slot is released, to spot stale queue entries
+	double first;         // time of the first record (s)
+	uint8_t anchor[TDOA_JOIN_MAX];
+	uint64_t ts[TDOA_JOIN_MAX];
+	float snr[TDOA_JOIN_MAX];
+} tdoa_join_t;
+
+typedef struct {
+	uint64_t tag;
+	uint8_t seq;
+	int n;                // anchors used
+	double p[3];          // position (m)
+	double resid;         // RMS of the range difference residuals (m)
+	double dop;           // dilution of precision
+	double latency;       // from the first record of the blink to the fix (s)
+} tdoa_fix_t;
+
+typedef void (*tdoa_fix_cb)(const tdoa_fix_t *fix, void *arg);
+
+typedef struct {
+	uint64_t records;     // records given
+	uint64_t unknown;     // records from anchors not configured
+	uint64_t dups;        // records repeating an anchor for a blink
+	uint64_t evicted;     // blinks closed early because the table was full
+	uint64_t ref_blinks;  // reference tag blinks used for the clock models
+	uint64_t fixes;       // fixes solved
+	uint64_t short_fixes; // blinks heard by too few synchronised anchors
+	uint64_t unsynced;    // records dropped because the anchor clock was not modelled yet
+	uint64_t degenerate;  // blinks whose anchors were too close to a line for a planar fix
+	uint64_t failed;      // fixes the solver gave up on (no solution, two of them, or too high a dop)
+	double lat_sum;       // sum and maximum of the fix latencies (s)
+	double lat_max;
+	double solve_s;       // CPU time spent in the solver (s)
+} tdoa_stats_t;
+
+typedef struct {
+	tdoa_anchor_t anchors[TDOA_ANCHORS];
+	int n_anchors;        // the first one is the time master
+	uint64_t ref_eui;     // reference tag, at a known position
+	double ref_p[3];
+	int has_ref;
+	double height;        // tag height for planar fixes (m)
+	int planar;           // all fixes planar, for anchors too close to a plane to give the height
+	double timeout;       // s
+
+	tdoa_join_t join[TDOA_JOIN_SLOTS];
+	struct { uint32_t slot, gen; } queue[TDOA_JOIN_SLOTS];  // joins in arrival order, for the timeouts
+	uint32_t q_head, q_len;
+
+	mlat_tdoa_job_t jobs[TDOA_BATCH];
+	tdoa_fix_t fixes[TDOA_BATCH];
+	int n_jobs;
+
+	double now;           // time of the last call (s)
+	tdoa_fix_cb cb;
+	void *cb_arg;
+	tdoa_stats_t stats;
+} tdoa_t;
+
+/* Start with no anchors. Fixes are given to cb. */
+void tdoa_init(tdoa_t *t, tdoa_fix_cb cb, void *arg);
+
+/* Add an anchor at p; the first one added is the time master. Returns its index, or -1 if there are too many. */
+int tdoa_add_anchor(tdoa_t *t, uint64_t eui, const double *p);
+
+/* Set the reference tag, at the known position p. */
+void tdoa_set_ref(tdoa_t *t, uint64_t eui, const double *p);
+
+/* Add a record received at time now (s, any monotonic clock). */
+void tdoa_record(tdoa_t *t, const tdoarec_t *r, double now);
+
+/* Close the blinks that have waited for more than the timeout at time now, and solve the fixes pending. */
+void tdoa_poll(tdoa_t *t, double now);
+
+/* Close every blink and solve all the fixes pending. */
+void tdoa_flush(tdoa_t *t);
+
+#endif /* _TDOA_H_ */
@@ -0,0 +1,192 @@
+/*
+ * TDoA Aggregation Service
+ *
+ * Reads the record lines of the TDoA anchors (dw1000_tdoa) on stdin, joins them by blink and writes a FIX line for each
+ * position solved, with a STATS line every second. With SIM_BLINKS, feeds the engine a synthetic stream instead, from
+ * the anchors of the configuration, and reports the position error and the throughput. Besides the anchors and the
+ * reference tag, the configuration (see possvc.h) may set "height z", "planar 0/1" and "timeout s".
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "tdoa.h"
+#include "possvc.h"
+
+/* Synthetic stream: tags, blink period (s), share of records lost, and spread of the anchor clock rates */
+#define SIM_TAGS      200
+#define SIM_PERIOD_S  0.1
+#define SIM_LOSS      0.05
+#define SIM_PPM       20.0
+
+static tdoa_t tdoa;
+static possvc_conf_t conf;
+
+typedef struct {
+	double p[SIM_TAGS][3];    // true tag positions
+	possvc_sim_t err;
+} sim_t;
+
+static void print_stats(void *arg, double elapsed)
+{
+	const tdoa_stats_t *s = &tdoa.stats;
+
+	printf("STATS records %llu fixes %llu (%.0f/s) latency %.1f/%.1f ms solver %.0f fix/s evicted %llu short %llu unsynced %llu "
+		   "unknown %llu dups %llu ref %llu degenerate %llu failed %llu\n",
+		   (unsigned long long)s->records, (unsigned long long)s->fixes, elapsed > 0 ? s->fixes / elapsed : 0,
+		   s->fixes ? s->lat_sum / s->fixes * 1e3 : 0, s->lat_max * 1e3, s->solve_s > 0 ? s->fixes / s->solve_s : 0,
+		   (unsigned long long)s->evicted, (unsigned long long)s->short_fixes, (unsigned long long)s->unsynced,
+		   (unsigned long long)s->unknown, (unsigned long long)s->dups, (unsigned long long)s->ref_blinks,
+		   (unsigned long long)s->degenerate, (unsigned long long)s->failed);
+}
+
+static void print_fix(const tdoa_fix_t *fix, void *arg)
+{
+	printf("FIX %016llx %3u %8.3f %8.3f %8.3f resid %.3f dop %.2f anchors %d latency %.1f ms\n", (unsigned long long)fix->tag,
+		   fix->seq, fix->p[0], fix->p[1], fix->p[2], fix->resid, fix->dop, fix->n, fix->latency * 1e3);
+}
+
+static void sim_fix(const tdoa_fix_t *fix, void *arg)
+{
+	sim_t *sim = (sim_t *)arg;
+
+	possvc_sim_fix(&sim->err, fix->p, sim->p[(fix->tag - POSSVC_SIM_TAG_EUI) % SIM_TAGS]);
+}
+
+/*
+ * Every tag (and the reference tag) blinks once per SIM_PERIOD_S; each anchor timestamps the blink in its own clock
+ * (offset, rate within SIM_PPM, TDOA_TS_STD of noise), loses SIM_LOSS of them, and the records of a period arrive
+ * shuffled.
+ */
+static void run_sim(long blinks)
+{
+	static tdoarec_t recs[(SIM_TAGS + 1) * TDOA_ANCHORS];
+	static sim_t sim;
+	double off[TDOA_ANCHORS], rate[TDOA_ANCHORS];
+	double t0, period_t = 0, start;
+	long sent = 0;
+	int i, k, n;
+
+	for (i = 0; i < tdoa.n_anchors; i++)
+	{
+		off[i] = (double)(rand() % 1000000) * 1e6;
+		rate[i] = 1 + (i ? (2.0 * rand() / RAND_MAX - 1) * SIM_PPM * 1e-6 : 0);
+	}
+	possvc_sim_init(&sim.err, &conf);
+	for (i = 0; i < SIM_TAGS; i++)
+		possvc_sim_place(&sim.err, sim.p[i], tdoa.height);
+	tdoa.cb = sim_fix;
+	tdoa.cb_arg = &sim;
+
+	start = possvc_now();
+	for (t0 = 0; sent < blinks; t0 += SIM_PERIOD_S)
+	{
+		n = 0;
+		for (k = -1; k < SIM_TAGS; k++)
+		{
+			const double *p = (k < 0) ? tdoa.ref_p : sim.p[k];
+			double te = t0 + (k + 1) * SIM_PERIOD_S / (SIM_TAGS + 1);
+
+			for (i = 0; i < tdoa.n_anchors; i++)
+			{
+				const double *a = tdoa.anchors[i].p;
+				double d = sqrt((p[0] - a[0]) * (p[0] - a[0]) + (p[1] - a[1]) * (p[1] - a[1]) + (p[2] - a[2]) * (p[2] - a[2]));
+				double ts = off[i] + (te + d / MLAT_C) * rate[i] * CLKMODEL_DTU_PER_S + possvc_gauss() * TDOA_TS_STD;
+
+				if (k >= 0 && (double)rand() / RAND_MAX < SIM_LOSS)
+					continue;
+				recs[n].anchor = tdoa.anchors[i].eui;
+				recs[n].tag = (k < 0) ? tdoa.ref_eui : POSSVC_SIM_TAG_EUI + k;
+				recs[n].seq = (uint8_t)(unsigned long)(t0 / SIM_PERIOD_S + 0.5);
+				recs[n].rx_ts = (uint64_t)fmod(ts, 1099511627776.0);
+				recs[n].fp_snr = 20 + 10 * (float)rand() / RAND_MAX;
+				recs[n].fp_rx_db = 0;
+				n++;
+			}
+			if (k >= 0)
+				sent++;
+		}
+
+		/* The reference blinks first, the tags' in any order */
+		for (i = n - 1; i > tdoa.n_anchors; i--)
+		{
+			tdoarec_t tmp;
+			int j = tdoa.n_anchors + rand() % (i - tdoa.n_anchors + 1);
+
+			tmp = recs[i];
+			recs[i] = recs[j];
+			recs[j] = tmp;
+		}
+		for (i = 0; i < n; i++)
+			tdoa_record(&tdoa, &recs[i], t0 + SIM_PERIOD_S);
+		period_t = t0 + SIM_PERIOD_S;
+		tdoa_poll(&tdoa, period_t + tdoa.timeout);
+	}
+	tdoa_flush(&tdoa);
+
+	print_stats(NULL, possvc_now() - start);
+	possvc_sim_print(&sim.err, "blinks", sent);
+}
+
+static void rec_line(void *arg, const char *line, double now)
+{
+	tdoarec_t rec;
+
+	if (tdoarec_scan(line, &rec) == 0)
+		tdoa_record(&tdoa, &rec, now);
+}
+
+static void rec_poll(void *arg, double now)
+{
+	tdoa_poll(&tdoa, now);
+}
+
+static void rec_flush(void *arg, double now)
+{
+	tdoa_flush(&tdoa);
+}
+
+int main(int argc, char *argv[])
+{
+	possvc_ops_t ops = { rec_line, rec_poll, print_stats, rec_flush, NULL };
+	double value;
+	long blinks;
+	int i;
+
+	if (possvc_args(argc, argv, "SIM_BLINKS", &conf, &blinks) != 0)
+		return 1;
+
+	tdoa_init(&tdoa, print_fix, NULL);
+	for (i = 0; i < conf.n_anchors; i++)
+		tdoa_add_anchor(&tdoa, conf.anchors[i].eui, conf.anchors[i].p);
+	if (conf.has_ref)
+		tdoa_set_ref(&tdoa, conf.ref.eui, conf.ref.p);
+	possvc_value(&conf, "height", &tdoa.height);
+	if (possvc_value(&conf, "planar", &value))
+		tdoa.planar = (int) value;
+	possvc_value(&conf, "timeout", &tdoa.timeout);
+
+	if (tdoa.n_anchors < MLAT_MIN_ANCHORS || !tdoa.has_ref)
+	{
+		printf("%s: needs %d anchors and a reference tag\n", argv[1], MLAT_MIN_ANCHORS);
+		return 1;
+	}
+
+	if (blinks > 0)
+		run_sim(blinks);
+	else
+		possvc_run(&ops);
+
+	return 0;
+}
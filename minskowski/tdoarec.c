@@ -0,0 +1,86 @@
+/*
+ * tdoarec.c
+ *
+ * Blink reception records of the TDoA anchors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "tdoarec.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+uint64_t tdoarec_eui(const uint8_t *p)
+{
+	uint64_t eui = 0;
+	int i;
+
+	for (i = 7; i >= 0; i--)
+		eui = (eui << 8) | p[i];
+	return eui;
+}
+
+int tdoarec_parse_blink(const uint8_t *frame, int len, uint64_t *tag, uint8_t *seq)
+{
+	if (len < TDOAREC_BLINK_LEN || frame[0] != TDOAREC_BLINK_FC)
+		return -1;
+
+	*seq = frame[TDOAREC_SN_IDX];
+	*tag = tdoarec_eui(&frame[TDOAREC_EUI_IDX]);
+	return 0;
+}
+
+void tdoarec_build_blink(uint8_t *frame, uint64_t eui, uint8_t seq)
+{
+	int i;
+
+	memset(frame, 0, TDOAREC_BLINK_LEN);
+	frame[0] = TDOAREC_BLINK_FC;
+	frame[TDOAREC_SN_IDX] = seq;
+	for (i = 0; i < 8; i++)
+		frame[TDOAREC_EUI_IDX + i] = (uint8_t)(eui >> (8 * i));
+}
+
+/*
+ * The DW1000 user manual gives both levels over the same N^2 (N the preamble symbols accumulated) and the same constant,
+ * so their difference does not depend on N, nor on the correction N needs for the SFD in use.
+ */
+void tdoarec_quality(tdoarec_t *r, uint16_t fp1, uint16_t fp2, uint16_t fp3, uint16_t std_noise, uint16_t cir_pwr)
+{
+	double fp = (double)fp1 * fp1 + (double)fp2 * fp2 + (double)fp3 * fp3;
+
+	r->fp_snr = (std_noise > 0) ? (float)(sqrt(fp / 3) / std_noise) : 0;
+	r->fp_rx_db = (fp > 0 && cir_pwr > 0) ? (float)(10 * log10(cir_pwr * 131072.0 / fp)) : 0;
+}
+
+int tdoarec_format(const tdoarec_t *r, char *buf, size_t size)
+{
+	return snprintf(buf, size, TDOAREC_TAG " %016llx %016llx %3u %13llu %6.1f %5.1f\n", (unsigned long long)r->anchor,
+			(unsigned long long)r->tag, r->seq, (unsigned long long)r->rx_ts, r->fp_snr, r->fp_rx_db);
+}
+
+int tdoarec_scan(const char *line, tdoarec_t *r)
+{
+	unsigned long long anchor, tag, rx_ts;
+	unsigned int seq;
+	float snr, db;
+
+	if (sscanf(line, TDOAREC_TAG " %llx %llx %u %llu %f %f", &anchor, &tag, &seq, &rx_ts, &snr, &db) != 6 || seq > 255)
+		return -1;
+
+	r->anchor = anchor;
+	r->tag = tag;
+	r->seq = (uint8_t)seq;
+	r->rx_ts = rx_ts;
+	r->fp_snr = snr;
+	r->fp_rx_db = db;
+	return 0;
+}
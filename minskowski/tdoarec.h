@@ -0,0 +1,74 @@
+/*
+ * tdoarec.h
+ *
+ * Blink reception records of the TDoA anchors: the blink frame they timestamp and the text line they emit for each.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _TDOAREC_H_
+#define _TDOAREC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Blink, the shortest ISO/IEC 24730-62 frame:
+ *
+ *   0      frame control (TDOAREC_BLINK_FC)
+ *   1      sequence number
+ *   2-9    tag EUI, least significant byte first
+ *   10-11  FCS, set by the DW1000
+ *
+ * Longer blinks (with an encoding header, such as the one of dw1000_sync.c) are accepted too.
+ */
+#define TDOAREC_BLINK_FC   0xC5
+#define TDOAREC_BLINK_LEN  12
+#define TDOAREC_SN_IDX     1
+#define TDOAREC_EUI_IDX    2
+
+/* First word of a record line */
+#define TDOAREC_TAG        "TDOA"
+
+/* Longest record line, with its newline and terminating NUL */
+#define TDOAREC_LINE_MAX   96
+
+/* Above this difference between the total and the first path levels the first path is likely blocked (dB) */
+#define TDOAREC_NLOS_DB    6.0
+
+typedef struct {
+	uint64_t anchor;      // EUI of the receiving anchor
+	uint64_t tag;         // EUI of the tag
+	uint8_t seq;          // blink sequence number
+	uint64_t rx_ts;       // RX timestamp, 40 bits (dtu)
+	float fp_snr;         // first path amplitude over the noise standard deviation
+	float fp_rx_db;       // total received level minus first path level (dB), see TDOAREC_NLOS_DB
+} tdoarec_t;
+
+/* EUI of the 8 bytes at p, least significant byte first. */
+uint64_t tdoarec_eui(const uint8_t *p);
+
+/* Tag EUI and sequence number of the blink frame (len bytes, FCS included). Returns 0, or -1 if it is not a blink. */
+int tdoarec_parse_blink(const uint8_t *frame, int len, uint64_t *tag, uint8_t *seq);
+
+/* Write the blink of tag EUI eui with sequence number seq to frame (TDOAREC_BLINK_LEN bytes). */
+void tdoarec_build_blink(uint8_t *frame, uint64_t eui, uint8_t seq);
+
+/* Quality fields of r from the DW1000 RX diagnostics: the three first path amplitudes, the noise standard deviation and
+ * the CIR power. */
+void tdoarec_quality(tdoarec_t *r, uint16_t fp1, uint16_t fp2, uint16_t fp3, uint16_t std_noise, uint16_t cir_pwr);
+
+/* Format r as a line into buf (size bytes, at least TDOAREC_LINE_MAX). Returns the length of the line. */
+int tdoarec_format(const tdoarec_t *r, char *buf, size_t size);
+
+/* Read back a line written by tdoarec_format. Returns 0, or -1 if it is not a record. */
+int tdoarec_scan(const char *line, tdoarec_t *r);
+
+#endif /* _TDOAREC_H_ */
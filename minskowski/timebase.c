@@ -0,0 +1,90 @@
+/*
+ * timebase.c
+ *
+ * Publisher side of the synchronized timebase: the shared memory page and its sequence lock.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "timebase.h"
+#include <stdio.h>
+#include <sys/stat.h>
+
+static volatile timebase_t *page = NULL;
+
+int timebase_publish_open(void)
+{
+	void *p;
+	int fd = shm_open(TIMEBASE_SHM_NAME, O_RDWR | O_CREAT, 0644);
+
+	if (fd < 0) {
+		perror("timebase: can't create shared memory");
+		return -1;
+	}
+
+	if (ftruncate(fd, sizeof(timebase_t)) != 0) {
+		perror("timebase: can't size shared memory");
+		close(fd);
+		return -1;
+	}
+
+	p = mmap(NULL, sizeof(timebase_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED) {
+		perror("timebase: can't map shared memory");
+		return -1;
+	}
+
+	// Readers see an invalid page until the first update
+	page = (volatile timebase_t *) p;
+	page->seq = 0;
+	page->magic = 0;
+
+	return 0;
+}
+
+void timebase_publish(const timebase_t *tb)
+{
+	timebase_t upd = *tb;
+	uint32_t seq;
+
+	if (page == NULL)
+		return;
+
+	seq = page->seq;
+
+	page->seq = seq + 1;
+	__sync_synchronize();
+
+	// The copy keeps seq odd all along
+	upd.magic = TIMEBASE_MAGIC;
+	upd.version = TIMEBASE_VERSION;
+	upd.seq = seq + 1;
+	memcpy((void *) page, &upd, sizeof(upd));
+
+	__sync_synchronize();
+	page->seq = seq + 2;
+}
+
+void timebase_publish_close(void)
+{
+	if (page == NULL)
+		return;
+
+	// Leave the page invalid, readers then know the daemon is gone
+	page->seq++;
+	__sync_synchronize();
+	page->magic = 0;
+	__sync_synchronize();
+	page->seq++;
+
+	munmap((void *) page, sizeof(timebase_t));
+	page = NULL;
+}
@@ -0,0 +1,162 @@
+/*
+ * timebase.h
+ *
+ * Synchronized timebase published by the sync daemon in shared memory, and the functions its readers use.
+ *
+ * A reader maps the page once with timebase_open(), then takes a consistent copy with timebase_read() whenever it needs
+ * to convert times: the page is protected by a sequence lock, so neither side ever blocks or makes a syscall.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _TIMEBASE_H_
+#define _TIMEBASE_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define TIMEBASE_SHM_NAME  "/dw1000-timebase"
+#define TIMEBASE_MAGIC     0x42544457  // "DWTB"
+#define TIMEBASE_VERSION   1
+
+/* flags */
+#define TIMEBASE_HOST      0x01        // the CLOCK_MONOTONIC map is valid
+#define TIMEBASE_SYNCED    0x02        // the network time map is valid
+#define TIMEBASE_XO_LOCKED 0x04        // the XO is locked to the reference carrier
+
+/* Reads of the sequence count a reader makes before it gives up on a page that stays locked */
+#define TIMEBASE_READ_SPINS 100000
+
+/* DW1000 time units (dtu) in 39936 ns: 1 dtu = 1 / (499.2 MHz * 128) = 625 / 39936 ns */
+#define TIMEBASE_DTU_NUM   625
+#define TIMEBASE_DTU_DEN   39936
+
+/*
+ * The page. DW1000 times are the 40-bit local device times (dtu), as read from the timestamps; they are converted
+ * relative to the anchors below, so they must be within 8.6 s of them (the page is updated every sync round).
+ */
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t seq;              // odd while the publisher is writing
+	uint32_t flags;
+
+	// CLOCK_MONOTONIC from local DW1000 time: mono_ns = host_ns + (dw - host_dw) * host_ns_per_dtu
+	uint64_t host_dw;
+	int64_t host_ns;
+	double host_ns_per_dtu;
+
+	// Network time (the REF node DW1000 clock, unwrapped, in ns) from local DW1000 time:
+	// sync_ns = sync_ns0 + (dw - sync_dw) * sync_ns_per_dtu
+	uint64_t sync_dw;
+	int64_t sync_ns0;
+	double sync_ns_per_dtu;
+	double sync_bound_ns;      // error bound of the network time at the last update
+	uint32_t sync_rounds;      // sync rounds so far
+
+	int64_t updated_ns;        // CLOCK_MONOTONIC of the last update
+} timebase_t;
+
+/* Publisher side (timebase.c). */
+int timebase_publish_open(void);
+void timebase_publish(const timebase_t *tb);
+void timebase_publish_close(void);
+
+/* Reader side. */
+
+/* Map the published page read-only. Returns NULL if the sync daemon has not created it. */
+static inline const volatile timebase_t *timebase_open(void)
+{
+	void *p;
+	int fd = shm_open(TIMEBASE_SHM_NAME, O_RDONLY, 0);
+
+	if (fd < 0)
+		return NULL;
+
+	p = mmap(NULL, sizeof(timebase_t), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	return (p == MAP_FAILED) ? NULL : (const volatile timebase_t *) p;
+}
+
+/*
+ * Take a consistent copy of the page. Returns 0, -1 if nothing has been published yet, or -2 if the page stayed locked
+ * for TIMEBASE_READ_SPINS reads, as it does when the publisher died in the middle of an update. A publisher that died
+ * between updates leaves a consistent page behind: updated_ns tells how old it is.
+ */
+static inline int timebase_read(const volatile timebase_t *tb, timebase_t *copy)
+{
+	uint32_t seq;
+	int spins = 0;
+
+	do {
+		while ((seq = tb->seq) & 1)
+			if (++spins >= TIMEBASE_READ_SPINS)
+				return -2;
+		__sync_synchronize();
+		memcpy(copy, (const void *) tb, sizeof(*copy));
+		__sync_synchronize();
+	} while (tb->seq != seq && ++spins < TIMEBASE_READ_SPINS);
+
+	if (tb->seq != seq)
+		return -2;
+
+	return (copy->magic == TIMEBASE_MAGIC && copy->version == TIMEBASE_VERSION) ? 0 : -1;
+}
+
+/* DW1000 time units to ns, exactly (rounded down, also for negative times) */
+static inline int64_t timebase_dtu_to_ns(int64_t dtu)
+{
+	int64_t q = dtu / TIMEBASE_DTU_DEN, r = dtu % TIMEBASE_DTU_DEN;
+
+	// C division truncates toward zero: take the remainder back into [0, TIMEBASE_DTU_DEN)
+	if (r < 0)
+	{
+		q--;
+		r += TIMEBASE_DTU_DEN;
+	}
+
+	return q * TIMEBASE_DTU_NUM + r * TIMEBASE_DTU_NUM / TIMEBASE_DTU_DEN;
+}
+
+/* Difference of two 40-bit DW1000 times, as a signed number */
+static inline int64_t timebase_diff40(uint64_t a, uint64_t b)
+{
+	return (int64_t) ((a - b) << 24) >> 24;
+}
+
+/* CLOCK_MONOTONIC (ns) at local DW1000 time dw. */
+static inline int64_t timebase_dw_to_mono_ns(const timebase_t *tb, uint64_t dw)
+{
+	return tb->host_ns + (int64_t) (timebase_diff40(dw, tb->host_dw) * tb->host_ns_per_dtu);
+}
+
+/* Local DW1000 time at CLOCK_MONOTONIC time mono_ns. */
+static inline uint64_t timebase_mono_ns_to_dw(const timebase_t *tb, int64_t mono_ns)
+{
+	return (tb->host_dw + (int64_t) ((mono_ns - tb->host_ns) / tb->host_ns_per_dtu)) & 0xFFFFFFFFFFULL;
+}
+
+/* Network time (ns) at local DW1000 time dw. */
+static inline int64_t timebase_dw_to_sync_ns(const timebase_t *tb, uint64_t dw)
+{
+	return tb->sync_ns0 + (int64_t) (timebase_diff40(dw, tb->sync_dw) * tb->sync_ns_per_dtu);
+}
+
+/* Network time (ns) at CLOCK_MONOTONIC time mono_ns. */
+static inline int64_t timebase_mono_ns_to_sync_ns(const timebase_t *tb, int64_t mono_ns)
+{
+	return timebase_dw_to_sync_ns(tb, timebase_mono_ns_to_dw(tb, mono_ns));
+}
+
+#endif /* _TIMEBASE_H_ */
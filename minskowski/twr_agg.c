@@ -0,0 +1,194 @@
+/*
+ * TWR Aggregation Service
+ *
+ * Reads range lines ("RANGE TAG ANCHOR RANGE_M [FP_SNR FP_RX_DB]", see twrpos.h) on stdin, solves the position of every
+ * tag with new ranges once per cycle and writes a POS line for each, with a STATS line every second. With SIM_CYCLES,
+ * feeds the engine synthetic ranges of moving tags instead, from the anchors of the configuration, and reports the
+ * position error and the throughput. Besides the anchors, the configuration (see possvc.h) may set "height z",
+ * "planar 0/1", "window s", "warm s" and "std m".
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "twrpos.h"
+#include "tdoarec.h"
+#include "possvc.h"
+
+/* Solving cycle (s) */
+#define CYCLE_S       0.1
+
+/* Synthetic ranges: tags, their speed (m/s), share of ranges lost, and share with a blocked first path and its excess (m) */
+#define SIM_TAGS      200
+#define SIM_SPEED     1.0
+#define SIM_LOSS      0.1
+#define SIM_NLOS      0.05
+#define SIM_NLOS_M    0.5
+
+static twrpos_t pos;
+static possvc_conf_t conf;
+static double cycle;          // time of the last cycle (s)
+
+typedef struct {
+	double p[SIM_TAGS][3];    // true tag positions
+	double v[SIM_TAGS][2];    // and velocities
+	possvc_sim_t err;
+} sim_t;
+
+static void print_stats(void *arg, double elapsed)
+{
+	const twrpos_stats_t *s = &pos.stats;
+
+	printf("STATS ranges %llu fixes %llu (%.0f/s) warm %llu iter %.2f solver %.0f fix/s short %llu failed %llu unknown %llu "
+		   "full %llu\n",
+		   (unsigned long long)s->ranges, (unsigned long long)s->fixes, elapsed > 0 ? s->fixes / elapsed : 0,
+		   (unsigned long long)s->warm, s->fixes ? (double)s->iter / s->fixes : 0, s->solve_s > 0 ? s->fixes / s->solve_s : 0,
+		   (unsigned long long)s->short_fixes, (unsigned long long)s->failed, (unsigned long long)s->unknown,
+		   (unsigned long long)s->full);
+}
+
+static void print_fix(const twrpos_fix_t *fix, void *arg)
+{
+	printf("POS %016llx %8.3f %8.3f %8.3f resid %.3f anchors %d iter %d%s\n", (unsigned long long)fix->tag, fix->p[0],
+		   fix->p[1], fix->p[2], fix->resid, fix->n, fix->iter, fix->warm ? " warm" : "");
+}
+
+static void sim_fix(const twrpos_fix_t *fix, void *arg)
+{
+	sim_t *sim = (sim_t *)arg;
+
+	possvc_sim_fix(&sim->err, fix->p, sim->p[(fix->tag - POSSVC_SIM_TAG_EUI) % SIM_TAGS]);
+}
+
+/*
+ * The tags wander at SIM_SPEED within the anchors, at the configured height, and range to every anchor once per cycle
+ * with the noise the weights expect for a random first path SNR; SIM_LOSS of the ranges are lost, and SIM_NLOS of them
+ * come through a blocked first path, SIM_NLOS_M long, and say so.
+ */
+static void run_sim(long cycles)
+{
+	static sim_t sim;
+	double now = 0, start;
+	long c;
+	int i, k;
+
+	possvc_sim_init(&sim.err, &conf);
+	for (i = 0; i < SIM_TAGS; i++)
+	{
+		double a = 2 * M_PI * rand() / RAND_MAX;
+
+		possvc_sim_place(&sim.err, sim.p[i], pos.height);
+		sim.v[i][0] = SIM_SPEED * cos(a);
+		sim.v[i][1] = SIM_SPEED * sin(a);
+	}
+	pos.cb = sim_fix;
+	pos.cb_arg = &sim;
+
+	start = possvc_now();
+	for (c = 0; c < cycles; c++)
+	{
+		now += CYCLE_S;
+		for (k = 0; k < SIM_TAGS; k++)
+		{
+			double *p = sim.p[k];
+
+			for (i = 0; i < 2; i++)
+			{
+				p[i] += sim.v[k][i] * CYCLE_S;
+				if (p[i] < sim.err.lo[i] || p[i] > sim.err.hi[i])
+					sim.v[k][i] = -sim.v[k][i];
+			}
+
+			for (i = 0; i < pos.n_anchors; i++)
+			{
+				const double *a = pos.anchors[i].p;
+				twrpos_range_t r;
+
+				if ((double)rand() / RAND_MAX < SIM_LOSS)
+					continue;
+				r.tag = POSSVC_SIM_TAG_EUI + k;
+				r.anchor = pos.anchors[i].eui;
+				r.fp_snr = 3 + 30 * (float)rand() / RAND_MAX;
+				r.fp_rx_db = ((double)rand() / RAND_MAX < SIM_NLOS) ? 10 : 2;
+				r.d = sqrt((p[0] - a[0]) * (p[0] - a[0]) + (p[1] - a[1]) * (p[1] - a[1]) + (p[2] - a[2]) * (p[2] - a[2]))
+					+ possvc_gauss() / sqrt(twrpos_weight(&pos, r.fp_snr, 2)) + (r.fp_rx_db > TDOAREC_NLOS_DB ? SIM_NLOS_M : 0);
+				twrpos_range(&pos, &r, now);
+			}
+		}
+		twrpos_cycle(&pos, now);
+	}
+
+	print_stats(NULL, possvc_now() - start);
+	possvc_sim_print(&sim.err, "cycles", cycles);
+}
+
+static void range_line(void *arg, const char *line, double now)
+{
+	twrpos_range_t r;
+
+	if (twrpos_scan(line, &r) == 0)
+		twrpos_range(&pos, &r, now);
+}
+
+static void range_poll(void *arg, double now)
+{
+	if (now - cycle >= CYCLE_S)
+	{
+		cycle = now;
+		twrpos_cycle(&pos, now);
+	}
+}
+
+static void range_flush(void *arg, double now)
+{
+	twrpos_cycle(&pos, now);
+}
+
+int main(int argc, char *argv[])
+{
+	possvc_ops_t ops = { range_line, range_poll, print_stats, range_flush, NULL };
+	double value;
+	long cycles;
+	int i;
+
+	if (possvc_args(argc, argv, "SIM_CYCLES", &conf, &cycles) != 0)
+		return 1;
+
+	twrpos_init(&pos, print_fix, NULL);
+	for (i = 0; i < conf.n_anchors; i++)
+		twrpos_add_anchor(&pos, conf.anchors[i].eui, conf.anchors[i].p);
+	possvc_value(&conf, "height", &pos.height);
+	if (possvc_value(&conf, "planar", &value))
+		pos.planar = (int) value;
+	possvc_value(&conf, "window", &pos.window);
+	possvc_value(&conf, "warm", &pos.warm);
+	if (possvc_value(&conf, "std", &value) && value > 0)
+		pos.range_std = value;
+
+	if (pos.n_anchors < MLAT_MIN_ANCHORS)
+	{
+		printf("%s: needs %d anchors\n", argv[1], MLAT_MIN_ANCHORS);
+		return 1;
+	}
+
+	if (cycles > 0)
+		run_sim(cycles);
+	else
+	{
+		cycle = possvc_now();
+		possvc_run(&ops);
+	}
+
+	return 0;
+}
@@ -0,0 +1,239 @@
+/*
+ * twrpos.c
+ *
+ * TWR positioning: collects the ranges from each tag to the anchors and solves the tag positions by weighted least
+ * squares.
+ *
+ * Each tag keeps the last range to every anchor, with its time and its weight, in an open addressing table with a
+ * bounded probe. A cycle gathers the tags with new ranges, takes the best weighted ranges younger than the window, and
+ * hands them all to mlat.c in one batch, each starting from the tag's previous fix if it is recent enough. The weight of a
+ * range is the inverse of its variance, which grows as the first path weakens and when it looks blocked.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "twrpos.h"
+#include "tdoarec.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+static inline uint32_t twrpos_hash(uint64_t eui)
+{
+	return (uint32_t)((eui * 0x9E3779B97F4A7C15ULL) >> 32) & (TWRPOS_TAGS - 1);
+}
+
+void twrpos_init(twrpos_t *t, twrpos_fix_cb cb, void *arg)
+{
+	memset(t, 0, sizeof(*t));
+	t->window = TWRPOS_WINDOW_S;
+	t->warm = TWRPOS_WARM_S;
+	t->range_std = TWRPOS_RANGE_STD;
+	t->cb = cb;
+	t->cb_arg = arg;
+}
+
+int twrpos_add_anchor(twrpos_t *t, uint64_t eui, const double *p)
+{
+	twrpos_anchor_t *a;
+
+	if (t->n_anchors >= TWRPOS_ANCHORS)
+		return -1;
+
+	a = &t->anchors[t->n_anchors];
+	a->eui = eui;
+	memcpy(a->p, p, sizeof(a->p));
+	return t->n_anchors++;
+}
+
+double twrpos_weight(const twrpos_t *t, float fp_snr, float fp_rx_db)
+{
+	double std = t->range_std;
+
+	if (fp_snr > 0 && fp_snr < TWRPOS_SNR_REF)
+		std *= TWRPOS_SNR_REF / fp_snr;
+	if (fp_rx_db > TDOAREC_NLOS_DB)
+		std *= TWRPOS_NLOS_GAIN;
+	return 1 / (std * std);
+}
+
+static int twrpos_find_anchor(const twrpos_t *t, uint64_t eui)
+{
+	int i;
+
+	for (i = 0; i < t->n_anchors; i++)
+		if (t->anchors[i].eui == eui)
+			return i;
+	return -1;
+}
+
+/* Slot of tag eui, taking a free one (or one with only stale ranges) if it is new; NULL if the probe is full */
+static twrpos_tag_t *twrpos_find_tag(twrpos_t *t, uint64_t eui, double now)
+{
+	uint32_t h = twrpos_hash(eui), i;
+	twrpos_tag_t *tag, *spare = NULL;
+
+	for (i = 0; i < TWRPOS_PROBE; i++)
+	{
+		tag = &t->tags[(h + i) & (TWRPOS_TAGS - 1)];
+		if (tag->used && tag->eui == eui)
+			return tag;
+		if (spare == NULL && (!tag->used || now - tag->last > t->window + t->warm))
+			spare = tag;
+	}
+
+	if (spare != NULL)
+	{
+		memset(spare, 0, sizeof(*spare));
+		spare->eui = eui;
+		spare->used = 1;
+	}
+	return spare;
+}
+
+int twrpos_range(twrpos_t *t, const twrpos_range_t *r, double now)
+{
+	twrpos_tag_t *tag;
+	int a;
+
+	t->stats.ranges++;
+	if ((a = twrpos_find_anchor(t, r->anchor)) < 0)
+	{
+		t->stats.unknown++;
+		return -1;
+	}
+	if ((tag = twrpos_find_tag(t, r->tag, now)) == NULL)
+	{
+		t->stats.full++;
+		return -1;
+	}
+
+	tag->d[a] = r->d;
+	tag->w[a] = twrpos_weight(t, r->fp_snr, r->fp_rx_db);
+	tag->t[a] = now;
+	tag->last = now;
+	tag->fresh = 1;
+	return 0;
+}
+
+/* Fill job with the best weighted ranges of tag within the window. Returns the number of anchors. */
+static int twrpos_job(const twrpos_t *t, const twrpos_tag_t *tag, mlat_twr_job_t *job, double now)
+{
+	int i, k, n = 0;
+
+	for (i = 0; i < t->n_anchors; i++)
+	{
+		if (tag->t[i] <= 0 || now - tag->t[i] > t->window)
+			continue;
+
+		/* Insertion by weight, keeping the MLAT_MAX_ANCHORS best */
+		for (k = (n < MLAT_MAX_ANCHORS) ? n++ : MLAT_MAX_ANCHORS; k > 0 && job->w[k - 1] < tag->w[i]; k--)
+		{
+			if (k < MLAT_MAX_ANCHORS)
+			{
+				memcpy(job->a[k], job->a[k - 1], sizeof(job->a[k]));
+				job->d[k] = job->d[k - 1];
+				job->w[k] = job->w[k - 1];
+			}
+		}
+		if (k < MLAT_MAX_ANCHORS)
+		{
+			memcpy(job->a[k], t->anchors[i].p, sizeof(job->a[k]));
+			job->d[k] = tag->d[i];
+			job->w[k] = tag->w[i];
+		}
+	}
+
+	job->n = n;
+	job->z = (tag->t_fix > 0 && !t->planar) ? tag->p[2] : t->height;
+	job->planar = t->planar;
+	job->warm = tag->t_fix > 0 && now - tag->t_fix <= t->warm;
+	memcpy(job->p0, tag->p, sizeof(job->p0));
+	return n;
+}
+
+int twrpos_cycle(twrpos_t *t, double now)
+{
+	struct timespec t0, t1;
+	int i, n_jobs = 0, fixes = 0;
+
+	for (i = 0; i < TWRPOS_TAGS; i++)
+	{
+		twrpos_tag_t *tag = &t->tags[i];
+
+		if (!tag->used || !tag->fresh)
+			continue;
+		tag->fresh = 0;
+		if (twrpos_job(t, tag, &t->jobs[n_jobs], now) < MLAT_MIN_ANCHORS)
+		{
+			t->stats.short_fixes++;
+			continue;
+		}
+		t->job_tag[n_jobs++] = i;
+	}
+	if (n_jobs == 0)
+		return 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	mlat_twr_batch(t->jobs, n_jobs);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	t->stats.solve_s += (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+
+	for (i = 0; i < n_jobs; i++)
+	{
+		const mlat_twr_job_t *job = &t->jobs[i];
+		twrpos_tag_t *tag = &t->tags[t->job_tag[i]];
+		twrpos_fix_t fix;
+
+		if (job->status != 0)
+		{
+			t->stats.failed++;
+			continue;
+		}
+
+		memcpy(tag->p, job->fix.p, sizeof(tag->p));
+		tag->t_fix = now;
+
+		fix.tag = tag->eui;
+		fix.n = job->n;
+		memcpy(fix.p, job->fix.p, sizeof(fix.p));
+		fix.resid = job->fix.resid;
+		fix.iter = job->fix.iter;
+		fix.warm = job->warm;
+
+		t->stats.fixes++;
+		t->stats.warm += job->warm;
+		t->stats.iter += job->fix.iter;
+		fixes++;
+
+		if (t->cb)
+			t->cb(&fix, t->cb_arg);
+	}
+	return fixes;
+}
+
+int twrpos_scan(const char *line, twrpos_range_t *r)
+{
+	unsigned long long tag, anchor;
+	float snr = 0, db = 0;
+	double d;
+	int got;
+
+	got = sscanf(line, TWRPOS_LINE_TAG " %llx %llx %lf %f %f", &tag, &anchor, &d, &snr, &db);
+	if (got != 3 && got != 5)
+		return -1;
+
+	r->tag = tag;
+	r->anchor = anchor;
+	r->d = d;
+	r->fp_snr = snr;
+	r->fp_rx_db = db;
+	return 0;
+}
@@ -0,0 +1,129 @@
+/*
+ * twrpos.h
+ *
+ * TWR positioning: collects the ranges from each tag to the anchors and solves the tag positions by weighted least
+ * squares (mlat.h).
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _TWRPOS_H_
+#define _TWRPOS_H_
+
+#include <stdint.h>
+#include "mlat.h"
+
+/* Anchors configured */
+#define TWRPOS_ANCHORS     32
+
+/* Tags tracked (a power of 2), and slots probed for one */
+#define TWRPOS_TAGS        256
+#define TWRPOS_PROBE       8
+
+/* Default age of the ranges used in a fix (s), and of a fix to warm start the next one from */
+#define TWRPOS_WINDOW_S    0.2
+#define TWRPOS_WARM_S      1.0
+
+/* Default standard deviation of a range with a clear first path (m), at or above TWRPOS_SNR_REF */
+#define TWRPOS_RANGE_STD   0.1
+#define TWRPOS_SNR_REF     10.0
+
+/* Standard deviation multiplier of a range whose first path looks blocked (TDOAREC_NLOS_DB) */
+#define TWRPOS_NLOS_GAIN   4.0
+
+/* First word of a range line: "RANGE TAG ANCHOR RANGE_M [FP_SNR FP_RX_DB]", EUIs in hex */
+#define TWRPOS_LINE_TAG    "RANGE"
+
+typedef struct {
+	uint64_t tag;
+	uint64_t anchor;
+	double d;             // range (m)
+	float fp_snr;         // first path quality, as in tdoarec_t; 0 if not known
+	float fp_rx_db;
+} twrpos_range_t;
+
+typedef struct {
+	uint64_t eui;
+	double p[3];          // position (m)
+} twrpos_anchor_t;
+
+/* Last range from a tag to each anchor */
+typedef struct {
+	uint64_t eui;
+	int used;
+	int fresh;            // ranges added since the last fix
+	double d[TWRPOS_ANCHORS];
+	double w[TWRPOS_ANCHORS];
+	double t[TWRPOS_ANCHORS]; // time of the range, 0 if none (s)
+	double last;          // time of the last range (s)
+	double p[3];          // last fix
+	double t_fix;         // time of the last fix, 0 if none (s)
+} twrpos_tag_t;
+
+typedef struct {
+	uint64_t tag;
+	int n;                // anchors used
+	double p[3];          // position (m)
+	double resid;         // weighted RMS of the range residuals (m)
+	int iter;             // Gauss-Newton iterations
+	int warm;             // started from the previous fix
+} twrpos_fix_t;
+
+typedef void (*twrpos_fix_cb)(const twrpos_fix_t *fix, void *arg);
+
+typedef struct {
+	uint64_t ranges;      // ranges given
+	uint64_t unknown;     // ranges to anchors not configured
+	uint64_t full;        // ranges dropped because the tag table was full
+	uint64_t fixes;       // fixes solved
+	uint64_t warm;        // fixes started from the previous one
+	uint64_t short_fixes; // tags with fresh ranges to too few anchors within the window
+	uint64_t failed;      // fixes the solver gave up on
+	uint64_t iter;        // Gauss-Newton iterations, over all the fixes
+	double solve_s;       // CPU time spent in the solver (s)
+} twrpos_stats_t;
+
+typedef struct {
+	twrpos_anchor_t anchors[TWRPOS_ANCHORS];
+	int n_anchors;
+	double height;        // tag height for planar fixes, and the starting height of the others (m)
+	int planar;           // all fixes planar, for anchors too close to a plane to give the height
+	double window;        // s
+	double warm;          // s, 0 to always start cold
+	double range_std;     // m
+
+	twrpos_tag_t tags[TWRPOS_TAGS];
+	mlat_twr_job_t jobs[TWRPOS_TAGS];
+	int job_tag[TWRPOS_TAGS];
+
+	twrpos_fix_cb cb;
+	void *cb_arg;
+	twrpos_stats_t stats;
+} twrpos_t;
+
+/* Start with no anchors. Fixes are given to cb. */
+void twrpos_init(twrpos_t *t, twrpos_fix_cb cb, void *arg);
+
+/* Add an anchor at p. Returns its index, or -1 if there are too many. */
+int twrpos_add_anchor(twrpos_t *t, uint64_t eui, const double *p);
+
+/* Weight (1/m^2) of a range with the given first path quality. */
+double twrpos_weight(const twrpos_t *t, float fp_snr, float fp_rx_db);
+
+/* Add a range measured at time now (s, any monotonic clock). Returns 0, or -1 if it was dropped. */
+int twrpos_range(twrpos_t *t, const twrpos_range_t *r, double now);
+
+/* Solve, in one batch, the position of every tag with ranges added since its last fix. Returns the number of fixes. */
+int twrpos_cycle(twrpos_t *t, double now);
+
+/* Read a range line. Returns 0, or -1 if it is not one. */
+int twrpos_scan(const char *line, twrpos_range_t *r);
+
+#endif /* _TWRPOS_H_ */
@@ -0,0 +1,218 @@
+/*
+ * xodisc.c
+ *
+ * Disciplining of the XO to a reference carrier, through the 24-bit XO DAC.
+ *
+ * Each capture measures the offset of the XO to the reference. A two state Kalman filter (offset and drift) tracks it,
+ * with every DAC step fed back into the model, so a measurement is never thrown away because the DAC just moved. While
+ * acquiring, the controller removes the whole estimated offset at once, which locks in a couple of captures; once
+ * locked it only corrects a fraction of it per update, set by the loop bandwidth, and keeps the drift compensated.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "xodisc.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+// Innovations beyond this many standard deviations are rejected once locked
+#define XODISC_GATE_SIGMA 5.0
+
+// Floor of the measurement variance, Hz^2
+#define XODISC_MIN_VAR    1e-6
+
+void xodisc_defaults(xodisc_params_t *p)
+{
+	p->hz_per_lsb = 800.0 / XODISC_DAC_MAX;
+	p->bias_hz = -(2.728371123 - 0.337881717433);  // the former loop added this to the measured offset
+	p->bandwidth_hz = 0.5;
+	p->q_freq = 1e-4;
+	p->q_drift = 1e-6;
+	p->lock_hz = 0.2;
+	p->lock_count = 3;
+}
+
+int xodisc_load_params(const char *path, xodisc_params_t *p)
+{
+	char line[128], name[32];
+	double value;
+	FILE *fp;
+
+	xodisc_defaults(p);
+
+	if ((fp = fopen(path, "r")) == NULL)
+		return -1;
+
+	while (fgets(line, sizeof(line), fp) != NULL)
+	{
+		if (line[0] == '#' || sscanf(line, "%31s %lf", name, &value) != 2)
+			continue;
+
+		if (!strcmp(name, "hz_per_lsb"))
+			p->hz_per_lsb = value;
+		else if (!strcmp(name, "bias_hz"))
+			p->bias_hz = value;
+		else if (!strcmp(name, "bandwidth_hz"))
+			p->bandwidth_hz = value;
+		else if (!strcmp(name, "q_freq"))
+			p->q_freq = value;
+		else if (!strcmp(name, "q_drift"))
+			p->q_drift = value;
+		else if (!strcmp(name, "lock_hz"))
+			p->lock_hz = value;
+		else if (!strcmp(name, "lock_count"))
+			p->lock_count = (int) value;
+	}
+
+	fclose(fp);
+	return 0;
+}
+
+int xodisc_save_params(const char *path, const xodisc_params_t *p)
+{
+	FILE *fp;
+
+	if ((fp = fopen(path, "w")) == NULL)
+		return -1;
+
+	fprintf(fp, "# XO disciplining loop parameters\n");
+	fprintf(fp, "hz_per_lsb %.9g\n", p->hz_per_lsb);
+	fprintf(fp, "bias_hz %.12g\n", p->bias_hz);
+	fprintf(fp, "bandwidth_hz %g\n", p->bandwidth_hz);
+	fprintf(fp, "q_freq %g\n", p->q_freq);
+	fprintf(fp, "q_drift %g\n", p->q_drift);
+	fprintf(fp, "lock_hz %g\n", p->lock_hz);
+	fprintf(fp, "lock_count %d\n", p->lock_count);
+
+	return (fclose(fp) == 0) ? 0 : -1;
+}
+
+void xodisc_init(xodisc_t *x, const xodisc_params_t *p, int32_t dac)
+{
+	double span = p->hz_per_lsb * XODISC_DAC_MAX / 2;
+
+	memset(x, 0, sizeof(*x));
+	x->p = *p;
+	x->dac = dac;
+
+	// Anywhere within the DAC range, drifting by up to about 1 Hz/s
+	x->P[0][0] = span * span;
+	x->P[1][1] = 1.0;
+}
+
+// Propagate the estimate over t seconds
+static void xodisc_predict(xodisc_t *x, double t)
+{
+	double qf = x->p.q_freq, qd = x->p.q_drift;
+	double p00 = x->P[0][0], p01 = x->P[0][1], p11 = x->P[1][1];
+
+	if (t <= 0)
+		return;
+
+	x->f += x->d * t;
+
+	// P = F P F' + Q, F = [1 t; 0 1], Q from the two random walks
+	x->P[0][0] = p00 + 2 * t * p01 + t * t * p11 + qf * t + qd * t * t * t / 3;
+	x->P[0][1] = x->P[1][0] = p01 + t * p11 + qd * t * t / 2;
+	x->P[1][1] = p11 + qd * t;
+}
+
+// Move the DAC to cancel the estimated offset, and the drift expected until the next update t seconds away
+static int32_t xodisc_control(xodisc_t *x, double t)
+{
+	double gain = 1.0, corr;
+	int32_t dac;
+
+	if (x->locked && t > 0)
+		gain = 1.0 - exp(-2 * M_PI * x->p.bandwidth_hz * t);
+
+	corr = gain * x->f + x->d * t;
+	dac = x->dac + (int32_t) lround(corr / x->p.hz_per_lsb);
+	if (dac < 0)
+		dac = 0;
+	else if (dac > XODISC_DAC_MAX)
+		dac = XODISC_DAC_MAX;
+
+	// Raising the DAC lowers the measured offset
+	x->f -= (dac - x->dac) * x->p.hz_per_lsb;
+	x->dac = dac;
+
+	return dac;
+}
+
+static void xodisc_lock_detect(xodisc_t *x, int good)
+{
+	if (good)
+	{
+		x->bad = 0;
+		if (++x->good >= x->p.lock_count)
+			x->locked = 1;
+	}
+	else
+	{
+		x->good = 0;
+		if (++x->bad >= x->p.lock_count)
+			x->locked = 0;
+	}
+}
+
+int32_t xodisc_update(xodisc_t *x, double offset_hz, double std_hz, double t)
+{
+	double r = (std_hz * std_hz > XODISC_MIN_VAR) ? std_hz * std_hz : XODISC_MIN_VAR;
+	double s, k0, k1, p00, p01, p11;
+
+	xodisc_predict(x, t);
+
+	x->innov = (offset_hz - x->p.bias_hz) - x->f;
+	s = x->P[0][0] + r;
+
+	// A jump the model cannot explain while locked is more likely a bad capture than the XO
+	if (x->locked && x->innov * x->innov > XODISC_GATE_SIGMA * XODISC_GATE_SIGMA * s)
+	{
+		xodisc_lock_detect(x, 0);
+		return xodisc_control(x, t);
+	}
+
+	p00 = x->P[0][0];
+	p01 = x->P[0][1];
+	p11 = x->P[1][1];
+	k0 = p00 / s;
+	k1 = p01 / s;
+
+	x->f += k0 * x->innov;
+	x->d += k1 * x->innov;
+
+	x->P[0][0] = (1 - k0) * p00;
+	x->P[0][1] = x->P[1][0] = (1 - k0) * p01;
+	x->P[1][1] = p11 - k1 * p01;
+
+	x->started = 1;
+	xodisc_lock_detect(x, fabs(x->f) < x->p.lock_hz);
+
+	return xodisc_control(x, t);
+}
+
+int32_t xodisc_miss(xodisc_t *x, double t)
+{
+	xodisc_predict(x, t);
+	xodisc_lock_detect(x, 0);
+
+	// Nothing to steer by before the first measurement
+	if (!x->started)
+		return x->dac;
+
+	return xodisc_control(x, t);
+}
+
+int xodisc_locked(const xodisc_t *x)
+{
+	return x->locked;
+}
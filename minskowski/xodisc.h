@@ -0,0 +1,79 @@
+/*
+ * xodisc.h
+ *
+ * Disciplining of the XO to a reference carrier, through the 24-bit XO DAC.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _XODISC_H_
+#define _XODISC_H_
+
+#include <stdint.h>
+
+#define XODISC_PATH      "/var/lib/dw1000/xodisc.conf"
+
+#define XODISC_DAC_MAX   0xFFFFFF
+#define XODISC_DAC_MID   0x7FFFFF
+
+/*
+ * Loop parameters, saved as "name value" lines in XODISC_PATH. Frequencies are XO offsets in Hz, as measured from the
+ * CW capture (carrier offset divided by the PLL multiplier).
+ */
+typedef struct {
+	double hz_per_lsb;    // XO frequency change per DAC step (the DAC pulls the XO over about 800 Hz)
+	double bias_hz;       // offset measured with the XO on frequency (CC1200 and reference errors)
+	double bandwidth_hz;  // tracking loop bandwidth once locked; the loop corrects fully while acquiring
+	double q_freq;        // XO frequency noise (random walk), Hz^2/s
+	double q_drift;       // XO drift noise (random walk of the drift), Hz^2/s^3
+	double lock_hz;       // estimated offset below which the loop counts towards lock
+	int lock_count;       // consecutive updates within lock_hz to declare lock, outside it (or missed) to lose it
+} xodisc_params_t;
+
+/*
+ * Kalman filter on the XO offset and drift, and the controller acting on its estimate. The DAC step is part of the
+ * model, so the filter keeps its history across corrections and is not reset by them.
+ */
+typedef struct {
+	xodisc_params_t p;
+	int32_t dac;          // current DAC setpoint
+	double f, d;          // estimated offset (Hz, bias removed) and drift (Hz/s)
+	double P[2][2];       // covariance of (f, d)
+	double innov;         // last innovation (Hz)
+	int good, bad;        // consecutive updates within and outside the lock threshold
+	int locked;
+	int started;          // a measurement has been taken
+} xodisc_t;
+
+/* Default parameters. */
+void xodisc_defaults(xodisc_params_t *p);
+
+/* Load the parameters from path over the defaults. Returns 0 if the file was read, -1 if the defaults are used. */
+int xodisc_load_params(const char *path, xodisc_params_t *p);
+
+/* Save the parameters to path. Returns 0 on success, -1 on error (errno is set). */
+int xodisc_save_params(const char *path, const xodisc_params_t *p);
+
+/* Start the loop with the DAC at dac, its setpoint when called (e.g. XODISC_DAC_MID, or the calibration store value). */
+void xodisc_init(xodisc_t *x, const xodisc_params_t *p, int32_t dac);
+
+/*
+ * Feed the offset measured over the last capture, and the standard deviation of that measurement, t seconds after the
+ * previous call. Returns the DAC setpoint to program before the next capture.
+ */
+int32_t xodisc_update(xodisc_t *x, double offset_hz, double std_hz, double t);
+
+/* Account for a capture that could not be used. Returns the DAC setpoint, which only follows the estimated drift. */
+int32_t xodisc_miss(xodisc_t *x, double t);
+
+/* Returns 1 while the loop is locked. */
+int xodisc_locked(const xodisc_t *x);
+
+#endif /* _XODISC_H_ */
@@ -0,0 +1,107 @@
+/*
+ * XO Disciplining Check
+ *
+ * Runs the xodisc loop (with its default parameters) and the proportional step it replaced side by side on the same
+ * simulated XO, and checks that both settle the measured offset at the same place: the point where the former loop's
+ * corrected offset, the measurement plus BASELINE_CORRECTION_HZ, is zero. Returns 1 if either misses it.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "xodisc.h"
+
+/* Added to the measured XO offset by the former loop (cc1200_xo_sync.c, dw1000_rfs.c), and its DAC range (Hz) */
+#define BASELINE_CORRECTION_HZ  (2.728371123 - 0.337881717433)
+#define BASELINE_FRANGE_HZ      800.0
+
+/* Captures per run, time between them (s), noise of a measurement (Hz), and captures averaged at the end */
+#define CHECK_CAPTURES  600
+#define CHECK_PERIOD_S  0.1
+#define CHECK_STD_HZ    0.05
+#define CHECK_SETTLED   200
+
+/* Largest distance allowed between the settled offsets (Hz) */
+#define CHECK_TOL_HZ    0.1
+
+typedef struct {
+	double offset_hz;     // offset measured with the DAC at XODISC_DAC_MID, at t = 0
+	double drift_hz_s;
+} xo_sim_t;
+
+static const xo_sim_t runs[] = {
+	{ 37.0, 0.0 }, { 37.0, 0.05 }, { -120.0, 0.0 }, { -120.0, -0.05 }, { 0.0, 0.02 },
+};
+
+static double gauss(void)
+{
+	double u = (rand() + 1.0) / (RAND_MAX + 2.0), v = (rand() + 1.0) / (RAND_MAX + 2.0);
+	return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+/* Offset the CW capture would measure at time t with the DAC at dac, noise aside */
+static double xo_measure(const xo_sim_t *xo, double hz_per_lsb, int32_t dac, double t)
+{
+	return xo->offset_hz + xo->drift_hz_s * t - (dac - XODISC_DAC_MID) * hz_per_lsb;
+}
+
+/* Mean measured offset over the last CHECK_SETTLED captures, with the former loop (kalman 0) or xodisc (kalman 1) */
+static double run_loop(const xo_sim_t *xo, int kalman)
+{
+	xodisc_params_t p;
+	xodisc_t x;
+	int32_t dac = XODISC_DAC_MID;
+	double t, m, sum = 0;
+	int j;
+
+	xodisc_defaults(&p);
+	xodisc_init(&x, &p, dac);
+	srand(1);
+
+	for (j = 0; j < CHECK_CAPTURES; j++)
+	{
+		t = (j + 1) * CHECK_PERIOD_S;
+		m = xo_measure(xo, p.hz_per_lsb, dac, t);
+		if (j >= CHECK_CAPTURES - CHECK_SETTLED)
+			sum += m;
+		m += gauss() * CHECK_STD_HZ;
+
+		if (kalman)
+			dac = xodisc_update(&x, m, CHECK_STD_HZ, CHECK_PERIOD_S);
+		else if (j > 10)
+			dac += (int32_t)((m + BASELINE_CORRECTION_HZ) / BASELINE_FRANGE_HZ * XODISC_DAC_MAX);
+	}
+
+	return sum / CHECK_SETTLED;
+}
+
+int main(void)
+{
+	double target = -BASELINE_CORRECTION_HZ, base, disc;
+	int i, fail = 0;
+
+	for (i = 0; i < (int)(sizeof(runs) / sizeof(runs[0])); i++)
+	{
+		base = run_loop(&runs[i], 0);
+		disc = run_loop(&runs[i], 1);
+
+		printf("%s offset %7.2f Hz drift %5.2f Hz/s: settled at %8.4f Hz (former loop %8.4f Hz, target %8.4f Hz)\n",
+			   (fabs(disc - target) < CHECK_TOL_HZ && fabs(disc - base) < CHECK_TOL_HZ) ? "OK  " : "FAIL",
+			   runs[i].offset_hz, runs[i].drift_hz_s, disc, base, target);
+		if (fabs(disc - target) >= CHECK_TOL_HZ || fabs(disc - base) >= CHECK_TOL_HZ)
+			fail = 1;
+	}
+
+	return fail;
+}